@@ -38,6 +38,7 @@
 #include "common/imageio_module.h"
 #include "common/points.h"
 #include "control/conf.h"
+#include "control/jobs/control_jobs.h"
 #include "develop/imageop.h"
 
 #include <inttypes.h>
@@ -55,10 +56,41 @@
 
 #define DT_MAX_STYLE_NAME_LENGTH 128
 
+// state shared by all threads exporting images in batch mode
+typedef struct dt_cli_batch_t
+{
+  dt_imageio_module_storage_t *storage;
+  dt_imageio_module_data_t *sdata;
+  dt_imageio_module_format_t *format;
+  gboolean high_quality, upscale, export_masks;
+  dt_colorspaces_color_profile_type_t icc_type;
+  const gchar *icc_filename;
+  dt_iop_color_intent_t icc_intent;
+  int total;
+  int omp_threads;
+  dt_control_export_budget_t budget;
+
+  // protected by mutex:
+  dt_pthread_mutex_t mutex;
+  GList *next;
+  int num;
+  int errors;
+} dt_cli_batch_t;
+
+typedef struct dt_cli_worker_t
+{
+  dt_cli_batch_t *batch;
+  dt_imageio_module_data_t *fdata;
+  pthread_t thread;
+} dt_cli_worker_t;
+
 static void usage(const char *progname)
 {
   fprintf(stderr, "usage: %s <input file> [<xmp file>] <output file> [options] [--core <darktable options>]\n", progname);
   fprintf(stderr, "\n");
+  fprintf(stderr, "the input can be a file, a folder, a quoted pattern like '/photos/*.CR2' or\n");
+  fprintf(stderr, "@<list file> with one file or folder per line.\n");
+  fprintf(stderr, "\n");
   fprintf(stderr, "options:\n");
   fprintf(stderr, "   --width <max width> default: 0 = full resolution\n");
   fprintf(stderr, "   --height <max height> default: 0 = full resolution\n");
@@ -69,11 +101,183 @@ static void usage(const char *progname)
   fprintf(stderr, "   --style <style name>\n");
   fprintf(stderr, "   --style-overwrite\n");
   fprintf(stderr, "   --apply-custom-presets <0|1|false|true>, default: true\n");
+  fprintf(stderr, "   --jobs <n> number of images processed at the same time, default: 1\n");
+  fprintf(stderr, "   --memory-limit <MB> memory for all images in flight, default: host_memory_limit\n");
   fprintf(stderr, "   --verbose\n");
   fprintf(stderr, "   --help,-h\n");
   fprintf(stderr, "   --version\n");
 }
 
+// import a single image into the film roll of its folder
+static int _import_file(const char *filename, GList **id_list)
+{
+  dt_film_t film;
+  gchar *directory = g_path_get_dirname(filename);
+  const int filmid = dt_film_new(&film, directory);
+  g_free(directory);
+  const int id = filmid ? dt_image_import(filmid, filename, TRUE) : 0;
+  if(!id)
+  {
+    fprintf(stderr, _("error: can't open file %s"), filename);
+    fprintf(stderr, "\n");
+    return 1;
+  }
+  *id_list = g_list_append(*id_list, GINT_TO_POINTER(id));
+  return 0;
+}
+
+static int _import_folder(const char *dirname, GList **id_list)
+{
+  const int filmid = dt_film_import(dirname);
+  if(!filmid)
+  {
+    fprintf(stderr, _("error: can't open folder %s"), dirname);
+    fprintf(stderr, "\n");
+    return 1;
+  }
+  *id_list = g_list_concat(*id_list, dt_film_get_image_ids(filmid));
+  return 0;
+}
+
+// import all files of a folder matching a pattern like /photos/*.CR2
+static int _import_pattern(const char *pattern, GList **id_list)
+{
+  gchar *dirname = g_path_get_dirname(pattern);
+  gchar *basename = g_path_get_basename(pattern);
+  GDir *dir = g_dir_open(dirname, 0, NULL);
+  int err = 0;
+  if(!dir)
+  {
+    fprintf(stderr, _("error: can't open folder %s"), dirname);
+    fprintf(stderr, "\n");
+    err = 1;
+  }
+  else
+  {
+    GPatternSpec *spec = g_pattern_spec_new(basename);
+    GList *files = NULL;
+    const gchar *name;
+    while((name = g_dir_read_name(dir)))
+      if(g_pattern_match_string(spec, name)) files = g_list_prepend(files, g_build_filename(dirname, name, NULL));
+    g_pattern_spec_free(spec);
+    g_dir_close(dir);
+
+    // keep the output sequence numbers stable
+    files = g_list_sort(files, (GCompareFunc)g_strcmp0);
+    for(GList *iter = files; iter; iter = g_list_next(iter))
+      if(g_file_test((char *)iter->data, G_FILE_TEST_IS_REGULAR)) err |= _import_file((char *)iter->data, id_list);
+    g_list_free_full(files, g_free);
+  }
+  g_free(dirname);
+  g_free(basename);
+  return err;
+}
+
+static int _import_path(const char *path, GList **id_list)
+{
+  if(g_file_test(path, G_FILE_TEST_IS_DIR))
+    return _import_folder(path, id_list);
+  else if(strpbrk(path, "*?") && !g_file_test(path, G_FILE_TEST_EXISTS))
+    return _import_pattern(path, id_list);
+  else
+    return _import_file(path, id_list);
+}
+
+// @list: one file, folder or pattern per line. empty lines and lines starting with # are skipped
+static int _import_list(const char *listname, GList **id_list)
+{
+  gchar *content = NULL;
+  if(!g_file_get_contents(listname, &content, NULL, NULL))
+  {
+    fprintf(stderr, _("error: can't open file %s"), listname);
+    fprintf(stderr, "\n");
+    return 1;
+  }
+  int err = 0;
+  gchar **lines = g_strsplit(content, "\n", -1);
+  for(gchar **line = lines; *line; line++)
+  {
+    g_strstrip(*line);
+    if(**line == '\0' || **line == '#') continue;
+    err |= _import_path(*line, id_list);
+  }
+  g_strfreev(lines);
+  g_free(content);
+  return err;
+}
+
+static void _batch_export_image(dt_cli_batch_t *b, dt_imageio_module_data_t *fdata, const int id, const int num)
+{
+  const dt_image_t *image = dt_image_cache_get(darktable.image_cache, id, 'r');
+  if(!image)
+  {
+    dt_pthread_mutex_lock(&b->mutex);
+    b->errors++;
+    dt_pthread_mutex_unlock(&b->mutex);
+    return;
+  }
+  const size_t width = image->width, height = image->height;
+  gchar *filename = g_strdup(image->filename);
+  dt_image_cache_read_release(darktable.image_cache, image);
+
+  const size_t required = dt_control_export_reserve_memory(&b->budget, width, height);
+  const double start = dt_get_wtime();
+
+  // TODO: have a parameter in command line to get the export presets
+  dt_export_metadata_t metadata;
+  metadata.flags = dt_lib_export_metadata_default_flags();
+  metadata.list = NULL;
+  const int err = b->storage->store(b->storage, b->sdata, id, b->format, fdata, num, b->total, b->high_quality,
+                                    b->upscale, b->export_masks, b->icc_type, b->icc_filename, b->icc_intent,
+                                    &metadata);
+
+  const double elapsed = dt_get_wtime() - start;
+  dt_control_export_release_memory(&b->budget, required);
+
+  dt_pthread_mutex_lock(&b->mutex);
+  if(err) b->errors++;
+  dt_pthread_mutex_unlock(&b->mutex);
+
+  if(err)
+    fprintf(stderr, _("[%d/%d] error: failed to export %s"), num, b->total, filename);
+  else
+    printf(_("[%d/%d] exported %s in %.3fs"), num, b->total, filename, elapsed);
+  fprintf(err ? stderr : stdout, "\n");
+  g_free(filename);
+}
+
+// take the next image from the list until all are done
+static void _batch_run(dt_cli_worker_t *w)
+{
+  dt_cli_batch_t *b = w->batch;
+  while(TRUE)
+  {
+    dt_pthread_mutex_lock(&b->mutex);
+    if(!b->next)
+    {
+      dt_pthread_mutex_unlock(&b->mutex);
+      break;
+    }
+    const int id = GPOINTER_TO_INT(b->next->data);
+    b->next = g_list_next(b->next);
+    const int num = ++b->num;
+    dt_pthread_mutex_unlock(&b->mutex);
+
+    _batch_export_image(b, w->fdata, id, num);
+  }
+}
+
+static void *_batch_thread(void *ptr)
+{
+  dt_cli_worker_t *w = (dt_cli_worker_t *)ptr;
+#ifdef _OPENMP // need to do this in every thread
+  omp_set_num_threads(w->batch->omp_threads);
+#endif
+  dt_pthread_setname("cli export");
+  _batch_run(w);
+  return NULL;
+}
+
 int main(int argc, char *arg[])
 {
 #ifdef __APPLE__
@@ -91,7 +295,7 @@ int main(int argc, char *arg[])
   char *output_filename = NULL;
   char *style = NULL;
   int file_counter = 0;
-  int width = 0, height = 0, bpp = 0;
+  int width = 0, height = 0, bpp = 0, jobs = 1, memory_limit = 0;
   gboolean verbose = FALSE, high_quality = TRUE, upscale = FALSE,
            style_overwrite = FALSE, custom_presets = TRUE, export_masks = FALSE;
 
@@ -201,7 +405,28 @@ int main(int argc, char *arg[])
         }
         g_free(str);
       }
-
+      else if(!strcmp(arg[k], "--jobs") && argc > k + 1)
+      {
+        k++;
+        jobs = atoi(arg[k]);
+        if(jobs < 1)
+        {
+          fprintf(stderr, "%s: %s\n", _("invalid number for --jobs"), arg[k]);
+          usage(arg[0]);
+          exit(1);
+        }
+      }
+      else if(!strcmp(arg[k], "--memory-limit") && argc > k + 1)
+      {
+        k++;
+        memory_limit = atoi(arg[k]);
+        if(memory_limit < 1)
+        {
+          fprintf(stderr, "%s: %s\n", _("invalid size for --memory-limit"), arg[k]);
+          usage(arg[0]);
+          exit(1);
+        }
+      }
       else if(!strcmp(arg[k], "-v") || !strcmp(arg[k], "--verbose"))
       {
         verbose = TRUE;
@@ -226,12 +451,19 @@ int main(int argc, char *arg[])
   }
 
   int m_argc = 0;
-  char **m_arg = malloc((5 + argc - k + 1) * sizeof(char *));
+  char **m_arg = malloc((7 + argc - k + 1) * sizeof(char *));
   m_arg[m_argc++] = "darktable-cli";
   m_arg[m_argc++] = "--library";
   m_arg[m_argc++] = ":memory:";
   m_arg[m_argc++] = "--conf";
   m_arg[m_argc++] = "write_sidecar_files=FALSE";
+  // the limit is applied by the tiling code and by the batch below, both read host_memory_limit
+  gchar *memory_conf = memory_limit ? g_strdup_printf("host_memory_limit=%d", memory_limit) : NULL;
+  if(memory_conf)
+  {
+    m_arg[m_argc++] = "--conf";
+    m_arg[m_argc++] = memory_conf;
+  }
   for(; k < argc; k++) m_arg[m_argc++] = arg[k];
   m_arg[m_argc] = NULL;
 
@@ -239,6 +471,7 @@ int main(int argc, char *arg[])
   {
     usage(arg[0]);
     free(m_arg);
+    g_free(memory_conf);
     exit(1);
   }
   else if(file_counter == 2)
@@ -253,6 +486,7 @@ int main(int argc, char *arg[])
     fprintf(stderr, _("error: output file is a directory. please specify file name"));
     fprintf(stderr, "\n");
     free(m_arg);
+    g_free(memory_conf);
     exit(1);
   }
 
@@ -266,43 +500,16 @@ int main(int argc, char *arg[])
   if(dt_init(m_argc, m_arg, FALSE, custom_presets, NULL))
   {
     free(m_arg);
+    g_free(memory_conf);
     exit(1);
   }
 
+  const double batch_start = dt_get_wtime();
   GList *id_list = NULL;
 
-  if(g_file_test(input_filename, G_FILE_TEST_IS_DIR))
-  {
-    const int filmid = dt_film_import(input_filename);
-    if(!filmid)
-    {
-      fprintf(stderr, _("error: can't open folder %s"), input_filename);
-      fprintf(stderr, "\n");
-      free(m_arg);
-      exit(1);
-    }
-    id_list = dt_film_get_image_ids(filmid);
-  }
-  else
-  {
-    dt_film_t film;
-    int id = 0;
-    int filmid = 0;
-
-    gchar *directory = g_path_get_dirname(input_filename);
-    filmid = dt_film_new(&film, directory);
-    id = dt_image_import(filmid, input_filename, TRUE);
-    if(!id)
-    {
-      fprintf(stderr, _("error: can't open file %s"), input_filename);
-      fprintf(stderr, "\n");
-      free(m_arg);
-      exit(1);
-    }
-    g_free(directory);
-
-    id_list = g_list_append(id_list, GINT_TO_POINTER(id));
-  }
+  // everything ends up in the same library, so one core does all the work
+  const int import_err = input_filename[0] == '@' ? _import_list(input_filename + 1, &id_list)
+                                                  : _import_path(input_filename, &id_list);
 
   const int total = g_list_length(id_list);
 
@@ -310,8 +517,11 @@ int main(int argc, char *arg[])
   {
     fprintf(stderr, _("no images to export, aborting\n"));
     free(m_arg);
+    g_free(memory_conf);
     exit(1);
   }
+  // some of the inputs couldn't be read, export the others anyway
+  if(import_err) fprintf(stderr, "%s\n", _("some images could not be imported, exporting the others"));
 
   // attach xmp, if requested:
   if(xmp_filename)
@@ -325,6 +535,7 @@ int main(int argc, char *arg[])
         fprintf(stderr, _("error: can't open xmp file %s"), xmp_filename);
         fprintf(stderr, "\n");
         free(m_arg);
+        g_free(memory_conf);
         exit(1);
       }
       // don't write new xmp:
@@ -365,6 +576,7 @@ int main(int argc, char *arg[])
         stderr, "%s\n",
         _("cannot find disk storage module. please check your installation, something seems to be broken."));
     free(m_arg);
+    g_free(memory_conf);
     exit(1);
   }
 
@@ -373,6 +585,7 @@ int main(int argc, char *arg[])
   {
     fprintf(stderr, "%s\n", _("failed to get parameters from storage module, aborting export ..."));
     free(m_arg);
+    g_free(memory_conf);
     exit(1);
   }
 
@@ -387,6 +600,7 @@ int main(int argc, char *arg[])
     fprintf(stderr, _("unknown extension '.%s'"), ext);
     fprintf(stderr, "\n");
     free(m_arg);
+    g_free(memory_conf);
     exit(1);
   }
 
@@ -395,6 +609,7 @@ int main(int argc, char *arg[])
   {
     fprintf(stderr, "%s\n", _("failed to get parameters from format module, aborting export ..."));
     free(m_arg);
+    g_free(memory_conf);
     exit(1);
   }
 
@@ -438,22 +653,65 @@ int main(int argc, char *arg[])
 
   // TODO: do we want to use the settings from conf?
   // TODO: expose these via command line arguments
-  dt_colorspaces_color_profile_type_t icc_type = DT_COLORSPACE_NONE;
-  const gchar *icc_filename = NULL;
-  dt_iop_color_intent_t icc_intent = DT_INTENT_LAST;
+  dt_cli_batch_t batch = { 0 };
+  batch.icc_type = DT_COLORSPACE_NONE;
+  batch.icc_filename = NULL;
+  batch.icc_intent = DT_INTENT_LAST;
 
   // TODO: add a callback to set the bpp without going through the config
 
-  int num = 1;
-  for(GList *iter = id_list; iter; iter = g_list_next(iter), num++)
+  // several images at the same time share the cpu threads, if the storage and the format can handle it
+  if(!dt_imageio_parallel_export(storage, sdata, format)) jobs = 1;
+  jobs = MIN(jobs, total);
+  batch.storage = storage;
+  batch.sdata = sdata;
+  batch.format = format;
+  batch.high_quality = high_quality;
+  batch.upscale = upscale;
+  batch.export_masks = export_masks;
+  batch.total = total;
+  batch.omp_threads = MAX(1, darktable.num_openmp_threads / jobs);
+  batch.next = id_list;
+  dt_pthread_mutex_init(&batch.mutex, NULL);
+  dt_control_export_budget_init(&batch.budget, NULL);
+
+  dt_cli_worker_t *workers = (dt_cli_worker_t *)calloc(jobs, sizeof(dt_cli_worker_t));
+  workers[0].batch = &batch;
+  workers[0].fdata = fdata;
+  for(int j = 1; j < jobs; j++)
+  {
+    // every thread needs its own format data
+    workers[j].batch = &batch;
+    workers[j].fdata = format->get_params(format);
+    workers[j].fdata->max_width = fdata->max_width;
+    workers[j].fdata->max_height = fdata->max_height;
+    g_strlcpy(workers[j].fdata->style, fdata->style, sizeof(workers[j].fdata->style));
+    workers[j].fdata->style_append = fdata->style_append;
+    dt_pthread_create(&workers[j].thread, _batch_thread, &workers[j]);
+  }
+
+#ifdef _OPENMP
+  omp_set_num_threads(batch.omp_threads);
+#endif
+  _batch_run(&workers[0]);
+#ifdef _OPENMP
+  omp_set_num_threads(darktable.num_openmp_threads);
+#endif
+
+  for(int j = 1; j < jobs; j++)
+  {
+    pthread_join(workers[j].thread, NULL);
+    format->free_params(format, workers[j].fdata);
+  }
+  free(workers);
+  dt_control_export_budget_cleanup(&batch.budget);
+  dt_pthread_mutex_destroy(&batch.mutex);
+
+  if(total > 1)
   {
-    const int id = GPOINTER_TO_INT(iter->data);
-    // TODO: have a parameter in command line to get the export presets
-    dt_export_metadata_t metadata;
-    metadata.flags = dt_lib_export_metadata_default_flags();
-    metadata.list = NULL;
-    storage->store(storage, sdata, id, format, fdata, num, total, high_quality, upscale, export_masks,
-                   icc_type, icc_filename, icc_intent, &metadata);
+    const double elapsed = dt_get_wtime() - batch_start;
+    printf(_("%d of %d images exported in %.3fs (%.2f images/s)\n"), total - batch.errors, total, elapsed,
+           elapsed > 0.0 ? (total - batch.errors) / elapsed : 0.0);
   }
 
   // cleanup time
@@ -465,6 +723,8 @@ int main(int argc, char *arg[])
   dt_cleanup();
 
   free(m_arg);
+  g_free(memory_conf);
+  return batch.errors || import_err ? 1 : 0;
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
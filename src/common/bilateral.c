@@ -22,6 +22,9 @@
 #include <math.h>             // for roundf
 #include <stdlib.h>           // for size_t, free, malloc, NULL
 #include <string.h>           // for memset
+#if defined(__SSE2__)
+#include <xmmintrin.h>
+#endif
 
 // these clamp away insane memory requirements.
 // they should reasonably faithfully represent the
@@ -120,58 +123,102 @@ dt_bilateral_t *dt_bilateral_init(const int width,     // width of input image
   return b;
 }
 
+// first image row (column) of each grid cell along y (x), and the end of the image after the last one. a
+// pixel goes to the cell image_to_grid() and the MIN() in splat/slice put it in.
+static void grid_cell_starts(int *const start, const int size, const int cells, const float sigma_s)
+{
+  int c = 0;
+  for(int i = 0; i < size; i++)
+  {
+    const int ci = MIN((int)CLAMPS(i / sigma_s, 0, cells), cells - 1);
+    while(c <= ci) start[c++] = i;
+  }
+  while(c <= cells) start[c++] = size;
+}
+
+// grid cells along x splatted by one task. a task writes to one more grid column than it has cells, and to two
+// grid rows, so the ones of the same parity in x and y never overlap
+#define DT_BILATERAL_SPLAT_CELLS 4
+
 #ifdef _OPENMP
 #pragma omp declare simd aligned(in:64)
 #endif
 void dt_bilateral_splat(dt_bilateral_t *b, const float *const in)
 {
-  const int ox = 1;
-  const int oy = b->size_x;
-  const int oz = b->size_y * b->size_x;
-  const float sigma_s = b->sigma_s * b->sigma_s;
+  // the grid is stored with z innermost, the z neighbours of a cell are adjacent in memory
+  const int oz = 1;
+  const int ox = b->size_z;
+  const int oy = b->size_x * b->size_z;
+  const float norm = 100.0f / (b->sigma_s * b->sigma_s);
   float *const buf = b->buf;
+  const int width = b->width;
+  const int cells_x = b->size_x - 1;
+  const int cells_y = b->size_y - 1;
+  const int blocks_x = (cells_x + DT_BILATERAL_SPLAT_CELLS - 1) / DT_BILATERAL_SPLAT_CELLS;
+
+  int *const col_start = malloc(sizeof(int) * (cells_x + 1));
+  int *const row_start = malloc(sizeof(int) * (cells_y + 1));
+  grid_cell_starts(col_start, b->width, cells_x, b->sigma_s);
+  grid_cell_starts(row_start, b->height, cells_y, b->sigma_s);
 
-// splat into downsampled grid
+  // splat into downsampled grid. the tasks are split into four phases by the parity of their position, so
+  // that the ones running in parallel write to disjoint parts of the grid: no atomics and no per-thread grids.
+  for(int phase = 0; phase < 4; phase++)
+  {
+    const int px = phase & 1;
+    const int py = phase >> 1;
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(in, oy, oz, ox, sigma_s, buf) \
+  dt_omp_firstprivate(in, oy, oz, ox, norm, buf, width, px, py, cells_y, blocks_x, col_start, row_start) \
   shared(b) \
-  collapse(2)
+  schedule(dynamic) collapse(2)
 #endif
-  for(int j = 0; j < b->height; j++)
-  {
-    for(int i = 0; i < b->width; i++)
+    for(int cy = py; cy < cells_y; cy += 2)
     {
-      size_t index = 4 * (j * b->width + i);
-      float x, y, z;
-      const float L = in[index];
-      image_to_grid(b, i, j, L, &x, &y, &z);
-      const int xi = MIN((int)x, b->size_x - 2);
-      const int yi = MIN((int)y, b->size_y - 2);
-      const int zi = MIN((int)z, b->size_z - 2);
-      const float xf = x - xi;
-      const float yf = y - yi;
-      const float zf = z - zi;
-      // nearest neighbour splatting:
-      const size_t grid_index = xi + b->size_x * (yi + b->size_y * zi);
-      // sum up payload here, doesn't have to be same as edge stopping data
-      // for cross bilateral applications.
-      // also note that this is not clipped (as L->z is), so potentially hdr/out of gamut
-      // should not cause clipping here.
-#ifdef _OPENMP
-#pragma omp simd aligned(buf:64)
-#endif
-      for(int k = 0; k < 8; k++)
+      for(int bx = px; bx < blocks_x; bx += 2)
       {
-        const size_t ii = grid_index + ((k & 1) ? ox : 0) + ((k & 2) ? oy : 0) + ((k & 4) ? oz : 0);
-        const float contrib = ((k & 1) ? xf : (1.0f - xf)) * ((k & 2) ? yf : (1.0f - yf))
-                              * ((k & 4) ? zf : (1.0f - zf)) * 100.0f / sigma_s;
-        buf[ii] += contrib;
+        const int i0 = col_start[bx * DT_BILATERAL_SPLAT_CELLS];
+        const int i1 = col_start[MIN((bx + 1) * DT_BILATERAL_SPLAT_CELLS, b->size_x - 1)];
+        for(int j = row_start[cy]; j < row_start[cy + 1]; j++)
+        {
+          for(int i = i0; i < i1; i++)
+          {
+            size_t index = 4 * ((size_t)j * width + i);
+            float x, y, z;
+            const float L = in[index];
+            image_to_grid(b, i, j, L, &x, &y, &z);
+            const int xi = MIN((int)x, b->size_x - 2);
+            const int yi = MIN((int)y, b->size_y - 2);
+            const int zi = MIN((int)z, b->size_z - 2);
+            const float xf = x - xi;
+            const float yf = y - yi;
+            const float zf = z - zi;
+            // nearest neighbour splatting:
+            const size_t grid_index = zi + b->size_z * (xi + (size_t)b->size_x * yi);
+            // sum up payload here, doesn't have to be same as edge stopping data
+            // for cross bilateral applications.
+            // also note that this is not clipped (as L->z is), so potentially hdr/out of gamut
+            // should not cause clipping here.
+            // the two z neighbours of each x/y corner are adjacent
+            for(int k = 0; k < 4; k++)
+            {
+              const size_t ii = grid_index + ((k & 1) ? ox : 0) + ((k & 2) ? oy : 0);
+              const float contrib = ((k & 1) ? xf : (1.0f - xf)) * ((k & 2) ? yf : (1.0f - yf)) * norm;
+              buf[ii] += contrib * (1.0f - zf);
+              buf[ii + oz] += contrib * zf;
+            }
+          }
+        }
       }
     }
   }
+
+  free(col_start);
+  free(row_start);
 }
 
+#undef DT_BILATERAL_SPLAT_CELLS
+
 #ifdef _OPENMP
 #pragma omp declare simd aligned(buf:64)
 #endif
@@ -214,59 +261,106 @@ static void blur_line_z(float *buf, const int offset1, const int offset2, const
   }
 }
 
-#ifdef _OPENMP
-#pragma omp declare simd aligned(buf:64)
-#endif
-static void blur_line(float *buf, const int offset1, const int offset2, const int offset3, const int size1,
-                      const int size2, const int size3)
+// lines blurred side by side by blur_line(), a cache line
+#define DT_BILATERAL_LANES 16
+
+// blurs size1 blocks of lines of size3 values offset3 apart. the lines of a block start at size2 adjacent
+// floats from k * offset1, they are blurred side by side so that every access is contiguous and vectorised.
+static void blur_line(float *buf, const size_t offset1, const size_t offset3, const int size1, const int size2,
+                      const int size3)
 {
   const float w0 = 6.f / 16.f;
   const float w1 = 4.f / 16.f;
   const float w2 = 1.f / 16.f;
+  const int groups = (size2 + DT_BILATERAL_LANES - 1) / DT_BILATERAL_LANES;
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(size1, size2, size3, offset1, offset2, offset3, w0, w1, w2) \
-    shared(buf)
+  dt_omp_firstprivate(size1, size2, size3, offset1, offset3, w0, w1, w2, groups) \
+    shared(buf) collapse(2)
 #endif
   for(int k = 0; k < size1; k++)
   {
-    size_t index = (size_t)k * offset1;
-    for(int j = 0; j < size2; j++)
+    for(int g = 0; g < groups; g++)
     {
-      float tmp1 = buf[index];
-      buf[index] = buf[index] * w0 + w1 * buf[index + offset3] + w2 * buf[index + 2 * offset3];
-      index += offset3;
-      float tmp2 = buf[index];
-      buf[index] = buf[index] * w0 + w1 * (buf[index + offset3] + tmp1) + w2 * buf[index + 2 * offset3];
-      index += offset3;
+      const int lanes = MIN(DT_BILATERAL_LANES, size2 - g * DT_BILATERAL_LANES);
+      float *const line = buf + k * offset1 + (size_t)g * DT_BILATERAL_LANES;
+      float tmp1[DT_BILATERAL_LANES], tmp2[DT_BILATERAL_LANES];
+
+      float *p = line;
+      for(int l = 0; l < lanes; l++)
+      {
+        tmp1[l] = p[l];
+        p[l] = p[l] * w0 + w1 * p[l + offset3] + w2 * p[l + 2 * offset3];
+      }
+      p += offset3;
+      for(int l = 0; l < lanes; l++)
+      {
+        tmp2[l] = p[l];
+        p[l] = p[l] * w0 + w1 * (p[l + offset3] + tmp1[l]) + w2 * p[l + 2 * offset3];
+      }
+      p += offset3;
       for(int i = 2; i < size3 - 2; i++)
       {
-        const float tmp3 = buf[index];
-        buf[index]
-            = buf[index] * w0 + w1 * (buf[index + offset3] + tmp2) + w2 * (buf[index + 2 * offset3] + tmp1);
-        index += offset3;
-        tmp1 = tmp2;
-        tmp2 = tmp3;
+        for(int l = 0; l < lanes; l++)
+        {
+          const float tmp3 = p[l];
+          p[l] = p[l] * w0 + w1 * (p[l + offset3] + tmp2[l]) + w2 * (p[l + 2 * offset3] + tmp1[l]);
+          tmp1[l] = tmp2[l];
+          tmp2[l] = tmp3;
+        }
+        p += offset3;
+      }
+      for(int l = 0; l < lanes; l++)
+      {
+        const float tmp3 = p[l];
+        p[l] = p[l] * w0 + w1 * (p[l + offset3] + tmp2[l]) + w2 * tmp1[l];
+        p[l + offset3] = p[l + offset3] * w0 + w1 * tmp3 + w2 * tmp2[l];
       }
-      const float tmp3 = buf[index];
-      buf[index] = buf[index] * w0 + w1 * (buf[index + offset3] + tmp2) + w2 * tmp1;
-      index += offset3;
-      buf[index] = buf[index] * w0 + w1 * tmp3 + w2 * tmp2;
-      index += offset3;
-      index += offset2 - offset3 * size3;
     }
   }
 }
 
+#undef DT_BILATERAL_LANES
+
 
 void dt_bilateral_blur(dt_bilateral_t *b)
 {
-  // gaussian up to 3 sigma
-  blur_line(b->buf, b->size_x * b->size_y, b->size_x, 1, b->size_z, b->size_y, b->size_x);
-  // gaussian up to 3 sigma
-  blur_line(b->buf, b->size_x * b->size_y, 1, b->size_x, b->size_z, b->size_x, b->size_y);
+  const size_t plane = b->size_x * b->size_z;
+  // gaussian up to 3 sigma along x, one row of cells at a time with the z values of a cell side by side
+  blur_line(b->buf, plane, b->size_z, b->size_y, b->size_z, b->size_x);
+  // gaussian up to 3 sigma along y, with whole rows of cells side by side
+  blur_line(b->buf, 0, plane, 1, plane, b->size_y);
   // -2 derivative of the gaussian up to 3 sigma: x*exp(-x*x)
-  blur_line_z(b->buf, 1, b->size_x, b->size_x * b->size_y, b->size_x, b->size_y, b->size_z);
+  blur_line_z(b->buf, plane, b->size_z, 1, b->size_y, b->size_x, b->size_z);
+}
+
+// trilinear interpolation in the grid from cell gi. z is innermost, so the two z neighbours of each of the
+// four x/y corners are adjacent and are loaded together.
+static inline float trilinear(const float *const buf, const size_t gi, const size_t ox, const size_t oy,
+                              const float xf, const float yf, const float zf)
+{
+#if defined(__SSE2__)
+  // corners (x, z) = (0, 0), (0, 1), (1, 0), (1, 1) of the rows y and y + 1
+  const __m128 c0 = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64 *)(buf + gi)),
+                                 (const __m64 *)(buf + gi + ox));
+  const __m128 c1 = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64 *)(buf + gi + oy)),
+                                 (const __m64 *)(buf + gi + ox + oy));
+  const __m128 wxz = _mm_mul_ps(_mm_set_ps(xf, xf, 1.0f - xf, 1.0f - xf), _mm_set_ps(zf, 1.0f - zf, zf, 1.0f - zf));
+  __m128 sum = _mm_add_ps(_mm_mul_ps(c0, _mm_mul_ps(wxz, _mm_set1_ps(1.0f - yf))),
+                          _mm_mul_ps(c1, _mm_mul_ps(wxz, _mm_set1_ps(yf))));
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+  return _mm_cvtss_f32(sum);
+#else
+  return buf[gi] * (1.0f - xf) * (1.0f - yf) * (1.0f - zf)
+         + buf[gi + ox] * (xf) * (1.0f - yf) * (1.0f - zf)
+         + buf[gi + oy] * (1.0f - xf) * (yf) * (1.0f - zf)
+         + buf[gi + ox + oy] * (xf) * (yf) * (1.0f - zf)
+         + buf[gi + 1] * (1.0f - xf) * (1.0f - yf) * (zf)
+         + buf[gi + ox + 1] * (xf) * (1.0f - yf) * (zf)
+         + buf[gi + oy + 1] * (1.0f - xf) * (yf) * (zf)
+         + buf[gi + ox + oy + 1] * (xf) * (yf) * (zf);
+#endif
 }
 
 
@@ -277,9 +371,8 @@ void dt_bilateral_slice(const dt_bilateral_t *const b, const float *const in, fl
 {
   // detail: 0 is leave as is, -1 is bilateral filtered, +1 is contrast boost
   const float norm = -detail * b->sigma_r * 0.04f;
-  const int ox = 1;
-  const int oy = b->size_x;
-  const int oz = b->size_y * b->size_x;
+  const int ox = b->size_z;
+  const int oy = b->size_x * b->size_z;
   float *const buf = b->buf;
   const int size_x = b->size_x;
   const int size_y = b->size_y;
@@ -289,7 +382,7 @@ void dt_bilateral_slice(const dt_bilateral_t *const b, const float *const in, fl
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(b, in, norm, ox, oy, oz, size_x, size_y, size_z, height, width, buf) \
+  dt_omp_firstprivate(b, in, norm, ox, oy, size_x, size_y, size_z, height, width, buf) \
     shared(out) collapse(2)
 #endif
   for(int j = 0; j < height; j++)
@@ -307,16 +400,8 @@ void dt_bilateral_slice(const dt_bilateral_t *const b, const float *const in, fl
       const float xf = x - xi;
       const float yf = y - yi;
       const float zf = z - zi;
-      const size_t gi = xi + size_x * (yi + size_y * zi);
-      const float Lout = L
-                         + norm * (buf[gi] * (1.0f - xf) * (1.0f - yf) * (1.0f - zf)
-                                   + buf[gi + ox] * (xf) * (1.0f - yf) * (1.0f - zf)
-                                   + buf[gi + oy] * (1.0f - xf) * (yf) * (1.0f - zf)
-                                   + buf[gi + ox + oy] * (xf) * (yf) * (1.0f - zf)
-                                   + buf[gi + oz] * (1.0f - xf) * (1.0f - yf) * (zf)
-                                   + buf[gi + ox + oz] * (xf) * (1.0f - yf) * (zf)
-                                   + buf[gi + oy + oz] * (1.0f - xf) * (yf) * (zf)
-                                   + buf[gi + ox + oy + oz] * (xf) * (yf) * (zf));
+      const size_t gi = zi + size_z * (xi + (size_t)size_x * yi);
+      const float Lout = L + norm * trilinear(buf, gi, ox, oy, xf, yf, zf);
       out[index] = Lout;
       // and copy color and mask
       out[index + 1] = in[index + 1];
@@ -334,9 +419,8 @@ void dt_bilateral_slice_to_output(const dt_bilateral_t *const b, const float *co
 {
   // detail: 0 is leave as is, -1 is bilateral filtered, +1 is contrast boost
   const float norm = -detail * b->sigma_r * 0.04f;
-  const int ox = 1;
-  const int oy = b->size_x;
-  const int oz = b->size_y * b->size_x;
+  const int ox = b->size_z;
+  const int oy = b->size_x * b->size_z;
   float *const buf = b->buf;
   const int size_x = b->size_x;
   const int size_y = b->size_y;
@@ -346,7 +430,7 @@ void dt_bilateral_slice_to_output(const dt_bilateral_t *const b, const float *co
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(b, in, norm, oy, oz, ox, buf, size_x, size_y, size_z, width, height) \
+  dt_omp_firstprivate(b, in, norm, oy, ox, buf, size_x, size_y, size_z, width, height) \
   shared(out) collapse(2)
 #endif
   for(int j = 0; j < height; j++)
@@ -364,15 +448,8 @@ void dt_bilateral_slice_to_output(const dt_bilateral_t *const b, const float *co
       const float xf = x - xi;
       const float yf = y - yi;
       const float zf = z - zi;
-      const size_t gi = xi + size_x * (yi + size_y * zi);
-      const float Lout = norm * (buf[gi] * (1.0f - xf) * (1.0f - yf) * (1.0f - zf)
-                                 + buf[gi + ox] * (xf) * (1.0f - yf) * (1.0f - zf)
-                                 + buf[gi + oy] * (1.0f - xf) * (yf) * (1.0f - zf)
-                                 + buf[gi + ox + oy] * (xf) * (yf) * (1.0f - zf)
-                                 + buf[gi + oz] * (1.0f - xf) * (1.0f - yf) * (zf)
-                                 + buf[gi + ox + oz] * (xf) * (1.0f - yf) * (zf)
-                                 + buf[gi + oy + oz] * (1.0f - xf) * (yf) * (zf)
-                                 + buf[gi + ox + oy + oz] * (xf) * (yf) * (zf));
+      const size_t gi = zi + size_z * (xi + (size_t)size_x * yi);
+      const float Lout = norm * trilinear(buf, gi, ox, oy, xf, yf, zf);
       out[index] = MAX(0.0f, out[index] + Lout);
     }
   }
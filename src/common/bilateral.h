@@ -25,7 +25,7 @@ typedef struct dt_bilateral_t
   size_t size_x, size_y, size_z;
   int width, height;
   float sigma_s, sigma_r;
-  float *buf __attribute__((aligned(64)));
+  float *buf __attribute__((aligned(64))); // size_y x size_x x size_z, z innermost
 } __attribute__((packed)) dt_bilateral_t;
 
 size_t dt_bilateral_memory_use(const int width,      // width of input image
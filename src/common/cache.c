@@ -27,7 +27,172 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-// this implements a concurrent LRU cache
+// this implements a concurrent LRU cache.
+// entries are spread over DT_CACHE_SHARDS shards by key, every shard has its own
+// lock, hashtable and intrusive lru list. the cost quota is shared by all shards.
+// with clock eviction a hit doesn't change the lru list, so entries are also published
+// in a small direct mapped table which readers probe without taking the shard lock.
+// to make that safe, entries are never freed before dt_cache_cleanup(), removed ones
+// are kept in a free list of their shard and recycled.
+
+static inline dt_cache_shard_t *_shard(dt_cache_t *cache, const uint32_t key)
+{
+  // keys are image ids, possibly with the mip level in the upper bits. mix them
+  // so that consecutive ids end up in different shards.
+  const uint32_t hash = key * 2654435761u;
+  return cache->shard + ((hash >> 24) & (DT_CACHE_SHARDS - 1));
+}
+
+static inline dt_cache_entry_t **_hint(dt_cache_shard_t *shard, const uint32_t key)
+{
+  // the shard is picked by the high bits of the mixed key, use the low ones here
+  return shard->hint + ((key * 2654435761u) & (DT_CACHE_HINTS - 1));
+}
+
+// called with the shard lock held
+static inline void _hint_set(dt_cache_t *cache, dt_cache_shard_t *shard, dt_cache_entry_t *entry)
+{
+  if(cache->eviction != DT_CACHE_EVICT_CLOCK) return;
+  dt_cache_entry_t **slot = _hint(shard, entry->key);
+  if(*slot != entry) g_atomic_pointer_set(slot, entry);
+}
+
+// called with the shard lock held
+static inline void _hint_clear(dt_cache_shard_t *shard, dt_cache_entry_t *entry)
+{
+  dt_cache_entry_t **slot = _hint(shard, entry->key);
+  if(*slot == entry) g_atomic_pointer_set(slot, NULL);
+}
+
+// return the locked entry for key if it can be found without the shard lock, NULL otherwise.
+static inline dt_cache_entry_t *_lockfree_get(dt_cache_t *cache, dt_cache_shard_t *shard, const uint32_t key,
+                                              const char mode, const char *file, const int line)
+{
+  if(cache->eviction != DT_CACHE_EVICT_CLOCK) return NULL;
+  dt_cache_entry_t *entry = (dt_cache_entry_t *)g_atomic_pointer_get(_hint(shard, key));
+  if(!entry) return NULL;
+  // the entry might have been removed since we read the pointer, but its lock is still valid
+  const int result = (mode == 'w') ? dt_pthread_rwlock_trywrlock_with_caller(&entry->lock, file, line)
+                                   : dt_pthread_rwlock_tryrdlock_with_caller(&entry->lock, file, line);
+  if(result) return NULL;
+  // now that we hold the lock nobody can remove or recycle it, check that it still is ours
+  if(!g_atomic_int_get(&entry->hashed) || entry->key != key)
+  {
+    dt_pthread_rwlock_unlock(&entry->lock);
+    return NULL;
+  }
+  g_atomic_int_set(&entry->referenced, 1);
+  return entry;
+}
+
+static inline void _shard_lock(dt_cache_shard_t *shard)
+{
+  if(dt_pthread_mutex_trylock(&shard->lock))
+  {
+    dt_pthread_mutex_lock(&shard->lock);
+    shard->contended_lock++;
+  }
+}
+
+static inline void _cost_add(dt_cache_t *cache, const size_t cost)
+{
+  g_atomic_pointer_add(&cache->cost, (gssize)cost);
+}
+
+static inline void _cost_sub(dt_cache_t *cache, const size_t cost)
+{
+  g_atomic_pointer_add(&cache->cost, -(gssize)cost);
+}
+
+static inline void _lru_unlink(dt_cache_shard_t *shard, dt_cache_entry_t *entry)
+{
+  if(entry->lru_prev) entry->lru_prev->lru_next = entry->lru_next;
+  else shard->lru_first = entry->lru_next;
+  if(entry->lru_next) entry->lru_next->lru_prev = entry->lru_prev;
+  else shard->lru_last = entry->lru_prev;
+  entry->lru_prev = entry->lru_next = NULL;
+}
+
+static inline void _lru_append(dt_cache_shard_t *shard, dt_cache_entry_t *entry)
+{
+  entry->lru_next = NULL;
+  entry->lru_prev = shard->lru_last;
+  if(shard->lru_last) shard->lru_last->lru_next = entry;
+  else shard->lru_first = entry;
+  shard->lru_last = entry;
+}
+
+// bubble up in lru list, or just remember the access for clock eviction
+static inline void _lru_touch(dt_cache_t *cache, dt_cache_shard_t *shard, dt_cache_entry_t *entry)
+{
+  if(cache->eviction == DT_CACHE_EVICT_CLOCK)
+    g_atomic_int_set(&entry->referenced, 1);
+  else if(shard->lru_last != entry)
+  {
+    _lru_unlink(shard, entry);
+    _lru_append(shard, entry);
+  }
+}
+
+static void _entry_free(dt_cache_t *cache, dt_cache_entry_t *entry)
+{
+  if(cache->cleanup)
+  {
+    assert(entry->data_size);
+    ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
+
+    cache->cleanup(cache->cleanup_data, entry);
+  }
+  else
+    dt_free_align(entry->data);
+}
+
+// take an entry from the free list of the shard or allocate a new one. called with the shard lock held.
+static dt_cache_entry_t *_entry_new(dt_cache_shard_t *shard)
+{
+  dt_cache_entry_t *entry = shard->free_entries;
+  if(entry)
+  {
+    shard->free_entries = entry->lru_next;
+    return entry;
+  }
+  // here dies your 32-bit system:
+  entry = (dt_cache_entry_t *)g_slice_alloc(sizeof(dt_cache_entry_t));
+  int ret = dt_pthread_rwlock_init(&entry->lock, 0);
+  if(ret) fprintf(stderr, "rwlock init: %d\n", ret);
+  entry->hashed = 0;
+  return entry;
+}
+
+// remove a write locked entry from its shard and unlock it. called with the shard lock held.
+static void _entry_remove(dt_cache_t *cache, dt_cache_shard_t *shard, dt_cache_entry_t *entry)
+{
+  gboolean removed = g_hash_table_remove(shard->hashtable, GINT_TO_POINTER(entry->key));
+  (void)removed; // make non-assert compile happy
+  assert(removed);
+  g_atomic_int_set(&entry->hashed, 0);
+  _hint_clear(shard, entry);
+  _lru_unlink(shard, entry);
+  _cost_sub(cache, entry->cost);
+
+  _entry_free(cache, entry);
+
+  dt_pthread_rwlock_unlock(&entry->lock);
+  // lock-free readers may still try to lock it, keep it around
+  entry->lru_next = shard->free_entries;
+  shard->free_entries = entry;
+}
+
+static void _entry_list_destroy(dt_cache_entry_t *entry)
+{
+  while(entry)
+  {
+    dt_cache_entry_t *next = entry->lru_next;
+    dt_pthread_rwlock_destroy(&entry->lock);
+    g_slice_free1(sizeof(*entry), entry);
+    entry = next;
+  }
+}
 
 void dt_cache_init(
     dt_cache_t *cache,
@@ -35,72 +200,81 @@ void dt_cache_init(
     size_t cost_quota)
 {
   cache->cost = 0;
-  cache->lru = 0;
   cache->entry_size = entry_size;
   cache->cost_quota = cost_quota;
-  dt_pthread_mutex_init(&cache->lock, 0);
+  cache->eviction = DT_CACHE_EVICT_LRU;
   cache->allocate = 0;
   cache->allocate_data = 0;
   cache->cleanup = 0;
   cache->cleanup_data = 0;
-  cache->hashtable = g_hash_table_new(0, 0);
+  for(int k = 0; k < DT_CACHE_SHARDS; k++)
+  {
+    dt_cache_shard_t *shard = cache->shard + k;
+    dt_pthread_mutex_init(&shard->lock, 0);
+    shard->hashtable = g_hash_table_new(0, 0);
+    shard->lru_first = shard->lru_last = NULL;
+    shard->free_entries = NULL;
+    for(int i = 0; i < DT_CACHE_HINTS; i++) shard->hint[i] = NULL;
+    shard->contended_lock = shard->contended_entry = 0;
+  }
 }
 
 void dt_cache_cleanup(dt_cache_t *cache)
 {
-  g_hash_table_destroy(cache->hashtable);
-  GList *l = cache->lru;
-  while(l)
+  for(int k = 0; k < DT_CACHE_SHARDS; k++)
   {
-    dt_cache_entry_t *entry = (dt_cache_entry_t *)l->data;
-
-    if(cache->cleanup)
-    {
-      assert(entry->data_size);
-      ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
-
-      cache->cleanup(cache->cleanup_data, entry);
-    }
-    else
-      dt_free_align(entry->data);
-
-    dt_pthread_rwlock_destroy(&entry->lock);
-    g_slice_free1(sizeof(*entry), entry);
-    l = g_list_next(l);
+    dt_cache_shard_t *shard = cache->shard + k;
+    g_hash_table_destroy(shard->hashtable);
+    for(dt_cache_entry_t *entry = shard->lru_first; entry; entry = entry->lru_next) _entry_free(cache, entry);
+    _entry_list_destroy(shard->lru_first);
+    _entry_list_destroy(shard->free_entries);
+    shard->lru_first = shard->lru_last = shard->free_entries = NULL;
+    dt_pthread_mutex_destroy(&shard->lock);
   }
-  g_list_free(cache->lru);
-  dt_pthread_mutex_destroy(&cache->lock);
 }
 
 int32_t dt_cache_contains(dt_cache_t *cache, const uint32_t key)
 {
-  dt_pthread_mutex_lock(&cache->lock);
-  int32_t result = g_hash_table_contains(cache->hashtable, GINT_TO_POINTER(key));
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_cache_shard_t *shard = _shard(cache, key);
+  _shard_lock(shard);
+  int32_t result = g_hash_table_contains(shard->hashtable, GINT_TO_POINTER(key));
+  dt_pthread_mutex_unlock(&shard->lock);
   return result;
 }
 
+uint64_t dt_cache_contention(dt_cache_t *cache)
+{
+  uint64_t sum = 0;
+  for(int k = 0; k < DT_CACHE_SHARDS; k++)
+    sum += cache->shard[k].contended_lock + cache->shard[k].contended_entry;
+  return sum;
+}
+
 int dt_cache_for_all(
     dt_cache_t *cache,
     int (*process)(const uint32_t key, const void *data, void *user_data),
     void *user_data)
 {
-  dt_pthread_mutex_lock(&cache->lock);
-  GHashTableIter iter;
-  gpointer key, value;
-
-  g_hash_table_iter_init (&iter, cache->hashtable);
-  while (g_hash_table_iter_next (&iter, &key, &value))
+  for(int k = 0; k < DT_CACHE_SHARDS; k++)
   {
-    dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
-    const int err = process(GPOINTER_TO_INT(key), entry->data, user_data);
-    if(err)
+    dt_cache_shard_t *shard = cache->shard + k;
+    dt_pthread_mutex_lock(&shard->lock);
+    GHashTableIter iter;
+    gpointer key, value;
+
+    g_hash_table_iter_init (&iter, shard->hashtable);
+    while (g_hash_table_iter_next (&iter, &key, &value))
     {
-      dt_pthread_mutex_unlock(&cache->lock);
-      return err;
+      dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
+      const int err = process(GPOINTER_TO_INT(key), entry->data, user_data);
+      if(err)
+      {
+        dt_pthread_mutex_unlock(&shard->lock);
+        return err;
+      }
     }
+    dt_pthread_mutex_unlock(&shard->lock);
   }
-  dt_pthread_mutex_unlock(&cache->lock);
   return 0;
 }
 
@@ -111,25 +285,36 @@ dt_cache_entry_t *dt_cache_testget(dt_cache_t *cache, const uint32_t key, char m
   gpointer orig_key, value;
   gboolean res;
   double start = dt_get_wtime();
-  dt_pthread_mutex_lock(&cache->lock);
+  dt_cache_shard_t *shard = _shard(cache, key);
+  dt_cache_entry_t *entry = _lockfree_get(cache, shard, key, mode, __FILE__, __LINE__);
+  if(entry)
+  {
+    if(mode == 'w')
+    {
+      assert(entry->data_size);
+      ASAN_POISON_MEMORY_REGION(entry->data, entry->data_size);
+    }
+    return entry;
+  }
+  _shard_lock(shard);
   res = g_hash_table_lookup_extended(
-      cache->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
+      shard->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
   if(res)
   {
-    dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
+    entry = (dt_cache_entry_t *)value;
     // lock the cache entry
     const int result
         = (mode == 'w') ? dt_pthread_rwlock_trywrlock(&entry->lock) : dt_pthread_rwlock_tryrdlock(&entry->lock);
     if(result)
     { // need to give up mutex so other threads have a chance to get in between and
       // free the lock we're trying to acquire:
-      dt_pthread_mutex_unlock(&cache->lock);
+      shard->contended_entry++;
+      dt_pthread_mutex_unlock(&shard->lock);
       return 0;
     }
-    // bubble up in lru list:
-    cache->lru = g_list_remove_link(cache->lru, entry->link);
-    cache->lru = g_list_concat(cache->lru, entry->link);
-    dt_pthread_mutex_unlock(&cache->lock);
+    _lru_touch(cache, shard, entry);
+    _hint_set(cache, shard, entry);
+    dt_pthread_mutex_unlock(&shard->lock);
     double end = dt_get_wtime();
     if(end - start > 0.1)
       fprintf(stderr, "try+ wait time %.06fs mode %c \n", end - start, mode);
@@ -144,13 +329,59 @@ dt_cache_entry_t *dt_cache_testget(dt_cache_t *cache, const uint32_t key, char m
 
     return entry;
   }
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_pthread_mutex_unlock(&shard->lock);
   double end = dt_get_wtime();
   if(end - start > 0.1)
     fprintf(stderr, "try- wait time %.06fs\n", end - start);
   return 0;
 }
 
+// best-effort garbage collection of one shard, which has to be locked by the caller.
+static void _shard_gc(dt_cache_t *cache, dt_cache_shard_t *shard, const float fill_ratio)
+{
+  dt_cache_entry_t *entry = shard->lru_first;
+  // with clock eviction, referenced entries are moved to the end once. don't walk in circles:
+  guint steps = 2 * g_hash_table_size(shard->hashtable);
+  while(entry && steps--)
+  {
+    dt_cache_entry_t *next = entry->lru_next; // we might remove this element, so walk to the next one while we still have the pointer..
+    if(cache->cost < cache->cost_quota * fill_ratio) break;
+
+    // lock-free readers set this without the shard lock
+    if(g_atomic_int_get(&entry->referenced))
+    {
+      // second chance
+      g_atomic_int_set(&entry->referenced, 0);
+      if(next)
+      {
+        _lru_unlink(shard, entry);
+        _lru_append(shard, entry);
+      }
+      entry = next;
+      continue;
+    }
+
+    // if still locked by anyone else give up:
+    if(dt_pthread_rwlock_trywrlock(&entry->lock))
+    {
+      entry = next;
+      continue;
+    }
+
+    if(entry->_lock_demoting)
+    {
+      // oops, we are currently demoting (rw -> r) lock to this entry in some thread. do not touch!
+      dt_pthread_rwlock_unlock(&entry->lock);
+      entry = next;
+      continue;
+    }
+
+    // delete!
+    _entry_remove(cache, shard, entry);
+    entry = next;
+  }
+}
+
 // if found, the data void* is returned. if not, it is set to be
 // the given *data and a new hash table entry is created, which can be
 // found using the given key later on.
@@ -160,27 +391,31 @@ dt_cache_entry_t *dt_cache_get_with_caller(dt_cache_t *cache, const uint32_t key
   gboolean res;
   int result;
   double start = dt_get_wtime();
+  dt_cache_shard_t *shard = _shard(cache, key);
+  dt_cache_entry_t *entry = _lockfree_get(cache, shard, key, mode, file, line);
+  if(entry) goto found;
 restart:
-  dt_pthread_mutex_lock(&cache->lock);
+  _shard_lock(shard);
   res = g_hash_table_lookup_extended(
-      cache->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
+      shard->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
   if(res)
   { // yay, found. read lock and pass on.
-    dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
+    entry = (dt_cache_entry_t *)value;
     if(mode == 'w') result = dt_pthread_rwlock_trywrlock_with_caller(&entry->lock, file, line);
     else            result = dt_pthread_rwlock_tryrdlock_with_caller(&entry->lock, file, line);
     if(result)
     { // need to give up mutex so other threads have a chance to get in between and
       // free the lock we're trying to acquire:
-      dt_pthread_mutex_unlock(&cache->lock);
+      shard->contended_entry++;
+      dt_pthread_mutex_unlock(&shard->lock);
       g_usleep(5);
       goto restart;
     }
-    // bubble up in lru list:
-    cache->lru = g_list_remove_link(cache->lru, entry->link);
-    cache->lru = g_list_concat(cache->lru, entry->link);
-    dt_pthread_mutex_unlock(&cache->lock);
+    _lru_touch(cache, shard, entry);
+    _hint_set(cache, shard, entry);
+    dt_pthread_mutex_unlock(&shard->lock);
 
+found:
 #ifdef _DEBUG
     const pthread_t writer = dt_pthread_rwlock_get_writer(&entry->lock);
     if(mode == 'w')
@@ -211,21 +446,28 @@ restart:
   if(cache->cost > 0.8f * cache->cost_quota)
   {
     // need to roll back all the way to get a consistent lock state:
-    dt_cache_gc(cache, 0.8f);
+    _shard_gc(cache, shard, 0.8f);
+    // the quota is shared, so help out in the other shards if ours is empty by now.
+    // only try their locks, we're holding ours already.
+    for(int k = 0; k < DT_CACHE_SHARDS && cache->cost > 0.8f * cache->cost_quota; k++)
+    {
+      dt_cache_shard_t *other = cache->shard + k;
+      if(other == shard || dt_pthread_mutex_trylock(&other->lock)) continue;
+      _shard_gc(cache, other, 0.8f);
+      dt_pthread_mutex_unlock(&other->lock);
+    }
   }
 
-  // here dies your 32-bit system:
-  dt_cache_entry_t *entry = (dt_cache_entry_t *)g_slice_alloc(sizeof(dt_cache_entry_t));
-  int ret = dt_pthread_rwlock_init(&entry->lock, 0);
-  if(ret) fprintf(stderr, "rwlock init: %d\n", ret);
+  entry = _entry_new(shard);
   entry->data = 0;
   entry->data_size = cache->entry_size;
   entry->cost = 1;
-  entry->link = g_list_append(0, entry);
+  entry->lru_prev = entry->lru_next = NULL;
+  entry->referenced = 0;
   entry->key = key;
   entry->_lock_demoting = 0;
 
-  g_hash_table_insert(cache->hashtable, GINT_TO_POINTER(key), entry);
+  g_hash_table_insert(shard->hashtable, GINT_TO_POINTER(key), entry);
 
   assert(cache->allocate || entry->data_size);
 
@@ -243,13 +485,16 @@ restart:
   // write lock in case the caller requests it:
   if(write) dt_pthread_rwlock_wrlock_with_caller(&entry->lock, file, line);
   else      dt_pthread_rwlock_rdlock_with_caller(&entry->lock, file, line);
+  // only now lock-free readers which still hold a pointer to a recycled entry may accept it
+  g_atomic_int_set(&entry->hashed, 1);
 
-  cache->cost += entry->cost;
+  _cost_add(cache, entry->cost);
 
   // put at end of lru list (most recently used):
-  cache->lru = g_list_concat(cache->lru, entry->link);
+  _lru_append(shard, entry);
+  _hint_set(cache, shard, entry);
 
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_pthread_mutex_unlock(&shard->lock);
   double end = dt_get_wtime();
   if(end - start > 0.1)
     fprintf(stderr, "wait time %.06fs\n", end - start);
@@ -265,22 +510,24 @@ int dt_cache_remove(dt_cache_t *cache, const uint32_t key)
   gboolean res;
   int result;
   dt_cache_entry_t *entry;
+  dt_cache_shard_t *shard = _shard(cache, key);
 restart:
-  dt_pthread_mutex_lock(&cache->lock);
+  _shard_lock(shard);
 
   res = g_hash_table_lookup_extended(
-      cache->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
+      shard->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
   entry = (dt_cache_entry_t *)value;
   if(!res)
   { // not found in cache, not deleting.
-    dt_pthread_mutex_unlock(&cache->lock);
+    dt_pthread_mutex_unlock(&shard->lock);
     return 1;
   }
   // need write lock to be able to delete:
   result = dt_pthread_rwlock_trywrlock(&entry->lock);
   if(result)
   {
-    dt_pthread_mutex_unlock(&cache->lock);
+    shard->contended_entry++;
+    dt_pthread_mutex_unlock(&shard->lock);
     g_usleep(5);
     goto restart;
   }
@@ -289,76 +536,26 @@ restart:
   {
     // oops, we are currently demoting (rw -> r) lock to this entry in some thread. do not touch!
     dt_pthread_rwlock_unlock(&entry->lock);
-    dt_pthread_mutex_unlock(&cache->lock);
+    dt_pthread_mutex_unlock(&shard->lock);
     g_usleep(5);
     goto restart;
   }
 
-  gboolean removed = g_hash_table_remove(cache->hashtable, GINT_TO_POINTER(key));
-  (void)removed; // make non-assert compile happy
-  assert(removed);
-  cache->lru = g_list_delete_link(cache->lru, entry->link);
+  _entry_remove(cache, shard, entry);
 
-  if(cache->cleanup)
-  {
-    assert(entry->data_size);
-    ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
-
-    cache->cleanup(cache->cleanup_data, entry);
-  }
-  else
-    dt_free_align(entry->data);
-
-  dt_pthread_rwlock_unlock(&entry->lock);
-  dt_pthread_rwlock_destroy(&entry->lock);
-  cache->cost -= entry->cost;
-  g_slice_free1(sizeof(*entry), entry);
-
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_pthread_mutex_unlock(&shard->lock);
   return 0;
 }
 
 // best-effort garbage collection. never blocks, never fails. well, sometimes it just doesn't free anything.
 void dt_cache_gc(dt_cache_t *cache, const float fill_ratio)
 {
-  GList *l = cache->lru;
-  int cnt = 0;
-  while(l)
+  for(int k = 0; k < DT_CACHE_SHARDS && cache->cost >= cache->cost_quota * fill_ratio; k++)
   {
-    cnt++;
-    dt_cache_entry_t *entry = (dt_cache_entry_t *)l->data;
-    assert(entry->link->data == entry);
-    l = g_list_next(l); // we might remove this element, so walk to the next one while we still have the pointer..
-    if(cache->cost < cache->cost_quota * fill_ratio) break;
-
-    // if still locked by anyone else give up:
-    if(dt_pthread_rwlock_trywrlock(&entry->lock)) continue;
-
-    if(entry->_lock_demoting)
-    {
-      // oops, we are currently demoting (rw -> r) lock to this entry in some thread. do not touch!
-      dt_pthread_rwlock_unlock(&entry->lock);
-      continue;
-    }
-
-    // delete!
-    g_hash_table_remove(cache->hashtable, GINT_TO_POINTER(entry->key));
-    cache->lru = g_list_delete_link(cache->lru, entry->link);
-    cache->cost -= entry->cost;
-
-    if(cache->cleanup)
-    {
-      assert(entry->data_size);
-      ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
-
-      cache->cleanup(cache->cleanup_data, entry);
-    }
-    else
-      dt_free_align(entry->data);
-
-    dt_pthread_rwlock_unlock(&entry->lock);
-    dt_pthread_rwlock_destroy(&entry->lock);
-    g_slice_free1(sizeof(*entry), entry);
+    dt_cache_shard_t *shard = cache->shard + k;
+    if(dt_pthread_mutex_trylock(&shard->lock)) continue;
+    _shard_gc(cache, shard, fill_ratio);
+    dt_pthread_mutex_unlock(&shard->lock);
   }
 }
 
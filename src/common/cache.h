@@ -23,32 +23,67 @@
 #include <inttypes.h>
 #include <stddef.h>
 
+// number of independently locked parts of a cache, has to be a power of two
+#define DT_CACHE_SHARDS 16
+// slots per shard of the direct mapped table used to find entries without taking the shard lock,
+// has to be a power of two
+#define DT_CACHE_HINTS 256
+
+typedef enum dt_cache_eviction_t
+{
+  DT_CACHE_EVICT_LRU = 0,   // move entries to the end of the list on every access
+  DT_CACHE_EVICT_CLOCK = 1, // only mark entries as referenced on access, give them a second chance on eviction
+} dt_cache_eviction_t;
+
 typedef struct dt_cache_entry_t
 {
   void *data;
   size_t data_size;
   size_t cost;
-  GList *link;
+  // intrusive lru list of the shard this entry lives in
+  struct dt_cache_entry_t *lru_prev, *lru_next;
+  int referenced;
   dt_pthread_rwlock_t lock;
   int _lock_demoting;
   uint32_t key;
+  // set while the entry holds valid data for key. entries are recycled within their shard and only
+  // freed in dt_cache_cleanup(), so lock-free readers may still lock a removed entry and check this.
+  int hashed;
 }
 dt_cache_entry_t;
 
 typedef void((*dt_cache_allocate_t)(void *userdata, dt_cache_entry_t *entry));
 typedef void((*dt_cache_cleanup_t)(void *userdata, dt_cache_entry_t *entry));
 
+typedef struct dt_cache_shard_t
+{
+  dt_pthread_mutex_t lock; // protects the hashtable and the lru list of this shard.
+
+  GHashTable *hashtable;       // stores (key, entry) pairs
+  dt_cache_entry_t *lru_first; // about to be kicked from cache
+  dt_cache_entry_t *lru_last;  // most recently used (or inserted, for clock eviction)
+  dt_cache_entry_t *free_entries; // removed entries, linked through lru_next, for reuse
+
+  // lock-free lookup for clock eviction, indexed by key. only written with the shard lock held.
+  dt_cache_entry_t *hint[DT_CACHE_HINTS];
+
+  // profiling: how often a thread had to wait for the shard lock or retry on a locked entry
+  uint64_t contended_lock;
+  uint64_t contended_entry;
+}
+dt_cache_shard_t;
+
 typedef struct dt_cache_t
 {
-  dt_pthread_mutex_t lock; // big fat lock. we're only expecting a couple hand full of cpu threads to use this concurrently.
+  // entries are distributed over the shards by key, so that threads working on different
+  // images don't serialize on a single lock.
+  dt_cache_shard_t shard[DT_CACHE_SHARDS];
+  dt_cache_eviction_t eviction;
 
   size_t entry_size; // cache line allocation
-  size_t cost;       // user supplied cost per cache line (bytes?)
+  size_t cost;       // user supplied cost of all cache lines (bytes?), updated atomically
   size_t cost_quota; // quota to try and meet. but don't use as hard limit.
 
-  GHashTable *hashtable; // stores (key, entry) pairs
-  GList *lru;            // last element is most recently used, first is about to be kicked from cache.
-
   // callback functions for cache misses/garbage collection
   dt_cache_allocate_t allocate;
   dt_cache_allocate_t cleanup;
@@ -73,6 +108,12 @@ static inline void dt_cache_set_cleanup_callback(dt_cache_t *cache, dt_cache_cle
   cache->cleanup = cleanup_cb;
   cache->cleanup_data = cleanup_data;
 }
+// lru is the default. set this before using the cache.
+// with clock eviction, hits on entries which are not locked by a writer don't take the shard lock.
+static inline void dt_cache_set_eviction(dt_cache_t *cache, dt_cache_eviction_t eviction)
+{
+  cache->eviction = eviction;
+}
 
 // returns a slot in the cache for this key (newly allocated if need be), locked according to mode (r, w)
 #define dt_cache_get(A, B, C)  dt_cache_get_with_caller(A, B, C, __FILE__, __LINE__)
@@ -93,6 +134,9 @@ int32_t dt_cache_remove(dt_cache_t *cache, const uint32_t key);
 // is locked)
 void dt_cache_gc(dt_cache_t *cache, const float fill_ratio);
 
+// number of times threads had to wait for a shard lock or retry on a locked entry.
+uint64_t dt_cache_contention(dt_cache_t *cache);
+
 // iterate over all currently contained data blocks.
 // not thread safe! only use this for init/cleanup!
 // returns non zero the first time process() returns non zero.
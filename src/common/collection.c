@@ -18,6 +18,7 @@
 
 #include "common/collection.h"
 #include "common/debug.h"
+#include "common/fulltext.h"
 #include "common/image.h"
 #include "common/imageio_rawspeed.h"
 #include "common/metadata.h"
@@ -41,6 +42,8 @@
 
 #define SELECT_QUERY "SELECT DISTINCT * FROM %s"
 #define LIMIT_QUERY "LIMIT ?1, ?2"
+// above this number of changed images we requery the whole collection
+#define INCREMENTAL_MAX_IMAGES 1000
 
 static const char *comparators[] = {
   "<",  // DT_COLLECTION_RATING_COMP_LT = 0,
@@ -84,7 +87,11 @@ const dt_collection_t *dt_collection_new(const dt_collection_t *clone)
     collection->tagid = clone->tagid;
   }
   else /* else we just initialize using the reset */
+  {
+    collection->index = g_array_new(FALSE, FALSE, sizeof(int));
+    collection->index_pos = g_hash_table_new(NULL, NULL);
     dt_collection_reset(collection);
+  }
 
   /* connect to all the signals that might indicate that the count of images matching the collection changed
    */
@@ -113,6 +120,10 @@ void dt_collection_free(const dt_collection_t *collection)
 
   g_free(collection->query);
   g_free(collection->query_no_group);
+  g_free(collection->query_member);
+  g_free(collection->index_query);
+  if(collection->index) g_array_free(collection->index, TRUE);
+  if(collection->index_pos) g_hash_table_destroy(collection->index_pos);
   g_strfreev(collection->where_ext);
   g_free((dt_collection_t *)collection);
 }
@@ -144,6 +155,42 @@ static char * and_operator(int *term)
   assert(0); // Not reached.
 }
 
+/* with -d sqlplan, prints how long a collection query took and how sqlite runs it. call after the query is done,
+ * with the time it started. */
+static void _collection_explain(const char *what, const char *query, const double start)
+{
+  if(!(darktable.unmuted & DT_DEBUG_SQL_PLAN)) return;
+  const double duration = dt_get_wtime() - start;
+
+  gchar *explain = g_strdup_printf("EXPLAIN QUERY PLAN %s", query);
+  sqlite3_stmt *stmt;
+  if(sqlite3_prepare_v2(dt_database_get(darktable.db), explain, -1, &stmt, NULL) != SQLITE_OK)
+  {
+    dt_print(DT_DEBUG_SQL_PLAN, "[collection] %s query took %.3f secs, no plan: %s\n", what, duration,
+             sqlite3_errmsg(dt_database_get(darktable.db)));
+    g_free(explain);
+    return;
+  }
+  // the limit of the main query, if there is one
+  sqlite3_bind_int(stmt, 1, 0);
+  sqlite3_bind_int(stmt, 2, -1);
+
+  dt_print(DT_DEBUG_SQL_PLAN, "[collection] %s query took %.3f secs: %s\n", what, duration, query);
+  // rows are (id, parent, notused, detail), indent the details by their depth in the plan
+  GHashTable *depth = g_hash_table_new(NULL, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const int id = sqlite3_column_int(stmt, 0);
+    const int parent = sqlite3_column_int(stmt, 1);
+    const int d = GPOINTER_TO_INT(g_hash_table_lookup(depth, GINT_TO_POINTER(parent))) + 1;
+    g_hash_table_insert(depth, GINT_TO_POINTER(id), GINT_TO_POINTER(d));
+    dt_print(DT_DEBUG_SQL_PLAN, "[collection] %*s%s\n", 2 * d, "", (const char *)sqlite3_column_text(stmt, 3));
+  }
+  g_hash_table_destroy(depth);
+  sqlite3_finalize(stmt);
+  g_free(explain);
+}
+
 void dt_collection_memory_update()
 {
   if(!darktable.collection || !darktable.db) return;
@@ -168,14 +215,241 @@ void dt_collection_memory_update()
   // 2. insert collected images into the temporary table
   gchar *ins_query = dt_util_dstrcat(NULL, "INSERT INTO memory.collected_images (imgid) %s", query);
 
+  const double start = dt_get_wtime();
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), ins_query, -1, &stmt, NULL);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, 0);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, -1);
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
+  _collection_explain("collected images", ins_query, start);
 
-  g_free(query);
   g_free(ins_query);
+
+  // 3. mirror it in memory for the incremental updates
+  dt_collection_t *collection = (dt_collection_t *)darktable.collection;
+  g_array_set_size(collection->index, 0);
+  g_hash_table_remove_all(collection->index_pos);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT imgid FROM memory.collected_images ORDER BY rowid", -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const int imgid = sqlite3_column_int(stmt, 0);
+    g_array_append_val(collection->index, imgid);
+    g_hash_table_insert(collection->index_pos, GINT_TO_POINTER(imgid), GINT_TO_POINTER(collection->index->len));
+  }
+  sqlite3_finalize(stmt);
+  g_free(collection->index_query);
+  collection->index_query = query;
+}
+
+// fills memory.collection_changed with the given image ids
+static void _collection_set_changed(const int *imgids, const int count)
+{
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "DELETE FROM memory.collection_changed", NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "INSERT OR IGNORE INTO memory.collection_changed (imgid) VALUES (?1)", -1, &stmt,
+                              NULL);
+  for(int k = 0; k < count; k++)
+  {
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgids[k]);
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+  }
+  sqlite3_finalize(stmt);
+}
+
+// runs the membership query on memory.collection_changed, returns the members in collection order
+static GArray *_collection_get_members(const dt_collection_t *collection)
+{
+  GArray *members = g_array_new(FALSE, FALSE, sizeof(int));
+  sqlite3_stmt *stmt;
+  const double start = dt_get_wtime();
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), collection->query_member, -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const int imgid = sqlite3_column_int(stmt, 0);
+    g_array_append_val(members, imgid);
+  }
+  sqlite3_finalize(stmt);
+  _collection_explain("membership", collection->query_member, start);
+  return members;
+}
+
+static gint _collection_cmp_position(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+  GHashTable *index_pos = (GHashTable *)user_data;
+  const int pa = GPOINTER_TO_INT(g_hash_table_lookup(index_pos, GINT_TO_POINTER(*(const int *)a)));
+  const int pb = GPOINTER_TO_INT(g_hash_table_lookup(index_pos, GINT_TO_POINTER(*(const int *)b)));
+  return (pa > pb) - (pa < pb);
+}
+
+/* after a change of the given images with an unchanged query, update memory.collected_images without
+ * requerying the whole library: images which don't match any more are removed, and the remaining ones are
+ * checked to still be in order with their neighbours. returns FALSE if that's not enough (new images in the
+ * collection, images moving inside of it, groups) and the collection has to be rebuilt. */
+static gboolean _collection_update_incremental(dt_collection_t *collection, GList *list)
+{
+  const int nb = g_list_length(list);
+  if(collection != darktable.collection || !collection->query_member || nb == 0 || nb > INCREMENTAL_MAX_IMAGES
+     || g_strcmp0(collection->index_query, collection->query)
+     || collection->params.sort == DT_COLLECTION_SORT_SHUFFLE)
+    return FALSE;
+
+  int *changed = malloc(sizeof(int) * nb);
+  int k = 0;
+  for(GList *l = list; l; l = g_list_next(l)) changed[k++] = GPOINTER_TO_INT(l->data);
+  _collection_set_changed(changed, nb);
+  free(changed);
+
+  if(darktable.gui && darktable.gui->grouping)
+  {
+    // only images alone in their group
+    sqlite3_stmt *stmt;
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                                "SELECT 1 FROM main.images"
+                                " WHERE group_id != id"
+                                "   AND (id IN (SELECT imgid FROM memory.collection_changed)"
+                                "        OR group_id IN (SELECT imgid FROM memory.collection_changed))"
+                                " LIMIT 1",
+                                -1, &stmt, NULL);
+    const gboolean grouped = sqlite3_step(stmt) == SQLITE_ROW;
+    sqlite3_finalize(stmt);
+    if(grouped) return FALSE;
+  }
+
+  GArray *members = _collection_get_members(collection);
+  GHashTable *is_member = g_hash_table_new(NULL, NULL);
+  for(int i = 0; i < members->len; i++)
+    g_hash_table_add(is_member, GINT_TO_POINTER(g_array_index(members, int, i)));
+  g_array_free(members, TRUE);
+
+  gboolean ok = TRUE;
+  GArray *removed = g_array_new(FALSE, FALSE, sizeof(int));
+  GArray *kept = g_array_new(FALSE, FALSE, sizeof(int));
+  for(GList *l = list; l && ok; l = g_list_next(l))
+  {
+    const int imgid = GPOINTER_TO_INT(l->data);
+    const gboolean was = g_hash_table_contains(collection->index_pos, l->data);
+    const gboolean now = g_hash_table_contains(is_member, l->data);
+    if(now && !was)
+      ok = FALSE; // we don't know where to insert it
+    else if(was && !now)
+      g_array_append_val(removed, imgid);
+    else if(was)
+      g_array_append_val(kept, imgid);
+  }
+  g_hash_table_destroy(is_member);
+
+  if(ok && kept->len > 0)
+  {
+    // the kept images and their neighbours (without the removed ones) have to be sorted as before
+    GHashTable *is_removed = g_hash_table_new(NULL, NULL);
+    for(int i = 0; i < removed->len; i++)
+      g_hash_table_add(is_removed, GINT_TO_POINTER(g_array_index(removed, int, i)));
+    GHashTable *check = g_hash_table_new(NULL, NULL);
+    for(int i = 0; i < kept->len; i++)
+    {
+      const int imgid = g_array_index(kept, int, i);
+      g_hash_table_add(check, GINT_TO_POINTER(imgid));
+      const int pos = GPOINTER_TO_INT(g_hash_table_lookup(collection->index_pos, GINT_TO_POINTER(imgid))) - 1;
+      for(int dir = -1; dir <= 1; dir += 2)
+      {
+        int n = pos + dir;
+        while(n >= 0 && n < collection->index->len
+              && g_hash_table_contains(is_removed, GINT_TO_POINTER(g_array_index(collection->index, int, n))))
+          n += dir;
+        if(n >= 0 && n < collection->index->len)
+          g_hash_table_add(check, GINT_TO_POINTER(g_array_index(collection->index, int, n)));
+      }
+    }
+    g_hash_table_destroy(is_removed);
+
+    GArray *expected = g_array_new(FALSE, FALSE, sizeof(int));
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, check);
+    while(g_hash_table_iter_next(&iter, &key, NULL))
+    {
+      const int imgid = GPOINTER_TO_INT(key);
+      g_array_append_val(expected, imgid);
+    }
+    g_hash_table_destroy(check);
+    g_array_sort_with_data(expected, _collection_cmp_position, collection->index_pos);
+
+    _collection_set_changed((int *)expected->data, expected->len);
+    GArray *sorted = _collection_get_members(collection);
+    ok = sorted->len == expected->len
+         && !memcmp(sorted->data, expected->data, sizeof(int) * expected->len);
+    g_array_free(sorted, TRUE);
+    g_array_free(expected, TRUE);
+  }
+  g_array_free(kept, TRUE);
+
+  if(!ok || removed->len == 0)
+  {
+    g_array_free(removed, TRUE);
+    return ok;
+  }
+
+  // drop the removed images from the index, and rewrite the table from the first of them on
+  int first = collection->index->len;
+  for(int i = 0; i < removed->len; i++)
+  {
+    const int imgid = g_array_index(removed, int, i);
+    first = MIN(first, GPOINTER_TO_INT(g_hash_table_lookup(collection->index_pos, GINT_TO_POINTER(imgid))) - 1);
+    g_hash_table_remove(collection->index_pos, GINT_TO_POINTER(imgid));
+  }
+  int pos = first;
+  for(int i = first; i < collection->index->len; i++)
+  {
+    const int imgid = g_array_index(collection->index, int, i);
+    if(!g_hash_table_contains(collection->index_pos, GINT_TO_POINTER(imgid))) continue;
+    g_array_index(collection->index, int, pos++) = imgid;
+    g_hash_table_insert(collection->index_pos, GINT_TO_POINTER(imgid), GINT_TO_POINTER(pos));
+  }
+  g_array_set_size(collection->index, pos);
+
+  sqlite3_stmt *stmt;
+  sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "DELETE FROM memory.collected_images WHERE rowid > ?1", -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, first);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "INSERT INTO memory.collected_images (rowid, imgid) VALUES (?1, ?2)", -1, &stmt,
+                              NULL);
+  for(int i = first; i < collection->index->len; i++)
+  {
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, i + 1);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, g_array_index(collection->index, int, i));
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+  }
+  sqlite3_finalize(stmt);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "UPDATE memory.sqlite_sequence SET seq = ?1 WHERE name='collected_images'", -1,
+                              &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, collection->index->len);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+
+  // images not in the collection can't stay selected
+  _collection_set_changed((int *)removed->data, removed->len);
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
+                        "DELETE FROM main.selected_images"
+                        " WHERE imgid IN (SELECT imgid FROM memory.collection_changed)",
+                        NULL, NULL, NULL);
+  sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+
+  // removed images are alone in their group, so they count the same with and without grouping
+  collection->count -= MIN(collection->count, removed->len);
+  collection->count_no_group -= MIN(collection->count_no_group, removed->len);
+  dt_print(DT_DEBUG_SQL, "[collection] removed %d images incrementally\n", removed->len);
+  g_array_free(removed, TRUE);
+  dt_collection_hint_message(collection);
+  return TRUE;
 }
 
 static void _dt_collection_set_selq_pre_sort(const dt_collection_t *collection, char **selq_pre)
@@ -198,7 +472,8 @@ static void _dt_collection_set_selq_pre_sort(const dt_collection_t *collection,
                               tagid ? tag : "");
 }
 
-int dt_collection_update(const dt_collection_t *collection)
+// builds and stores the queries of the collection, without touching the counts
+static int _dt_collection_build_query(const dt_collection_t *collection)
 {
   uint32_t result;
   gchar *wq, *wq_no_group, *sq, *selq_pre, *selq_post, *query, *query_no_group;
@@ -448,6 +723,22 @@ int dt_collection_update(const dt_collection_t *collection)
                         (collection->params.query_flags & COLLECTION_QUERY_USE_LIMIT) ? " " LIMIT_QUERY : "");
   result = _dt_collection_store(collection, query, query_no_group);
 
+  /* membership and order of a few images, to maintain memory.collected_images incrementally. in an unexpanded
+   * group only the representative image is shown, we only use this for images alone in their group where
+   * the grouping part of the query reduces to the image being the expanded one. */
+  g_free(collection->query_member);
+  ((dt_collection_t *)collection)->query_member = NULL;
+  if(!(collection->params.query_flags & COLLECTION_QUERY_USE_ONLY_WHERE_EXT))
+  {
+    gchar *member_where = (darktable.gui && darktable.gui->grouping)
+                              ? g_strdup_printf("(%s) OR mi.id = %d", wq_no_group, darktable.gui->expanded_group_id)
+                              : g_strdup(wq_no_group);
+    ((dt_collection_t *)collection)->query_member
+        = dt_util_dstrcat(NULL, "%s(%s) AND mi.id IN (SELECT imgid FROM memory.collection_changed)%s %s", selq_pre,
+                          member_where, selq_post ? selq_post : "", sq ? sq : "");
+    g_free(member_where);
+  }
+
 #ifdef _DEBUG
   printf("SQL Collection for 1st:%d and 2nd:%d: %s\n\n",collection->params.sort,collection->params.sort_second_order,query);/*only for debugging*/
 #endif
@@ -462,6 +753,11 @@ int dt_collection_update(const dt_collection_t *collection)
   g_free(query);
   g_free(query_no_group);
 
+  return result;
+}
+
+static void _dt_collection_recount(const dt_collection_t *collection)
+{
   /* update the cached count. collection isn't a real const anyway, we are writing to it in
    * _dt_collection_store, too. */
   ((dt_collection_t *)collection)->count = _dt_collection_compute_count(collection, FALSE);
@@ -469,7 +765,12 @@ int dt_collection_update(const dt_collection_t *collection)
   dt_collection_hint_message(collection);
 
   _collection_update_aspect_ratio(collection);
+}
 
+int dt_collection_update(const dt_collection_t *collection)
+{
+  const int result = _dt_collection_build_query(collection);
+  _dt_collection_recount(collection);
   return result;
 }
 
@@ -1001,6 +1302,7 @@ static uint32_t _dt_collection_compute_count(const dt_collection_t *collection,
   else
     count_query = dt_util_dstrcat(count_query, "SELECT COUNT(DISTINCT mi.id) %s", fq);
 
+  const double start = dt_get_wtime();
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), count_query, -1, &stmt, NULL);
   if((collection->params.query_flags & COLLECTION_QUERY_USE_LIMIT)
      && !(collection->params.query_flags & COLLECTION_QUERY_USE_ONLY_WHERE_EXT))
@@ -1011,6 +1313,7 @@ static uint32_t _dt_collection_compute_count(const dt_collection_t *collection,
 
   if(sqlite3_step(stmt) == SQLITE_ROW) count = sqlite3_column_int(stmt, 0);
   sqlite3_finalize(stmt);
+  _collection_explain(no_group ? "count without grouping" : "count", count_query, start);
   g_free(count_query);
   return count;
 }
@@ -1561,9 +1864,14 @@ static gchar *get_query_string(const dt_collection_properties_t property, const
       query = dt_util_dstrcat(query, ")");
       break;
     case DT_COLLECTION_PROP_TAG: // tag
-      query = dt_util_dstrcat(query, "(id IN (SELECT imgid FROM main.tagged_images AS a JOIN "
-                                     "data.tags AS b ON a.tagid = b.id WHERE name LIKE '%s'))",
-                              escaped_text);
+      if(dt_fulltext_ready())
+        query = dt_util_dstrcat(query, "(id IN (SELECT imgid FROM main.tagged_images WHERE tagid IN "
+                                       "(SELECT rowid FROM memory.tags_fts WHERE name LIKE '%s')))",
+                                escaped_text);
+      else
+        query = dt_util_dstrcat(query, "(id IN (SELECT imgid FROM main.tagged_images AS a JOIN "
+                                       "data.tags AS b ON a.tagid = b.id WHERE name LIKE '%s'))",
+                                escaped_text);
       break;
 
     case DT_COLLECTION_PROP_LENS: // lens
@@ -1672,8 +1980,12 @@ static gchar *get_query_string(const dt_collection_properties_t property, const
       GList *list, *l;
       list = dt_util_str_to_glist(",", escaped_text);
 
+      const gboolean fulltext = dt_fulltext_ready();
       for (l = list; l != NULL; l = l->next)
-        l->data = dt_util_dstrcat(query, "(filename LIKE '%%%s%%')", (char *)l->data);
+        l->data = fulltext
+          ? dt_util_dstrcat(query, "(id IN (SELECT rowid FROM memory.images_fts WHERE filename LIKE '%%%s%%'))",
+                            (char *)l->data)
+          : dt_util_dstrcat(query, "(filename LIKE '%%%s%%')", (char *)l->data);
 
       query = dt_util_glist_to_str(" OR ", list);
       g_list_free(list);
@@ -1785,7 +2097,10 @@ static gchar *get_query_string(const dt_collection_properties_t property, const
            && property < DT_COLLECTION_PROP_METADATA + DT_METADATA_NUMBER)
         {
           const int keyid = dt_metadata_get_keyid_by_display_order(property - DT_COLLECTION_PROP_METADATA);
-          if(strcmp(escaped_text, _("not defined")) != 0)
+          if(strcmp(escaped_text, _("not defined")) != 0 && dt_fulltext_ready())
+            query = dt_util_dstrcat(query, "(id IN (SELECT rowid FROM memory.images_fts WHERE m%d "
+                                           "LIKE '%%%s%%'))", keyid, escaped_text);
+          else if(strcmp(escaped_text, _("not defined")) != 0)
             query = dt_util_dstrcat(query, "(id IN (SELECT id FROM main.meta_data WHERE key = %d AND value "
                                            "LIKE '%%%s%%'))", keyid, escaped_text);
           else
@@ -1977,13 +2292,18 @@ void dt_collection_update_query(const dt_collection_t *collection, dt_collection
                                  (dt_collection_get_filter_flags(collection) & ~COLLECTION_FILTER_FILM_ID));
 
   /* update query and at last the visual */
-  dt_collection_update(collection);
+  _dt_collection_build_query(collection);
+
+  // when only some images have changed, try to avoid running the whole query again
+  const gboolean incremental = query_change == DT_COLLECTION_CHANGE_RELOAD && !collection->clone
+                               && _collection_update_incremental((dt_collection_t *)collection, list);
+  if(!incremental) _dt_collection_recount(collection);
 
   // remove from selected images where not in this query.
   sqlite3_stmt *stmt = NULL;
   const gchar *cquery = dt_collection_get_query_no_group(collection);
   gchar *complete_query = NULL;
-  if(cquery && cquery[0] != '\0')
+  if(!incremental && cquery && cquery[0] != '\0')
   {
     complete_query
         = dt_util_dstrcat(complete_query, "DELETE FROM main.selected_images WHERE imgid NOT IN (%s)", cquery);
@@ -2000,7 +2320,7 @@ void dt_collection_update_query(const dt_collection_t *collection, dt_collection
   /* raise signal of collection change, only if this is an original */
   if(!collection->clone)
   {
-    dt_collection_memory_update();
+    if(!incremental) dt_collection_memory_update();
     dt_control_signal_raise(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED, query_change, list, next);
   }
 }
@@ -2050,6 +2370,8 @@ void dt_collection_hint_message(const dt_collection_t *collection)
 static int dt_collection_image_offset_with_collection(const dt_collection_t *collection, int imgid)
 {
   if(imgid == -1) return 0;
+  if(collection->index_query && !g_strcmp0(collection->index_query, collection->query))
+    return MAX(0, GPOINTER_TO_INT(g_hash_table_lookup(collection->index_pos, GINT_TO_POINTER(imgid))) - 1);
   const gchar *qin = dt_collection_get_query(collection);
   int offset = 0;
   sqlite3_stmt *stmt;
@@ -167,6 +167,13 @@ typedef struct dt_collection_t
   unsigned int tagid;
   dt_collection_params_t params;
   dt_collection_params_t store;
+  /** membership and order of the images in memory.collection_changed */
+  gchar *query_member;
+  /** main collection only: the content of memory.collected_images, image ids in collection order and image
+   * id -> position starting at 1 like the rowid. index_query is the query it was built from. */
+  GArray *index;
+  GHashTable *index_pos;
+  gchar *index_query;
 } dt_collection_t;
 
 /* returns the name for the given collection property */
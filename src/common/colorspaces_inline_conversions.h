@@ -157,6 +157,71 @@ static inline __m128 dt_prophotoRGB_to_XYZ_sse2(__m128 rgb)
         rgb_to_xyz_2 * _mm_shuffle_ps(rgb, rgb, _MM_SHUFFLE(2, 2, 2, 2));
   return XYZ;
 }
+
+#if defined(DT_HAVE_AVX_CODEPATHS)
+#include <immintrin.h>
+
+// the avx2 versions below convert two pixels at once, one in each 128 bit lane, exactly like the sse2 ones above
+
+DT_TARGET_AVX2 static inline __m256 lab_f_inv_m_avx2(const __m256 x)
+{
+  const __m256 epsilon = _mm256_set1_ps(0.20689655172413796f); // cbrtf(216.0f/24389.0f);
+  const __m256 kappa_rcp_x16 = _mm256_set1_ps(16.0f * 27.0f / 24389.0f);
+  const __m256 kappa_rcp_x116 = _mm256_set1_ps(116.0f * 27.0f / 24389.0f);
+
+  // x > epsilon
+  const __m256 res_big = x * x * x;
+  // x <= epsilon
+  const __m256 res_small = kappa_rcp_x116 * x - kappa_rcp_x16;
+
+  // blend results according to whether each component is > epsilon or not
+  const __m256 mask = _mm256_cmp_ps(x, epsilon, _CMP_GT_OS);
+  return _mm256_blendv_ps(res_small, res_big, mask);
+}
+
+/** uses D50 white point. */
+DT_TARGET_AVX2 static inline __m256 dt_Lab_to_XYZ_avx2(const __m256 Lab)
+{
+  const __m256 d50 = _mm256_setr_ps(0.9642f, 1.0f, 0.8249f, 0.0f, 0.9642f, 1.0f, 0.8249f, 0.0f);
+  const __m256 coef = _mm256_setr_ps(1.0f / 500.0f, 1.0f / 116.0f, -1.0f / 200.0f, 0.0f,
+                                     1.0f / 500.0f, 1.0f / 116.0f, -1.0f / 200.0f, 0.0f);
+  const __m256 offset = _mm256_set1_ps(0.137931034f);
+
+  const __m256 f = _mm256_shuffle_ps(Lab, Lab, _MM_SHUFFLE(0, 2, 0, 1)) * coef;
+
+  return d50 * lab_f_inv_m_avx2(f + _mm256_shuffle_ps(f, f, _MM_SHUFFLE(1, 1, 3, 1)) + offset);
+}
+
+DT_TARGET_AVX2 static inline __m256 lab_f_m_avx2(const __m256 x)
+{
+  const __m256 epsilon = _mm256_set1_ps(216.0f / 24389.0f);
+  const __m256 kappa = _mm256_set1_ps(24389.0f / 27.0f);
+
+  // calculate as if x > epsilon : result = cbrtf(x)
+  // approximate cbrtf(x):
+  const __m256 a = _mm256_castsi256_ps(_mm256_add_epi32(
+      _mm256_cvtps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(_mm256_castps_si256(x)), _mm256_set1_ps(3.0f))),
+      _mm256_set1_epi32(709921077)));
+  const __m256 a3 = a * a * a;
+  const __m256 res_big = a * (a3 + x + x) / (a3 + a3 + x);
+
+  // calculate as if x <= epsilon : result = (kappa*x+16)/116
+  const __m256 res_small = (kappa * x + _mm256_set1_ps(16.0f)) / _mm256_set1_ps(116.0f);
+
+  // blend results according to whether each component is > epsilon or not
+  const __m256 mask = _mm256_cmp_ps(x, epsilon, _CMP_GT_OS);
+  return _mm256_blendv_ps(res_small, res_big, mask);
+}
+
+/** uses D50 white point. */
+DT_TARGET_AVX2 static inline __m256 dt_XYZ_to_Lab_avx2(const __m256 XYZ)
+{
+  const __m256 d50_inv = _mm256_setr_ps(0.9642f, 1.0f, 0.8249f, 1.0f, 0.9642f, 1.0f, 0.8249f, 1.0f);
+  const __m256 coef = _mm256_setr_ps(116.0f, 500.0f, 200.0f, 0.0f, 116.0f, 500.0f, 200.0f, 0.0f);
+  const __m256 f = lab_f_m_avx2(XYZ / d50_inv);
+  return coef * (_mm256_shuffle_ps(f, f, _MM_SHUFFLE(3, 1, 0, 1)) - _mm256_shuffle_ps(f, f, _MM_SHUFFLE(3, 2, 1, 3)));
+}
+#endif
 #endif
 
 #ifdef _OPENMP
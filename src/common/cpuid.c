@@ -35,9 +35,18 @@
 #endif
 
 #if defined(HAVE___GET_GPUID)
+// xcr0 tells which register sets the os saves on context switches, avx registers are only usable if it does
+static guint32 _xgetbv()
+{
+  guint32 ax, dx;
+  __asm__ __volatile__("xgetbv" : "=a"(ax), "=d"(dx) : "c"(0));
+  return ax;
+}
+
 dt_cpu_flags_t dt_detect_cpu_features()
 {
   guint32 ax, bx, cx, dx;
+  gboolean os_ymm = FALSE, os_zmm = FALSE;
   static dt_cpu_flags_t cpuflags = 0;
   static GMutex lock;
 
@@ -57,7 +66,24 @@ dt_cpu_flags_t dt_detect_cpu_features()
       if(cx & 0x00040000) cpuflags |= CPU_FLAG_SSE4_1;
       if(cx & 0x00080000) cpuflags |= CPU_FLAG_SSE4_2;
 
-      if(cx & 0x08000000) cpuflags |= CPU_FLAG_AVX;
+      // osxsave, then the ymm (and zmm) state
+      if(cx & 0x08000000)
+      {
+        const guint32 xcr0 = _xgetbv();
+        os_ymm = (xcr0 & 0x06) == 0x06;
+        os_zmm = os_ymm && (xcr0 & 0xe0) == 0xe0;
+      }
+
+      if((cx & 0x10000000) && os_ymm) cpuflags |= CPU_FLAG_AVX;
+      if((cx & 0x00001000) && os_ymm) cpuflags |= CPU_FLAG_FMA;
+    }
+
+    /* Structured extended features */
+    if(__get_cpuid_max(0, NULL) >= 7)
+    {
+      __cpuid_count(0x00000007, 0, ax, bx, cx, dx);
+      if((bx & 0x00000020) && os_ymm) cpuflags |= CPU_FLAG_AVX2;
+      if((bx & 0x00010000) && os_zmm) cpuflags |= CPU_FLAG_AVX512F;
     }
 
     /* Are there extensions? */
@@ -42,6 +42,7 @@
 #include "common/cpuid.h"
 #include "common/file_location.h"
 #include "common/film.h"
+#include "common/fulltext.h"
 #include "common/grealpath.h"
 #include "common/image.h"
 #include "common/image_cache.h"
@@ -61,6 +62,7 @@
 #include "control/signal.h"
 #include "develop/blend.h"
 #include "develop/imageop.h"
+#include "develop/pixelpipe_cache_disk.h"
 #include "gui/gtk.h"
 #include "gui/guides.h"
 #include "gui/presets.h"
@@ -121,7 +123,7 @@ static int usage(const char *argv0)
   printf("  --configdir <user config directory>\n");
   printf("  -d {all,cache,camctl,camsupport,control,dev,fswatch,input,lighttable,\n");
   printf("      lua,masks,memory,nan,opencl,perf,pwstorage,print,sql,ioporder,\n");
-  printf("      imageio}\n");
+  printf("      imageio,sqlplan}\n");
   printf("  --datadir <data directory>\n");
 #ifdef HAVE_OPENCL
   printf("  --disable-opencl\n");
@@ -305,15 +307,31 @@ static void dt_codepaths_init()
   {
 #ifdef HAVE_BUILTIN_CPU_SUPPORTS
     darktable.codepath.SSE2 = (__builtin_cpu_supports("sse") && __builtin_cpu_supports("sse2"));
+#ifdef DT_HAVE_AVX_CODEPATHS
+    darktable.codepath.AVX2 = (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"));
+    darktable.codepath.AVX512 = (darktable.codepath.AVX2 && __builtin_cpu_supports("avx512f"));
+#endif
 #else
     dt_cpu_flags_t flags = dt_detect_cpu_features();
     darktable.codepath.SSE2 = ((flags & (CPU_FLAG_SSE)) && (flags & (CPU_FLAG_SSE2)));
+#ifdef DT_HAVE_AVX_CODEPATHS
+    darktable.codepath.AVX2 = ((flags & (CPU_FLAG_AVX2)) && (flags & (CPU_FLAG_FMA)));
+    darktable.codepath.AVX512 = (darktable.codepath.AVX2 && (flags & (CPU_FLAG_AVX512F)));
+#endif
 #endif
   }
 
   // second, apply overrides from conf
   // NOTE: all intrinsics sets can only be overridden to OFF
   if(!dt_conf_get_bool("codepaths/sse2")) darktable.codepath.SSE2 = 0;
+  if(!dt_conf_get_bool("codepaths/avx2")) darktable.codepath.AVX2 = 0;
+  if(!dt_conf_get_bool("codepaths/avx512")) darktable.codepath.AVX512 = 0;
+
+  // the wider variants replace sse2 ones, they are never used without them
+  if(!darktable.codepath.SSE2) darktable.codepath.AVX2 = 0;
+  if(!darktable.codepath.AVX2) darktable.codepath.AVX512 = 0;
+  dt_print(DT_DEBUG_PERF, "[dt_codepaths_init] sse2: %d, avx2: %d, avx-512: %d\n", darktable.codepath.SSE2,
+           darktable.codepath.AVX2, darktable.codepath.AVX512);
 
   // last: do we have any intrinsics sets enabled?
   darktable.codepath._no_intrinsics = !(darktable.codepath.SSE2);
@@ -637,6 +655,8 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
           darktable.unmuted |= DT_DEBUG_OPENCL; // gpu accel via opencl
         else if(!strcmp(argv[k + 1], "sql"))
           darktable.unmuted |= DT_DEBUG_SQL; // SQLite3 queries
+        else if(!strcmp(argv[k + 1], "sqlplan"))
+          darktable.unmuted |= DT_DEBUG_SQL_PLAN; // query plans and timings of the collection queries
         else if(!strcmp(argv[k + 1], "memory"))
           darktable.unmuted |= DT_DEBUG_MEMORY; // some stats on mem usage now and then.
         else if(!strcmp(argv[k + 1], "lighttable"))
@@ -879,15 +899,6 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   // Initialize the signal system
   darktable.signals = dt_control_signal_init();
 
-  // Make sure that the database and xmp files are in sync
-  // We need conf and db to be up and running for that which is the case here.
-  // FIXME: is this also useful in non-gui mode?
-  GList *changed_xmp_files = NULL;
-  if(init_gui && dt_conf_get_bool("run_crawler_on_start"))
-  {
-    changed_xmp_files = dt_control_crawler_run();
-  }
-
   if(init_gui)
   {
     dt_control_init(darktable.control);
@@ -946,6 +957,9 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   darktable.mipmap_cache = (dt_mipmap_cache_t *)calloc(1, sizeof(dt_mipmap_cache_t));
   dt_mipmap_cache_init(darktable.mipmap_cache);
 
+  darktable.pipe_cache_disk = (dt_dev_pixelpipe_cache_disk_t *)calloc(1, sizeof(dt_dev_pixelpipe_cache_disk_t));
+  dt_dev_pixelpipe_cache_disk_init(darktable.pipe_cache_disk);
+
   // The GUI must be initialized before the views, because the init()
   // functions of the views depend on darktable.control->accels_* to register
   // their keyboard accelerators
@@ -1099,13 +1113,17 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 #endif
   }
 
-  // last but not least construct the popup that asks the user about images whose xmp files are newer than the
-  // db entry
-  if(init_gui && changed_xmp_files)
+  // last but not least make sure that the database and xmp files are in sync. this runs in the background and
+  // pops up a window that asks the user about images whose xmp files are newer than the db entry.
+  // FIXME: is this also useful in non-gui mode?
+  if(init_gui && dt_conf_get_bool("run_crawler_on_start"))
   {
-    dt_control_crawler_show_image_list(changed_xmp_files);
+    dt_control_crawler_start();
   }
 
+  // the full text index for the collect module is built in the background, until then it searches with LIKE
+  if(init_gui) dt_fulltext_init();
+
   dt_print(DT_DEBUG_CONTROL, "[init] startup took %f seconds\n", dt_get_wtime() - start_wtime);
 
   return 0;
@@ -1115,6 +1133,7 @@ void dt_cleanup()
 {
   const int init_gui = (darktable.gui != NULL);
 
+  if(init_gui) dt_database_update_collection_indexes(darktable.db);
   dt_database_maybe_maintenance(darktable.db, init_gui, TRUE);
 
 #ifdef HAVE_PRINT
@@ -1149,6 +1168,8 @@ void dt_cleanup()
   free(darktable.image_cache);
   dt_mipmap_cache_cleanup(darktable.mipmap_cache);
   free(darktable.mipmap_cache);
+  dt_dev_pixelpipe_cache_disk_cleanup(darktable.pipe_cache_disk);
+  free(darktable.pipe_cache_disk);
   if(init_gui)
   {
     dt_control_cleanup(darktable.control);
@@ -193,6 +193,7 @@ struct dt_control_t;
 struct dt_develop_t;
 struct dt_mipmap_cache_t;
 struct dt_image_cache_t;
+struct dt_dev_pixelpipe_cache_disk_t;
 struct dt_lib_t;
 struct dt_conf_t;
 struct dt_points_t;
@@ -223,15 +224,26 @@ typedef enum dt_debug_thread_t
   DT_DEBUG_CAMERA_SUPPORT = 1 << 16,
   DT_DEBUG_IOPORDER = 1 << 17,
   DT_DEBUG_IMAGEIO = 1 << 18,
+  DT_DEBUG_SQL_PLAN = 1 << 19,
 } dt_debug_thread_t;
 
 typedef struct dt_codepath_t
 {
   unsigned int SSE2 : 1;
+  unsigned int AVX2 : 1;   // avx2 + fma
+  unsigned int AVX512 : 1; // avx-512f
   unsigned int _no_intrinsics : 1;
   unsigned int OPENMP_SIMD : 1; // always stays the last one
 } dt_codepath_t;
 
+// hot loops may have variants for instruction sets newer than the build target. they are compiled for it with
+// these attributes, and must only be called when darktable.codepath says the cpu supports them.
+#if defined(__GNUC__) && defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__))
+#define DT_HAVE_AVX_CODEPATHS 1
+#define DT_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define DT_TARGET_AVX512 __attribute__((target("avx512f,avx2,fma")))
+#endif
+
 typedef struct darktable_t
 {
   dt_codepath_t codepath;
@@ -252,6 +264,7 @@ typedef struct darktable_t
   struct dt_gui_gtk_t *gui;
   struct dt_mipmap_cache_t *mipmap_cache;
   struct dt_image_cache_t *image_cache;
+  struct dt_dev_pixelpipe_cache_disk_t *pipe_cache_disk;
   struct dt_bauhaus_t *bauhaus;
   const struct dt_database_t *db;
   const struct dt_pwstorage_t *pwstorage;
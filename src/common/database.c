@@ -21,6 +21,7 @@
 #endif
 
 #include "common/database.h"
+#include "common/collection.h"
 #include "common/darktable.h"
 #include "common/debug.h"
 #include "common/file_location.h"
@@ -62,12 +63,32 @@ typedef struct dt_database_t
 
   gchar *error_message, *error_dbfilename;
   int error_other_pid;
+
+  /* prepared statements for reuse */
+  struct dt_database_stmt_cache_t *stmt_cache;
+
+  /* statements taking longer are logged, in nanoseconds. 0 to log nothing */
+  sqlite3_int64 slow_query_ns;
 } dt_database_t;
 
+// maximum number of distinct queries and of idle statements per query kept in the statement cache
+#define DT_DATABASE_STMT_CACHE_QUERIES 512
+#define DT_DATABASE_STMT_CACHE_PER_QUERY 4
+
+typedef struct dt_database_stmt_cache_t
+{
+  dt_pthread_mutex_t lock;
+  // sql text -> GQueue of prepared statements currently not in use
+  GHashTable *idle;
+} dt_database_stmt_cache_t;
+
 
 /* migrates database from old place to new */
 static void _database_migrate_to_xdg_structure();
 
+/* applies the sqlite3 settings from the config */
+static void _database_configure(dt_database_t *db);
+
 /* delete old mipmaps files */
 static void _database_delete_mipmaps_files();
 
@@ -2043,6 +2064,7 @@ static void _create_memory_schema(dt_database_t *db)
       "CREATE TABLE memory.collected_images (rowid INTEGER PRIMARY KEY AUTOINCREMENT, imgid INTEGER)", NULL,
       NULL, NULL);
   sqlite3_exec(db->handle, "CREATE TABLE memory.tmp_selection (imgid INTEGER PRIMARY KEY)", NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE TABLE memory.collection_changed (imgid INTEGER PRIMARY KEY)", NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE TABLE memory.taglist "
                            "(tmpid INTEGER PRIMARY KEY, id INTEGER UNIQUE ON CONFLICT IGNORE, count INTEGER)",
                NULL, NULL, NULL);
@@ -2389,6 +2411,39 @@ void ask_for_upgrade(const gchar *dbname, const gboolean has_gui)
   }
 }
 
+// copies the database through sqlite, a copy of the file alone would miss what is still in its write-ahead log
+static gboolean _database_backup_copy(const char *filename, const char *backup)
+{
+  sqlite3 *src = NULL, *dest = NULL;
+  int rc = sqlite3_open_v2(filename, &src, SQLITE_OPEN_READWRITE, NULL);
+  if(rc == SQLITE_OK) rc = sqlite3_open(backup, &dest);
+  if(rc == SQLITE_OK)
+  {
+    sqlite3_backup *copy = sqlite3_backup_init(dest, "main", src, "main");
+    if(copy)
+    {
+      sqlite3_backup_step(copy, -1);
+      sqlite3_backup_finish(copy);
+    }
+    rc = sqlite3_errcode(dest);
+  }
+  sqlite3_close(src);
+  sqlite3_close(dest);
+  return rc == SQLITE_OK;
+}
+
+// removes the database together with the files of its write-ahead log. returns 0 on success.
+static int _database_unlink(const char *filename)
+{
+  for(const char **suffix = (const char *[]){ "-wal", "-shm", NULL }; *suffix; suffix++)
+  {
+    gchar *name = g_strconcat(filename, *suffix, NULL);
+    g_unlink(name);
+    g_free(name);
+  }
+  return g_unlink(filename);
+}
+
 void dt_database_backup(const char *filename)
 {
   char *version = g_strdup_printf("%s", darktable_package_version);
@@ -2409,13 +2464,14 @@ void dt_database_backup(const char *filename)
   GError *gerror = NULL;
   if(!g_file_test(backup, G_FILE_TEST_EXISTS))
   {
-    GFile *src = g_file_new_for_path(filename);
-    GFile *dest = g_file_new_for_path(backup);
     gboolean copyStatus = TRUE;
     if(g_file_test(filename, G_FILE_TEST_EXISTS))
     {
-      copyStatus = g_file_copy(src, dest, G_FILE_COPY_NONE, NULL, NULL, NULL, &gerror);
-      if(copyStatus) copyStatus = g_chmod(backup, S_IRUSR) == 0;
+      copyStatus = _database_backup_copy(filename, backup);
+      if(copyStatus)
+        copyStatus = g_chmod(backup, S_IRUSR) == 0;
+      else
+        _database_unlink(backup);
     }
     else
     {
@@ -2555,9 +2611,7 @@ start:
   sqlite3_finalize(stmt);
 
   // some sqlite3 config
-  sqlite3_exec(db->handle, "PRAGMA synchronous = OFF", NULL, NULL, NULL);
-  sqlite3_exec(db->handle, "PRAGMA journal_mode = MEMORY", NULL, NULL, NULL);
-  sqlite3_exec(db->handle, "PRAGMA page_size = 32768", NULL, NULL, NULL);
+  _database_configure(db);
 
   /* now that we got functional databases that are locked for us we can make sure that the schema is set up */
 
@@ -2633,7 +2687,7 @@ start:
       {
         fprintf(stderr, "[init] deleting `%s' on user request", dbfilename_data);
 
-        if(g_unlink(dbfilename_data) == 0)
+        if(_database_unlink(dbfilename_data) == 0)
           fprintf(stderr, " ... ok\n");
         else
           fprintf(stderr, " ... failed\n");
@@ -2715,7 +2769,7 @@ start:
     {
       fprintf(stderr, "[init] deleting `%s' on user request", dbfilename_library);
 
-      if(g_unlink(dbfilename_library) == 0)
+      if(_database_unlink(dbfilename_library) == 0)
         fprintf(stderr, " ... ok\n");
       else
         fprintf(stderr, " ... failed\n");
@@ -2787,6 +2841,13 @@ error:
 
 void dt_database_destroy(const dt_database_t *db)
 {
+  // sqlite3_close() fails as long as there are unfinalized statements
+  if(db->stmt_cache)
+  {
+    g_hash_table_destroy(db->stmt_cache->idle);
+    dt_pthread_mutex_destroy(&db->stmt_cache->lock);
+    free(db->stmt_cache);
+  }
   sqlite3_close(db->handle);
   if (db->lockfile_data)
   {
@@ -2810,6 +2871,114 @@ sqlite3 *dt_database_get(const dt_database_t *db)
   return db ? db->handle : NULL;
 }
 
+sqlite3_stmt *dt_database_prepare_cached(const dt_database_t *db, const char *query)
+{
+  dt_database_stmt_cache_t *cache = db->stmt_cache;
+  sqlite3_stmt *stmt = NULL;
+
+  if(cache)
+  {
+    dt_pthread_mutex_lock(&cache->lock);
+    GQueue *idle = g_hash_table_lookup(cache->idle, query);
+    if(idle) stmt = g_queue_pop_head(idle);
+    dt_pthread_mutex_unlock(&cache->lock);
+  }
+
+  if(!stmt && sqlite3_prepare_v2(db->handle, query, -1, &stmt, NULL) != SQLITE_OK)
+  {
+    fprintf(stderr, "[sql] failed to prepare \"%s\": %s\n", query, sqlite3_errmsg(db->handle));
+    sqlite3_finalize(stmt);
+    stmt = NULL;
+  }
+  return stmt;
+}
+
+void dt_database_release_cached(const dt_database_t *db, sqlite3_stmt *stmt)
+{
+  if(!stmt) return;
+  dt_database_stmt_cache_t *cache = db->stmt_cache;
+
+  sqlite3_reset(stmt);
+  sqlite3_clear_bindings(stmt);
+
+  gboolean keep = FALSE;
+  if(cache)
+  {
+    const char *query = sqlite3_sql(stmt);
+    dt_pthread_mutex_lock(&cache->lock);
+    GQueue *idle = g_hash_table_lookup(cache->idle, query);
+    if(!idle && g_hash_table_size(cache->idle) < DT_DATABASE_STMT_CACHE_QUERIES)
+    {
+      idle = g_queue_new();
+      g_hash_table_insert(cache->idle, g_strdup(query), idle);
+    }
+    keep = idle && g_queue_get_length(idle) < DT_DATABASE_STMT_CACHE_PER_QUERY;
+    if(keep) g_queue_push_head(idle, stmt);
+    dt_pthread_mutex_unlock(&cache->lock);
+  }
+
+  if(!keep) sqlite3_finalize(stmt);
+}
+
+static void _stmt_cache_free_idle(gpointer data)
+{
+  g_queue_free_full((GQueue *)data, (GDestroyNotify)sqlite3_finalize);
+}
+
+static int _database_trace(unsigned type, void *ctx, void *p, void *x)
+{
+  const dt_database_t *db = ctx;
+  sqlite3_stmt *stmt = p;
+  const sqlite3_int64 ns = *(sqlite3_int64 *)x;
+  const gboolean slow = db->slow_query_ns > 0 && ns >= db->slow_query_ns;
+  if(!slow && !(darktable.unmuted & DT_DEBUG_SQL)) return 0;
+
+  char *query = sqlite3_expanded_sql(stmt);
+  if(slow)
+    fprintf(stderr, "[sql] slow statement, %.3f ms: \"%s\"\n", ns / 1e6, query ? query : sqlite3_sql(stmt));
+  else
+    dt_print(DT_DEBUG_SQL, "[sql] %.3f ms: \"%s\"\n", ns / 1e6, query ? query : sqlite3_sql(stmt));
+  sqlite3_free(query);
+  return 0;
+}
+
+// applies the pragmas from the config, sets up the statement cache and the timing of statements
+static void _database_configure(dt_database_t *db)
+{
+  // the page size can't be changed any more once the database is in wal mode
+  sqlite3_exec(db->handle, "PRAGMA page_size = 32768", NULL, NULL, NULL);
+
+  // without a schema this applies to the attached data database as well. in wal mode both come with -wal and
+  // -shm files, which have to be taken along when copying or removing them (see dt_database_backup)
+  gchar *journal_mode = dt_conf_get_string("database/journal_mode");
+  gchar *synchronous = dt_conf_get_string("database/synchronous");
+  const gboolean wal = !g_strcmp0(journal_mode, "wal");
+  gchar *pragmas = g_strdup_printf("PRAGMA journal_mode = %s;"
+                                   "PRAGMA synchronous = %s;"
+                                   "PRAGMA mmap_size = %" G_GINT64_FORMAT ";"
+                                   "PRAGMA cache_size = %d",
+                                   wal ? "WAL" : "MEMORY",
+                                   !g_strcmp0(synchronous, "full") ? "FULL"
+                                   : !g_strcmp0(synchronous, "normal") ? "NORMAL" : "OFF",
+                                   (gint64)MAX(dt_conf_get_int("database/mmap_size"), 0) << 20,
+                                   // negative values are in KiB
+                                   -(MAX(dt_conf_get_int("database/cache_size"), 1) << 10));
+  if(sqlite3_exec(db->handle, pragmas, NULL, NULL, NULL) != SQLITE_OK)
+    fprintf(stderr, "[init] failed to configure the database: %s\n", sqlite3_errmsg(db->handle));
+  dt_print(DT_DEBUG_SQL, "[sql] %s\n", pragmas);
+  g_free(pragmas);
+  g_free(journal_mode);
+  g_free(synchronous);
+
+  db->stmt_cache = calloc(1, sizeof(dt_database_stmt_cache_t));
+  dt_pthread_mutex_init(&db->stmt_cache->lock, NULL);
+  db->stmt_cache->idle = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, _stmt_cache_free_idle);
+
+  db->slow_query_ns = (sqlite3_int64)MAX(dt_conf_get_int("database/slow_query_threshold"), 0) * 1000000;
+  if(db->slow_query_ns > 0 || (darktable.unmuted & DT_DEBUG_SQL))
+    sqlite3_trace_v2(db->handle, SQLITE_TRACE_PROFILE, _database_trace, db);
+}
+
 const gchar *dt_database_get_path(const struct dt_database_t *db)
 {
   return db->dbfilename_library;
@@ -3012,6 +3181,77 @@ void dt_database_maybe_maintenance(const struct dt_database_t *db, const gboolea
   }
 }
 
+// indexes for the properties of the collect module rules. together with the rowid each one covers the condition
+// built by get_query_string() in collection.c, so sqlite can search or at least scan the much smaller index
+// instead of the images table. they are only kept while a rule uses them, to not slow down imports otherwise.
+typedef struct _collection_index_t
+{
+  dt_collection_properties_t property;
+  const char *name;
+  const char *definition;
+} _collection_index_t;
+
+static const _collection_index_t _collection_indexes[] = {
+  { DT_COLLECTION_PROP_CAMERA, "images_maker_model_index", "images (maker, model)" },
+  { DT_COLLECTION_PROP_LENS, "images_lens_index", "images (lens)" },
+  { DT_COLLECTION_PROP_APERTURE, "images_aperture_index", "images (ROUND(aperture,1))" },
+  { DT_COLLECTION_PROP_EXPOSURE, "images_exposure_index", "images (exposure)" },
+  { DT_COLLECTION_PROP_FOCAL_LENGTH, "images_focal_length_index", "images (focal_length)" },
+  { DT_COLLECTION_PROP_ISO, "images_iso_index", "images (iso)" },
+  { DT_COLLECTION_PROP_DAY, "images_datetime_taken_index", "images (datetime_taken)" },
+  { DT_COLLECTION_PROP_TIME, "images_datetime_taken_index", "images (datetime_taken)" },
+  { DT_COLLECTION_PROP_IMPORT_TIMESTAMP, "images_import_timestamp_index", "images (import_timestamp)" },
+  { DT_COLLECTION_PROP_CHANGE_TIMESTAMP, "images_change_timestamp_index", "images (change_timestamp)" },
+  { DT_COLLECTION_PROP_EXPORT_TIMESTAMP, "images_export_timestamp_index", "images (export_timestamp)" },
+  { DT_COLLECTION_PROP_PRINT_TIMESTAMP, "images_print_timestamp_index", "images (print_timestamp)" },
+  { DT_COLLECTION_PROP_GEOTAGGING, "images_geotag_index", "images (longitude, latitude)" },
+  { DT_COLLECTION_PROP_ASPECT_RATIO, "images_aspect_ratio_index", "images (aspect_ratio)" },
+  { DT_COLLECTION_PROP_LOCAL_COPY, "images_flags_index", "images (flags)" },
+  { DT_COLLECTION_PROP_COLORLABEL, "color_labels_color_index", "color_labels (color, imgid)" },
+  { DT_COLLECTION_PROP_MODULE, "history_operation_index", "history (operation, enabled, imgid)" },
+  { DT_COLLECTION_PROP_ORDER, "module_order_version_index", "module_order (version)" },
+  // stands for all metadata properties
+  { DT_COLLECTION_PROP_METADATA, "meta_data_key_value_index", "meta_data (key, value, id)" },
+};
+
+void dt_database_update_collection_indexes(const struct dt_database_t *db)
+{
+  const int nb_indexes = G_N_ELEMENTS(_collection_indexes);
+  gboolean used[G_N_ELEMENTS(_collection_indexes)] = { FALSE };
+
+  if(dt_conf_get_bool("database/collection_indexes"))
+  {
+    const int num_rules = CLAMP(dt_conf_get_int("plugins/lighttable/collect/num_rules"), 1, 10);
+    for(int k = 0; k < num_rules; k++)
+    {
+      char confname[200];
+      snprintf(confname, sizeof(confname), "plugins/lighttable/collect/item%1d", k);
+      int property = dt_conf_get_int(confname);
+      if(property >= DT_COLLECTION_PROP_METADATA && property < DT_COLLECTION_PROP_METADATA + DT_METADATA_NUMBER)
+        property = DT_COLLECTION_PROP_METADATA;
+      for(int i = 0; i < nb_indexes; i++)
+        if(_collection_indexes[i].property == property) used[i] = TRUE;
+    }
+  }
+
+  for(int i = 0; i < nb_indexes; i++)
+  {
+    // some properties share their index
+    gboolean wanted = FALSE;
+    for(int j = 0; j < nb_indexes; j++)
+      if(used[j] && !strcmp(_collection_indexes[i].name, _collection_indexes[j].name)) wanted = TRUE;
+
+    gchar *query = wanted ? g_strdup_printf("CREATE INDEX IF NOT EXISTS main.%s ON %s", _collection_indexes[i].name,
+                                            _collection_indexes[i].definition)
+                          : g_strdup_printf("DROP INDEX IF EXISTS main.%s", _collection_indexes[i].name);
+    const double start = dt_get_wtime();
+    if(sqlite3_exec(db->handle, query, NULL, NULL, NULL) != SQLITE_OK)
+      fprintf(stderr, "[db maintenance] %s failed: %s\n", query, sqlite3_errmsg(db->handle));
+    dt_print(DT_DEBUG_SQL, "[db maintenance] %s took %.3f secs\n", query, dt_get_wtime() - start);
+    g_free(query);
+  }
+}
+
 void dt_database_optimize(const struct dt_database_t *db)
 {
   // optimize should in most cases be no-op and have no noticeable downsides
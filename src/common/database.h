@@ -28,12 +28,19 @@ struct dt_database_t *dt_database_init(const char *alternative, const gboolean l
 void dt_database_destroy(const struct dt_database_t *);
 /** get handle */
 struct sqlite3 *dt_database_get(const struct dt_database_t *);
+/** get a prepared statement for query from the statement cache, preparing it if there is no unused one. give it
+    back with dt_database_release_cached() instead of finalizing it. returns NULL on error. */
+struct sqlite3_stmt *dt_database_prepare_cached(const struct dt_database_t *db, const char *query);
+/** reset the statement and return it to the statement cache */
+void dt_database_release_cached(const struct dt_database_t *db, struct sqlite3_stmt *stmt);
 /** Returns database path */
 const gchar *dt_database_get_path(const struct dt_database_t *db);
 /** test if database was already locked by another instance */
 gboolean dt_database_get_lock_acquired(const struct dt_database_t *db);
 /** show an error popup. this has to be postponed until after we tried using dbus to reach another instance */
 void dt_database_show_error(const struct dt_database_t *db);
+/** create the indexes for the properties used in the rules of the collect module and drop the unused ones */
+void dt_database_update_collection_indexes(const struct dt_database_t *db);
 /** perform pre-db-close optimizations (always call when quiting darktable) */
 void dt_database_optimize(const struct dt_database_t *);
 /** conditionally perfrom db maintenance */
@@ -98,6 +98,16 @@
     __DT_DEBUG_SQL_QUERY__(b)                                                                                     \
   } while(0)
 
+// a is the dt_database_t, not the sqlite3 handle. release the statement with dt_database_release_cached()
+#define DT_DEBUG_SQLITE3_PREPARE_CACHED(a, b, d)                                                                  \
+  do                                                                                                              \
+  {                                                                                                               \
+    dt_print(DT_DEBUG_SQL, "[sql] %s:%d, function %s(): prepare cached \"%s\"\n", __FILE__, __LINE__,             \
+             __FUNCTION__, (b));                                                                                  \
+    *(d) = dt_database_prepare_cached(a, b);                                                                      \
+    __DT_DEBUG_SQL_QUERY__(b)                                                                                     \
+  } while(0)
+
 #define DT_DEBUG_SQLITE3_BIND_INT(a, b, c) __DT_DEBUG_ASSERT__(sqlite3_bind_int(a, b, c))
 #define DT_DEBUG_SQLITE3_BIND_INT64(a, b, c) __DT_DEBUG_ASSERT__(sqlite3_bind_int64(a, b, c))
 #define DT_DEBUG_SQLITE3_BIND_DOUBLE(a, b, c) __DT_DEBUG_ASSERT__(sqlite3_bind_double(a, b, c))
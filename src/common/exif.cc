@@ -79,6 +79,18 @@ extern "C" {
 // persistent list of exiv2 tags. set up in dt_init()
 static GList *exiv2_taglist = NULL;
 
+// the xmp toolkit registers namespaces while decoding, which is only thread safe with a lock function. it is
+// called from within readMetadata(), so it can't use exiv2_threadsafe which read_metadata_threadsafe() holds.
+static GRecMutex _xmp_toolkit_mutex;
+
+static void _xmp_toolkit_lock(void *data, bool lock)
+{
+  if(lock)
+    g_rec_mutex_lock((GRecMutex *)data);
+  else
+    g_rec_mutex_unlock((GRecMutex *)data);
+}
+
 static const char *_get_exiv2_type(const int type)
 {
   switch(type)
@@ -161,7 +173,7 @@ void dt_exif_set_exiv2_taglist()
 {
   if(exiv2_taglist) return;
 
-  Exiv2::XmpParser::initialize();
+  Exiv2::XmpParser::initialize(_xmp_toolkit_lock, &_xmp_toolkit_mutex);
   ::atexit(Exiv2::XmpParser::terminate);
 
   try
@@ -273,7 +285,8 @@ static const char *_exif_get_exiv2_tag_type(const char *tagname)
 
 // exiv2's readMetadata is not thread safe in 0.26. so we lock it. since readMetadata might throw an exception we
 // wrap it into some c++ magic to make sure we unlock in all cases. well, actually not magic but basic raii.
-// FIXME: check again once we rely on 0.27
+// 0.27 reads different images in parallel, as long as the xmp toolkit has a lock function (see
+// _xmp_toolkit_lock()). only dt_exif_prefetch() relies on that so far, the other readers keep the lock.
 class Lock
 {
 public:
@@ -1388,13 +1401,14 @@ int dt_exif_get_thumbnail(const char *path, uint8_t **buffer, size_t *size, char
   }
 }
 
-/** read the metadata of an image.
- * XMP data trumps IPTC data trumps EXIF data
- */
-int dt_exif_read(dt_image_t *img, const char *path)
+struct dt_exif_prefetch_t
+{
+  std::unique_ptr<Exiv2::Image> image;
+};
+
+// at least set datetime taken to something useful in case there is no exif data in this file (pfm, png, ...)
+static void _exif_datetime_from_file(dt_image_t *img, const char *path)
 {
-  // at least set datetime taken to something useful in case there is no exif data in this file (pfm, png,
-  // ...)
   struct stat statbuf;
 
   if(!stat(path, &statbuf))
@@ -1402,49 +1416,111 @@ int dt_exif_read(dt_image_t *img, const char *path)
     struct tm result;
     strftime(img->exif_datetime_taken, 20, "%Y:%m:%d %H:%M:%S", localtime_r(&statbuf.st_mtime, &result));
   }
+}
+
+// decodes the metadata of an image after readMetadata(), XMP data trumps IPTC data trumps EXIF data
+static bool _exif_decode_image(dt_image_t *img, Exiv2::Image *image)
+{
+  bool res = true;
+
+  // EXIF metadata
+  Exiv2::ExifData &exifData = image->exifData();
+  if(!exifData.empty())
+    res = _exif_decode_exif_data(img, exifData);
+  else
+    img->exif_inited = 1;
+
+  // these get overwritten by IPTC and XMP. is that how it should work?
+  dt_exif_apply_default_metadata(img);
+
+  // IPTC metadata.
+  Exiv2::IptcData &iptcData = image->iptcData();
+  if(!iptcData.empty()) res = _exif_decode_iptc_data(img, iptcData) && res;
+
+  // XMP metadata
+  Exiv2::XmpData &xmpData = image->xmpData();
+  if(!xmpData.empty())
+    res = _exif_decode_xmp_data(img, xmpData, -1, true) && res;
+
+  // Initialize size - don't wait for full raw to be loaded to get this
+  // information. If use_embedded_thumbnail is set, it will take a
+  // change in development history to have this information
+  img->height = image->pixelHeight();
+  img->width = image->pixelWidth();
+
+  return res;
+}
+
+/** read the metadata of an image.
+ * XMP data trumps IPTC data trumps EXIF data
+ */
+int dt_exif_read(dt_image_t *img, const char *path)
+{
+  _exif_datetime_from_file(img, path);
 
   try
   {
     std::unique_ptr<Exiv2::Image> image(Exiv2::ImageFactory::open(WIDEN(path)));
     assert(image.get() != 0);
     read_metadata_threadsafe(image);
-    bool res = true;
-
-    // EXIF metadata
-    Exiv2::ExifData &exifData = image->exifData();
-    if(!exifData.empty())
-      res = _exif_decode_exif_data(img, exifData);
-    else
-      img->exif_inited = 1;
 
-    // these get overwritten by IPTC and XMP. is that how it should work?
-    dt_exif_apply_default_metadata(img);
+    return _exif_decode_image(img, image.get()) ? 0 : 1;
+  }
+  catch(Exiv2::AnyError &e)
+  {
+    std::string s(e.what());
+    std::cerr << "[exiv2 dt_exif_read] " << path << ": " << s << std::endl;
+    return 1;
+  }
+}
 
-    // IPTC metadata.
-    Exiv2::IptcData &iptcData = image->iptcData();
-    if(!iptcData.empty()) res = _exif_decode_iptc_data(img, iptcData) && res;
+dt_exif_prefetch_t *dt_exif_prefetch(const char *path)
+{
+  try
+  {
+    std::unique_ptr<Exiv2::Image> image(Exiv2::ImageFactory::open(WIDEN(path)));
+    assert(image.get() != 0);
+    // every thread reads into its own image here, which exiv2 can do in parallel since 0.27 with the xmp toolkit
+    // lock set up in dt_exif_init()
+    if(Exiv2::versionNumber() >= EXIV2_MAKE_VERSION(0,27,0))
+      image->readMetadata();
+    else
+      read_metadata_threadsafe(image);
 
-    // XMP metadata
-    Exiv2::XmpData &xmpData = image->xmpData();
-    if(!xmpData.empty())
-      res = _exif_decode_xmp_data(img, xmpData, -1, true) && res;
+    dt_exif_prefetch_t *prefetch = new dt_exif_prefetch_t;
+    prefetch->image = std::move(image);
+    return prefetch;
+  }
+  catch(Exiv2::AnyError &e)
+  {
+    std::string s(e.what());
+    std::cerr << "[exiv2 dt_exif_prefetch] " << path << ": " << s << std::endl;
+    return NULL;
+  }
+}
 
-    // Initialize size - don't wait for full raw to be loaded to get this
-    // information. If use_embedded_thumbnail is set, it will take a
-    // change in development history to have this information
-    img->height = image->pixelHeight();
-    img->width = image->pixelWidth();
+int dt_exif_read_prefetched(dt_image_t *img, const char *path, const dt_exif_prefetch_t *prefetch)
+{
+  _exif_datetime_from_file(img, path);
+  if(!prefetch) return 1;
 
-    return res ? 0 : 1;
+  try
+  {
+    return _exif_decode_image(img, prefetch->image.get()) ? 0 : 1;
   }
   catch(Exiv2::AnyError &e)
   {
     std::string s(e.what());
-    std::cerr << "[exiv2 dt_exif_read] " << path << ": " << s << std::endl;
+    std::cerr << "[exiv2 dt_exif_read_prefetched] " << path << ": " << s << std::endl;
     return 1;
   }
 }
 
+void dt_exif_prefetch_free(dt_exif_prefetch_t *prefetch)
+{
+  delete prefetch;
+}
+
 int dt_exif_write_blob(uint8_t *blob, uint32_t size, const char *path, const int compressed)
 {
   try
@@ -4111,7 +4187,7 @@ void dt_exif_init()
   // preface the exiv2 messages with "[exiv2] "
   Exiv2::LogMsg::setHandler(&dt_exif_log_handler);
 
-  Exiv2::XmpParser::initialize();
+  Exiv2::XmpParser::initialize(_xmp_toolkit_lock, &_xmp_toolkit_mutex);
   // this has to stay with the old url (namespace already propagated outside dt)
   Exiv2::XmpProperties::registerNs("http://darktable.sf.net/", "darktable");
   Exiv2::XmpProperties::registerNs("http://ns.adobe.com/lightroom/1.0/", "lr");
@@ -37,6 +37,18 @@ const GList * const dt_exif_get_exiv2_taglist();
  * struct. returns 0 on success. */
 int dt_exif_read(dt_image_t *img, const char *path);
 
+/** metadata of a file, read ahead of decoding it into an image struct. */
+typedef struct dt_exif_prefetch_t dt_exif_prefetch_t;
+
+/** read the metadata of the file with full path name without touching the database or the image cache, so
+ * this can run in worker threads. returns NULL if the file has no readable metadata. */
+dt_exif_prefetch_t *dt_exif_prefetch(const char *path);
+
+/** same as dt_exif_read, but decodes the metadata read by dt_exif_prefetch. prefetch may be NULL. */
+int dt_exif_read_prefetched(dt_image_t *img, const char *path, const dt_exif_prefetch_t *prefetch);
+
+void dt_exif_prefetch_free(dt_exif_prefetch_t *prefetch);
+
 /** read exif data to image struct from given data blob, wherever you got it from. */
 int dt_exif_read_from_blob(dt_image_t *img, uint8_t *blob, const int size);
 
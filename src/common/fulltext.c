@@ -0,0 +1,209 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/fulltext.h"
+#include "common/darktable.h"
+#include "common/database.h"
+#include "common/debug.h"
+#include "common/metadata.h"
+#include "control/conf.h"
+#include "control/control.h"
+
+#include <sqlite3.h>
+
+// the trigram tokenizer appeared in sqlite 3.34
+#define DT_FULLTEXT_SQLITE_VERSION 3034000
+// images indexed per statement while filling the index, so other threads get the database in between
+#define DT_FULLTEXT_CHUNK 20000
+
+static gint _fulltext_ready = FALSE;
+
+gboolean dt_fulltext_ready()
+{
+  return g_atomic_int_get(&_fulltext_ready);
+}
+
+static void _fulltext_drop(sqlite3 *db)
+{
+  sqlite3_exec(db,
+               "DROP TRIGGER IF EXISTS temp.fts_images_insert;"
+               "DROP TRIGGER IF EXISTS temp.fts_images_update;"
+               "DROP TRIGGER IF EXISTS temp.fts_images_delete;"
+               "DROP TRIGGER IF EXISTS temp.fts_meta_data_insert;"
+               "DROP TRIGGER IF EXISTS temp.fts_meta_data_update;"
+               "DROP TRIGGER IF EXISTS temp.fts_meta_data_delete;"
+               "DROP TRIGGER IF EXISTS temp.fts_tags_insert;"
+               "DROP TRIGGER IF EXISTS temp.fts_tags_update;"
+               "DROP TRIGGER IF EXISTS temp.fts_tags_delete;"
+               "DROP TABLE IF EXISTS memory.images_fts;"
+               "DROP TABLE IF EXISTS memory.tags_fts",
+               NULL, NULL, NULL);
+}
+
+// sets the metadata column of key to value (an sql expression) and leaves the other ones alone
+static void _fulltext_set_metadata(GString *sql, const char *key, const char *value, const char *id)
+{
+  g_string_append(sql, "UPDATE images_fts SET ");
+  for(int k = 0; k < DT_METADATA_NUMBER; k++)
+    g_string_append_printf(sql, "%sm%d = CASE %s WHEN %d THEN %s ELSE m%d END", k ? ", " : "", k, key, k, value, k);
+  g_string_append_printf(sql, " WHERE rowid = %s;", id);
+}
+
+// creates the tables and the triggers keeping them up to date, all in one go so no change gets lost. max_id is
+// the last image which isn't indexed by the triggers, read in the same transaction. the connection is shared
+// with the other threads, which may have a transaction open (a batch of an import): a savepoint nests into it
+// instead of failing, and rolling back to it leaves their changes alone.
+static gboolean _fulltext_create(sqlite3 *db, int *max_id)
+{
+  char *err = NULL;
+  if(sqlite3_exec(db, "SAVEPOINT fulltext_create", NULL, NULL, &err) != SQLITE_OK)
+  {
+    fprintf(stderr, "[fulltext] can't create the full text index: %s\n", err);
+    sqlite3_free(err);
+    return FALSE;
+  }
+
+  GString *sql = g_string_new(NULL);
+
+  g_string_append(sql, "CREATE VIRTUAL TABLE memory.images_fts USING fts5(filename");
+  for(int k = 0; k < DT_METADATA_NUMBER; k++) g_string_append_printf(sql, ", m%d", k);
+  g_string_append(sql, ", tokenize = 'trigram');"
+                       "CREATE VIRTUAL TABLE memory.tags_fts USING fts5(name, tokenize = 'trigram');");
+
+  // temporary triggers may change tables of other databases, the unqualified names are found in memory
+  g_string_append(sql,
+                  "CREATE TEMP TRIGGER fts_images_insert AFTER INSERT ON main.images"
+                  " BEGIN INSERT INTO images_fts (rowid, filename) VALUES (NEW.id, NEW.filename); END;"
+                  // the image cache writes the filename with everything else, don't touch the index for that
+                  "CREATE TEMP TRIGGER fts_images_update AFTER UPDATE OF filename ON main.images"
+                  " WHEN OLD.filename IS NOT NEW.filename"
+                  " BEGIN UPDATE images_fts SET filename = NEW.filename WHERE rowid = NEW.id; END;"
+                  "CREATE TEMP TRIGGER fts_images_delete AFTER DELETE ON main.images"
+                  " BEGIN DELETE FROM images_fts WHERE rowid = OLD.id; END;");
+
+  g_string_append(sql, "CREATE TEMP TRIGGER fts_meta_data_insert AFTER INSERT ON main.meta_data BEGIN ");
+  _fulltext_set_metadata(sql, "NEW.key", "NEW.value", "NEW.id");
+  g_string_append(sql, " END;"
+                       "CREATE TEMP TRIGGER fts_meta_data_update AFTER UPDATE ON main.meta_data BEGIN ");
+  _fulltext_set_metadata(sql, "OLD.key", "NULL", "OLD.id");
+  _fulltext_set_metadata(sql, "NEW.key", "NEW.value", "NEW.id");
+  g_string_append(sql, " END;"
+                       "CREATE TEMP TRIGGER fts_meta_data_delete AFTER DELETE ON main.meta_data BEGIN ");
+  _fulltext_set_metadata(sql, "OLD.key", "NULL", "OLD.id");
+  g_string_append(sql, " END;");
+
+  g_string_append(sql,
+                  "CREATE TEMP TRIGGER fts_tags_insert AFTER INSERT ON data.tags"
+                  " BEGIN INSERT INTO tags_fts (rowid, name) VALUES (NEW.id, NEW.name); END;"
+                  "CREATE TEMP TRIGGER fts_tags_update AFTER UPDATE OF name ON data.tags"
+                  " WHEN OLD.name IS NOT NEW.name"
+                  " BEGIN UPDATE tags_fts SET name = NEW.name WHERE rowid = NEW.id; END;"
+                  "CREATE TEMP TRIGGER fts_tags_delete AFTER DELETE ON data.tags"
+                  " BEGIN DELETE FROM tags_fts WHERE rowid = OLD.id; END;"
+                  "INSERT INTO memory.tags_fts (rowid, name) SELECT id, name FROM data.tags;");
+
+  gboolean ok = sqlite3_exec(db, sql->str, NULL, NULL, &err) == SQLITE_OK;
+  if(ok)
+  {
+    *max_id = 0;
+    sqlite3_stmt *stmt;
+    DT_DEBUG_SQLITE3_PREPARE_V2(db, "SELECT MAX(id) FROM main.images", -1, &stmt, NULL);
+    if(sqlite3_step(stmt) == SQLITE_ROW) *max_id = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+    ok = sqlite3_exec(db, "RELEASE fulltext_create", NULL, NULL, &err) == SQLITE_OK;
+  }
+  if(!ok)
+  {
+    fprintf(stderr, "[fulltext] can't create the full text index: %s\n", err);
+    sqlite3_free(err);
+    sqlite3_exec(db, "ROLLBACK TO fulltext_create; RELEASE fulltext_create", NULL, NULL, NULL);
+    // the savepoint is gone if the transaction around it ended in the meantime
+    _fulltext_drop(db);
+  }
+  g_string_free(sql, TRUE);
+  return ok;
+}
+
+static int32_t _fulltext_build_job_run(dt_job_t *job)
+{
+  sqlite3 *db = dt_database_get(darktable.db);
+  const double start = dt_get_wtime();
+
+  // images imported from now on are added by the triggers, and they keep the ones already indexed up to date
+  int max_id = 0;
+  if(!_fulltext_create(db, &max_id)) return 1;
+
+  // an id of a removed image may be used again by a new one, which the triggers have indexed already
+  sqlite3_stmt *stmt;
+  GString *sql = g_string_new("INSERT OR REPLACE INTO memory.images_fts (rowid, filename");
+  for(int k = 0; k < DT_METADATA_NUMBER; k++) g_string_append_printf(sql, ", m%d", k);
+  g_string_append(sql, ") SELECT mi.id, mi.filename");
+  for(int k = 0; k < DT_METADATA_NUMBER; k++)
+    g_string_append_printf(sql, ", (SELECT value FROM main.meta_data AS md WHERE md.id = mi.id AND md.key = %d)", k);
+  g_string_append(sql, " FROM main.images AS mi WHERE mi.id BETWEEN ?1 AND ?2");
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, sql->str, -1, &stmt, NULL);
+  g_string_free(sql, TRUE);
+
+  gboolean ok = TRUE;
+  for(int from = 0; from <= max_id && ok; from += DT_FULLTEXT_CHUNK)
+  {
+    if(dt_control_job_get_state(job) == DT_JOB_STATE_CANCELLED)
+      ok = FALSE;
+    else
+    {
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, from);
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, MIN(from + DT_FULLTEXT_CHUNK - 1, max_id));
+      if(sqlite3_step(stmt) != SQLITE_DONE)
+      {
+        fprintf(stderr, "[fulltext] can't fill the full text index: %s\n", sqlite3_errmsg(db));
+        ok = FALSE;
+      }
+      sqlite3_reset(stmt);
+    }
+  }
+  sqlite3_finalize(stmt);
+
+  if(!ok)
+  {
+    _fulltext_drop(db);
+    return 1;
+  }
+
+  g_atomic_int_set(&_fulltext_ready, TRUE);
+  dt_print(DT_DEBUG_SQL, "[fulltext] index of %d images built in %.3f secs\n", max_id,
+           dt_get_wtime() - start);
+  return 0;
+}
+
+void dt_fulltext_init()
+{
+  if(!dt_conf_get_bool("database/fulltext_search")) return;
+  if(sqlite3_libversion_number() < DT_FULLTEXT_SQLITE_VERSION || !sqlite3_compileoption_used("ENABLE_FTS5"))
+  {
+    dt_print(DT_DEBUG_SQL, "[fulltext] sqlite %s has no fts5 trigram tokenizer, text searches use LIKE\n",
+             sqlite3_libversion());
+    return;
+  }
+
+  dt_job_t *job = dt_control_job_create(&_fulltext_build_job_run, "build full text index");
+  if(job) dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG, job);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
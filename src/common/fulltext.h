@@ -0,0 +1,39 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+
+/**
+ * full text index for the text properties of the collect module. two fts5 tables with the trigram tokenizer
+ * live in the memory database: memory.images_fts holds the filename and one column m<keyid> per metadata key
+ * of each image (rowid is the image id), memory.tags_fts holds the tag names (rowid is the tag id). with the
+ * trigram tokenizer, LIKE '%text%' on their columns is answered from the index.
+ * the tables are filled by a background job on startup and kept in sync with temporary triggers.
+ */
+
+/** starts building the index, if enabled and supported by sqlite. */
+void dt_fulltext_init();
+
+/** TRUE once the index is complete and can be used for queries. */
+gboolean dt_fulltext_ready();
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
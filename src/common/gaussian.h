@@ -51,6 +51,14 @@ void dt_gaussian_blur(dt_gaussian_t *g, const float *const in, float *const out)
 
 void dt_gaussian_blur_4c(dt_gaussian_t *g, const float *const in, float *const out);
 
+/** the older one column at a time implementations, which dt_gaussian_blur() and dt_gaussian_blur_4c() fall back
+ *  to. exported as reference for the blocked one. */
+void dt_gaussian_blur_columns(dt_gaussian_t *g, const float *const in, float *const out);
+
+#if defined(__SSE__)
+void dt_gaussian_blur_4c_sse(dt_gaussian_t *g, const float *const in, float *const out);
+#endif
+
 void dt_gaussian_free(dt_gaussian_t *g);
 
 
@@ -1467,6 +1467,7 @@ const dt_history_hash_t dt_history_hash_get_status(const int32_t imgid)
   dt_history_hash_t status = 0;
   if(imgid == -1) return status;
   sqlite3_stmt *stmt;
+  // called for every thumbnail shown: the image id is bound, so the query text stays the same for the cache
   char *query = dt_util_dstrcat(NULL,
                                 "SELECT CASE"
                                 "  WHEN basic_hash == current_hash THEN %d"
@@ -1475,18 +1476,18 @@ const dt_history_hash_t dt_history_hash_get_status(const int32_t imgid)
                                 "       (auto_hash IS NULL OR current_hash != auto_hash) THEN %d"
                                 "  ELSE %d END AS status"
                                 " FROM main.history_hash"
-                                " WHERE imgid = %d",
+                                " WHERE imgid = ?1",
                                 DT_HISTORY_HASH_BASIC, DT_HISTORY_HASH_AUTO,
-                                DT_HISTORY_HASH_CURRENT, DT_HISTORY_HASH_BASIC, imgid);
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              query, -1, &stmt, NULL);
+                                DT_HISTORY_HASH_CURRENT, DT_HISTORY_HASH_BASIC);
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db, query, &stmt);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   if(sqlite3_step(stmt) == SQLITE_ROW)
   {
     status = sqlite3_column_int(stmt, 0);
   }
   // if no history_hash basic status
   else status = DT_HISTORY_HASH_BASIC;
-  sqlite3_finalize(stmt);
+  dt_database_release_cached(darktable.db, stmt);
   g_free(query);
   return status;
 }
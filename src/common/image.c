@@ -1059,13 +1059,11 @@ GList* dt_image_find_duplicates(const char* filename)
 }
 
 // Search for duplicate's sidecar files and import them if found and not in DB yet
-static void _image_read_duplicates(const uint32_t id, const char *filename)
+static void _image_read_duplicates(const uint32_t id, const char *filename, GList *files)
 {
   int count_xmps_processed = 0;
   gchar pattern[PATH_MAX] = { 0 };
 
-  GList *files = dt_image_find_duplicates(filename);
-
   // we store the xmp filename without version part in pattern to speed up string comparison later
   g_snprintf(pattern, sizeof(pattern), "%s.xmp", filename);
 
@@ -1128,12 +1126,79 @@ static void _image_read_duplicates(const uint32_t id, const char *filename)
     count_xmps_processed++;
     file_iter = g_list_next(file_iter);
   }
+}
+
+// everything about a file to import that can be found out without writing to the database or the image cache.
+// this is gathered by the worker threads of a batch import.
+typedef struct _image_import_file_t
+{
+  gchar *filename; // normalized, NULL if the file is not to be imported
+  gchar *ext;      // lower case
+  uint32_t flags;  // DT_IMAGE_HAS_WAV and DT_IMAGE_HAS_TXT
+  GList *duplicates;
+  dt_exif_prefetch_t *exif;
+} _image_import_file_t;
+
+// the statements used for every imported image, prepared once per batch
+typedef struct _image_import_stmts_t
+{
+  sqlite3_stmt *select_id;
+  sqlite3_stmt *insert;
+  sqlite3_stmt *select_group;
+  sqlite3_stmt *select_jpeg_group;
+  sqlite3_stmt *update_group;
+} _image_import_stmts_t;
 
-  g_list_free_full(files, g_free);
+static void _image_import_stmts_prepare(_image_import_stmts_t *stmts)
+{
+  sqlite3 *db = dt_database_get(darktable.db);
+  DT_DEBUG_SQLITE3_PREPARE_V2
+    (db, "SELECT id FROM main.images WHERE film_id = ?1 AND filename = ?2", -1, &stmts->select_id, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_V2
+    (db,
+     "INSERT INTO main.images (id, film_id, filename, license, sha1sum, flags, version, "
+     "                         max_version, history_end, position, import_timestamp)"
+     " SELECT NULL, ?1, ?2, '', '', ?3, 0, 0, 0, (IFNULL(MAX(position),0) & 0xFFFFFFFF00000000)  + (1 << 32), ?4 "
+     " FROM images",
+     -1, &stmts->insert, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_V2
+    (db,
+     "SELECT group_id"
+     " FROM main.images"
+     " WHERE film_id = ?1 AND filename LIKE ?2 AND id = group_id", -1, &stmts->select_group, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_V2
+    (db,
+     "SELECT group_id"
+     " FROM main.images"
+     " WHERE film_id = ?1 AND filename LIKE ?2 AND id != ?3", -1, &stmts->select_jpeg_group, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_V2
+    (db, "UPDATE main.images SET group_id = ?1 WHERE id = ?2", -1, &stmts->update_group, NULL);
 }
 
-static uint32_t dt_image_import_internal(const int32_t film_id, const char *filename,
-                                         gboolean override_ignore_jpegs, gboolean lua_locking)
+static void _image_import_stmts_finalize(_image_import_stmts_t *stmts)
+{
+  sqlite3_finalize(stmts->select_id);
+  sqlite3_finalize(stmts->insert);
+  sqlite3_finalize(stmts->select_group);
+  sqlite3_finalize(stmts->select_jpeg_group);
+  sqlite3_finalize(stmts->update_group);
+}
+
+// returns the id of the image in the film roll, 0 if there is none
+static uint32_t _image_import_find(sqlite3_stmt *stmt, const int32_t film_id, const char *imgfname)
+{
+  uint32_t id = 0;
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, film_id);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, imgfname, -1, SQLITE_STATIC);
+  if(sqlite3_step(stmt) == SQLITE_ROW) id = sqlite3_column_int(stmt, 0);
+  sqlite3_reset(stmt);
+  sqlite3_clear_bindings(stmt);
+  return id;
+}
+
+// checks if the file is to be imported at all and fills in the normalized filename and its extension
+static gboolean _image_import_check(const char *filename, gboolean override_ignore_jpegs,
+                                    _image_import_file_t *file)
 {
   char *normalized_filename = dt_util_normalize_path(filename);
   if(!normalized_filename
@@ -1141,7 +1206,7 @@ static uint32_t dt_image_import_internal(const int32_t film_id, const char *file
      || dt_util_get_file_size(normalized_filename) == 0)
   {
     g_free(normalized_filename);
-    return 0;
+    return FALSE;
   }
   const char *cc = normalized_filename + strlen(normalized_filename);
   for(; *cc != '.' && cc > normalized_filename; cc--)
@@ -1149,7 +1214,7 @@ static uint32_t dt_image_import_internal(const int32_t film_id, const char *file
   if(!strcasecmp(cc, ".dt") || !strcasecmp(cc, ".dttags") || !strcasecmp(cc, ".xmp"))
   {
     g_free(normalized_filename);
-    return 0;
+    return FALSE;
   }
   char *ext = g_ascii_strdown(cc + 1, -1);
   if(override_ignore_jpegs == FALSE && (!strcmp(ext, "jpg") || !strcmp(ext, "jpeg"))
@@ -1157,7 +1222,7 @@ static uint32_t dt_image_import_internal(const int32_t film_id, const char *file
   {
     g_free(normalized_filename);
     g_free(ext);
-    return 0;
+    return FALSE;
   }
   int supported = 0;
   for(const char **i = dt_supported_extensions; *i != NULL; i++)
@@ -1170,34 +1235,59 @@ static uint32_t dt_image_import_internal(const int32_t film_id, const char *file
   {
     g_free(normalized_filename);
     g_free(ext);
-    return 0;
+    return FALSE;
+  }
+  file->filename = normalized_filename;
+  file->ext = ext;
+  return TRUE;
+}
+
+// gathers what is needed for a new image from the file system: sidecar files and the embedded metadata
+static void _image_import_read_files(_image_import_file_t *file, gboolean read_exif)
+{
+  // set the bits in flags that indicate if any of the extra files (.txt, .wav) are present
+  char *extra_file = dt_image_get_audio_path_from_path(file->filename);
+  if(extra_file)
+  {
+    file->flags |= DT_IMAGE_HAS_WAV;
+    g_free(extra_file);
   }
+  extra_file = dt_image_get_text_path_from_path(file->filename);
+  if(extra_file)
+  {
+    file->flags |= DT_IMAGE_HAS_TXT;
+    g_free(extra_file);
+  }
+  file->duplicates = dt_image_find_duplicates(file->filename);
+  if(read_exif) file->exif = dt_exif_prefetch(file->filename);
+}
+
+static void _image_import_file_cleanup(_image_import_file_t *file)
+{
+  g_free(file->filename);
+  g_free(file->ext);
+  g_list_free_full(file->duplicates, g_free);
+  dt_exif_prefetch_free(file->exif);
+  memset(file, 0, sizeof(_image_import_file_t));
+}
+
+// adds the checked file to the images table, if it isn't there already (then created is FALSE). this only
+// touches the images table, so batch imports can run it for many files in one transaction. it needs to run in
+// the order of the files to keep their position.
+static uint32_t _image_import_insert(const int32_t film_id, const _image_import_file_t *file,
+                                     _image_import_stmts_t *stmts, gboolean *created)
+{
   int rc;
   uint32_t id = 0;
   // select from images; if found => return
-  gchar *imgfname;
-  imgfname = g_path_get_basename(normalized_filename);
-  sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2
-    (dt_database_get(darktable.db),
-     "SELECT id FROM main.images WHERE film_id = ?1 AND filename = ?2", -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, film_id);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, imgfname, -1, SQLITE_STATIC);
-  if(sqlite3_step(stmt) == SQLITE_ROW)
+  gchar *imgfname = g_path_get_basename(file->filename);
+  id = _image_import_find(stmts->select_id, film_id, imgfname);
+  *created = id == 0;
+  if(id)
   {
-    id = sqlite3_column_int(stmt, 0);
     g_free(imgfname);
-    sqlite3_finalize(stmt);
-    dt_image_t *img = dt_image_cache_get(darktable.image_cache, id, 'w');
-    img->flags &= ~DT_IMAGE_REMOVE;
-    dt_image_cache_write_release(darktable.image_cache, img, DT_IMAGE_CACHE_RELAXED);
-    _image_read_duplicates(id, normalized_filename);
-    dt_image_synch_all_xmp(normalized_filename);
-    g_free(ext);
-    g_free(normalized_filename);
     return id;
   }
-  sqlite3_finalize(stmt);
 
   // also need to set the no-legacy bit, to make sure we get the right presets (new ones)
   uint32_t flags = dt_conf_get_int("ui_last/import_initial_rating");
@@ -1207,29 +1297,10 @@ static uint32_t dt_image_import_internal(const int32_t film_id, const char *file
     dt_conf_set_int("ui_last/import_initial_rating", 1);
   }
   flags |= DT_IMAGE_NO_LEGACY_PRESETS;
-  // set the bits in flags that indicate if any of the extra files (.txt, .wav) are present
-  char *extra_file = dt_image_get_audio_path_from_path(normalized_filename);
-  if(extra_file)
-  {
-    flags |= DT_IMAGE_HAS_WAV;
-    g_free(extra_file);
-  }
-  extra_file = dt_image_get_text_path_from_path(normalized_filename);
-  if(extra_file)
-  {
-    flags |= DT_IMAGE_HAS_TXT;
-    g_free(extra_file);
-  }
+  flags |= file->flags;
 
   //insert a v0 record (which may be updated later if no v0 xmp exists)
-  DT_DEBUG_SQLITE3_PREPARE_V2
-    (dt_database_get(darktable.db),
-     "INSERT INTO main.images (id, film_id, filename, license, sha1sum, flags, version, "
-     "                         max_version, history_end, position, import_timestamp)"
-     " SELECT NULL, ?1, ?2, '', '', ?3, 0, 0, 0, (IFNULL(MAX(position),0) & 0xFFFFFFFF00000000)  + (1 << 32), ?4 "
-     " FROM images",
-     -1, &stmt, NULL);
-
+  sqlite3_stmt *stmt = stmts->insert;
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, film_id);
   DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, imgfname, -1, SQLITE_TRANSIENT);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 3, flags);
@@ -1237,17 +1308,42 @@ static uint32_t dt_image_import_internal(const int32_t film_id, const char *file
 
   rc = sqlite3_step(stmt);
   if(rc != SQLITE_DONE) fprintf(stderr, "sqlite3 error %d\n", rc);
-  sqlite3_finalize(stmt);
+  sqlite3_reset(stmt);
+  sqlite3_clear_bindings(stmt);
 
-  DT_DEBUG_SQLITE3_PREPARE_V2
-    (dt_database_get(darktable.db),
-     "SELECT id FROM main.images WHERE film_id = ?1 AND filename = ?2", -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, film_id);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, imgfname, -1, SQLITE_STATIC);
-  if(sqlite3_step(stmt) == SQLITE_ROW) id = sqlite3_column_int(stmt, 0);
-  sqlite3_finalize(stmt);
+  id = _image_import_find(stmts->select_id, film_id, imgfname);
+  g_free(imgfname);
+  if(!id) return 0;
+
+  // a group of its own until the import is finished
+  stmt = stmts->update_group;
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, id);
+  sqlite3_step(stmt);
+  sqlite3_reset(stmt);
+  sqlite3_clear_bindings(stmt);
+  return id;
+}
+
+// the rest of importing the image with the id from _image_import_insert(): grouping, metadata, tags and sidecar
+// files. this goes through the image cache and writes xmp files, so it isn't run inside of transactions.
+static void _image_import_finish(const int32_t film_id, const uint32_t id, const gboolean created,
+                                 _image_import_file_t *file, _image_import_stmts_t *stmts, gboolean lua_locking)
+{
+  const char *normalized_filename = file->filename;
+  const char *ext = file->ext;
+  if(!created)
+  {
+    dt_image_t *img = dt_image_cache_get(darktable.image_cache, id, 'w');
+    img->flags &= ~DT_IMAGE_REMOVE;
+    dt_image_cache_write_release(darktable.image_cache, img, DT_IMAGE_CACHE_RELAXED);
+    _image_read_duplicates(id, normalized_filename, file->duplicates);
+    dt_image_synch_all_xmp(normalized_filename);
+    return;
+  }
 
   // Try to find out if this should be grouped already.
+  gchar *imgfname = g_path_get_basename(normalized_filename);
   gchar *basename = g_strdup(imgfname);
   gchar *cc2 = basename + strlen(basename);
   for(; *cc2 != '.' && cc2 > basename; cc2--)
@@ -1258,13 +1354,7 @@ static uint32_t dt_image_import_internal(const int32_t film_id, const char *file
   // in case we are not a jpg check if we need to change group representative
   if(strcmp(ext, "jpg") != 0 && strcmp(ext, "jpeg") != 0)
   {
-    sqlite3_stmt *stmt2;
-    DT_DEBUG_SQLITE3_PREPARE_V2
-      (dt_database_get(darktable.db),
-       "SELECT group_id"
-       " FROM main.images"
-       " WHERE film_id = ?1 AND filename LIKE ?2 AND id = group_id", -1, &stmt2,
-      NULL);
+    sqlite3_stmt *stmt2 = stmts->select_group;
     DT_DEBUG_SQLITE3_BIND_INT(stmt2, 1, film_id);
     DT_DEBUG_SQLITE3_BIND_TEXT(stmt2, 2, sql_pattern, -1, SQLITE_TRANSIENT);
     // if we have a group already
@@ -1310,16 +1400,12 @@ static uint32_t dt_image_import_internal(const int32_t film_id, const char *file
     {
       group_id = id;
     }
-    sqlite3_finalize(stmt2);
+    sqlite3_reset(stmt2);
+    sqlite3_clear_bindings(stmt2);
   }
   else
   {
-    sqlite3_stmt *stmt2;
-    DT_DEBUG_SQLITE3_PREPARE_V2
-      (dt_database_get(darktable.db),
-       "SELECT group_id"
-       " FROM main.images"
-       " WHERE film_id = ?1 AND filename LIKE ?2 AND id != ?3", -1, &stmt2, NULL);
+    sqlite3_stmt *stmt2 = stmts->select_jpeg_group;
     DT_DEBUG_SQLITE3_BIND_INT(stmt2, 1, film_id);
     DT_DEBUG_SQLITE3_BIND_TEXT(stmt2, 2, sql_pattern, -1, SQLITE_TRANSIENT);
     DT_DEBUG_SQLITE3_BIND_INT(stmt2, 3, id);
@@ -1327,16 +1413,15 @@ static uint32_t dt_image_import_internal(const int32_t film_id, const char *file
       group_id = sqlite3_column_int(stmt2, 0);
     else
       group_id = id;
-    sqlite3_finalize(stmt2);
+    sqlite3_reset(stmt2);
+    sqlite3_clear_bindings(stmt2);
   }
-  DT_DEBUG_SQLITE3_PREPARE_V2
-    (dt_database_get(darktable.db),
-     "UPDATE main.images SET group_id = ?1 WHERE id = ?2",
-     -1, &stmt, NULL);
+  sqlite3_stmt *stmt = stmts->update_group;
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, group_id);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, id);
   sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
+  sqlite3_reset(stmt);
+  sqlite3_clear_bindings(stmt);
 
   // printf("[image_import] importing `%s' to img id %d\n", imgfname, id);
 
@@ -1344,8 +1429,11 @@ static uint32_t dt_image_import_internal(const int32_t film_id, const char *file
   dt_image_t *img = dt_image_cache_get(darktable.image_cache, id, 'w');
   img->group_id = group_id;
 
-  // read dttags and exif for database queries!
-  (void)dt_exif_read(img, normalized_filename);
+  // read dttags and exif for database queries! batch imports did the reading beforehand.
+  if(file->exif)
+    (void)dt_exif_read_prefetched(img, normalized_filename, file->exif);
+  else
+    (void)dt_exif_read(img, normalized_filename);
   char dtfilename[PATH_MAX] = { 0 };
   g_strlcpy(dtfilename, normalized_filename, sizeof(dtfilename));
   // dt_image_path_append_version(id, dtfilename, sizeof(dtfilename));
@@ -1366,7 +1454,6 @@ static uint32_t dt_image_import_internal(const int32_t film_id, const char *file
   guint tagid = 0;
   char tagname[512];
   snprintf(tagname, sizeof(tagname), "darktable|format|%s", ext);
-  g_free(ext);
   dt_tag_new(tagname, &tagid);
   dt_tag_attach(tagid, id, FALSE, FALSE);
 
@@ -1374,7 +1461,7 @@ static uint32_t dt_image_import_internal(const int32_t film_id, const char *file
   dt_mipmap_cache_remove(darktable.mipmap_cache, id);
 
   // read all sidecar files
-  _image_read_duplicates(id, normalized_filename);
+  _image_read_duplicates(id, normalized_filename, file->duplicates);
 
   //synch database entries to xmp
   dt_image_synch_all_xmp(normalized_filename);
@@ -1382,7 +1469,6 @@ static uint32_t dt_image_import_internal(const int32_t film_id, const char *file
   g_free(imgfname);
   g_free(basename);
   g_free(sql_pattern);
-  g_free(normalized_filename);
 
 #ifdef USE_LUA
   //Synchronous calling of lua post-import-image events
@@ -1403,6 +1489,30 @@ static uint32_t dt_image_import_internal(const int32_t film_id, const char *file
   // from dt_tag_new above, but this could lead to too rapid signals, being able to lock up the
   // keywords side pane when trying to use it, which can lock up the whole dt GUI ..
   // if (new_tags_set) dt_control_signal_raise(darktable.signals,DT_SIGNAL_TAG_CHANGED);
+}
+
+// adds the checked file to the database, see above
+static uint32_t _image_import_file(const int32_t film_id, _image_import_file_t *file,
+                                   _image_import_stmts_t *stmts, gboolean lua_locking)
+{
+  gboolean created = FALSE;
+  const uint32_t id = _image_import_insert(film_id, file, stmts, &created);
+  if(id) _image_import_finish(film_id, id, created, file, stmts, lua_locking);
+  return id;
+}
+
+static uint32_t dt_image_import_internal(const int32_t film_id, const char *filename,
+                                         gboolean override_ignore_jpegs, gboolean lua_locking)
+{
+  _image_import_file_t file = { 0 };
+  if(!_image_import_check(filename, override_ignore_jpegs, &file)) return 0;
+  _image_import_read_files(&file, FALSE);
+
+  _image_import_stmts_t stmts;
+  _image_import_stmts_prepare(&stmts);
+  const uint32_t id = _image_import_file(film_id, &file, &stmts, lua_locking);
+  _image_import_stmts_finalize(&stmts);
+  _image_import_file_cleanup(&file);
   return id;
 }
 
@@ -1416,6 +1526,123 @@ uint32_t dt_image_import_lua(const int32_t film_id, const char *filename, gboole
   return dt_image_import_internal(film_id, filename, override_ignore_jpegs, FALSE);
 }
 
+// number of threads reading the files of a batch import. this is bound by i/o, not by the cpus.
+#define DT_IMAGE_IMPORT_THREADS 4
+// how many files the worker threads may read ahead of the database inserts
+#define DT_IMAGE_IMPORT_READ_AHEAD 64
+// number of images inserted into the images table in one transaction
+#define DT_IMAGE_IMPORT_TRANSACTION 256
+
+typedef struct _image_import_batch_t
+{
+  int32_t film_id;
+  gboolean override_ignore_jpegs;
+  char **filenames;
+  _image_import_file_t *files;
+  gboolean *ready;
+  dt_pthread_mutex_t mutex;
+  pthread_cond_t cond;
+} _image_import_batch_t;
+
+static void _image_import_batch_read(gpointer data, gpointer user_data)
+{
+  _image_import_batch_t *batch = user_data;
+  const int i = GPOINTER_TO_INT(data) - 1;
+  _image_import_file_t *file = batch->files + i;
+
+  if(_image_import_check(batch->filenames[i], batch->override_ignore_jpegs, file))
+  {
+    // images which are in the database already don't need their metadata
+    gchar *imgfname = g_path_get_basename(file->filename);
+    sqlite3_stmt *stmt;
+    DT_DEBUG_SQLITE3_PREPARE_V2
+      (dt_database_get(darktable.db),
+       "SELECT id FROM main.images WHERE film_id = ?1 AND filename = ?2", -1, &stmt, NULL);
+    const uint32_t id = _image_import_find(stmt, batch->film_id, imgfname);
+    sqlite3_finalize(stmt);
+    g_free(imgfname);
+
+    _image_import_read_files(file, id == 0);
+  }
+
+  dt_pthread_mutex_lock(&batch->mutex);
+  batch->ready[i] = TRUE;
+  pthread_cond_broadcast(&batch->cond);
+  dt_pthread_mutex_unlock(&batch->mutex);
+}
+
+GList *dt_image_import_batch(const int32_t film_id, GList *filenames, gboolean override_ignore_jpegs,
+                             dt_image_import_progress_t progress, void *data)
+{
+  const int count = g_list_length(filenames);
+  if(count == 0) return NULL;
+
+  _image_import_batch_t batch;
+  batch.film_id = film_id;
+  batch.override_ignore_jpegs = override_ignore_jpegs;
+  batch.filenames = g_malloc_n(count, sizeof(char *));
+  batch.files = g_malloc0_n(count, sizeof(_image_import_file_t));
+  batch.ready = g_malloc0_n(count, sizeof(gboolean));
+  dt_pthread_mutex_init(&batch.mutex, NULL);
+  pthread_cond_init(&batch.cond, NULL);
+  int k = 0;
+  for(GList *l = filenames; l; l = g_list_next(l)) batch.filenames[k++] = l->data;
+
+  GThreadPool *pool = g_thread_pool_new(_image_import_batch_read, &batch, DT_IMAGE_IMPORT_THREADS, FALSE, NULL);
+  const int ahead = MIN(count, DT_IMAGE_IMPORT_READ_AHEAD);
+  for(int i = 0; i < ahead; i++) g_thread_pool_push(pool, GINT_TO_POINTER(i + 1), NULL);
+
+  _image_import_stmts_t stmts;
+  _image_import_stmts_prepare(&stmts);
+
+  sqlite3 *db = dt_database_get(darktable.db);
+  GList *imgs = NULL;
+  uint32_t ids[DT_IMAGE_IMPORT_TRANSACTION];
+  gboolean created[DT_IMAGE_IMPORT_TRANSACTION];
+  for(int start = 0; start < count; start += DT_IMAGE_IMPORT_TRANSACTION)
+  {
+    const int end = MIN(count, start + DT_IMAGE_IMPORT_TRANSACTION);
+
+    // only the inserts share a transaction, so other threads don't wait for the database while the rest of the
+    // import goes through the image cache and writes xmp files
+    sqlite3_exec(db, "BEGIN TRANSACTION", NULL, NULL, NULL);
+    for(int i = start; i < end; i++)
+    {
+      if(i + ahead < count) g_thread_pool_push(pool, GINT_TO_POINTER(i + ahead + 1), NULL);
+
+      dt_pthread_mutex_lock(&batch.mutex);
+      while(!batch.ready[i]) dt_pthread_cond_wait(&batch.cond, &batch.mutex);
+      dt_pthread_mutex_unlock(&batch.mutex);
+
+      _image_import_file_t *file = batch.files + i;
+      ids[i - start] = file->filename ? _image_import_insert(film_id, file, &stmts, &created[i - start]) : 0;
+    }
+    sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
+
+    for(int i = start; i < end; i++)
+    {
+      const uint32_t id = ids[i - start];
+      if(id)
+      {
+        _image_import_finish(film_id, id, created[i - start], batch.files + i, &stmts, TRUE);
+        imgs = g_list_prepend(imgs, GINT_TO_POINTER(id));
+      }
+      _image_import_file_cleanup(batch.files + i);
+      if(progress) progress(id, data);
+    }
+  }
+
+  _image_import_stmts_finalize(&stmts);
+  g_thread_pool_free(pool, FALSE, TRUE);
+  pthread_cond_destroy(&batch.cond);
+  dt_pthread_mutex_destroy(&batch.mutex);
+  g_free(batch.ready);
+  g_free(batch.files);
+  g_free(batch.filenames);
+
+  return g_list_reverse(imgs);
+}
+
 void dt_image_init(dt_image_t *img)
 {
   img->width = img->height = img->verified_size = 0;
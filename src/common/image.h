@@ -264,6 +264,12 @@ GList* dt_image_find_duplicates(const char* filename);
 uint32_t dt_image_import(int32_t film_id, const char *filename, gboolean override_ignore_jpegs);
 /** imports a new image from raw/etc file and adds it to the data base and image cache. Use from lua thread.*/
 uint32_t dt_image_import_lua(int32_t film_id, const char *filename, gboolean override_ignore_jpegs);
+/** called by dt_image_import_batch after each file with the id of the new image, 0 if it was not imported. */
+typedef void (*dt_image_import_progress_t)(const uint32_t imgid, void *data);
+/** imports the files (full paths) into the film roll, keeping their order. the files are read by worker threads
+    ahead of adding them to the data base in large transactions. returns the list of the imported image ids. */
+GList *dt_image_import_batch(const int32_t film_id, GList *filenames, gboolean override_ignore_jpegs,
+                             dt_image_import_progress_t progress, void *data);
 /** removes the given image from the database. */
 void dt_image_remove(const int32_t imgid);
 /** duplicates the given image in the database with the duplicate getting the supplied version number. if that
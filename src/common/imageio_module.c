@@ -117,6 +117,8 @@ static int dt_imageio_load_module_format(dt_imageio_module_format_t *module, con
     module->levels = _default_format_levels;
   if(!g_module_symbol(module->module, "read_image", (gpointer) & (module->read_image)))
     module->read_image = NULL;
+  if(!g_module_symbol(module->module, "parallel_write", (gpointer) & (module->parallel_write)))
+    module->parallel_write = NULL;
 
 #ifdef USE_LUA
   {
@@ -245,6 +247,8 @@ static int dt_imageio_load_module_storage(dt_imageio_module_storage_t *module, c
     module->initialize_store = NULL;
   if(!g_module_symbol(module->module, "finalize_store", (gpointer) & (module->finalize_store)))
     module->finalize_store = NULL;
+  if(!g_module_symbol(module->module, "parallel_store", (gpointer) & (module->parallel_store)))
+    module->parallel_store = NULL;
   if(!g_module_symbol(module->module, "set_params", (gpointer) & (module->set_params))) goto error;
 
   if(!g_module_symbol(module->module, "supported", (gpointer) & (module->supported)))
@@ -437,6 +441,14 @@ void dt_imageio_insert_storage(dt_imageio_module_storage_t *storage)
   dt_control_signal_raise(darktable.signals, DT_SIGNAL_IMAGEIO_STORAGE_CHANGE);
 }
 
+gboolean dt_imageio_parallel_export(dt_imageio_module_storage_t *storage, dt_imageio_module_data_t *sdata,
+                                    dt_imageio_module_format_t *format)
+{
+  // both have to opt in: the storage for store() and the format for its per-thread params
+  return storage->parallel_store && storage->parallel_store(storage, sdata)
+         && format->parallel_write && format->parallel_write(format);
+}
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -129,6 +129,9 @@ typedef struct dt_imageio_module_format_t
   int (*flags)(dt_imageio_module_data_t *data);
 
   int (*read_image)(dt_imageio_module_data_t *data, uint8_t *out);
+  /* optional: return 1 if write_image() may be called for several images at the same time, each with its own
+   * params. formats which keep state across the images of one export (pdf) must not implement it. */
+  int (*parallel_write)(struct dt_imageio_module_format_t *self);
   luaA_Type parameter_lua_type;
 
 } dt_imageio_module_format_t;
@@ -183,6 +186,8 @@ typedef struct dt_imageio_module_storage_t
                dt_iop_color_intent_t icc_intent, dt_export_metadata_t *metadata_flags);
   /* called once at the end (after exporting all images), if implemented. */
   void (*finalize_store)(struct dt_imageio_module_storage_t *self, dt_imageio_module_data_t *data);
+  /* optional: return 1 if store() may be called for several images at the same time with these params. */
+  int (*parallel_store)(struct dt_imageio_module_storage_t *self, dt_imageio_module_data_t *data);
 
   void *(*legacy_params)(struct dt_imageio_module_storage_t *self, const void *const old_params,
                          const size_t old_params_size, const int old_version, const int new_version,
@@ -231,6 +236,10 @@ int dt_imageio_get_index_of_storage(dt_imageio_module_storage_t *storage);
 /* add a module into the known module list */
 void dt_imageio_insert_storage(dt_imageio_module_storage_t *storage);
 
+/* can several images be exported at the same time with this storage and format? */
+gboolean dt_imageio_parallel_export(dt_imageio_module_storage_t *storage, dt_imageio_module_data_t *sdata,
+                                    dt_imageio_module_format_t *format);
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
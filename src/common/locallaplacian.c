@@ -28,6 +28,9 @@
 #if defined(__SSE2__)
 #include <xmmintrin.h>
 #endif
+#if defined(DT_HAVE_AVX_CODEPATHS)
+#include <immintrin.h>
+#endif
 
 // the maximum number of levels for the gaussian pyramid
 #define max_levels 30
@@ -496,7 +499,7 @@ void apply_curve_sse2(
     const float highlights,
     const float clarity)
 {
-  // TODO: do all this in avx2 8-wide (should be straight forward):
+  // 8-wide variants are apply_curve_avx2() and apply_curve_avx512() below
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
   dt_omp_firstprivate(clarity, g, h, highlights, in, out, padding, shadows, sigma, w) \
@@ -529,6 +532,168 @@ void apply_curve_sse2(
 }
 #endif
 
+#if defined(DT_HAVE_AVX_CODEPATHS)
+// same as curve_vec4, 8-wide
+DT_TARGET_AVX2 static inline __m256 curve_vec8(
+    const __m256 x,
+    const __m256 g,
+    const __m256 sigma,
+    const __m256 shadows,
+    const __m256 highlights,
+    const __m256 clarity)
+{
+  const __m256 const0 = _mm256_set1_ps(0x3f800000u);
+  const __m256 const1 = _mm256_set1_ps((float)0x402DF854u); // for e^x
+  const __m256 sign_mask = _mm256_set1_ps(-0.f);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 two = _mm256_set1_ps(2.0f);
+  const __m256 twosig = _mm256_mul_ps(two, sigma);
+  const __m256 s22 = _mm256_mul_ps(_mm256_set1_ps(2.0f/3.0f), _mm256_mul_ps(sigma, sigma));
+
+  const __m256 c = _mm256_sub_ps(x, g);
+  const __m256 select = _mm256_cmp_ps(c, zero, _CMP_LT_OQ);
+  const __m256 shadhi = _mm256_blendv_ps(shadows, highlights, select);
+  const __m256 ssigma = _mm256_xor_ps(sigma, _mm256_and_ps(select, sign_mask));
+  const __m256 vlin = _mm256_fmadd_ps(shadhi, _mm256_sub_ps(c, ssigma), _mm256_add_ps(g, ssigma));
+
+  const __m256 t = _mm256_min_ps(one, _mm256_max_ps(zero, _mm256_div_ps(c, _mm256_mul_ps(two, ssigma))));
+  const __m256 t2 = _mm256_mul_ps(t, t);
+  const __m256 mt = _mm256_sub_ps(one, t);
+  const __m256 vmid = _mm256_fmadd_ps(_mm256_mul_ps(ssigma, two), _mm256_mul_ps(mt, t),
+                                      _mm256_fmadd_ps(t2, _mm256_fmadd_ps(ssigma, shadhi, ssigma), g));
+
+  const __m256 linselect = _mm256_cmp_ps(_mm256_andnot_ps(sign_mask, c), twosig, _CMP_GT_OQ);
+  const __m256 val = _mm256_blendv_ps(vmid, vlin, linselect);
+
+  // midtone local contrast, with dt_fast_expf
+  const __m256 arg = _mm256_xor_ps(sign_mask, _mm256_div_ps(_mm256_mul_ps(c, c), s22));
+  const __m256 k = _mm256_max_ps(_mm256_fmadd_ps(arg, _mm256_sub_ps(const1, const0), const0), zero);
+  const __m256 gauss = _mm256_castsi256_ps(_mm256_cvtps_epi32(k));
+  return _mm256_fmadd_ps(clarity, _mm256_mul_ps(c, gauss), val);
+}
+
+// avx2 (8-wide)
+DT_TARGET_AVX2 static void apply_curve_avx2(
+    float *const out,
+    const float *const in,
+    const uint32_t w,
+    const uint32_t h,
+    const uint32_t padding,
+    const float g,
+    const float sigma,
+    const float shadows,
+    const float highlights,
+    const float clarity)
+{
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(clarity, g, h, highlights, in, out, padding, shadows, sigma, w) \
+  schedule(static)
+#endif
+  for(uint32_t j=padding;j<h-padding;j++)
+  {
+    const float *in2  = in  + j*w + padding;
+    float *out2 = out + j*w + padding;
+    const float *const end = out2 + ((w-2*padding) & ~7u);
+    const float *const fin = out2+w-2*padding;
+    const __m256 g8 = _mm256_set1_ps(g);
+    const __m256 sig8 = _mm256_set1_ps(sigma);
+    const __m256 shd8 = _mm256_set1_ps(shadows);
+    const __m256 hil8 = _mm256_set1_ps(highlights);
+    const __m256 clr8 = _mm256_set1_ps(clarity);
+    for(;out2<end;out2+=8,in2+=8)
+      _mm256_storeu_ps(out2, curve_vec8(_mm256_loadu_ps(in2), g8, sig8, shd8, hil8, clr8));
+    for(;out2<fin;out2++,in2++)
+      *out2 = curve_scalar(*in2, g, sigma, shadows, highlights, clarity);
+    out2 = out + j*w;
+    for(int i=0;i<padding;i++)   out2[i] = out2[padding];
+    for(int i=w-padding;i<w;i++) out2[i] = out2[w-padding-1];
+  }
+  pad_by_replication(out, w, h, padding);
+}
+
+// same as curve_vec4, 16-wide
+DT_TARGET_AVX512 static inline __m512 curve_vec16(
+    const __m512 x,
+    const __m512 g,
+    const __m512 sigma,
+    const __m512 shadows,
+    const __m512 highlights,
+    const __m512 clarity)
+{
+  const __m512 const0 = _mm512_set1_ps(0x3f800000u);
+  const __m512 const1 = _mm512_set1_ps((float)0x402DF854u); // for e^x
+  const __m512 zero = _mm512_setzero_ps();
+  const __m512 one = _mm512_set1_ps(1.0f);
+  const __m512 two = _mm512_set1_ps(2.0f);
+  const __m512 twosig = _mm512_mul_ps(two, sigma);
+  const __m512 s22 = _mm512_mul_ps(_mm512_set1_ps(2.0f/3.0f), _mm512_mul_ps(sigma, sigma));
+
+  const __m512 c = _mm512_sub_ps(x, g);
+  const __mmask16 select = _mm512_cmp_ps_mask(c, zero, _CMP_LT_OQ);
+  const __m512 shadhi = _mm512_mask_blend_ps(select, shadows, highlights);
+  const __m512 ssigma = _mm512_mask_blend_ps(select, sigma, _mm512_sub_ps(zero, sigma));
+  const __m512 vlin = _mm512_fmadd_ps(shadhi, _mm512_sub_ps(c, ssigma), _mm512_add_ps(g, ssigma));
+
+  const __m512 t = _mm512_min_ps(one, _mm512_max_ps(zero, _mm512_div_ps(c, _mm512_mul_ps(two, ssigma))));
+  const __m512 t2 = _mm512_mul_ps(t, t);
+  const __m512 mt = _mm512_sub_ps(one, t);
+  const __m512 vmid = _mm512_fmadd_ps(_mm512_mul_ps(ssigma, two), _mm512_mul_ps(mt, t),
+                                      _mm512_fmadd_ps(t2, _mm512_fmadd_ps(ssigma, shadhi, ssigma), g));
+
+  const __mmask16 linselect = _mm512_cmp_ps_mask(_mm512_abs_ps(c), twosig, _CMP_GT_OQ);
+  const __m512 val = _mm512_mask_blend_ps(linselect, vmid, vlin);
+
+  // midtone local contrast, with dt_fast_expf
+  const __m512 arg = _mm512_sub_ps(zero, _mm512_div_ps(_mm512_mul_ps(c, c), s22));
+  const __m512 k = _mm512_max_ps(_mm512_fmadd_ps(arg, _mm512_sub_ps(const1, const0), const0), zero);
+  const __m512 gauss = _mm512_castsi512_ps(_mm512_cvtps_epi32(k));
+  return _mm512_fmadd_ps(clarity, _mm512_mul_ps(c, gauss), val);
+}
+
+// avx-512 (16-wide), the end of the row is done with a masked load and store
+DT_TARGET_AVX512 static void apply_curve_avx512(
+    float *const out,
+    const float *const in,
+    const uint32_t w,
+    const uint32_t h,
+    const uint32_t padding,
+    const float g,
+    const float sigma,
+    const float shadows,
+    const float highlights,
+    const float clarity)
+{
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(clarity, g, h, highlights, in, out, padding, shadows, sigma, w) \
+  schedule(static)
+#endif
+  for(uint32_t j=padding;j<h-padding;j++)
+  {
+    const float *in2  = in  + j*w + padding;
+    float *out2 = out + j*w + padding;
+    const __m512 g16 = _mm512_set1_ps(g);
+    const __m512 sig16 = _mm512_set1_ps(sigma);
+    const __m512 shd16 = _mm512_set1_ps(shadows);
+    const __m512 hil16 = _mm512_set1_ps(highlights);
+    const __m512 clr16 = _mm512_set1_ps(clarity);
+    for(uint32_t i=0;i<w-2*padding;i+=16)
+    {
+      const uint32_t n = MIN(16, w-2*padding-i);
+      const __mmask16 m = (__mmask16)((1u << n) - 1);
+      _mm512_mask_storeu_ps(out2+i, m,
+                            curve_vec16(_mm512_maskz_loadu_ps(m, in2+i), g16, sig16, shd16, hil16, clr16));
+    }
+    out2 = out + j*w;
+    for(int i=0;i<padding;i++)   out2[i] = out2[padding];
+    for(int i=w-padding;i<w;i++) out2[i] = out2[w-padding-1];
+  }
+  pad_by_replication(out, w, h, padding);
+}
+#endif
+
 // scalar version
 void apply_curve(
     float *const out,
@@ -569,7 +734,7 @@ void local_laplacian_internal(
     const float shadows,        // user param: lift shadows
     const float highlights,     // user param: compress highlights
     const float clarity,        // user param: increase clarity/local contrast
-    const int use_sse2,         // flag whether to use SSE version
+    const int use_sse2,         // flag whether to use SSE (or AVX2/AVX-512) version
     local_laplacian_boundary_t *b)
 {
   // don't divide by 2 more often than we can:
@@ -625,6 +790,13 @@ void local_laplacian_internal(
   // willing to pay the cost).
   for(int k=0;k<num_gamma;k++)
   { // process images
+#if defined(DT_HAVE_AVX_CODEPATHS)
+    if(use_sse2 && darktable.codepath.AVX512)
+      apply_curve_avx512(buf[k][0], padded[0], w, h, max_supp, gamma[k], sigma, shadows, highlights, clarity);
+    else if(use_sse2 && darktable.codepath.AVX2)
+      apply_curve_avx2(buf[k][0], padded[0], w, h, max_supp, gamma[k], sigma, shadows, highlights, clarity);
+    else
+#endif
 #if defined(__SSE2__)
     if(use_sse2)
       apply_curve_sse2(buf[k][0], padded[0], w, h, max_supp, gamma[k], sigma, shadows, highlights, clarity);
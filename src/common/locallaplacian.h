@@ -54,7 +54,7 @@ void local_laplacian_internal(
     const float shadows,        // user param: lift shadows
     const float highlights,     // user param: compress highlights
     const float clarity,        // user param: increase clarity/local contrast
-    const int use_sse2,         // switch on sse optimised version, if available
+    const int use_sse2,         // switch on sse (or avx2/avx-512, if the cpu has it) optimised version
     // the following is just needed for clipped roi with boundary conditions from coarse buffer (can be 0)
     local_laplacian_boundary_t *b);
 
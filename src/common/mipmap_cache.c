@@ -26,6 +26,7 @@
 #include "common/imageio.h"
 #include "common/imageio_jpeg.h"
 #include "common/imageio_module.h"
+#include "common/mipmap_pack.h"
 #include "control/conf.h"
 #include "control/jobs.h"
 #include "develop/imageop_math.h"
@@ -307,6 +308,22 @@ void *dt_mipmap_cache_alloc(dt_mipmap_buffer_t *buf, const dt_image_t *img)
   return dsc + 1;
 }
 
+static inline gboolean _ondisk_enabled(const dt_mipmap_cache_t *cache, const dt_mipmap_size_t mip)
+{
+  return cache->cachedir[0] && ((dt_conf_get_bool("cache_disk_backend") && mip < DT_MIPMAP_8)
+                                || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8));
+}
+
+static gboolean _ondisk_thumbnail_exists(const dt_mipmap_cache_t *cache, const uint32_t imgid,
+                                         const dt_mipmap_size_t mip)
+{
+  if(!cache->cachedir[0]) return FALSE;
+  if(cache->pack[mip]) return dt_mipmap_pack_contains(cache->pack[mip], imgid);
+  char filename[PATH_MAX] = {0};
+  snprintf(filename, sizeof(filename), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, imgid);
+  return g_file_test(filename, G_FILE_TEST_EXISTS);
+}
+
 // callback for the cache backend to initialize payload pointers
 void dt_mipmap_cache_allocate_dynamic(void *data, dt_cache_entry_t *entry)
 {
@@ -369,8 +386,20 @@ void dt_mipmap_cache_allocate_dynamic(void *data, dt_cache_entry_t *entry)
   int loaded_from_disk = 0;
   if(mip < DT_MIPMAP_F)
   {
-    if(cache->cachedir[0] && ((dt_conf_get_bool("cache_disk_backend") && mip < DT_MIPMAP_8)
-                              || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8)))
+    if(_ondisk_enabled(cache, mip) && cache->pack[mip])
+    {
+      dt_colorspaces_color_profile_type_t color_space;
+      if(!dt_mipmap_pack_read(cache->pack[mip], get_imgid(entry->key), (uint8_t *)(dsc + 1),
+                              dsc->size - sizeof(*dsc), &dsc->width, &dsc->height, &color_space))
+      {
+        dt_print(DT_DEBUG_CACHE, "[mipmap_cache] grab mip %d for image %" PRIu32 " from disk pack\n", mip,
+                 get_imgid(entry->key));
+        dsc->iscale = 1.0f;
+        dsc->color_space = color_space;
+        loaded_from_disk = 1;
+      }
+    }
+    else if(_ondisk_enabled(cache, mip))
     {
       // try and load from disk, if successful set flag
       char filename[PATH_MAX] = {0};
@@ -443,6 +472,72 @@ static void dt_mipmap_cache_unlink_ondisk_thumbnail(void *data, uint32_t imgid,
     char filename[PATH_MAX] = { 0 };
     snprintf(filename, sizeof(filename), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, imgid);
     g_unlink(filename);
+    if(cache->pack[mip]) dt_mipmap_pack_remove(cache->pack[mip], imgid);
+  }
+}
+
+// writes the thumbnail to the disk cache, unless it is disabled or the file exists already.
+static void _write_ondisk_thumbnail(dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t mip,
+                                    const struct dt_mipmap_buffer_dsc *dsc)
+{
+  if(!_ondisk_enabled(cache, mip)) return;
+
+  if(cache->pack[mip])
+  {
+    const int quality = cache->pack_uncompressed ? 0 : MIN(100, MAX(10, dt_conf_get_int("database_cache_quality")));
+    dt_mipmap_pack_write(cache->pack[mip], imgid, (const uint8_t *)(dsc + 1), dsc->width, dsc->height,
+                         dsc->color_space, quality);
+    return;
+  }
+
+  // serialize to disk
+  char filename[PATH_MAX] = {0};
+  snprintf(filename, sizeof(filename), "%s.d/%d", cache->cachedir, mip);
+  const int mkd = g_mkdir_with_parents(filename, 0750);
+  if(!mkd)
+  {
+    snprintf(filename, sizeof(filename), "%s.d/%d/%" PRIu32 ".jpg", cache->cachedir, (int)mip, imgid);
+    // Don't write existing files as both performance and quality (lossy jpg) suffer
+    FILE *f = NULL;
+    if (!g_file_test(filename, G_FILE_TEST_EXISTS) && (f = g_fopen(filename, "wb")))
+    {
+      // first check the disk isn't full
+      struct statvfs vfsbuf;
+      if (!statvfs(filename, &vfsbuf))
+      {
+        const int64_t free_mb = ((vfsbuf.f_frsize * vfsbuf.f_bavail) >> 20);
+        if (free_mb < 100)
+        {
+          fprintf(stderr, "Aborting image write as only %" PRId64 " MB free to write %s\n", free_mb, filename);
+          goto write_error;
+        }
+      }
+      else
+      {
+        fprintf(stderr, "Aborting image write since couldn't determine free space available to write %s\n", filename);
+        goto write_error;
+      }
+
+      const int cache_quality = dt_conf_get_int("database_cache_quality");
+      const uint8_t *exif = NULL;
+      int exif_len = 0;
+      if(dsc->color_space == DT_COLORSPACE_SRGB)
+      {
+        exif = dt_mipmap_cache_exif_data_srgb;
+        exif_len = dt_mipmap_cache_exif_data_srgb_length;
+      }
+      else if(dsc->color_space == DT_COLORSPACE_ADOBERGB)
+      {
+        exif = dt_mipmap_cache_exif_data_adobergb;
+        exif_len = dt_mipmap_cache_exif_data_adobergb_length;
+      }
+      if(dt_imageio_jpeg_write(filename, (const uint8_t *)(dsc + 1), dsc->width, dsc->height, MIN(100, MAX(10, cache_quality)), exif, exif_len))
+      {
+write_error:
+        g_unlink(filename);
+      }
+    }
+    if(f) fclose(f);
   }
 }
 
@@ -460,59 +555,9 @@ void dt_mipmap_cache_deallocate_dynamic(void *data, dt_cache_entry_t *entry)
       {
         dt_mipmap_cache_unlink_ondisk_thumbnail(data, get_imgid(entry->key), mip);
       }
-      else if(cache->cachedir[0] && ((dt_conf_get_bool("cache_disk_backend") && mip < DT_MIPMAP_8)
-                                     || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8)))
+      else
       {
-        // serialize to disk
-        char filename[PATH_MAX] = {0};
-        snprintf(filename, sizeof(filename), "%s.d/%d", cache->cachedir, mip);
-        const int mkd = g_mkdir_with_parents(filename, 0750);
-        if(!mkd)
-        {
-          snprintf(filename, sizeof(filename), "%s.d/%d/%" PRIu32 ".jpg", cache->cachedir, (int)mip,
-                   get_imgid(entry->key));
-          // Don't write existing files as both performance and quality (lossy jpg) suffer
-          FILE *f = NULL;
-          if (!g_file_test(filename, G_FILE_TEST_EXISTS) && (f = g_fopen(filename, "wb")))
-          {
-            // first check the disk isn't full
-            struct statvfs vfsbuf;
-            if (!statvfs(filename, &vfsbuf))
-            {
-              const int64_t free_mb = ((vfsbuf.f_frsize * vfsbuf.f_bavail) >> 20);
-              if (free_mb < 100)
-              {
-                fprintf(stderr, "Aborting image write as only %" PRId64 " MB free to write %s\n", free_mb, filename);
-                goto write_error;
-              }
-            }
-            else
-            {
-              fprintf(stderr, "Aborting image write since couldn't determine free space available to write %s\n", filename);
-              goto write_error;
-            }
-
-            const int cache_quality = dt_conf_get_int("database_cache_quality");
-            const uint8_t *exif = NULL;
-            int exif_len = 0;
-            if(dsc->color_space == DT_COLORSPACE_SRGB)
-            {
-              exif = dt_mipmap_cache_exif_data_srgb;
-              exif_len = dt_mipmap_cache_exif_data_srgb_length;
-            }
-            else if(dsc->color_space == DT_COLORSPACE_ADOBERGB)
-            {
-              exif = dt_mipmap_cache_exif_data_adobergb;
-              exif_len = dt_mipmap_cache_exif_data_adobergb_length;
-            }
-            if(dt_imageio_jpeg_write(filename, entry->data + sizeof(*dsc), dsc->width, dsc->height, MIN(100, MAX(10, cache_quality)), exif, exif_len))
-            {
-write_error:
-              g_unlink(filename);
-            }
-          }
-          if(f) fclose(f);
-        }
+        _write_ondisk_thumbnail(cache, get_imgid(entry->key), mip, dsc);
       }
     }
   }
@@ -529,6 +574,17 @@ static uint32_t nearest_power_of_two(const uint32_t value)
 void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
 {
   dt_mipmap_cache_get_filename(cache->cachedir, sizeof(cache->cachedir));
+  // thumbnails in a few pack files instead of a jpeg file each
+  gchar *storage = dt_conf_get_string("cache_disk_backend_storage");
+  const gboolean packed = cache->cachedir[0] && g_strcmp0(storage, "jpeg files");
+  cache->pack_uncompressed = !g_strcmp0(storage, "uncompressed pack");
+  g_free(storage);
+  for(int k = DT_MIPMAP_0; k < DT_MIPMAP_F; k++)
+  {
+    char dirname[PATH_MAX] = { 0 };
+    snprintf(dirname, sizeof(dirname), "%s.d/%d", cache->cachedir, k);
+    cache->pack[k] = packed ? dt_mipmap_pack_open(dirname) : NULL;
+  }
   // make sure static memory is initialized
   struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)dt_mipmap_cache_static_dead_image;
   dead_image_f((dt_mipmap_buffer_t *)(dsc + 1));
@@ -584,6 +640,8 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
   cache->mip_full.stats_standin = 0;
 
   dt_cache_init(&cache->mip_thumbs.cache, 0, max_mem);
+  // lots of small entries which are hit over and over while scrolling, don't reorder the lru on every hit
+  dt_cache_set_eviction(&cache->mip_thumbs.cache, DT_CACHE_EVICT_CLOCK);
   dt_cache_set_allocate_callback(&cache->mip_thumbs.cache, dt_mipmap_cache_allocate_dynamic, cache);
   dt_cache_set_cleanup_callback(&cache->mip_thumbs.cache, dt_mipmap_cache_deallocate_dynamic, cache);
 
@@ -611,6 +669,12 @@ void dt_mipmap_cache_cleanup(dt_mipmap_cache_t *cache)
   dt_cache_cleanup(&cache->mip_thumbs.cache);
   dt_cache_cleanup(&cache->mip_full.cache);
   dt_cache_cleanup(&cache->mip_f.cache);
+  // after the caches, these have written their thumbnails on cleanup
+  for(int k = DT_MIPMAP_0; k < DT_MIPMAP_F; k++)
+  {
+    dt_mipmap_pack_close(cache->pack[k]);
+    cache->pack[k] = NULL;
+  }
 }
 
 void dt_mipmap_cache_print(dt_mipmap_cache_t *cache)
@@ -625,6 +689,9 @@ void dt_mipmap_cache_print(dt_mipmap_cache_t *cache)
   printf("[mipmap_cache] full  fill %"PRIu32"/%"PRIu32" slots (%.2f%%)\n",
          (uint32_t)cache->mip_full.cache.cost, (uint32_t)cache->mip_full.cache.cost_quota,
          100.0f * (float)cache->mip_full.cache.cost / (float)cache->mip_full.cache.cost_quota);
+  printf("[mipmap_cache] lock contention thumbs %" PRIu64 ", float %" PRIu64 ", full %" PRIu64 "\n",
+         dt_cache_contention(&cache->mip_thumbs.cache), dt_cache_contention(&cache->mip_f.cache),
+         dt_cache_contention(&cache->mip_full.cache));
 
   uint64_t sum = 0;
   uint64_t sum_fetches = 0;
@@ -679,6 +746,52 @@ static dt_mipmap_cache_one_t *_get_cache(dt_mipmap_cache_t *cache, const dt_mipm
   }
 }
 
+// fills all smaller thumbnails of the image which are not cached yet from the freshly generated level mip, each
+// downscaled from the next larger one, and writes them to the disk cache right away. this saves a run of the
+// pixelpipe per level when browsing new images at different sizes.
+static void _init_smaller_mips(dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t mip,
+                               const struct dt_mipmap_buffer_dsc *dsc)
+{
+  _write_ondisk_thumbnail(cache, imgid, mip, dsc);
+
+  const struct dt_mipmap_buffer_dsc *src = dsc;
+  dt_cache_entry_t *src_entry = NULL;
+  // locks are always taken from larger to smaller levels, as _init_8 does (non-blocking) the other way round
+  for(int k = (int)mip - 1; k >= DT_MIPMAP_0; k--)
+  {
+    dt_cache_entry_t *entry = dt_cache_get(&_get_cache(cache, k)->cache, get_key(imgid, k), 'w');
+    ASAN_UNPOISON_MEMORY_REGION(entry->data, dt_mipmap_buffer_dsc_size);
+    struct dt_mipmap_buffer_dsc *out = (struct dt_mipmap_buffer_dsc *)entry->data;
+    if(out->flags & DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE)
+    {
+      ASAN_UNPOISON_MEMORY_REGION(out + 1, out->size - sizeof(struct dt_mipmap_buffer_dsc));
+      dt_print(DT_DEBUG_CACHE, "[mipmap_cache] generate mip %d for image %d from level %d\n", k, imgid, mip);
+      dt_iop_flip_and_zoom_8((const uint8_t *)(src + 1), src->width, src->height, (uint8_t *)(out + 1),
+                             cache->max_width[k], cache->max_height[k], ORIENTATION_NONE, &out->width,
+                             &out->height);
+      out->iscale = 1.0f;
+      out->color_space = src->color_space;
+      out->flags &= ~DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE;
+      _write_ondisk_thumbnail(cache, imgid, k, out);
+    }
+    if(src_entry) dt_cache_release(&_get_cache(cache, k + 1)->cache, src_entry);
+
+    // continue downscaling from this level, stop at a broken one
+    if(out->width > 8 && out->height > 8)
+    {
+      src_entry = entry;
+      src = out;
+    }
+    else
+    {
+      dt_cache_release(&_get_cache(cache, k)->cache, entry);
+      src_entry = NULL;
+      break;
+    }
+  }
+  if(src_entry) dt_cache_release(&_get_cache(cache, DT_MIPMAP_0)->cache, src_entry);
+}
+
 void dt_mipmap_cache_get_with_caller(
     dt_mipmap_cache_t *cache,
     dt_mipmap_buffer_t *buf,
@@ -733,12 +846,10 @@ void dt_mipmap_cache_get_with_caller(
   {
     // only prefetch if the disk cache exists:
     if(!cache->cachedir[0]) return;
-    if(mip > DT_MIPMAP_FULL || (int)mip < DT_MIPMAP_0)
+    if(mip >= DT_MIPMAP_F || (int)mip < DT_MIPMAP_0)
       return; // remove the (int) once we no longer have to support gcc < 4.8 :/
-    char filename[PATH_MAX] = {0};
-    snprintf(filename, sizeof(filename), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, key);
     // don't attempt to load if disk cache doesn't exist
-    if(!g_file_test(filename, G_FILE_TEST_EXISTS)) return;
+    if(!_ondisk_thumbnail_exists(cache, imgid, mip)) return;
     dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, dt_image_load_job_create(imgid, mip));
   }
   else if(flags == DT_MIPMAP_BLOCKING)
@@ -854,6 +965,9 @@ void dt_mipmap_cache_get_with_caller(
     }
 #endif
 
+    if(mipmap_generated && mip < DT_MIPMAP_F && mode == 'r' && dsc->width > 8 && dsc->height > 8)
+      _init_smaller_mips(cache, imgid, mip, dsc);
+
     if(mipmap_generated)
     {
       /* raise signal that mipmaps has been flushed to cache */
@@ -918,13 +1032,8 @@ void dt_mipmap_cache_get_with_caller(
     __sync_fetch_and_add(&(_get_cache(cache, mip)->stats_misses), 1);
     // in case we don't even have a disk cache for our requested thumbnail,
     // prefetch at least mip0, in case we have that in the disk caches:
-    if(cache->cachedir[0])
-    {
-      char filename[PATH_MAX] = {0};
-      snprintf(filename, sizeof(filename), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, key);
-      if(g_file_test(filename, G_FILE_TEST_EXISTS))
-        dt_mipmap_cache_get(cache, 0, imgid, DT_MIPMAP_0, DT_MIPMAP_PREFETCH_DISK, 0);
-    }
+    if(mip < DT_MIPMAP_F && _ondisk_thumbnail_exists(cache, imgid, mip))
+      dt_mipmap_cache_get(cache, 0, imgid, DT_MIPMAP_0, DT_MIPMAP_PREFETCH_DISK, 0);
     // nothing found :(
     buf->buf = NULL;
     buf->imgid = 0;
@@ -977,6 +1086,12 @@ dt_mipmap_size_t dt_mipmap_cache_get_matching_size(const dt_mipmap_cache_t *cach
   return best;
 }
 
+gboolean dt_mipmap_cache_is_on_disk(const dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t mip)
+{
+  if(mip >= DT_MIPMAP_F || (int)mip < DT_MIPMAP_0) return FALSE;
+  return _ondisk_thumbnail_exists(cache, imgid, mip);
+}
+
 void dt_mipmap_cache_remove(dt_mipmap_cache_t *cache, const uint32_t imgid)
 {
   // get rid of all ldr thumbnails:
@@ -1288,7 +1403,6 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
   }
 
   // TODO: various speed optimizations:
-  // TODO: also init all smaller mips!
   // TODO: use mipf, but:
   // TODO: if output is cropped, don't use mipf!
 }
@@ -1306,6 +1420,12 @@ void dt_mipmap_cache_copy_thumbnails(const dt_mipmap_cache_t *cache, const uint3
   {
     for(dt_mipmap_size_t mip = DT_MIPMAP_0; mip < DT_MIPMAP_F; mip++)
     {
+      if(cache->pack[mip])
+      {
+        // the copy shares the data in the pack
+        dt_mipmap_pack_copy(cache->pack[mip], dst_imgid, src_imgid);
+        continue;
+      }
       // try and load from disk, if successful set flag
       char srcpath[PATH_MAX] = {0};
       char dstpath[PATH_MAX] = {0};
@@ -99,6 +99,9 @@ typedef struct dt_mipmap_cache_t
   dt_mipmap_cache_one_t mip_f;
   dt_mipmap_cache_one_t mip_full;
   char cachedir[PATH_MAX]; // cached sha1sum filename for faster access
+  // packed disk backend per thumbnail level, NULL when using a jpeg file per thumbnail
+  struct dt_mipmap_pack_t *pack[DT_MIPMAP_F];
+  gboolean pack_uncompressed;
 } dt_mipmap_cache_t;
 
 // dynamic memory allocation interface for imageio backend: a write locked
@@ -157,6 +160,9 @@ dt_mipmap_size_t dt_mipmap_cache_get_matching_size(
     const int32_t width,
     const int32_t height);
 
+// true if the thumbnail can be read back from the disk cache instead of being generated
+gboolean dt_mipmap_cache_is_on_disk(const dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t mip);
+
 // returns the colorspace to use for created thumbnails, takes config into account
 dt_colorspaces_color_profile_type_t dt_mipmap_cache_get_colorspace();
 
@@ -0,0 +1,347 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/mipmap_pack.h"
+#include "common/darktable.h"
+#include "common/imageio_jpeg.h"
+
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DT_MIPMAP_PACK_MAGIC "dtmpack2"
+
+// don't bother compacting packs with less garbage than this
+#define DT_MIPMAP_PACK_COMPACT_MIN ((uint64_t)64 << 20)
+// first length of a new pack file
+#define DT_MIPMAP_PACK_CAPACITY_MIN ((uint64_t)1 << 20)
+
+typedef struct _index_header_t
+{
+  char magic[8];
+  uint32_t record_size;
+  uint32_t reserved;
+} _index_header_t;
+
+// makes room for size more bytes in the pack file
+static int _reserve(dt_mipmap_pack_t *pack, const uint64_t size)
+{
+  if(pack->size + size <= pack->capacity) return 0;
+  const uint64_t capacity = MAX(MAX(2 * pack->capacity, pack->size + size), DT_MIPMAP_PACK_CAPACITY_MIN);
+  if(ftruncate(fileno(pack->pack), capacity)) return 1;
+  pack->capacity = capacity;
+  return 0;
+}
+
+static int _append_record(dt_mipmap_pack_t *pack, const dt_mipmap_pack_record_t *rec)
+{
+  if(fwrite(rec, sizeof(dt_mipmap_pack_record_t), 1, pack->index) != 1 || fflush(pack->index)) return 1;
+
+  if(rec->format == DT_MIPMAP_PACK_REMOVED)
+    g_hash_table_remove(pack->records, GUINT_TO_POINTER(rec->imgid));
+  else
+    g_hash_table_insert(pack->records, GUINT_TO_POINTER(rec->imgid), g_memdup(rec, sizeof(*rec)));
+  return 0;
+}
+
+static FILE *_create_index(const char *filename)
+{
+  FILE *f = g_fopen(filename, "wb");
+  if(!f) return NULL;
+  _index_header_t header = { .record_size = sizeof(dt_mipmap_pack_record_t) };
+  memcpy(header.magic, DT_MIPMAP_PACK_MAGIC, sizeof(header.magic));
+  if(fwrite(&header, sizeof(header), 1, f) != 1)
+  {
+    fclose(f);
+    return NULL;
+  }
+  return f;
+}
+
+// reads the index into pack->records, dropping records that point beyond the end of the pack (after a crash).
+// the used size of the pack is where the last thumbnail ends.
+static void _load_index(dt_mipmap_pack_t *pack)
+{
+  pack->size = 0;
+  GMappedFile *map = g_mapped_file_new(pack->indexname, FALSE, NULL);
+  if(!map) return;
+  const size_t length = g_mapped_file_get_length(map);
+  const char *contents = g_mapped_file_get_contents(map);
+  const _index_header_t *header = (const _index_header_t *)contents;
+  if(length >= sizeof(_index_header_t) && !memcmp(header->magic, DT_MIPMAP_PACK_MAGIC, sizeof(header->magic))
+     && header->record_size == sizeof(dt_mipmap_pack_record_t))
+  {
+    const size_t count = (length - sizeof(_index_header_t)) / sizeof(dt_mipmap_pack_record_t);
+    const dt_mipmap_pack_record_t *recs = (const dt_mipmap_pack_record_t *)(contents + sizeof(_index_header_t));
+    for(size_t k = 0; k < count; k++)
+    {
+      if(recs[k].format == DT_MIPMAP_PACK_REMOVED || recs[k].offset + recs[k].size > pack->capacity)
+        g_hash_table_remove(pack->records, GUINT_TO_POINTER(recs[k].imgid));
+      else
+      {
+        g_hash_table_insert(pack->records, GUINT_TO_POINTER(recs[k].imgid),
+                            g_memdup(recs + k, sizeof(dt_mipmap_pack_record_t)));
+        pack->size = MAX(pack->size, recs[k].offset + recs[k].size);
+      }
+    }
+  }
+  g_mapped_file_unref(map);
+}
+
+// rewrites pack and index with the live thumbnails only
+static void _compact(dt_mipmap_pack_t *pack)
+{
+  GMappedFile *map = g_mapped_file_new(pack->packname, FALSE, NULL);
+  if(!map) return;
+  const char *contents = g_mapped_file_get_contents(map);
+
+  char packname[PATH_MAX] = { 0 }, indexname[PATH_MAX] = { 0 };
+  snprintf(packname, sizeof(packname), "%s.tmp", pack->packname);
+  snprintf(indexname, sizeof(indexname), "%s.tmp", pack->indexname);
+  FILE *p = g_fopen(packname, "wb");
+  FILE *i = _create_index(indexname);
+  int err = !p || !i;
+
+  uint64_t size = 0;
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, pack->records);
+  while(!err && g_hash_table_iter_next(&iter, &key, &value))
+  {
+    dt_mipmap_pack_record_t *rec = (dt_mipmap_pack_record_t *)value;
+    err = fwrite(contents + rec->offset, 1, rec->size, p) != rec->size;
+    rec->offset = size;
+    size += rec->size;
+    err = err || fwrite(rec, sizeof(dt_mipmap_pack_record_t), 1, i) != 1;
+  }
+  if(p) err = fclose(p) || err;
+  if(i) err = fclose(i) || err;
+  g_mapped_file_unref(map);
+
+  if(err || g_rename(packname, pack->packname) || g_rename(indexname, pack->indexname))
+  {
+    // start over, the offsets in the table might be wrong now
+    fprintf(stderr, "[mipmap_pack] failed to compact `%s', removing it\n", pack->packname);
+    g_unlink(packname);
+    g_unlink(indexname);
+    g_unlink(pack->packname);
+    g_unlink(pack->indexname);
+    g_hash_table_remove_all(pack->records);
+    size = 0;
+  }
+  dt_print(DT_DEBUG_CACHE, "[mipmap_pack] compacted `%s' from %" PRIu64 " to %" PRIu64 " bytes\n",
+           pack->packname, pack->size, size);
+  pack->size = pack->capacity = size;
+}
+
+dt_mipmap_pack_t *dt_mipmap_pack_open(const char *dir)
+{
+  if(g_mkdir_with_parents(dir, 0750)) return NULL;
+
+  dt_mipmap_pack_t *pack = (dt_mipmap_pack_t *)calloc(1, sizeof(dt_mipmap_pack_t));
+  snprintf(pack->packname, sizeof(pack->packname), "%s/thumbs.pack", dir);
+  snprintf(pack->indexname, sizeof(pack->indexname), "%s/thumbs.idx", dir);
+  pack->records = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+
+  GStatBuf st;
+  if(!g_stat(pack->packname, &st)) pack->capacity = st.st_size;
+  _load_index(pack);
+
+  uint64_t live = 0;
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, pack->records);
+  while(g_hash_table_iter_next(&iter, &key, &value)) live += ((dt_mipmap_pack_record_t *)value)->size;
+  // shared thumbnails of duplicates are counted twice, so this may underestimate the garbage
+  if(pack->size > live && pack->size - live > MAX(live, DT_MIPMAP_PACK_COMPACT_MIN)) _compact(pack);
+
+  if(g_file_test(pack->indexname, G_FILE_TEST_EXISTS) && pack->size > 0)
+    pack->index = g_fopen(pack->indexname, "ab");
+  else
+  {
+    // nothing usable, start with fresh files
+    g_hash_table_remove_all(pack->records);
+    pack->size = pack->capacity = 0;
+    g_unlink(pack->packname);
+    pack->index = _create_index(pack->indexname);
+  }
+  pack->pack = g_fopen(pack->packname, "r+b");
+  if(!pack->pack) pack->pack = g_fopen(pack->packname, "w+b");
+
+  if(!pack->pack || !pack->index)
+  {
+    fprintf(stderr, "[mipmap_pack] could not open `%s'\n", pack->packname);
+    if(pack->pack) fclose(pack->pack);
+    if(pack->index) fclose(pack->index);
+    g_hash_table_destroy(pack->records);
+    free(pack);
+    return NULL;
+  }
+
+  dt_pthread_mutex_init(&pack->lock, NULL);
+  dt_print(DT_DEBUG_CACHE, "[mipmap_pack] opened `%s' with %u thumbnails in %" PRIu64 " of %" PRIu64 " bytes\n",
+           pack->packname, g_hash_table_size(pack->records), pack->size, pack->capacity);
+  return pack;
+}
+
+void dt_mipmap_pack_close(dt_mipmap_pack_t *pack)
+{
+  if(!pack) return;
+  fclose(pack->pack);
+  fclose(pack->index);
+  if(pack->map) g_mapped_file_unref(pack->map);
+  g_hash_table_destroy(pack->records);
+  dt_pthread_mutex_destroy(&pack->lock);
+  free(pack);
+}
+
+gboolean dt_mipmap_pack_contains(dt_mipmap_pack_t *pack, const uint32_t imgid)
+{
+  dt_pthread_mutex_lock(&pack->lock);
+  const gboolean found = g_hash_table_contains(pack->records, GUINT_TO_POINTER(imgid));
+  dt_pthread_mutex_unlock(&pack->lock);
+  return found;
+}
+
+int dt_mipmap_pack_read(dt_mipmap_pack_t *pack, const uint32_t imgid, uint8_t *out, const size_t out_size,
+                        uint32_t *width, uint32_t *height, dt_colorspaces_color_profile_type_t *color_space)
+{
+  dt_pthread_mutex_lock(&pack->lock);
+  const dt_mipmap_pack_record_t *found
+      = (dt_mipmap_pack_record_t *)g_hash_table_lookup(pack->records, GUINT_TO_POINTER(imgid));
+  if(!found)
+  {
+    dt_pthread_mutex_unlock(&pack->lock);
+    return 1;
+  }
+  const dt_mipmap_pack_record_t rec = *found;
+  if(!pack->map || g_mapped_file_get_length(pack->map) < rec.offset + rec.size)
+  {
+    // the pack grew since it was mapped
+    if(pack->map) g_mapped_file_unref(pack->map);
+    pack->map = g_mapped_file_new(pack->packname, FALSE, NULL);
+  }
+  GMappedFile *map = pack->map ? g_mapped_file_ref(pack->map) : NULL;
+  dt_pthread_mutex_unlock(&pack->lock);
+
+  if(!map) return 1;
+  int err = (size_t)rec.width * rec.height * 4 > out_size || g_mapped_file_get_length(map) < rec.offset + rec.size;
+  const uint8_t *data = (const uint8_t *)g_mapped_file_get_contents(map) + rec.offset;
+  if(!err && rec.format == DT_MIPMAP_PACK_RAW)
+  {
+    err = rec.size != (uint64_t)rec.width * rec.height * 4;
+    if(!err) memcpy(out, data, rec.size);
+  }
+  else if(!err && rec.format == DT_MIPMAP_PACK_JPEG)
+  {
+    dt_imageio_jpeg_t jpg;
+    err = dt_imageio_jpeg_decompress_header(data, rec.size, &jpg) || jpg.width != rec.width
+          || jpg.height != rec.height || dt_imageio_jpeg_decompress(&jpg, out);
+  }
+  else
+    err = 1;
+  g_mapped_file_unref(map);
+
+  if(err) return 1;
+  *width = rec.width;
+  *height = rec.height;
+  *color_space = rec.color_space;
+  return 0;
+}
+
+int dt_mipmap_pack_write(dt_mipmap_pack_t *pack, const uint32_t imgid, const uint8_t *in, const uint32_t width,
+                         const uint32_t height, const dt_colorspaces_color_profile_type_t color_space,
+                         const int quality)
+{
+  dt_pthread_mutex_lock(&pack->lock);
+  const dt_mipmap_pack_record_t *found
+      = (dt_mipmap_pack_record_t *)g_hash_table_lookup(pack->records, GUINT_TO_POINTER(imgid));
+  // like the jpeg files, don't write thumbnails which are there already
+  const gboolean uptodate = found && found->width == width && found->height == height;
+  dt_pthread_mutex_unlock(&pack->lock);
+  if(uptodate) return 0;
+
+  uint8_t *blob = NULL;
+  const uint8_t *data = in;
+  size_t size = (size_t)width * height * 4;
+  if(quality > 0)
+  {
+    blob = dt_alloc_align(64, size);
+    // returns 1 on errors, which is no valid jpeg size either
+    const int length = blob ? dt_imageio_jpeg_compress(in, blob, width, height, quality) : 0;
+    if(length <= 1)
+    {
+      dt_free_align(blob);
+      return 1;
+    }
+    data = blob;
+    size = length;
+  }
+
+  dt_mipmap_pack_record_t rec = { .imgid = imgid,
+                                  .format = quality > 0 ? DT_MIPMAP_PACK_JPEG : DT_MIPMAP_PACK_RAW,
+                                  .size = size,
+                                  .width = width,
+                                  .height = height,
+                                  .color_space = color_space };
+  dt_pthread_mutex_lock(&pack->lock);
+  rec.offset = pack->size;
+  // on errors the next thumbnail simply overwrites whatever made it into the file
+  int err = _reserve(pack, size) || fseeko(pack->pack, rec.offset, SEEK_SET)
+            || fwrite(data, 1, size, pack->pack) != size || fflush(pack->pack);
+  if(!err)
+  {
+    pack->size += size;
+    err = _append_record(pack, &rec);
+  }
+  dt_pthread_mutex_unlock(&pack->lock);
+  dt_free_align(blob);
+  if(err) fprintf(stderr, "[mipmap_pack] failed to write thumbnail of image %" PRIu32 " to `%s'\n", imgid,
+                  pack->packname);
+  return err;
+}
+
+void dt_mipmap_pack_remove(dt_mipmap_pack_t *pack, const uint32_t imgid)
+{
+  dt_pthread_mutex_lock(&pack->lock);
+  if(g_hash_table_contains(pack->records, GUINT_TO_POINTER(imgid)))
+  {
+    const dt_mipmap_pack_record_t rec = { .imgid = imgid, .format = DT_MIPMAP_PACK_REMOVED };
+    _append_record(pack, &rec);
+  }
+  dt_pthread_mutex_unlock(&pack->lock);
+}
+
+void dt_mipmap_pack_copy(dt_mipmap_pack_t *pack, const uint32_t dst_imgid, const uint32_t src_imgid)
+{
+  dt_pthread_mutex_lock(&pack->lock);
+  const dt_mipmap_pack_record_t *found
+      = (dt_mipmap_pack_record_t *)g_hash_table_lookup(pack->records, GUINT_TO_POINTER(src_imgid));
+  if(found)
+  {
+    dt_mipmap_pack_record_t rec = *found;
+    rec.imgid = dst_imgid;
+    _append_record(pack, &rec);
+  }
+  dt_pthread_mutex_unlock(&pack->lock);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,96 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/colorspaces.h"
+#include "common/dtpthread.h"
+
+#include <glib.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+
+/**
+ * packed disk backend for the thumbnail cache: instead of one jpeg file per image and mip level, all
+ * thumbnails of one level are appended to a single pack file, which is read back through a memory mapping.
+ * an append-only index file next to it records (imgid, offset, size) of every thumbnail. like the jpeg files,
+ * thumbnails are invalidated by dt_mipmap_cache_remove() when the image changes. removing or replacing a
+ * thumbnail only appends a new index record, the space is reclaimed by compacting the pack when it is opened
+ * and more than half of it is unused.
+ */
+
+typedef enum dt_mipmap_pack_format_t
+{
+  DT_MIPMAP_PACK_REMOVED = 0, // index record marking a removed thumbnail
+  DT_MIPMAP_PACK_RAW = 1,     // uncompressed 8-bit rgba
+  DT_MIPMAP_PACK_JPEG = 2
+} dt_mipmap_pack_format_t;
+
+typedef struct dt_mipmap_pack_record_t
+{
+  uint32_t imgid;
+  uint32_t format;
+  uint64_t offset;
+  uint64_t size;
+  uint32_t width, height;
+  int32_t color_space;
+  uint32_t reserved;
+} dt_mipmap_pack_record_t;
+
+typedef struct dt_mipmap_pack_t
+{
+  dt_pthread_mutex_t lock;
+  char packname[PATH_MAX];
+  char indexname[PATH_MAX];
+  // the index is opened for appending, the pack for writing at its size
+  FILE *pack, *index;
+  // bytes used in the pack file
+  uint64_t size;
+  // length of the pack file, grown by doubling so that the mapping has to be replaced only a few times
+  uint64_t capacity;
+  // imgid -> dt_mipmap_pack_record_t
+  GHashTable *records;
+  // mapping of the pack, replaced by a larger one when reading beyond its end
+  GMappedFile *map;
+} dt_mipmap_pack_t;
+
+/** opens (or creates) the pack in directory dir, returns NULL on failure. */
+dt_mipmap_pack_t *dt_mipmap_pack_open(const char *dir);
+void dt_mipmap_pack_close(dt_mipmap_pack_t *pack);
+
+/** true if the pack holds a thumbnail of the image. */
+gboolean dt_mipmap_pack_contains(dt_mipmap_pack_t *pack, const uint32_t imgid);
+
+/** reads the thumbnail as rgba into out (of out_size bytes). returns 0 on success. */
+int dt_mipmap_pack_read(dt_mipmap_pack_t *pack, const uint32_t imgid, uint8_t *out, const size_t out_size,
+                        uint32_t *width, uint32_t *height, dt_colorspaces_color_profile_type_t *color_space);
+
+/** appends the thumbnail unless the pack has one already. quality > 0 stores it as jpeg, else raw. */
+int dt_mipmap_pack_write(dt_mipmap_pack_t *pack, const uint32_t imgid, const uint8_t *in, const uint32_t width,
+                         const uint32_t height, const dt_colorspaces_color_profile_type_t color_space,
+                         const int quality);
+
+void dt_mipmap_pack_remove(dt_mipmap_pack_t *pack, const uint32_t imgid);
+
+/** lets dst_imgid share the thumbnail of src_imgid. */
+void dt_mipmap_pack_copy(dt_mipmap_pack_t *pack, const uint32_t dst_imgid, const uint32_t src_imgid);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
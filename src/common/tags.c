@@ -159,18 +159,17 @@ gboolean dt_tag_new(const char *name, guint *tagid)
 
   if(!name || name[0] == '\0') return FALSE; // no tagid name.
 
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT id FROM data.tags WHERE name = ?1", -1, &stmt,
-                              NULL);
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db, "SELECT id FROM data.tags WHERE name = ?1", &stmt);
   DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, name, -1, SQLITE_TRANSIENT);
   rt = sqlite3_step(stmt);
   if(rt == SQLITE_ROW)
   {
     // tagid already exists.
     if(tagid != NULL) *tagid = sqlite3_column_int64(stmt, 0);
-    sqlite3_finalize(stmt);
+    dt_database_release_cached(darktable.db, stmt);
     return TRUE;
   }
-  sqlite3_finalize(stmt);
+  dt_database_release_cached(darktable.db, stmt);
 
   if(g_strstr_len(name, -1, "darktable|") == name)
   {
@@ -992,15 +991,15 @@ gboolean dt_is_tag_attached(const guint tagid, const gint imgid)
 {
   sqlite3_stmt *stmt;
 
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT imgid"
-                              " FROM main.tagged_images"
-                              " WHERE imgid = ?1 AND tagid = ?2", -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db,
+                                  "SELECT imgid"
+                                  " FROM main.tagged_images"
+                                  " WHERE imgid = ?1 AND tagid = ?2", &stmt);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, tagid);
 
   const gboolean ret = (sqlite3_step(stmt) == SQLITE_ROW);
-  sqlite3_finalize(stmt);
+  dt_database_release_cached(darktable.db, stmt);
   return ret;
 }
 
@@ -210,6 +210,14 @@ typedef struct dt_control_t
   GList *queues[DT_JOB_QUEUE_MAX];
   size_t queue_length[DT_JOB_QUEUE_MAX];
 
+  dt_control_scheduler_t scheduler;
+  // state of the work stealing scheduler, private to jobs.c
+  struct dt_control_ws_t *ws;
+
+  dt_pthread_mutex_t stats_mutex;
+  dt_control_queue_stats_t stats[DT_JOB_QUEUE_MAX];
+  double stats_start;
+
   dt_pthread_mutex_t res_mutex;
   dt_job_t *job_res[DT_CTL_WORKER_RESERVED];
   uint8_t new_res[DT_CTL_WORKER_RESERVED];
@@ -24,9 +24,14 @@
 
 #include "common/darktable.h"
 #include "common/database.h"
+#include "common/debug.h"
+#include "common/file_location.h"
+#include "common/grealpath.h"
 #include "common/history.h"
 #include "common/image.h"
+#include "common/image_cache.h"
 #include "control/conf.h"
+#include "control/control.h"
 #include "crawler.h"
 #include "gui/gtk.h"
 #ifdef GDK_WINDOWING_QUARTZ
@@ -53,144 +58,357 @@ typedef struct dt_control_crawler_result_t
   char *image_path, *xmp_path;
 } dt_control_crawler_result_t;
 
+// number of threads checking folders, this is bound by the file system latency more than by the cpu
+#define DT_CRAWLER_THREADS 8
+// minimum time between two updates of the list of found xmp files, in seconds
+#define DT_CRAWLER_REPORT_INTERVAL 1.0
 
-GList *dt_control_crawler_run()
+typedef struct _crawler_image_t
 {
-  sqlite3_stmt *stmt, *inner_stmt;
-  GList *result = NULL;
-  gboolean look_for_xmp = dt_conf_get_bool("write_sidecar_files");
+  int id, version, flags, new_flags;
+  time_t timestamp;
+  gchar *filename;
+} _crawler_image_t;
 
-  sqlite3_prepare_v2(dt_database_get(darktable.db),
-                     "SELECT i.id, write_timestamp, version, folder || '" G_DIR_SEPARATOR_S "' || filename, flags "
-                     "FROM main.images i, main.film_rolls f ON i.film_id = f.id ORDER BY f.id, filename",
-                     -1, &stmt, NULL);
-  sqlite3_prepare_v2(dt_database_get(darktable.db), "UPDATE main.images SET flags = ?1 WHERE id = ?2", -1,
-                     &inner_stmt, NULL);
-
-  // let's wrap this into a transaction, it might make it a little faster.
-  sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+typedef struct _crawler_folder_t
+{
+  gchar *path;
+  GList *images; // _crawler_image_t
+  // filled by the worker threads
+  gboolean checked; // FALSE if skipped or missing
+  gint64 mtime, size;
+  GList *results; // dt_control_crawler_result_t
+} _crawler_folder_t;
+
+// what we know about a folder from the last crawl: it had no updated xmp files as long as it is unchanged
+typedef struct _crawler_cache_t
+{
+  gint64 mtime, size;
+} _crawler_cache_t;
 
-  while(sqlite3_step(stmt) == SQLITE_ROW)
+typedef struct _crawler_t
+{
+  dt_job_t *job;
+  gboolean look_for_xmp;
+  // folder path -> _crawler_cache_t, read only while the threads run
+  GHashTable *cache;
+  // folders handled by the threads
+  GAsyncQueue *done;
+} _crawler_t;
+
+static void _crawler_folder_free(gpointer data)
+{
+  _crawler_folder_t *folder = (_crawler_folder_t *)data;
+  for(GList *l = folder->images; l; l = g_list_next(l))
   {
-    const int id = sqlite3_column_int(stmt, 0);
-    const time_t timestamp = sqlite3_column_int(stmt, 1);
-    const int version = sqlite3_column_int(stmt, 2);
-    const gchar *image_path = (char *)sqlite3_column_text(stmt, 3);
-    int flags = sqlite3_column_int(stmt, 4);
-
-    // if the image is missing we ignore it.
-    if(!g_file_test(image_path, G_FILE_TEST_EXISTS))
-    {
-      dt_print(DT_DEBUG_CONTROL, "[crawler] `%s' (id: %d) is missing.\n", image_path, id);
-      continue;
-    }
+    _crawler_image_t *image = (_crawler_image_t *)l->data;
+    g_free(image->filename);
+    free(image);
+  }
+  g_list_free(folder->images);
+  g_free(folder->path);
+  free(folder);
+}
+
+static void _crawler_result_free(gpointer data)
+{
+  dt_control_crawler_result_t *item = (dt_control_crawler_result_t *)data;
+  g_free(item->image_path);
+  g_free(item->xmp_path);
+  free(item);
+}
 
-    // no need to look for xmp files if none get written anyway.
-    if(look_for_xmp)
+// the folder cache lives next to the thumbnail cache, one per library
+static gchar *_crawler_cache_filename()
+{
+  const gchar *dbfilename = dt_database_get_path(darktable.db);
+  if(!strcmp(dbfilename, ":memory:")) return NULL;
+
+  gchar *abspath = g_realpath(dbfilename);
+  if(!abspath) abspath = g_strdup(dbfilename);
+  gchar *checksum = g_compute_checksum_for_string(G_CHECKSUM_SHA1, abspath, -1);
+  char cachedir[PATH_MAX] = { 0 };
+  dt_loc_get_user_cache_dir(cachedir, sizeof(cachedir));
+  gchar *filename = g_strdup_printf("%s/crawler-%s.cache", cachedir, checksum);
+  g_free(checksum);
+  g_free(abspath);
+  return filename;
+}
+
+// one line per folder: mtime, size and path, separated by tabs
+static GHashTable *_crawler_cache_load()
+{
+  GHashTable *cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free);
+  gchar *filename = _crawler_cache_filename();
+  gchar *contents = NULL;
+  if(filename && g_file_get_contents(filename, &contents, NULL, NULL))
+  {
+    gchar **lines = g_strsplit(contents, "\n", -1);
+    for(gchar **line = lines; *line; line++)
     {
-      // construct the xmp filename for this image
-      gchar xmp_path[PATH_MAX] = { 0 };
-      g_strlcpy(xmp_path, image_path, sizeof(xmp_path));
-      dt_image_path_append_version_no_db(version, xmp_path, sizeof(xmp_path));
-      size_t len = strlen(xmp_path);
-      if(len + 4 >= PATH_MAX) continue;
-      xmp_path[len++] = '.';
-      xmp_path[len++] = 'x';
-      xmp_path[len++] = 'm';
-      xmp_path[len++] = 'p';
-      xmp_path[len] = '\0';
-
-      struct stat statbuf;
-      // on Windows the encoding might not be UTF8
-      gchar *xmp_path_locale = g_locale_from_utf8(xmp_path, -1, NULL, NULL, NULL);
-      const int stat_res = stat(xmp_path, &statbuf);
-      g_free(xmp_path_locale);
-      if(stat_res == -1) continue; // TODO: shall we report these?
-
-      // step 1: check if the xmp is newer than our db entry
-      // FIXME: allow for a few seconds difference?
-      if(timestamp < statbuf.st_mtime)
+      gchar **fields = g_strsplit(*line, "\t", 3);
+      if(g_strv_length(fields) == 3)
       {
-        dt_control_crawler_result_t *item
-            = (dt_control_crawler_result_t *)malloc(sizeof(dt_control_crawler_result_t));
-        item->id = id;
-        item->timestamp_xmp = statbuf.st_mtime;
-        item->timestamp_db = timestamp;
-        item->image_path = g_strdup(image_path);
-        item->xmp_path = g_strdup(xmp_path);
-
-        result = g_list_append(result, item);
-        dt_print(DT_DEBUG_CONTROL, "[crawler] `%s' (id: %d) is a newer xmp file.\n", xmp_path, id);
+        _crawler_cache_t *entry = (_crawler_cache_t *)malloc(sizeof(_crawler_cache_t));
+        entry->mtime = g_ascii_strtoll(fields[0], NULL, 10);
+        entry->size = g_ascii_strtoll(fields[1], NULL, 10);
+        g_hash_table_insert(cache, g_strdup(fields[2]), entry);
       }
-      // older timestamps are the case for all images after the db upgrade. better not report these
-      //       else if(timestamp > statbuf.st_mtime)
-      //         printf("`%s' (%d) has an older xmp file.\n", image_path, id);
+      g_strfreev(fields);
     }
+    g_strfreev(lines);
+  }
+  g_free(contents);
+  g_free(filename);
+  return cache;
+}
 
-    // step 2: check if the image has associated files (.txt, .wav)
-    size_t len = strlen(image_path);
-    const char *c = image_path + len;
-    while((c > image_path) && (*c != '.')) c--;
-    len = c - image_path + 1;
+static void _crawler_cache_save(GHashTable *cache)
+{
+  gchar *filename = _crawler_cache_filename();
+  if(!filename) return;
+  GString *contents = g_string_new(NULL);
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, cache);
+  while(g_hash_table_iter_next(&iter, &key, &value))
+  {
+    const _crawler_cache_t *entry = (_crawler_cache_t *)value;
+    g_string_append_printf(contents, "%" G_GINT64_FORMAT "\t%" G_GINT64_FORMAT "\t%s\n", entry->mtime,
+                           entry->size, (const char *)key);
+  }
+  if(!g_file_set_contents(filename, contents->str, contents->len, NULL))
+    fprintf(stderr, "[crawler] could not write `%s'\n", filename);
+  g_string_free(contents, TRUE);
+  g_free(filename);
+}
 
-    char *extra_path = (char *)calloc(len + 3 + 1, sizeof(char));
-    g_strlcpy(extra_path, image_path, len + 1);
+// checks whether
+// - the XMP file on disk is newer than the timestamp from db
+// - there is a .txt or .wav file associated with the image
+static void _crawler_check_image(const _crawler_t *crawler, _crawler_folder_t *folder, _crawler_image_t *image)
+{
+  gchar *image_path = g_build_filename(folder->path, image->filename, NULL);
+  image->new_flags = image->flags;
 
-    extra_path[len] = 't';
-    extra_path[len + 1] = 'x';
-    extra_path[len + 2] = 't';
-    gboolean has_txt = g_file_test(extra_path, G_FILE_TEST_EXISTS);
+  // if the image is missing we ignore it.
+  if(!g_file_test(image_path, G_FILE_TEST_EXISTS))
+  {
+    dt_print(DT_DEBUG_CONTROL, "[crawler] `%s' (id: %d) is missing.\n", image_path, image->id);
+    g_free(image_path);
+    return;
+  }
 
-    if(!has_txt)
+  // no need to look for xmp files if none get written anyway.
+  if(crawler->look_for_xmp)
+  {
+    // construct the xmp filename for this image
+    gchar xmp_path[PATH_MAX] = { 0 };
+    g_strlcpy(xmp_path, image_path, sizeof(xmp_path));
+    dt_image_path_append_version_no_db(image->version, xmp_path, sizeof(xmp_path));
+    g_strlcat(xmp_path, ".xmp", sizeof(xmp_path));
+
+    GStatBuf statbuf;
+    // step 1: check if the xmp is newer than our db entry
+    // FIXME: allow for a few seconds difference?
+    if(strlen(xmp_path) + 1 < sizeof(xmp_path) && g_stat(xmp_path, &statbuf) == 0
+       && image->timestamp < statbuf.st_mtime)
     {
-      extra_path[len] = 'T';
-      extra_path[len + 1] = 'X';
-      extra_path[len + 2] = 'T';
-      has_txt = g_file_test(extra_path, G_FILE_TEST_EXISTS);
+      dt_control_crawler_result_t *item
+          = (dt_control_crawler_result_t *)malloc(sizeof(dt_control_crawler_result_t));
+      item->id = image->id;
+      item->timestamp_xmp = statbuf.st_mtime;
+      item->timestamp_db = image->timestamp;
+      item->image_path = g_strdup(image_path);
+      item->xmp_path = g_strdup(xmp_path);
+
+      folder->results = g_list_append(folder->results, item);
+      dt_print(DT_DEBUG_CONTROL, "[crawler] `%s' (id: %d) is a newer xmp file.\n", xmp_path, image->id);
     }
+    // older timestamps are the case for all images after the db upgrade. better not report these
+  }
+
+  // step 2: check if the image has associated files (.txt, .wav)
+  size_t len = strlen(image_path);
+  const char *c = image_path + len;
+  while((c > image_path) && (*c != '.')) c--;
+  len = c - image_path + 1;
+
+  char *extra_path = (char *)calloc(len + 3 + 1, sizeof(char));
+  g_strlcpy(extra_path, image_path, len + 1);
+
+  extra_path[len] = 't';
+  extra_path[len + 1] = 'x';
+  extra_path[len + 2] = 't';
+  gboolean has_txt = g_file_test(extra_path, G_FILE_TEST_EXISTS);
 
-    extra_path[len] = 'w';
-    extra_path[len + 1] = 'a';
-    extra_path[len + 2] = 'v';
-    gboolean has_wav = g_file_test(extra_path, G_FILE_TEST_EXISTS);
+  if(!has_txt)
+  {
+    extra_path[len] = 'T';
+    extra_path[len + 1] = 'X';
+    extra_path[len + 2] = 'T';
+    has_txt = g_file_test(extra_path, G_FILE_TEST_EXISTS);
+  }
+
+  extra_path[len] = 'w';
+  extra_path[len + 1] = 'a';
+  extra_path[len + 2] = 'v';
+  gboolean has_wav = g_file_test(extra_path, G_FILE_TEST_EXISTS);
+
+  if(!has_wav)
+  {
+    extra_path[len] = 'W';
+    extra_path[len + 1] = 'A';
+    extra_path[len + 2] = 'V';
+    has_wav = g_file_test(extra_path, G_FILE_TEST_EXISTS);
+  }
 
-    if(!has_wav)
+  // TODO: decide if we want to remove the flag for images that lost their extra file. currently we do (the
+  // else cases)
+  if(has_txt)
+    image->new_flags |= DT_IMAGE_HAS_TXT;
+  else
+    image->new_flags &= ~DT_IMAGE_HAS_TXT;
+  if(has_wav)
+    image->new_flags |= DT_IMAGE_HAS_WAV;
+  else
+    image->new_flags &= ~DT_IMAGE_HAS_WAV;
+
+  free(extra_path);
+  g_free(image_path);
+}
+
+// runs in the thread pool. a folder which didn't change since the last crawl found nothing is skipped with a
+// single stat, xmp files and extra files can't have been added, removed or replaced in it.
+static void _crawler_check_folder(gpointer data, gpointer user_data)
+{
+  _crawler_folder_t *folder = (_crawler_folder_t *)data;
+  _crawler_t *crawler = (_crawler_t *)user_data;
+
+  GStatBuf statbuf;
+  if(dt_control_job_get_state(crawler->job) != DT_JOB_STATE_CANCELLED && g_stat(folder->path, &statbuf) == 0)
+  {
+    folder->mtime = statbuf.st_mtime;
+    folder->size = statbuf.st_size;
+    const _crawler_cache_t *entry = (_crawler_cache_t *)g_hash_table_lookup(crawler->cache, folder->path);
+    if(!entry || entry->mtime != folder->mtime || entry->size != folder->size)
     {
-      extra_path[len] = 'W';
-      extra_path[len + 1] = 'A';
-      extra_path[len + 2] = 'V';
-      has_wav = g_file_test(extra_path, G_FILE_TEST_EXISTS);
+      for(GList *l = folder->images; l; l = g_list_next(l))
+        _crawler_check_image(crawler, folder, (_crawler_image_t *)l->data);
+      folder->checked = TRUE;
     }
+  }
+  g_async_queue_push(crawler->done, folder);
+}
 
-    // TODO: decide if we want to remove the flag for images that lost their extra file. currently we do (the
-    // else cases)
-    int new_flags = flags;
-    if(has_txt)
-      new_flags |= DT_IMAGE_HAS_TXT;
-    else
-      new_flags &= ~DT_IMAGE_HAS_TXT;
-    if(has_wav)
-      new_flags |= DT_IMAGE_HAS_WAV;
-    else
-      new_flags &= ~DT_IMAGE_HAS_WAV;
-    if(flags != new_flags)
+static gboolean _crawler_show_results(gpointer user_data);
+
+static int32_t _crawler_job_run(dt_job_t *job)
+{
+  _crawler_t crawler = { .job = job, .look_for_xmp = dt_conf_get_bool("write_sidecar_files") };
+  crawler.cache = _crawler_cache_load();
+  crawler.done = g_async_queue_new();
+
+  // collect all images, folder by folder
+  GList *folders = NULL;
+  _crawler_folder_t *folder = NULL;
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT i.id, write_timestamp, version, folder, filename, flags "
+                              "FROM main.images i, main.film_rolls f ON i.film_id = f.id ORDER BY f.id, filename",
+                              -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const char *path = (const char *)sqlite3_column_text(stmt, 3);
+    if(!folder || g_strcmp0(folder->path, path))
     {
-      sqlite3_bind_int(inner_stmt, 1, new_flags);
-      sqlite3_bind_int(inner_stmt, 2, id);
-      sqlite3_step(inner_stmt);
-      sqlite3_reset(inner_stmt);
-      sqlite3_clear_bindings(inner_stmt);
+      folder = (_crawler_folder_t *)calloc(1, sizeof(_crawler_folder_t));
+      folder->path = g_strdup(path);
+      folders = g_list_prepend(folders, folder);
     }
-
-    free(extra_path);
+    _crawler_image_t *image = (_crawler_image_t *)calloc(1, sizeof(_crawler_image_t));
+    image->id = sqlite3_column_int(stmt, 0);
+    image->timestamp = sqlite3_column_int(stmt, 1);
+    image->version = sqlite3_column_int(stmt, 2);
+    image->filename = g_strdup((const char *)sqlite3_column_text(stmt, 4));
+    image->flags = sqlite3_column_int(stmt, 5);
+    folder->images = g_list_prepend(folder->images, image);
   }
+  sqlite3_finalize(stmt);
+  folders = g_list_reverse(folders);
+  for(GList *l = folders; l; l = g_list_next(l))
+    ((_crawler_folder_t *)l->data)->images = g_list_reverse(((_crawler_folder_t *)l->data)->images);
+
+  const int nb_folders = g_list_length(folders);
+  const double start = dt_get_wtime();
+  GThreadPool *pool = g_thread_pool_new(_crawler_check_folder, &crawler, DT_CRAWLER_THREADS, FALSE, NULL);
+  for(GList *l = folders; l; l = g_list_next(l)) g_thread_pool_push(pool, l->data, NULL);
+  g_list_free(folders);
+
+  // handle the folders as they come in, so the first results show up while the rest is still being checked
+  GHashTable *cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free);
+  GList *results = NULL;
+  double last_report = dt_get_wtime();
+  int nb_checked = 0;
+  for(int k = 0; k < nb_folders; k++)
+  {
+    folder = (_crawler_folder_t *)g_async_queue_pop(crawler.done);
+    for(GList *l = folder->images; folder->checked && l; l = g_list_next(l))
+    {
+      const _crawler_image_t *image = (_crawler_image_t *)l->data;
+      if(image->flags == image->new_flags) continue;
+      // the image cache might hold the image already, don't write behind its back
+      dt_image_t *img = dt_image_cache_get(darktable.image_cache, image->id, 'w');
+      if(!img) continue;
+      img->flags = (img->flags & ~(DT_IMAGE_HAS_TXT | DT_IMAGE_HAS_WAV))
+                   | (image->new_flags & (DT_IMAGE_HAS_TXT | DT_IMAGE_HAS_WAV));
+      dt_image_cache_write_release(darktable.image_cache, img, DT_IMAGE_CACHE_RELAXED);
+    }
 
-  sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+    // remember the folder as clean unless it has something to report. skipped folders keep their entry
+    const _crawler_cache_t *old = (_crawler_cache_t *)g_hash_table_lookup(crawler.cache, folder->path);
+    if((folder->checked && !folder->results) || (!folder->checked && old && old->mtime == folder->mtime
+                                                 && old->size == folder->size))
+    {
+      _crawler_cache_t *entry = (_crawler_cache_t *)malloc(sizeof(_crawler_cache_t));
+      entry->mtime = folder->mtime;
+      entry->size = folder->size;
+      g_hash_table_insert(cache, g_strdup(folder->path), entry);
+    }
+    if(folder->checked) nb_checked++;
 
-  sqlite3_finalize(stmt);
-  sqlite3_finalize(inner_stmt);
+    results = g_list_concat(results, folder->results);
+    folder->results = NULL;
+    _crawler_folder_free(folder);
 
-  return result;
+    dt_control_job_set_progress(job, (double)(k + 1) / nb_folders);
+    if(results && (k == nb_folders - 1 || dt_get_wtime() - last_report > DT_CRAWLER_REPORT_INTERVAL))
+    {
+      g_idle_add(_crawler_show_results, results);
+      results = NULL;
+      last_report = dt_get_wtime();
+    }
+  }
+  g_thread_pool_free(pool, FALSE, TRUE);
+  g_async_queue_unref(crawler.done);
+  g_hash_table_destroy(crawler.cache);
+
+  // a cancelled crawl doesn't know about the folders it didn't get to
+  if(dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED) _crawler_cache_save(cache);
+  g_hash_table_destroy(cache);
+  g_list_free_full(results, _crawler_result_free);
+
+  dt_print(DT_DEBUG_CONTROL, "[crawler] checked %d of %d folders in %.3f seconds\n", nb_checked, nb_folders,
+           dt_get_wtime() - start);
+  return 0;
+}
+
+void dt_control_crawler_start()
+{
+  dt_job_t *job = dt_control_job_create(&_crawler_job_run, "look for updated xmp files");
+  if(!job) return;
+  dt_control_job_add_progress(job, _("looking for updated xmp files"), TRUE);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_BG, job);
 }
 
 
@@ -203,6 +421,11 @@ typedef struct dt_control_crawler_gui_t
   gulong select_all_handler_id;
 } dt_control_crawler_gui_t;
 
+// the dialog currently shown, results found later on are added to it
+static dt_control_crawler_gui_t *_crawler_gui = NULL;
+// once the user closed the dialog we don't bother them again
+static gboolean _crawler_dialog_closed = FALSE;
+
 // close the window and clean up
 static void dt_control_crawler_response_callback(GtkWidget *dialog, gint response_id, gpointer user_data)
 {
@@ -210,6 +433,8 @@ static void dt_control_crawler_response_callback(GtkWidget *dialog, gint respons
   g_object_unref(G_OBJECT(gui->model));
   gtk_widget_destroy(dialog);
   free(gui);
+  _crawler_gui = NULL;
+  _crawler_dialog_closed = TRUE;
 }
 
 // unselect the "select all" toggle
@@ -305,11 +530,28 @@ void _overwrite_button_clicked(GtkButton *button, gpointer user_data)
   _clear_select_all(gui);
 }
 
-// show a popup window with a list of updated images/xmp files and allow the user to tell dt what to do about them
-void dt_control_crawler_show_image_list(GList *images)
+static void _crawler_append_results(dt_control_crawler_gui_t *gui, GList *images)
 {
-  if(!images) return;
+  GtkListStore *store = GTK_LIST_STORE(gui->model);
+  for(GList *list_iter = images; list_iter; list_iter = g_list_next(list_iter))
+  {
+    GtkTreeIter iter;
+    dt_control_crawler_result_t *item = list_iter->data;
+    char timestamp_db[64], timestamp_xmp[64];
+    strftime(timestamp_db, sizeof(timestamp_db), "%c", localtime(&item->timestamp_db));
+    strftime(timestamp_xmp, sizeof(timestamp_xmp), "%c", localtime(&item->timestamp_xmp));
+    gtk_list_store_append(store, &iter);
+    gtk_list_store_set(store, &iter, DT_CONTROL_CRAWLER_COL_SELECTED, 0, DT_CONTROL_CRAWLER_COL_ID, item->id,
+                       DT_CONTROL_CRAWLER_COL_IMAGE_PATH, item->image_path, DT_CONTROL_CRAWLER_COL_XMP_PATH,
+                       item->xmp_path, DT_CONTROL_CRAWLER_COL_TS_XMP, timestamp_xmp,
+                       DT_CONTROL_CRAWLER_COL_TS_DB, timestamp_db, -1);
+  }
+  g_list_free_full(images, _crawler_result_free);
+}
 
+// show a popup window with a list of updated images/xmp files and allow the user to tell dt what to do about them
+static dt_control_crawler_gui_t *_crawler_show_image_list()
+{
   dt_control_crawler_gui_t *gui = (dt_control_crawler_gui_t *)malloc(sizeof(dt_control_crawler_gui_t));
 
   // a list with all the images
@@ -327,25 +569,6 @@ void dt_control_crawler_show_image_list(GList *images)
 
   gui->model = GTK_TREE_MODEL(store);
 
-  GList *list_iter = g_list_first(images);
-  while(list_iter)
-  {
-    GtkTreeIter iter;
-    dt_control_crawler_result_t *item = list_iter->data;
-    char timestamp_db[64], timestamp_xmp[64];
-    strftime(timestamp_db, sizeof(timestamp_db), "%c", localtime(&item->timestamp_db));
-    strftime(timestamp_xmp, sizeof(timestamp_xmp), "%c", localtime(&item->timestamp_xmp));
-    gtk_list_store_append(store, &iter);
-    gtk_list_store_set(store, &iter, DT_CONTROL_CRAWLER_COL_SELECTED, 0, DT_CONTROL_CRAWLER_COL_ID, item->id,
-                       DT_CONTROL_CRAWLER_COL_IMAGE_PATH, item->image_path, DT_CONTROL_CRAWLER_COL_XMP_PATH,
-                       item->xmp_path, DT_CONTROL_CRAWLER_COL_TS_XMP, timestamp_xmp,
-                       DT_CONTROL_CRAWLER_COL_TS_DB, timestamp_db, -1);
-    g_free(item->image_path);
-    g_free(item->xmp_path);
-    list_iter = g_list_next(list_iter);
-  }
-  g_list_free_full(images, g_free);
-
   GtkWidget *tree = gtk_tree_view_new_with_model(GTK_TREE_MODEL(store));
 
   GtkCellRenderer *renderer = gtk_cell_renderer_toggle_new();
@@ -405,6 +628,21 @@ void dt_control_crawler_show_image_list(GList *images)
   gtk_widget_show_all(dialog);
 
   g_signal_connect(dialog, "response", G_CALLBACK(dt_control_crawler_response_callback), gui);
+  return gui;
+}
+
+// called in the gui thread with a batch of results from the crawler job
+static gboolean _crawler_show_results(gpointer user_data)
+{
+  GList *images = (GList *)user_data;
+  if(_crawler_dialog_closed)
+  {
+    g_list_free_full(images, _crawler_result_free);
+    return FALSE;
+  }
+  if(!_crawler_gui) _crawler_gui = _crawler_show_image_list();
+  _crawler_append_results(_crawler_gui, images);
+  return FALSE;
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
@@ -19,6 +19,8 @@
 #include "control/jobs.h"
 #include "control/control.h"
 
+#include <float.h>
+
 #define DT_CONTROL_FG_PRIORITY 4
 #define DT_CONTROL_MAX_JOBS 30
 
@@ -46,6 +48,8 @@ typedef struct _dt_job_t
   dt_job_state_t state;
   unsigned char priority;
   dt_job_queue_t queue;
+  // time the job got added, for the queue statistics
+  double queued_time;
 
   dt_job_state_change_callback state_changed_cb;
 
@@ -54,6 +58,31 @@ typedef struct _dt_job_t
   char description[DT_CONTROL_DESCRIPTION_LEN];
 } _dt_job_t;
 
+/* work stealing scheduler: every worker owns one deque per job queue, protected by its own lock.
+   jobs added by a worker go to its own deques, jobs added from other threads are distributed round
+   robin. an idle worker first looks at its own deques and then steals from the others, in the order
+   of the queue priorities. only a few counters are shared, and these are updated atomically.
+*/
+typedef struct dt_control_deque_t
+{
+  dt_pthread_mutex_t mutex;
+  // head is the next job to run
+  GQueue queues[DT_JOB_QUEUE_MAX];
+} dt_control_deque_t;
+
+typedef struct dt_control_ws_t
+{
+  dt_control_deque_t *deques;
+  // number of queued jobs per queue
+  gint queued[DT_JOB_QUEUE_MAX];
+  // priority of each queue, aged the same way as the job priorities of the default scheduler
+  gint priority[DT_JOB_QUEUE_MAX];
+  gint export_scheduled;
+  gint next_deque;
+  // serializes the deduplication of DT_JOB_QUEUE_SYSTEM_FG
+  dt_pthread_mutex_t fg_mutex;
+} dt_control_ws_t;
+
 /** check if two jobs are to be considered equal. a simple memcmp won't work since the mutexes probably won't
    match
     we don't want to compare result, priority or state since these will change during the course of
@@ -287,10 +316,56 @@ static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
   return job;
 }
 
+static void dt_control_job_stats_add(dt_control_t *control, _dt_job_t *job)
+{
+  job->queued_time = dt_get_wtime();
+  dt_pthread_mutex_lock(&control->stats_mutex);
+  control->stats[job->queue].added++;
+  dt_pthread_mutex_unlock(&control->stats_mutex);
+}
+
+static void dt_control_job_stats_finish(dt_control_t *control, _dt_job_t *job, const double start,
+                                        const double end)
+{
+  // executed synchronously or as a reserved job, never queued
+  if(job->queued_time == 0.0) return;
+  const double latency = start - job->queued_time;
+  dt_pthread_mutex_lock(&control->stats_mutex);
+  dt_control_queue_stats_t *stats = &control->stats[job->queue];
+  stats->finished++;
+  stats->latency_sum += latency;
+  stats->latency_max = MAX(stats->latency_max, latency);
+  stats->runtime_sum += end - start;
+  dt_pthread_mutex_unlock(&control->stats_mutex);
+}
+
+void dt_control_jobs_print_stats(dt_control_t *control)
+{
+  static const char *names[DT_JOB_QUEUE_MAX]
+      = { "user foreground", "system foreground", "user background", "user export", "system background" };
+  const double elapsed = MAX(dt_get_wtime() - control->stats_start, 1e-6);
+  dt_pthread_mutex_lock(&control->stats_mutex);
+  fprintf(stderr, "[control_jobs] %s scheduler, %d workers, %.1f s\n",
+          control->scheduler == DT_CONTROL_SCHEDULER_WORK_STEALING ? "work stealing" : "default",
+          control->num_threads, elapsed);
+  for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
+  {
+    const dt_control_queue_stats_t *stats = &control->stats[i];
+    if(!stats->added) continue;
+    const double n = MAX(stats->finished, 1);
+    fprintf(stderr,
+            "[control_jobs] %-17s added %6" PRIu64 " finished %6" PRIu64 " (%.2f jobs/s), "
+            "latency avg %.4f s max %.4f s, runtime avg %.4f s\n",
+            names[i], stats->added, stats->finished, stats->finished / elapsed, stats->latency_sum / n,
+            stats->latency_max, stats->runtime_sum / n);
+  }
+  dt_pthread_mutex_unlock(&control->stats_mutex);
+}
+
 static void dt_control_job_execute(_dt_job_t *job)
 {
-  dt_print(DT_DEBUG_CONTROL, "[run_job+] %02d %f ", DT_CTL_WORKER_RESERVED + dt_control_get_threadid(),
-           dt_get_wtime());
+  const double start = dt_get_wtime();
+  dt_print(DT_DEBUG_CONTROL, "[run_job+] %02d %f ", DT_CTL_WORKER_RESERVED + dt_control_get_threadid(), start);
   dt_control_job_print(job);
   dt_print(DT_DEBUG_CONTROL, "\n");
 
@@ -300,6 +375,7 @@ static void dt_control_job_execute(_dt_job_t *job)
   job->result = job->execute(job);
 
   dt_control_job_set_state(job, DT_JOB_STATE_FINISHED);
+  dt_control_job_stats_finish(darktable.control, job, start, dt_get_wtime());
 
   dt_print(DT_DEBUG_CONTROL, "[run_job-] %02d %f ", DT_CTL_WORKER_RESERVED + dt_control_get_threadid(),
            dt_get_wtime());
@@ -332,6 +408,273 @@ static int32_t dt_control_run_job(dt_control_t *control)
   return 0;
 }
 
+static __thread int ws_worker = -1;
+
+static int dt_control_ws_base_priority(const dt_job_queue_t queue_id)
+{
+  return (queue_id == DT_JOB_QUEUE_USER_FG || queue_id == DT_JOB_QUEUE_SYSTEM_FG) ? DT_CONTROL_FG_PRIORITY : 0;
+}
+
+// remove the head of a deque queue. called with the deque locked.
+static _dt_job_t *dt_control_ws_pop(dt_control_ws_t *ws, dt_control_deque_t *deque, const int queue_id)
+{
+  _dt_job_t *job = (_dt_job_t *)g_queue_pop_head(&deque->queues[queue_id]);
+  if(job) g_atomic_int_add(&ws->queued[queue_id], -1);
+  return job;
+}
+
+static _dt_job_t *dt_control_ws_schedule_job(dt_control_t *control, const int worker)
+{
+  dt_control_ws_t *ws = control->ws;
+
+  // pick the queue with the highest priority which has work, ties go to the more important queue
+  int winner_queue = DT_JOB_QUEUE_MAX;
+  int max_priority = -1;
+  for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
+  {
+    if(g_atomic_int_get(&ws->queued[i]) <= 0) continue;
+    if(i == DT_JOB_QUEUE_USER_EXPORT && g_atomic_int_get(&ws->export_scheduled)) continue;
+    const int priority = g_atomic_int_get(&ws->priority[i]);
+    if(priority > max_priority)
+    {
+      max_priority = priority;
+      winner_queue = i;
+    }
+  }
+  if(winner_queue == DT_JOB_QUEUE_MAX) return NULL;
+
+  // only one export at a time
+  if(winner_queue == DT_JOB_QUEUE_USER_EXPORT
+     && !g_atomic_int_compare_and_exchange(&ws->export_scheduled, FALSE, TRUE))
+    return NULL;
+
+  // own deque first, then steal from the others
+  _dt_job_t *job = NULL;
+  for(int k = 0; k < control->num_threads && !job; k++)
+  {
+    const int victim = (worker + k) % control->num_threads;
+    dt_control_deque_t *deque = &ws->deques[victim];
+    dt_pthread_mutex_lock(&deque->mutex);
+    job = dt_control_ws_pop(ws, deque, winner_queue);
+    dt_pthread_mutex_unlock(&deque->mutex);
+  }
+
+  if(!job)
+  {
+    // somebody else was faster
+    if(winner_queue == DT_JOB_QUEUE_USER_EXPORT) g_atomic_int_set(&ws->export_scheduled, FALSE);
+    return NULL;
+  }
+
+  // place it in scheduled job array (for job deduping)
+  dt_control_deque_t *own = &ws->deques[worker];
+  dt_pthread_mutex_lock(&own->mutex);
+  control->job[worker] = job;
+  dt_pthread_mutex_unlock(&own->mutex);
+
+  // age the queues that didn't get picked
+  g_atomic_int_set(&ws->priority[winner_queue], dt_control_ws_base_priority(winner_queue));
+  for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
+    if(i != winner_queue && g_atomic_int_get(&ws->queued[i]) > 0) g_atomic_int_inc(&ws->priority[i]);
+
+  return job;
+}
+
+static int32_t dt_control_ws_run_job(dt_control_t *control, const int worker)
+{
+  _dt_job_t *job = dt_control_ws_schedule_job(control, worker);
+
+  if(!job) return -1;
+
+  /* change state to running */
+  dt_pthread_mutex_lock(&job->wait_mutex);
+  if(dt_control_job_get_state(job) == DT_JOB_STATE_QUEUED)
+    dt_control_job_execute(job);
+
+  dt_pthread_mutex_unlock(&job->wait_mutex);
+
+  // remove the job from scheduled job array (for job deduping)
+  dt_control_deque_t *own = &control->ws->deques[worker];
+  dt_pthread_mutex_lock(&own->mutex);
+  control->job[worker] = NULL;
+  dt_pthread_mutex_unlock(&own->mutex);
+  if(job->queue == DT_JOB_QUEUE_USER_EXPORT) g_atomic_int_set(&control->ws->export_scheduled, FALSE);
+
+  // and free it
+  dt_control_job_dispose(job);
+
+  return 0;
+}
+
+// same semantics as the DT_JOB_QUEUE_SYSTEM_FG handling in dt_control_add_job(), but spread over all deques
+static _dt_job_t *dt_control_ws_add_fg_job(dt_control_t *control, dt_control_deque_t *target, _dt_job_t *job,
+                                           _dt_job_t **job_for_disposal)
+{
+  dt_control_ws_t *ws = control->ws;
+  const int queue_id = DT_JOB_QUEUE_SYSTEM_FG;
+
+  for(int k = 0; k < control->num_threads; k++)
+  {
+    dt_control_deque_t *deque = &ws->deques[k];
+    dt_pthread_mutex_lock(&deque->mutex);
+
+    // check if we have already scheduled the job
+    if(dt_control_job_equal(job, (_dt_job_t *)control->job[k]))
+    {
+      dt_pthread_mutex_unlock(&deque->mutex);
+      *job_for_disposal = job;
+      return NULL;
+    }
+
+    // if the job is already in the queue -> move it to the top
+    for(GList *iter = deque->queues[queue_id].head; iter; iter = g_list_next(iter))
+    {
+      _dt_job_t *other_job = (_dt_job_t *)iter->data;
+      if(dt_control_job_equal(job, other_job))
+      {
+        g_queue_delete_link(&deque->queues[queue_id], iter);
+        g_atomic_int_add(&ws->queued[queue_id], -1);
+        *job_for_disposal = job;
+        job = other_job;
+        break;
+      }
+    }
+    dt_pthread_mutex_unlock(&deque->mutex);
+    if(*job_for_disposal) break;
+  }
+
+  // now we can add the new job to the stack
+  dt_control_job_set_state(job, DT_JOB_STATE_QUEUED);
+  dt_pthread_mutex_lock(&target->mutex);
+  g_queue_push_head(&target->queues[queue_id], job);
+  g_atomic_int_inc(&ws->queued[queue_id]);
+  dt_pthread_mutex_unlock(&target->mutex);
+
+  // and take care of the maximal queue size: drop the oldest job
+  if(g_atomic_int_get(&ws->queued[queue_id]) > DT_CONTROL_MAX_JOBS)
+  {
+    dt_control_deque_t *oldest_deque = NULL;
+    double oldest_time = DBL_MAX;
+    for(int k = 0; k < control->num_threads; k++)
+    {
+      dt_control_deque_t *deque = &ws->deques[k];
+      dt_pthread_mutex_lock(&deque->mutex);
+      _dt_job_t *tail = (_dt_job_t *)g_queue_peek_tail(&deque->queues[queue_id]);
+      if(tail && tail != job && tail->queued_time < oldest_time)
+      {
+        oldest_time = tail->queued_time;
+        oldest_deque = deque;
+      }
+      dt_pthread_mutex_unlock(&deque->mutex);
+    }
+    if(oldest_deque)
+    {
+      dt_pthread_mutex_lock(&oldest_deque->mutex);
+      _dt_job_t *tail = (_dt_job_t *)g_queue_peek_tail(&oldest_deque->queues[queue_id]);
+      if(tail && tail != job)
+      {
+        g_queue_pop_tail(&oldest_deque->queues[queue_id]);
+        g_atomic_int_add(&ws->queued[queue_id], -1);
+      }
+      else
+        tail = NULL;
+      dt_pthread_mutex_unlock(&oldest_deque->mutex);
+      if(tail)
+      {
+        dt_control_job_set_state(tail, DT_JOB_STATE_DISCARDED);
+        dt_control_job_dispose(tail);
+      }
+    }
+  }
+  return job;
+}
+
+static int dt_control_ws_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t *job)
+{
+  dt_control_ws_t *ws = control->ws;
+
+  // workers keep their own follow-up jobs, everybody else spreads them
+  const int target_id = (ws_worker >= 0) ? ws_worker
+                                         : (int)((guint)g_atomic_int_add(&ws->next_deque, 1) % control->num_threads);
+  dt_control_deque_t *target = &ws->deques[target_id];
+
+  dt_print(DT_DEBUG_CONTROL, "[add_job] %d | ", g_atomic_int_get(&ws->queued[queue_id]));
+  dt_control_job_print(job);
+  dt_print(DT_DEBUG_CONTROL, "\n");
+
+  _dt_job_t *job_for_disposal = NULL;
+  job->priority = dt_control_ws_base_priority(queue_id);
+
+  // the state has to be set before the job becomes visible to the workers
+  if(queue_id == DT_JOB_QUEUE_SYSTEM_FG)
+  {
+    // this is a stack with limited size and bubble up and all that stuff
+    dt_pthread_mutex_lock(&ws->fg_mutex);
+    job = dt_control_ws_add_fg_job(control, target, job, &job_for_disposal);
+    dt_pthread_mutex_unlock(&ws->fg_mutex);
+  }
+  else
+  {
+    // the rest are FIFOs
+    dt_control_job_set_state(job, DT_JOB_STATE_QUEUED);
+    dt_pthread_mutex_lock(&target->mutex);
+    g_queue_push_tail(&target->queues[queue_id], job);
+    g_atomic_int_inc(&ws->queued[queue_id]);
+    dt_pthread_mutex_unlock(&target->mutex);
+  }
+
+  if(job)
+  {
+    // notify workers
+    dt_pthread_mutex_lock(&control->cond_mutex);
+    pthread_cond_broadcast(&control->cond);
+    dt_pthread_mutex_unlock(&control->cond_mutex);
+  }
+
+  // dispose of dropped job, if any
+  dt_control_job_set_state(job_for_disposal, DT_JOB_STATE_DISCARDED);
+  dt_control_job_dispose(job_for_disposal);
+
+  return 0;
+}
+
+static void dt_control_ws_init(dt_control_t *control)
+{
+  dt_control_ws_t *ws = (dt_control_ws_t *)calloc(1, sizeof(dt_control_ws_t));
+  ws->deques = (dt_control_deque_t *)calloc(control->num_threads, sizeof(dt_control_deque_t));
+  for(int k = 0; k < control->num_threads; k++)
+  {
+    dt_pthread_mutex_init(&ws->deques[k].mutex, NULL);
+    for(int i = 0; i < DT_JOB_QUEUE_MAX; i++) g_queue_init(&ws->deques[k].queues[i]);
+  }
+  for(int i = 0; i < DT_JOB_QUEUE_MAX; i++) ws->priority[i] = dt_control_ws_base_priority(i);
+  dt_pthread_mutex_init(&ws->fg_mutex, NULL);
+  control->ws = ws;
+}
+
+static void dt_control_ws_cleanup(dt_control_t *control)
+{
+  dt_control_ws_t *ws = control->ws;
+  if(!ws) return;
+  for(int k = 0; k < control->num_threads; k++)
+  {
+    for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
+    {
+      _dt_job_t *job;
+      while((job = (_dt_job_t *)g_queue_pop_head(&ws->deques[k].queues[i])))
+      {
+        dt_control_job_set_state(job, DT_JOB_STATE_DISCARDED);
+        dt_control_job_dispose(job);
+      }
+    }
+    dt_pthread_mutex_destroy(&ws->deques[k].mutex);
+  }
+  dt_pthread_mutex_destroy(&ws->fg_mutex);
+  free(ws->deques);
+  free(ws);
+  control->ws = NULL;
+}
+
 int32_t dt_control_add_job_res(dt_control_t *control, _dt_job_t *job, int32_t res)
 {
   if(((unsigned int)res) >= DT_CTL_WORKER_RESERVED || !job)
@@ -375,6 +718,8 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
     return 1;
   }
 
+  job->queue = queue_id;
+
   if(!control->running)
   {
     // whatever we are adding here won't be scheduled as the system isn't running. execute it synchronous instead.
@@ -386,7 +731,10 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
     return 0;
   }
 
-  job->queue = queue_id;
+  // only jobs going through the queues are counted, the stats don't exist while the control isn't running
+  dt_control_job_stats_add(control, job);
+
+  if(control->scheduler == DT_CONTROL_SCHEDULER_WORK_STEALING) return dt_control_ws_add_job(control, queue_id, job);
 
   _dt_job_t *job_for_disposal = NULL;
 
@@ -557,11 +905,13 @@ static void *dt_control_work(void *ptr)
   snprintf(name, sizeof(name), "worker %d", threadid);
   dt_pthread_setname(name);
   free(params);
+  const gboolean work_stealing = control->scheduler == DT_CONTROL_SCHEDULER_WORK_STEALING;
+  if(work_stealing) ws_worker = threadid;
   // int32_t threadid = dt_control_get_threadid();
   while(dt_control_running())
   {
     // dt_print(DT_DEBUG_CONTROL, "[control_work] %d\n", threadid);
-    if(dt_control_run_job(control) < 0)
+    if((work_stealing ? dt_control_ws_run_job(control, threadid) : dt_control_run_job(control)) < 0)
     {
       // wait for a new job.
       dt_pthread_mutex_lock(&control->cond_mutex);
@@ -608,6 +958,17 @@ void dt_control_jobs_init(dt_control_t *control)
   control->num_threads = CLAMP(dt_conf_get_int("worker_threads"), 1, 8);
   control->thread = (pthread_t *)calloc(control->num_threads, sizeof(pthread_t));
   control->job = (dt_job_t **)calloc(control->num_threads, sizeof(dt_job_t *));
+
+  gchar *scheduler = dt_conf_get_string("worker_scheduler");
+  control->scheduler = g_strcmp0(scheduler, "work stealing") ? DT_CONTROL_SCHEDULER_QUEUES
+                                                              : DT_CONTROL_SCHEDULER_WORK_STEALING;
+  g_free(scheduler);
+  control->ws = NULL;
+  if(control->scheduler == DT_CONTROL_SCHEDULER_WORK_STEALING) dt_control_ws_init(control);
+
+  dt_pthread_mutex_init(&control->stats_mutex, NULL);
+  memset(control->stats, 0, sizeof(control->stats));
+  control->stats_start = dt_get_wtime();
   dt_pthread_mutex_lock(&control->run_mutex);
   control->running = 1;
   dt_pthread_mutex_unlock(&control->run_mutex);
@@ -637,6 +998,9 @@ void dt_control_jobs_init(dt_control_t *control)
 
 void dt_control_jobs_cleanup(dt_control_t *control)
 {
+  if(darktable.unmuted & (DT_DEBUG_CONTROL | DT_DEBUG_PERF)) dt_control_jobs_print_stats(control);
+  dt_control_ws_cleanup(control);
+  dt_pthread_mutex_destroy(&control->stats_mutex);
   free(control->job);
   free(control->thread);
 }
@@ -45,11 +45,29 @@ typedef enum dt_job_queue_t
   DT_JOB_QUEUE_USER_FG = 0,     // gui actions, ...
   DT_JOB_QUEUE_SYSTEM_FG = 1,   // thumbnail creation, ..., may be pushed out of the queue
   DT_JOB_QUEUE_USER_BG = 2,     // imports, ...
-  DT_JOB_QUEUE_USER_EXPORT = 3, // exports. only one of these jobs will ever be scheduled at a time
+  DT_JOB_QUEUE_USER_EXPORT = 3, // exports. only one of these jobs will ever be scheduled at a time, it may export several images in parallel
   DT_JOB_QUEUE_SYSTEM_BG = 4,   // some lua stuff that may not be pushed out of the queue, ...
   DT_JOB_QUEUE_MAX = 5
 } dt_job_queue_t;
 
+typedef enum dt_control_scheduler_t
+{
+  DT_CONTROL_SCHEDULER_QUEUES = 0,       // one set of global queues under one lock
+  DT_CONTROL_SCHEDULER_WORK_STEALING = 1 // per worker queues, idle workers steal from the others
+} dt_control_scheduler_t;
+
+/** per queue statistics, collected for both schedulers */
+typedef struct dt_control_queue_stats_t
+{
+  uint64_t added;
+  uint64_t finished;
+  // time between adding and running a job, in seconds
+  double latency_sum;
+  double latency_max;
+  // time spent executing jobs, in seconds
+  double runtime_sum;
+} dt_control_queue_stats_t;
+
 typedef struct _dt_job_t dt_job_t;
 
 typedef int32_t (*dt_job_execute_callback)(dt_job_t *);
@@ -90,6 +108,9 @@ int32_t dt_control_add_job_res(struct dt_control_t *s, dt_job_t *job, int32_t re
 
 int32_t dt_control_get_threadid();
 
+/** print latency and throughput of all queues (debug). */
+void dt_control_jobs_print_stats(struct dt_control_t *control);
+
 #ifdef HAVE_GPHOTO2
 #include "control/jobs/camera_jobs.h"
 #endif
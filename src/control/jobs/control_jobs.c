@@ -33,6 +33,7 @@
 #include "common/undo.h"
 #include "control/conf.h"
 #include "develop/imageop_math.h"
+#include "develop/tiling.h"
 
 #include "gui/gtk.h"
 
@@ -1197,6 +1198,156 @@ static int32_t dt_control_refresh_exif_run(dt_job_t *job)
 }
 
 
+// rough number of full size float buffers an export pipeline needs at the same time
+#define DT_CONTROL_EXPORT_MEMORY_FACTOR 5.0f
+
+// shared between all threads of one export job
+typedef struct dt_control_export_state_t
+{
+  dt_job_t *job;
+  dt_control_export_t *settings;
+  dt_imageio_module_format_t *mformat;
+  dt_imageio_module_storage_t *mstorage;
+  dt_export_metadata_t *metadata;
+  guint tagid, etagid;
+  int omp_threads;
+  dt_control_export_budget_t budget;
+
+  // protected by mutex:
+  dt_pthread_mutex_t mutex;
+  GList *next;
+  guint total, scheduled, done;
+} dt_control_export_state_t;
+
+typedef struct dt_control_export_worker_t
+{
+  dt_control_export_state_t *state;
+  dt_imageio_module_data_t *fdata;
+} dt_control_export_worker_t;
+
+void dt_control_export_budget_init(dt_control_export_budget_t *b, dt_job_t *job)
+{
+  dt_pthread_mutex_init(&b->mutex, NULL);
+  pthread_cond_init(&b->cond, NULL);
+  b->memory = 0;
+  b->job = job;
+}
+
+void dt_control_export_budget_cleanup(dt_control_export_budget_t *b)
+{
+  pthread_cond_destroy(&b->cond);
+  dt_pthread_mutex_destroy(&b->mutex);
+}
+
+size_t dt_control_export_reserve_memory(dt_control_export_budget_t *b, const size_t width, const size_t height)
+{
+  const size_t bpp = 4 * sizeof(float);
+  const size_t required = DT_CONTROL_EXPORT_MEMORY_FACTOR * width * height * bpp;
+  dt_pthread_mutex_lock(&b->mutex);
+  // an image on its own always goes, even if it exceeds the budget (tiling will take care of it)
+  while(b->memory
+        && !dt_tiling_piece_fits_host_memory(width, height, bpp, DT_CONTROL_EXPORT_MEMORY_FACTOR, b->memory)
+        && !(b->job && dt_control_job_get_state(b->job) == DT_JOB_STATE_CANCELLED))
+    dt_pthread_cond_wait(&b->cond, &b->mutex);
+  b->memory += required;
+  dt_pthread_mutex_unlock(&b->mutex);
+  return required;
+}
+
+void dt_control_export_release_memory(dt_control_export_budget_t *b, const size_t required)
+{
+  dt_pthread_mutex_lock(&b->mutex);
+  b->memory -= required;
+  pthread_cond_broadcast(&b->cond);
+  dt_pthread_mutex_unlock(&b->mutex);
+}
+
+static void _export_image(dt_control_export_state_t *s, dt_imageio_module_data_t *fdata, const int imgid,
+                          const guint num)
+{
+  dt_control_export_t *settings = s->settings;
+  const guint total = s->total;
+
+  // progress message
+  char message[512] = { 0 };
+  snprintf(message, sizeof(message), _("exporting %d / %d to %s"), num, total, s->mstorage->name(s->mstorage));
+  // update the message. initialize_store() might have changed the number of images
+  dt_control_job_set_progress_message(s->job, message);
+
+  // remove 'changed' tag from image
+  dt_tag_detach(s->tagid, imgid, FALSE, FALSE);
+  // make sure the 'exported' tag is set on the image
+  dt_tag_attach_from_gui(s->etagid, imgid, FALSE, FALSE);
+
+  /* register export timestamp in cache */
+  dt_image_cache_set_export_timestamp(darktable.image_cache, imgid);
+
+  // check if image still exists:
+  const dt_image_t *image = dt_image_cache_get(darktable.image_cache, (int32_t)imgid, 'r');
+  if(image)
+  {
+    char imgfilename[PATH_MAX] = { 0 };
+    gboolean from_cache = TRUE;
+    dt_image_full_path(image->id, imgfilename, sizeof(imgfilename), &from_cache);
+    if(!g_file_test(imgfilename, G_FILE_TEST_IS_REGULAR))
+    {
+      dt_control_log(_("image `%s' is currently unavailable"), image->filename);
+      fprintf(stderr, "image `%s' is currently unavailable\n", imgfilename);
+      // dt_image_remove(imgid);
+      dt_image_cache_read_release(darktable.image_cache, image);
+    }
+    else
+    {
+      const size_t width = image->width, height = image->height;
+      dt_image_cache_read_release(darktable.image_cache, image);
+      const size_t required = dt_control_export_reserve_memory(&s->budget, width, height);
+      if(dt_control_job_get_state(s->job) != DT_JOB_STATE_CANCELLED
+         && s->mstorage->store(s->mstorage, settings->sdata, imgid, s->mformat, fdata, num, total,
+                               settings->high_quality, settings->upscale, settings->export_masks,
+                               settings->icc_type, settings->icc_filename, settings->icc_intent, s->metadata)
+                != 0)
+        dt_control_job_cancel(s->job);
+      dt_control_export_release_memory(&s->budget, required);
+    }
+  }
+}
+
+static void _export_worker_run(dt_control_export_worker_t *w)
+{
+  dt_control_export_state_t *s = w->state;
+  while(TRUE)
+  {
+    dt_pthread_mutex_lock(&s->mutex);
+    if(!s->next || dt_control_job_get_state(s->job) == DT_JOB_STATE_CANCELLED)
+    {
+      dt_pthread_mutex_unlock(&s->mutex);
+      break;
+    }
+    const int imgid = GPOINTER_TO_INT(s->next->data);
+    s->next = g_list_next(s->next);
+    const guint num = ++s->scheduled;
+    dt_pthread_mutex_unlock(&s->mutex);
+
+    _export_image(s, w->fdata, imgid, num);
+
+    dt_pthread_mutex_lock(&s->mutex);
+    const double fraction = MIN((double)++s->done / s->total, 1.0);
+    dt_pthread_mutex_unlock(&s->mutex);
+    dt_control_job_set_progress(s->job, fraction);
+  }
+}
+
+static void *_export_worker_thread(void *ptr)
+{
+  dt_control_export_worker_t *w = (dt_control_export_worker_t *)ptr;
+#ifdef _OPENMP // need to do this in every thread
+  omp_set_num_threads(w->state->omp_threads);
+#endif
+  dt_pthread_setname("export");
+  _export_worker_run(w);
+  return NULL;
+}
+
 static int32_t dt_control_export_job_run(dt_job_t *job)
 {
   dt_control_image_enumerator_t *params = (dt_control_image_enumerator_t *)dt_control_job_get_params(job);
@@ -1241,8 +1392,6 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
   const guint total = g_list_length(t);
   dt_control_log(ngettext("exporting %d image..", "exporting %d images..", total), total);
 
-  double fraction = 0;
-
   // set up the fdata struct
   fdata->max_width = (settings->max_width != 0 && w != 0) ? MIN(w, settings->max_width) : MAX(w, settings->max_width);
   fdata->max_height = (settings->max_height != 0 && h != 0) ? MIN(h, settings->max_height) : MAX(h, settings->max_height);
@@ -1263,54 +1412,62 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
     metadata.list = g_list_remove(metadata.list, metadata.list->data);
   }
 
-  while(t && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED)
+  // storages and formats which can deal with it get several images exported at the same time, so that
+  // loading, processing and writing of different images overlap. the number of images in flight is bounded
+  // by the memory budget of the tiling code. formats like pdf collect all images into one file and stay on
+  // a single thread.
+  int threads = 1;
+  if(dt_imageio_parallel_export(mstorage, sdata, mformat))
+    threads = CLAMP(dt_conf_get_int("max_parallel_exports"), 1, MAX(1, (int)total));
+
+  dt_control_export_state_t state = { 0 };
+  state.job = job;
+  state.settings = settings;
+  state.mformat = mformat;
+  state.mstorage = mstorage;
+  state.metadata = &metadata;
+  state.tagid = tagid;
+  state.etagid = etagid;
+  state.omp_threads = MAX(1, darktable.num_openmp_threads / threads);
+  state.next = t;
+  state.total = total;
+  dt_pthread_mutex_init(&state.mutex, NULL);
+  dt_control_export_budget_init(&state.budget, job);
+
+  dt_control_export_worker_t *workers
+      = (dt_control_export_worker_t *)calloc(threads, sizeof(dt_control_export_worker_t));
+  pthread_t *thread = (pthread_t *)calloc(threads, sizeof(pthread_t));
+  workers[0].state = &state;
+  workers[0].fdata = fdata;
+  for(int k = 1; k < threads; k++)
   {
-    const int imgid = GPOINTER_TO_INT(t->data);
-    t = g_list_next(t);
-    const guint num = total - g_list_length(t);
-
-    // progress message
-    char message[512] = { 0 };
-    snprintf(message, sizeof(message), _("exporting %d / %d to %s"), num, total, mstorage->name(mstorage));
-    // update the message. initialize_store() might have changed the number of images
-    dt_control_job_set_progress_message(job, message);
-
-    // remove 'changed' tag from image
-    dt_tag_detach(tagid, imgid, FALSE, FALSE);
-    // make sure the 'exported' tag is set on the image
-    dt_tag_attach_from_gui(etagid, imgid, FALSE, FALSE);
-
-    /* register export timestamp in cache */
-    dt_image_cache_set_export_timestamp(darktable.image_cache, imgid);
+    // every thread needs its own format data
+    workers[k].state = &state;
+    workers[k].fdata = mformat->get_params(mformat);
+    workers[k].fdata->max_width = fdata->max_width;
+    workers[k].fdata->max_height = fdata->max_height;
+    g_strlcpy(workers[k].fdata->style, fdata->style, sizeof(workers[k].fdata->style));
+    workers[k].fdata->style_append = fdata->style_append;
+    dt_pthread_create(&thread[k], _export_worker_thread, &workers[k]);
+  }
 
-    // check if image still exists:
-    const dt_image_t *image = dt_image_cache_get(darktable.image_cache, (int32_t)imgid, 'r');
-    if(image)
-    {
-      char imgfilename[PATH_MAX] = { 0 };
-      gboolean from_cache = TRUE;
-      dt_image_full_path(image->id, imgfilename, sizeof(imgfilename), &from_cache);
-      if(!g_file_test(imgfilename, G_FILE_TEST_IS_REGULAR))
-      {
-        dt_control_log(_("image `%s' is currently unavailable"), image->filename);
-        fprintf(stderr, "image `%s' is currently unavailable\n", imgfilename);
-        // dt_image_remove(imgid);
-        dt_image_cache_read_release(darktable.image_cache, image);
-      }
-      else
-      {
-        dt_image_cache_read_release(darktable.image_cache, image);
-        if(mstorage->store(mstorage, sdata, imgid, mformat, fdata, num, total, settings->high_quality, settings->upscale,
-                           settings->export_masks, settings->icc_type, settings->icc_filename, settings->icc_intent,
-                           &metadata) != 0)
-          dt_control_job_cancel(job);
-      }
-    }
+#ifdef _OPENMP
+  if(threads > 1) omp_set_num_threads(state.omp_threads);
+#endif
+  _export_worker_run(&workers[0]);
+#ifdef _OPENMP
+  if(threads > 1) omp_set_num_threads(darktable.num_openmp_threads);
+#endif
 
-    fraction += 1.0 / total;
-    if(fraction > 1.0) fraction = 1.0;
-    dt_control_job_set_progress(job, fraction);
+  for(int k = 1; k < threads; k++)
+  {
+    pthread_join(thread[k], NULL);
+    mformat->free_params(mformat, workers[k].fdata);
   }
+  free(thread);
+  free(workers);
+  dt_control_export_budget_cleanup(&state.budget);
+  dt_pthread_mutex_destroy(&state.mutex);
   g_list_free_full(metadata.list, g_free);
 
   if(mstorage->finalize_store) mstorage->finalize_store(mstorage, sdata);
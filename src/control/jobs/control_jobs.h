@@ -47,6 +47,24 @@ void dt_control_export(GList *imgid_list, int max_width, int max_height, int for
                        dt_iop_color_intent_t icc_intent, const gchar *metadata_export);
 void dt_control_merge_hdr();
 
+// memory budget for several images exported at the same time, bounded by the host memory limit of tiling
+typedef struct dt_control_export_budget_t
+{
+  dt_pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  // memory reserved by the images which are being exported right now
+  size_t memory;
+  // optional: stop waiting once this job is cancelled
+  dt_job_t *job;
+} dt_control_export_budget_t;
+
+void dt_control_export_budget_init(dt_control_export_budget_t *b, dt_job_t *job);
+void dt_control_export_budget_cleanup(dt_control_export_budget_t *b);
+/* wait until an image of this size fits into the budget, together with all the images exported right now.
+ * returns the amount reserved, to be handed back to dt_control_export_release_memory() */
+size_t dt_control_export_reserve_memory(dt_control_export_budget_t *b, const size_t width, const size_t height);
+void dt_control_export_release_memory(dt_control_export_budget_t *b, const size_t required);
+
 void dt_control_seed_denoise();
 void dt_control_denoise();
 void dt_control_refresh_exif();
@@ -18,6 +18,10 @@
 #include "control/jobs/film_jobs.h"
 #include "common/darktable.h"
 #include "common/film.h"
+#include "common/image.h"
+#include "common/mipmap_cache.h"
+#include "dtgtk/thumbtable.h"
+#include "gui/gtk.h"
 #include <stdlib.h>
 
 typedef struct dt_film_import1_t
@@ -77,6 +81,56 @@ dt_job_t *dt_film_import1_create(dt_film_t *film)
   return job;
 }
 
+typedef struct dt_film_import_thumbnails_t
+{
+  GList *imgs;
+  dt_mipmap_size_t mip;
+} dt_film_import_thumbnails_t;
+
+static int32_t dt_film_import_thumbnails_run(dt_job_t *job)
+{
+  dt_film_import_thumbnails_t *params = dt_control_job_get_params(job);
+  for(GList *l = params->imgs; l; l = g_list_next(l))
+  {
+    if(dt_control_job_get_state(job) == DT_JOB_STATE_CANCELLED) break;
+    dt_mipmap_buffer_t buf;
+    dt_mipmap_cache_get(darktable.mipmap_cache, &buf, GPOINTER_TO_INT(l->data), params->mip, DT_MIPMAP_BLOCKING,
+                        'r');
+    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  }
+  return 0;
+}
+
+static void dt_film_import_thumbnails_cleanup(void *p)
+{
+  dt_film_import_thumbnails_t *params = p;
+  g_list_free(params->imgs);
+  free(params);
+}
+
+// generate the lighttable thumbnails of the imported images in the background, after the import itself.
+// this only makes sense if they can be written to disk, the memory cache wouldn't hold them all anyway.
+static void _film_import_thumbnails(GList *imgs)
+{
+  if(!imgs || !darktable.gui || !dt_conf_get_bool("cache_disk_backend")) return;
+  const int thumb_size = dt_ui_thumbtable(darktable.gui->ui)->thumb_size;
+  if(thumb_size <= 0) return;
+
+  dt_job_t *job = dt_control_job_create(&dt_film_import_thumbnails_run, "generate thumbnails of imported images");
+  if(!job) return;
+  dt_film_import_thumbnails_t *params = (dt_film_import_thumbnails_t *)calloc(1, sizeof(dt_film_import_thumbnails_t));
+  if(!params)
+  {
+    dt_control_job_dispose(job);
+    return;
+  }
+  params->imgs = g_list_copy(imgs);
+  params->mip = dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, thumb_size, thumb_size);
+  dt_control_job_set_params(job, params, dt_film_import_thumbnails_cleanup);
+  // low priority, this must not delay the thumbnails the user is looking at
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG, job);
+}
+
 static GList *_film_recursive_get_files(const gchar *path, gboolean recursive, GList **result)
 {
   gchar *fullname;
@@ -133,6 +187,31 @@ int _film_filename_cmp(gchar *a, gchar *b)
   return ret;
 }
 
+/* compare used to group the files to import by directory */
+static int _film_dirname_cmp(gchar *a, gchar *b)
+{
+  gchar *a_dirname = g_path_get_dirname(a);
+  gchar *b_dirname = g_path_get_dirname(b);
+  int ret = g_strcmp0(a_dirname, b_dirname);
+  g_free(a_dirname);
+  g_free(b_dirname);
+  return ret;
+}
+
+typedef struct _film_import_progress_t
+{
+  dt_job_t *job;
+  double fraction;
+  guint total;
+} _film_import_progress_t;
+
+static void _film_import_progress(const uint32_t imgid, void *data)
+{
+  _film_import_progress_t *progress = data;
+  progress->fraction += 1.0 / progress->total;
+  dt_control_job_set_progress(progress->job, progress->fraction);
+}
+
 static void dt_film_import1(dt_job_t *job, dt_film_t *film)
 {
   gboolean recursive = dt_conf_get_bool("ui_last/import_recursive");
@@ -189,19 +268,22 @@ static void dt_film_import1(dt_job_t *job, dt_film_t *film)
     return;
   }
 
-  /* we got ourself a list of images, lets sort and start import */
+  /* we got ourself a list of images, lets sort and start import. the sort is stable, so sorting by directory
+     keeps the files of each directory sorted by name and lets us import each directory in one batch. */
   images = g_list_sort(images, (GCompareFunc)_film_filename_cmp);
+  images = g_list_sort(images, (GCompareFunc)_film_dirname_cmp);
 
   /* let's start import of images */
   gchar message[512] = { 0 };
-  double fraction = 0;
   guint total = g_list_length(images);
   g_snprintf(message, sizeof(message) - 1, ngettext("importing %d image", "importing %d images", total), total);
   dt_control_job_set_progress_message(job, message);
+  _film_import_progress_t progress = { job, 0.0, total };
 
 
-  /* loop thru the images and import to current film roll */
+  /* loop thru the directories and import their images to the film roll */
   dt_film_t *cfr = film;
+  GList *imgs = NULL;
   GList *image = g_list_first(images);
   do
   {
@@ -250,16 +332,27 @@ static void dt_film_import1(dt_job_t *job, dt_film_t *film)
       dt_film_new(cfr, cdn);
     }
 
+    /* gather the images of this directory */
+    GList *dir_images = NULL;
+    for(; image; image = g_list_next(image))
+    {
+      gchar *dn = g_path_get_dirname((const gchar *)image->data);
+      const gboolean same_dir = !g_strcmp0(dn, cdn);
+      g_free(dn);
+      if(!same_dir) break;
+      dir_images = g_list_prepend(dir_images, image->data);
+    }
+    dir_images = g_list_reverse(dir_images);
     g_free(cdn);
 
-    /* import image */
-    dt_image_import(cfr->id, (const gchar *)image->data, FALSE);
-
-    fraction += 1.0 / total;
-    dt_control_job_set_progress(job, fraction);
+    /* import images */
+    imgs = g_list_concat(imgs, dt_image_import_batch(cfr->id, dir_images, FALSE, _film_import_progress, &progress));
+    g_list_free(dir_images);
 
+  } while(image != NULL);
 
-  } while((image = g_list_next(image)) != NULL);
+  _film_import_thumbnails(imgs);
+  g_list_free(imgs);
 
   g_list_free_full(images, g_free);
 
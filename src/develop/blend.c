@@ -26,6 +26,9 @@
 #include "develop/masks.h"
 #include "develop/tiling.h"
 #include <math.h>
+#if defined(DT_HAVE_AVX_CODEPATHS)
+#include <immintrin.h>
+#endif
 
 
 typedef struct _blend_buffer_desc_t
@@ -429,6 +432,79 @@ static void _blend_normal_bounded(const _blend_buffer_desc_t *bd, const float *a
   }
 }
 
+#if defined(DT_HAVE_AVX_CODEPATHS)
+/* _blend_normal_bounded() for the common buffer layouts, rgb with four channels and RAW with one, eight floats
+ * at a time. the other layouts and the end of the row take the plain version. */
+DT_TARGET_AVX2 static void _blend_normal_bounded_avx2(const _blend_buffer_desc_t *bd, const float *a, float *b,
+                                                      const float *mask)
+{
+  const int rgb = (bd->cst == iop_cs_rgb && bd->ch == 4);
+  const int raw = (bd->cst == iop_cs_RAW && bd->ch == 1);
+  size_t j = 0;
+
+  if(rgb || raw)
+  {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+
+    for(; j + 8 <= bd->stride; j += 8)
+    {
+      // rgb has two pixels per vector, each with its own opacity in all four channels
+      const size_t i = j / bd->ch;
+      const __m256 local_opacity
+          = rgb ? _mm256_set_m128(_mm_set1_ps(mask[i + 1]), _mm_set1_ps(mask[i])) : _mm256_loadu_ps(&mask[i]);
+      const __m256 va = _mm256_loadu_ps(&a[j]);
+      const __m256 vb = _mm256_loadu_ps(&b[j]);
+      const __m256 blended = _mm256_fmadd_ps(vb, local_opacity, _mm256_mul_ps(va, _mm256_sub_ps(one, local_opacity)));
+      const __m256 clamped = _mm256_min_ps(_mm256_max_ps(blended, zero), one);
+      _mm256_storeu_ps(&b[j], rgb ? _mm256_blend_ps(clamped, local_opacity, 0x88) : clamped);
+    }
+  }
+
+  if(j < bd->stride)
+  {
+    const _blend_buffer_desc_t rest = { .cst = bd->cst, .stride = bd->stride - j, .ch = bd->ch, .bch = bd->bch };
+    _blend_normal_bounded(&rest, a + j, b + j, mask + j / bd->ch);
+  }
+}
+
+/* same as _blend_normal_bounded_avx2(), sixteen floats at a time */
+DT_TARGET_AVX512 static void _blend_normal_bounded_avx512(const _blend_buffer_desc_t *bd, const float *a, float *b,
+                                                          const float *mask)
+{
+  const int rgb = (bd->cst == iop_cs_rgb && bd->ch == 4);
+  const int raw = (bd->cst == iop_cs_RAW && bd->ch == 1);
+  size_t j = 0;
+
+  if(rgb || raw)
+  {
+    const __m512 zero = _mm512_setzero_ps();
+    const __m512 one = _mm512_set1_ps(1.0f);
+    const __m512i spread = _mm512_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3);
+
+    for(; j + 16 <= bd->stride; j += 16)
+    {
+      // rgb has four pixels per vector, each with its own opacity in all four channels
+      const size_t i = j / bd->ch;
+      const __m512 local_opacity
+          = rgb ? _mm512_permutexvar_ps(spread, _mm512_castps128_ps512(_mm_loadu_ps(&mask[i])))
+                : _mm512_loadu_ps(&mask[i]);
+      const __m512 va = _mm512_loadu_ps(&a[j]);
+      const __m512 vb = _mm512_loadu_ps(&b[j]);
+      const __m512 blended = _mm512_fmadd_ps(vb, local_opacity, _mm512_mul_ps(va, _mm512_sub_ps(one, local_opacity)));
+      const __m512 clamped = _mm512_min_ps(_mm512_max_ps(blended, zero), one);
+      _mm512_storeu_ps(&b[j], rgb ? _mm512_mask_blend_ps(0x8888, clamped, local_opacity) : clamped);
+    }
+  }
+
+  if(j < bd->stride)
+  {
+    const _blend_buffer_desc_t rest = { .cst = bd->cst, .stride = bd->stride - j, .ch = bd->ch, .bch = bd->bch };
+    _blend_normal_bounded(&rest, a + j, b + j, mask + j / bd->ch);
+  }
+}
+#endif
+
 /* normal blend without any clamping */
 static void _blend_normal_unbounded(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask)
 {
@@ -2532,7 +2608,14 @@ _blend_row_func *dt_develop_choose_blend_func(const unsigned int blend_mode)
       break;
     case DEVELOP_BLEND_NORMAL:
     case DEVELOP_BLEND_BOUNDED:
-      blend = _blend_normal_bounded;
+#if defined(DT_HAVE_AVX_CODEPATHS)
+      if(darktable.codepath.AVX512)
+        blend = _blend_normal_bounded_avx512;
+      else if(darktable.codepath.AVX2)
+        blend = _blend_normal_bounded_avx2;
+      else
+#endif
+        blend = _blend_normal_bounded;
       break;
     case DEVELOP_BLEND_COLORADJUST:
       blend = _blend_coloradjust;
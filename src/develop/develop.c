@@ -45,6 +45,7 @@
 #define DT_DEV_AVERAGE_DELAY_START 250
 #define DT_DEV_PREVIEW_AVERAGE_DELAY_START 50
 #define DT_DEV_AVERAGE_DELAY_COUNT 5
+#define DT_DEV_PROGRESSIVE_TILE_SIZE 512
 #define DT_IOP_ORDER_INFO (darktable.unmuted & DT_DEBUG_IOPORDER)
 
 const gchar *dt_dev_scope_type_names[DT_DEV_SCOPE_N] = { "histogram", "waveform" };
@@ -526,6 +527,148 @@ restart:
   dt_control_signal_raise(darktable.signals, DT_SIGNAL_DEVELOP_PREVIEW2_PIPE_FINISHED);
 }
 
+typedef struct dt_dev_progressive_tile_t
+{
+  dt_iop_roi_t roi;
+  float dist;
+} dt_dev_progressive_tile_t;
+
+static int _dev_progressive_tile_cmp(const void *a, const void *b)
+{
+  const float da = ((const dt_dev_progressive_tile_t *)a)->dist;
+  const float db = ((const dt_dev_progressive_tile_t *)b)->dist;
+  return (da > db) - (da < db);
+}
+
+static gboolean _dev_progressive_wanted(dt_develop_t *dev, const dt_iop_roi_t *roi, const float zoom_x,
+                                        const float zoom_y)
+{
+  const dt_dev_pixelpipe_t *pipe = dev->pipe;
+  if(!dev->gui_attached || dev->image_loading || !dt_conf_get_bool("darkroom/ui/progressive_rendering"))
+    return FALSE;
+  // the output still shows this view, keep it until the new one is complete
+  if(pipe->output_backbuf && pipe->output_imgid == pipe->image.id && pipe->output_backbuf_width == roi->width
+     && pipe->output_backbuf_height == roi->height && pipe->backbuf_scale == roi->scale
+     && pipe->backbuf_zoom_x == zoom_x && pipe->backbuf_zoom_y == zoom_y)
+    return FALSE;
+  // the preview is the first, coarse version of the new view
+  if(!dev->preview_pipe->output_backbuf || dev->preview_pipe->output_imgid != pipe->image.id) return FALSE;
+  return roi->width * roi->height >= 4 * DT_DEV_PROGRESSIVE_TILE_SIZE * DT_DEV_PROGRESSIVE_TILE_SIZE;
+}
+
+// has the user zoomed or panned away from the view being rendered? these don't flag the pipe as changed.
+static gboolean _dev_progressive_view_changed(dt_develop_t *dev, const dt_dev_zoom_t zoom, const int closeup,
+                                              const float zoom_x, const float zoom_y, const int width,
+                                              const int height)
+{
+  return dt_control_get_dev_zoom() != zoom || dt_control_get_dev_closeup() != closeup
+         || dt_control_get_dev_zoom_x() != zoom_x || dt_control_get_dev_zoom_y() != zoom_y
+         || dev->width != width || dev->height != height;
+}
+
+// renders a new view (after zooming or panning) starting with the upscaled preview, then refines it in tiles
+// from the centre outwards. every tile is processed with a border of the support of the pipe and pasted into
+// the output as soon as it is done, and the remaining ones are dropped when the view or the history changes.
+// returns 1 in that case. if the pipe can't be processed in parts, a full run replaces the tiles at the end.
+// the tiles go through the scratch cache of the pipe, the lines of the full view stay where they are.
+static int _dev_process_image_progressive(dt_develop_t *dev, const dt_iop_roi_t *roi, const dt_dev_zoom_t zoom,
+                                          const int closeup, const float zoom_x, const float zoom_y)
+{
+  dt_dev_pixelpipe_t *pipe = dev->pipe;
+  dt_dev_pixelpipe_t *preview = dev->preview_pipe;
+  const int width_dev = dev->width, height_dev = dev->height;
+
+  dt_pthread_mutex_lock(&pipe->backbuf_mutex);
+  if(pipe->output_backbuf == NULL || pipe->output_backbuf_width != roi->width
+     || pipe->output_backbuf_height != roi->height)
+  {
+    g_free(pipe->output_backbuf);
+    pipe->output_backbuf_width = roi->width;
+    pipe->output_backbuf_height = roi->height;
+    pipe->output_backbuf = g_malloc0((size_t)roi->width * roi->height * 4 * sizeof(uint8_t));
+  }
+
+  dt_pthread_mutex_lock(&preview->backbuf_mutex);
+  const int pwd = preview->output_backbuf_width, pht = preview->output_backbuf_height;
+  const uint32_t *const in = (uint32_t *)preview->output_backbuf;
+  uint32_t *const out = (uint32_t *)pipe->output_backbuf;
+  // the preview holds the whole image
+  const float sx = pwd / (pipe->processed_width * roi->scale);
+  const float sy = pht / (pipe->processed_height * roi->scale);
+  const int width = roi->width, height = roi->height, x = roi->x, y = roi->y;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, out, pwd, pht, sx, sy, width, height, x, y) \
+  schedule(static)
+#endif
+  for(int j = 0; j < height; j++)
+  {
+    const int py = CLAMP((int)((y + j + 0.5f) * sy), 0, pht - 1);
+    for(int i = 0; i < width; i++)
+    {
+      const int px = CLAMP((int)((x + i + 0.5f) * sx), 0, pwd - 1);
+      out[(size_t)j * width + i] = in[(size_t)py * pwd + px];
+    }
+  }
+  dt_pthread_mutex_unlock(&preview->backbuf_mutex);
+
+  pipe->output_imgid = pipe->image.id;
+  pipe->backbuf_scale = roi->scale;
+  pipe->backbuf_zoom_x = zoom_x;
+  pipe->backbuf_zoom_y = zoom_y;
+  dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+  dt_control_queue_redraw_center();
+
+  const int nx = (roi->width + DT_DEV_PROGRESSIVE_TILE_SIZE - 1) / DT_DEV_PROGRESSIVE_TILE_SIZE;
+  const int ny = (roi->height + DT_DEV_PROGRESSIVE_TILE_SIZE - 1) / DT_DEV_PROGRESSIVE_TILE_SIZE;
+  dt_dev_progressive_tile_t *tiles = malloc(sizeof(dt_dev_progressive_tile_t) * nx * ny);
+  for(int ty = 0; ty < ny; ty++)
+    for(int tx = 0; tx < nx; tx++)
+    {
+      dt_dev_progressive_tile_t *t = tiles + ty * nx + tx;
+      t->roi.x = tx * DT_DEV_PROGRESSIVE_TILE_SIZE;
+      t->roi.y = ty * DT_DEV_PROGRESSIVE_TILE_SIZE;
+      t->roi.width = MIN(DT_DEV_PROGRESSIVE_TILE_SIZE, roi->width - t->roi.x);
+      t->roi.height = MIN(DT_DEV_PROGRESSIVE_TILE_SIZE, roi->height - t->roi.y);
+      t->roi.scale = roi->scale;
+      const float dx = t->roi.x + 0.5f * t->roi.width - 0.5f * roi->width;
+      const float dy = t->roi.y + 0.5f * t->roi.height - 0.5f * roi->height;
+      t->dist = dx * dx + dy * dy;
+    }
+  qsort(tiles, nx * ny, sizeof(dt_dev_progressive_tile_t), _dev_progressive_tile_cmp);
+
+  const int support = dt_dev_pixelpipe_support(pipe, dev, roi);
+  const int border = MAX(support, 0);
+  pipe->bypass_cache = 1;
+  for(int k = 0; k < nx * ny; k++)
+  {
+    const dt_iop_roi_t *t = &tiles[k].roi;
+    const int x0 = MAX(0, t->x - border), y0 = MAX(0, t->y - border);
+    const int x1 = MIN(roi->width, t->x + t->width + border), y1 = MIN(roi->height, t->y + t->height + border);
+    const dt_iop_roi_t area = { x0, y0, x1 - x0, y1 - y0, roi->scale };
+    if(_dev_progressive_view_changed(dev, zoom, closeup, zoom_x, zoom_y, width_dev, height_dev)
+       || dt_dev_pixelpipe_process_patch(pipe, dev, roi, &area, t) || pipe->changed != DT_DEV_PIPE_UNCHANGED)
+    {
+      // the output is only partly refined, don't take it for the finished view
+      pipe->bypass_cache = 0;
+      pipe->backbuf_scale = 0.0f;
+      free(tiles);
+      return 1;
+    }
+    dt_control_queue_redraw_center();
+  }
+  pipe->bypass_cache = 0;
+  free(tiles);
+
+  // some modules look at the whole image, the tiles only show what they do to a part of it
+  if(support < 0 && dt_dev_pixelpipe_process(pipe, dev, roi->x, roi->y, roi->width, roi->height, roi->scale))
+  {
+    pipe->backbuf_scale = 0.0f;
+    return 1;
+  }
+  return 0;
+}
+
 void dt_dev_process_image_job(dt_develop_t *dev)
 {
   dt_pthread_mutex_lock(&dev->pipe_mutex);
@@ -631,8 +774,24 @@ restart:
   x = MAX(0, scale * dev->pipe->processed_width  * (.5 + zoom_x) - wd / 2);
   y = MAX(0, scale * dev->pipe->processed_height * (.5 + zoom_y) - ht / 2);
 
+  // after an edit of drawn masks only the region they touch needs to be processed again
+  const dt_iop_roi_t roi = (dt_iop_roi_t){ x, y, wd, ht, scale };
+  dt_iop_roi_t area = { 0 }, patch = { 0 };
+  const gboolean partial = !dev->image_loading && !(pipe_changed & (DT_DEV_PIPE_REMOVE | DT_DEV_PIPE_ZOOMED))
+                           && (pipe_changed & (DT_DEV_PIPE_SYNCH | DT_DEV_PIPE_TOP_CHANGED))
+                           && dev->pipe->backbuf_scale == scale && dev->pipe->backbuf_zoom_x == zoom_x
+                           && dev->pipe->backbuf_zoom_y == zoom_y
+                           && dt_dev_pixelpipe_dirty_region(dev->pipe, dev, &roi, &area, &patch);
+
   dt_get_times(&start);
-  if(dt_dev_pixelpipe_process(dev->pipe, dev, x, y, wd, ht, scale))
+  int err = 0;
+  if(partial)
+    err = patch.width > 0 && dt_dev_pixelpipe_process_patch(dev->pipe, dev, &roi, &area, &patch);
+  else if(_dev_progressive_wanted(dev, &roi, zoom_x, zoom_y))
+    err = _dev_process_image_progressive(dev, &roi, zoom, closeup, zoom_x, zoom_y);
+  else
+    err = dt_dev_pixelpipe_process(dev->pipe, dev, x, y, wd, ht, scale);
+  if(err)
   {
     // interrupted because image changed?
     if(dev->image_force_reload)
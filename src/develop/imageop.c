@@ -181,6 +181,12 @@ static void default_process(struct dt_iop_module_t *self, struct dt_dev_pixelpip
 {
   if(darktable.codepath.OPENMP_SIMD && self->process_plain)
     self->process_plain(self, piece, i, o, roi_in, roi_out);
+#if defined(DT_HAVE_AVX_CODEPATHS)
+  else if(darktable.codepath.AVX512 && self->process_avx512)
+    self->process_avx512(self, piece, i, o, roi_in, roi_out);
+  else if(darktable.codepath.AVX2 && self->process_avx2)
+    self->process_avx2(self, piece, i, o, roi_in, roi_out);
+#endif
 #if defined(__SSE__)
   else if(darktable.codepath.SSE2 && self->process_sse2)
     self->process_sse2(self, piece, i, o, roi_in, roi_out);
@@ -314,6 +320,10 @@ int dt_iop_load_module_so(void *m, const char *libname, const char *op)
 
   if(!g_module_symbol(module->module, "process_sse2", (gpointer) & (module->process_sse2)))
     module->process_sse2 = NULL;
+  if(!g_module_symbol(module->module, "process_avx2", (gpointer) & (module->process_avx2)))
+    module->process_avx2 = NULL;
+  if(!g_module_symbol(module->module, "process_avx512", (gpointer) & (module->process_avx512)))
+    module->process_avx512 = NULL;
 
   if(!g_module_symbol(module->module, "process", (gpointer) & (module->process_plain))) goto error;
 
@@ -456,6 +466,8 @@ int dt_iop_load_module_by_so(dt_iop_module_t *module, dt_iop_module_so_t *so, dt
   module->process_tiling = so->process_tiling;
   module->process_plain = so->process_plain;
   module->process_sse2 = so->process_sse2;
+  module->process_avx2 = so->process_avx2;
+  module->process_avx512 = so->process_avx512;
   module->process_cl = so->process_cl;
   module->process_tiling_cl = so->process_tiling_cl;
   module->distort_transform = so->distort_transform;
@@ -1596,6 +1608,7 @@ void dt_iop_commit_params(dt_iop_module_t *module, dt_iop_params_t *params,
                           dt_dev_pixelpipe_iop_t *piece)
 {
   piece->hash = 0;
+  piece->params_hash = 0;
 
   if(piece->enabled)
   {
@@ -1629,7 +1642,9 @@ void dt_iop_commit_params(dt_iop_module_t *module, dt_iop_params_t *params,
 
     module->commit_params(module, params, pipe, piece);
     uint64_t hash = 5381;
-    for(int i = 0; i < length; i++) hash = ((hash << 5) + hash) ^ str[i];
+    for(int i = 0; i < pos; i++) hash = ((hash << 5) + hash) ^ str[i];
+    piece->params_hash = hash;
+    for(int i = pos; i < length; i++) hash = ((hash << 5) + hash) ^ str[i];
     piece->hash = hash;
 
     free(str);
@@ -340,6 +340,10 @@ void dt_masks_iop_combo_populate(GtkWidget *w, struct dt_iop_module_t **m);
 void dt_masks_iop_use_same_as(struct dt_iop_module_t *module, struct dt_iop_module_t *src);
 int dt_masks_group_get_hash_buffer_length(dt_masks_form_t *form);
 char *dt_masks_group_get_hash_buffer(dt_masks_form_t *form, char *str);
+/** union of the areas (xmin, ymin, xmax, ymax in coordinates relative to the wd x ht input image) where the group
+ * groupid differs between two snapshots of the forms list. returns FALSE if the changes are not bounded. */
+gboolean dt_masks_group_get_changed_area(GList *old_forms, GList *new_forms, const int groupid, const float wd,
+                                         const float ht, float area[4]);
 
 void dt_masks_form_remove(struct dt_iop_module_t *module, dt_masks_form_t *grp, dt_masks_form_t *form);
 void dt_masks_form_change_opacity(dt_masks_form_t *form, int parentid, int up);
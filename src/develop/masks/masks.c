@@ -2643,6 +2643,137 @@ char *dt_masks_group_get_hash_buffer(dt_masks_form_t *form, char *str)
   return str + pos;
 }
 
+static size_t _masks_point_size(const dt_masks_form_t *form)
+{
+  if(form->type & DT_MASKS_GROUP) return sizeof(dt_masks_point_group_t);
+  if(form->type & DT_MASKS_CIRCLE) return sizeof(dt_masks_point_circle_t);
+  if(form->type & DT_MASKS_PATH) return sizeof(dt_masks_point_path_t);
+  if(form->type & DT_MASKS_GRADIENT) return sizeof(dt_masks_point_gradient_t);
+  if(form->type & DT_MASKS_ELLIPSE) return sizeof(dt_masks_point_ellipse_t);
+  if(form->type & DT_MASKS_BRUSH) return sizeof(dt_masks_point_brush_t);
+  return 0;
+}
+
+static gboolean _masks_form_equal(const dt_masks_form_t *a, const dt_masks_form_t *b)
+{
+  if(a->type != b->type || a->version != b->version || a->source[0] != b->source[0]
+     || a->source[1] != b->source[1])
+    return FALSE;
+
+  const size_t size = _masks_point_size(a);
+  GList *pa = a->points, *pb = b->points;
+  for(; pa && pb; pa = g_list_next(pa), pb = g_list_next(pb))
+    if(memcmp(pa->data, pb->data, size)) return FALSE;
+  return pa == NULL && pb == NULL;
+}
+
+static inline void _masks_area_add(float area[4], const float x, const float y, const float rx, const float ry)
+{
+  area[0] = fminf(area[0], x - rx);
+  area[1] = fminf(area[1], y - ry);
+  area[2] = fmaxf(area[2], x + rx);
+  area[3] = fmaxf(area[3], y + ry);
+}
+
+static inline void _masks_area_add_bezier_point(float area[4], const float *corner, const float *ctrl1,
+                                                const float *ctrl2, const float *border, const float wd,
+                                                const float ht)
+{
+  // the curves stay inside the hull of their control points, the feathering adds the border around them
+  const float b = fmaxf(border[0], border[1]) * MIN(wd, ht);
+  _masks_area_add(area, corner[0], corner[1], b / wd, b / ht);
+  _masks_area_add(area, ctrl1[0], ctrl1[1], b / wd, b / ht);
+  _masks_area_add(area, ctrl2[0], ctrl2[1], b / wd, b / ht);
+}
+
+// grows area to contain the form including its border. returns FALSE for forms which are not bounded.
+static gboolean _masks_form_area_union(GList *forms, const dt_masks_form_t *form, const float wd, const float ht,
+                                       float area[4])
+{
+  if(form->type & DT_MASKS_GROUP)
+  {
+    for(GList *l = form->points; l; l = g_list_next(l))
+    {
+      const dt_masks_point_group_t *pt = (dt_masks_point_group_t *)l->data;
+      const dt_masks_form_t *f = dt_masks_get_from_id_ext(forms, pt->formid);
+      if(f && !_masks_form_area_union(forms, f, wd, ht, area)) return FALSE;
+    }
+  }
+  else if(form->type & DT_MASKS_CIRCLE)
+  {
+    if(!form->points) return TRUE;
+    const dt_masks_point_circle_t *circle = (dt_masks_point_circle_t *)form->points->data;
+    const float r = (circle->radius + circle->border) * MIN(wd, ht);
+    _masks_area_add(area, circle->center[0], circle->center[1], r / wd, r / ht);
+  }
+  else if(form->type & DT_MASKS_ELLIPSE)
+  {
+    if(!form->points) return TRUE;
+    // bound the rotated ellipse by the circle around its larger axis
+    const dt_masks_point_ellipse_t *ellipse = (dt_masks_point_ellipse_t *)form->points->data;
+    const float radius = MAX(ellipse->radius[0], ellipse->radius[1]);
+    const float r = (ellipse->flags & DT_MASKS_ELLIPSE_PROPORTIONAL ? radius * (1.0f + ellipse->border)
+                                                                    : radius + ellipse->border) * MIN(wd, ht);
+    _masks_area_add(area, ellipse->center[0], ellipse->center[1], r / wd, r / ht);
+  }
+  else if(form->type & DT_MASKS_PATH)
+  {
+    for(GList *l = form->points; l; l = g_list_next(l))
+    {
+      const dt_masks_point_path_t *pt = (dt_masks_point_path_t *)l->data;
+      _masks_area_add_bezier_point(area, pt->corner, pt->ctrl1, pt->ctrl2, pt->border, wd, ht);
+    }
+  }
+  else if(form->type & DT_MASKS_BRUSH)
+  {
+    for(GList *l = form->points; l; l = g_list_next(l))
+    {
+      const dt_masks_point_brush_t *pt = (dt_masks_point_brush_t *)l->data;
+      _masks_area_add_bezier_point(area, pt->corner, pt->ctrl1, pt->ctrl2, pt->border, wd, ht);
+    }
+  }
+  else
+  {
+    // gradients reach over the whole image
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static gboolean _masks_changed_area(GList *old_forms, GList *new_forms, const int formid, const float wd,
+                                    const float ht, float area[4])
+{
+  const dt_masks_form_t *old_form = dt_masks_get_from_id_ext(old_forms, formid);
+  const dt_masks_form_t *new_form = dt_masks_get_from_id_ext(new_forms, formid);
+  if(!old_form && !new_form) return TRUE;
+
+  if(!old_form || !new_form || !_masks_form_equal(old_form, new_form))
+  {
+    // the form changed as a whole: the old and the new shape are affected
+    return (!old_form || _masks_form_area_union(old_forms, old_form, wd, ht, area))
+           && (!new_form || _masks_form_area_union(new_forms, new_form, wd, ht, area));
+  }
+
+  // same group entries: look for changes of the members
+  if(new_form->type & DT_MASKS_GROUP)
+  {
+    for(GList *l = new_form->points; l; l = g_list_next(l))
+    {
+      const dt_masks_point_group_t *pt = (dt_masks_point_group_t *)l->data;
+      if(!_masks_changed_area(old_forms, new_forms, pt->formid, wd, ht, area)) return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+gboolean dt_masks_group_get_changed_area(GList *old_forms, GList *new_forms, const int groupid, const float wd,
+                                         const float ht, float area[4])
+{
+  area[0] = area[1] = FLT_MAX;
+  area[2] = area[3] = -FLT_MAX;
+  return _masks_changed_area(old_forms, new_forms, groupid, wd, ht, area);
+}
+
 void dt_masks_update_image(dt_develop_t *dev)
 {
   /* invalidate image data*/
@@ -20,6 +20,7 @@
 #include "develop/format.h"
 #include "develop/pixelpipe_hb.h"
 #include "libs/lib.h"
+#include <float.h>
 #include <stdlib.h>
 
 
@@ -32,7 +33,39 @@
 //   ping, pong, and priority buffer (focused plugin)
 // - drop read by the time another is requested (with priority, drop that, or alternating ping and pong?)
 
-int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size)
+#define DT_PIPECACHE_INVALID ((uint64_t)-1)
+
+static inline int64_t _line_age(const dt_dev_pixelpipe_cache_t *cache, const int k)
+{
+  return cache->clock - cache->used[k];
+}
+
+static inline int _line_lookup(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash)
+{
+  if(hash == DT_PIPECACHE_INVALID) return -1;
+  const gpointer line = g_hash_table_lookup(cache->index, &hash);
+  return line ? GPOINTER_TO_INT(line) - 1 : -1;
+}
+
+// the keys of the index point into cache->hash[], so the old key has to go before it's overwritten.
+static void _line_set_hash(dt_dev_pixelpipe_cache_t *cache, const int k, const uint64_t hash)
+{
+  if(cache->hash[k] != DT_PIPECACHE_INVALID) g_hash_table_remove(cache->index, &cache->hash[k]);
+  cache->hash[k] = hash;
+  cache->cost[k] = 0.0f;
+  if(hash != DT_PIPECACHE_INVALID) g_hash_table_insert(cache->index, &cache->hash[k], GINT_TO_POINTER(k + 1));
+}
+
+static void _line_free(dt_dev_pixelpipe_cache_t *cache, const int k)
+{
+  _line_set_hash(cache, k, DT_PIPECACHE_INVALID);
+  dt_free_align(cache->data[k]);
+  cache->allmem -= cache->size[k];
+  cache->data[k] = NULL;
+  cache->size[k] = 0;
+}
+
+int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size, size_t memlimit)
 {
   cache->entries = entries;
   cache->data = (void **)calloc(entries, sizeof(void *));
@@ -42,7 +75,12 @@ int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, si
   memset(cache->dsc, 0x2c, sizeof(dt_iop_buffer_dsc_t) * entries);
 #endif
   cache->hash = (uint64_t *)calloc(entries, sizeof(uint64_t));
-  cache->used = (int32_t *)calloc(entries, sizeof(int32_t));
+  cache->used = (int64_t *)calloc(entries, sizeof(int64_t));
+  cache->cost = (float *)calloc(entries, sizeof(float));
+  cache->index = g_hash_table_new(g_int64_hash, g_int64_equal);
+  cache->clock = 0;
+  cache->memlimit = memlimit;
+  cache->allmem = 0;
   for(int k = 0; k < entries; k++)
   {
     cache->size[k] = size;
@@ -54,12 +92,13 @@ int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, si
       memset(cache->data[k], 0x5d, size);
 #endif
       ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
+      cache->allmem += size;
     }
     else cache->data[k] = 0;
-    cache->hash[k] = -1;
+    cache->hash[k] = DT_PIPECACHE_INVALID;
     cache->used[k] = 0;
   }
-  cache->queries = cache->misses = 0;
+  cache->queries = cache->misses = cache->evictions = 0;
   return 1;
 
 alloc_memory_fail:
@@ -73,7 +112,9 @@ alloc_memory_fail:
     dt_free_align(cache->data[k]);
     cache->size[k] = 0;
     cache->data[k] = NULL;
+    cache->hash[k] = DT_PIPECACHE_INVALID;
   }
+  cache->allmem = 0;
   return 0;
 }
 
@@ -84,7 +125,10 @@ void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache)
   free(cache->dsc);
   free(cache->hash);
   free(cache->used);
+  free(cache->cost);
   free(cache->size);
+  g_hash_table_destroy(cache->index);
+  cache->index = NULL;
 }
 
 uint64_t dt_dev_pixelpipe_cache_hash(int imgid, const dt_iop_roi_t *roi, dt_dev_pixelpipe_t *pipe, int module)
@@ -124,10 +168,7 @@ uint64_t dt_dev_pixelpipe_cache_hash(int imgid, const dt_iop_roi_t *roi, dt_dev_
 
 int dt_dev_pixelpipe_cache_available(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash)
 {
-  // search for hash in cache
-  for(int32_t k = 0; k < cache->entries; k++)
-    if(cache->hash[k] == hash) return 1;
-  return 0;
+  return _line_lookup(cache, hash) >= 0;
 }
 
 int dt_dev_pixelpipe_cache_get_important(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size,
@@ -142,81 +183,178 @@ int dt_dev_pixelpipe_cache_get(dt_dev_pixelpipe_cache_t *cache, const uint64_t h
   return dt_dev_pixelpipe_cache_get_weighted(cache, hash, size, data, dsc, 0);
 }
 
-int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size,
-                                        void **data, dt_iop_buffer_dsc_t **dsc, int weight)
+// the line with the highest score is evicted first: old lines which were cheap to compute.
+static inline float _line_score(const dt_dev_pixelpipe_cache_t *cache, const int k)
 {
-  cache->queries++;
-  *data = NULL;
-  int max_used = -1, max = 0;
-  size_t sz = 0;
+  return _line_age(cache, k) / (1.0f + cache->cost[k]);
+}
+
+// lines which were handed out during the last query are still in use by the pipeline
+// (input of the module being processed), everything with a non-positive age has been
+// marked important. none of these may be recycled in budgeted mode.
+static inline gboolean _line_evictable(const dt_dev_pixelpipe_cache_t *cache, const int k)
+{
+  return _line_age(cache, k) > 1;
+}
+
+// find a line to recycle for a new buffer of the given size in budgeted mode.
+static int _budget_pick_line(dt_dev_pixelpipe_cache_t *cache, const size_t size)
+{
+  // empty or invalidated lines come first, preferably one which is large enough already
+  int free_line = -1;
   for(int k = 0; k < cache->entries; k++)
   {
-    // search for hash in cache
-    if(cache->used[k] > max_used)
+    if(cache->hash[k] != DT_PIPECACHE_INVALID || !_line_evictable(cache, k)) continue;
+    if(free_line < 0 || (cache->size[k] >= size && cache->size[free_line] < size)) free_line = k;
+  }
+  if(free_line >= 0) return free_line;
+
+  int victim = -1;
+  float max_score = 0.0f;
+  for(int k = 0; k < cache->entries; k++)
+  {
+    if(!_line_evictable(cache, k)) continue;
+    const float score = _line_score(cache, k);
+    if(victim < 0 || score > max_score)
     {
-      max_used = cache->used[k];
-      max = k;
+      victim = k;
+      max_score = score;
     }
-    cache->used[k]++; // age all entries
-    if(cache->hash[k] == hash)
-    {
-      *data = cache->data[k];
-      *dsc = &cache->dsc[k];
-      sz = cache->size[k];
-      cache->used[k] = weight; // this is the MRU entry
+  }
+  if(victim >= 0) return victim;
 
-      ASAN_POISON_MEMORY_REGION(*data, sz);
-      ASAN_UNPOISON_MEMORY_REGION(*data, size);
+  // everything is in use, fall back to plain LRU
+  int64_t max_age = INT64_MIN;
+  for(int k = 0; k < cache->entries; k++)
+  {
+    if(_line_age(cache, k) > max_age)
+    {
+      max_age = _line_age(cache, k);
+      victim = k;
     }
   }
+  return victim;
+}
 
-  if(!*data || sz < size)
+// free other lines until a buffer of the given size fits into the budget.
+static void _budget_make_room(dt_dev_pixelpipe_cache_t *cache, const int keep, const size_t size)
+{
+  while(cache->allmem + size > cache->memlimit)
   {
-    // kill LRU entry
-    // printf("[pixelpipe_cache_get] hash not found, returning slot %d/%d age %d\n", max, cache->entries,
-    // weight);
-    if(cache->size[max] < size)
+    int victim = -1;
+    float max_score = 0.0f;
+    for(int k = 0; k < cache->entries; k++)
     {
-      dt_free_align(cache->data[max]);
-      cache->data[max] = (void *)dt_alloc_align(64, size);
-      cache->size[max] = size;
+      if(k == keep || !cache->data[k] || !_line_evictable(cache, k)) continue;
+      // invalid lines don't hold anything worth keeping
+      const float score = cache->hash[k] == DT_PIPECACHE_INVALID ? FLT_MAX : _line_score(cache, k);
+      if(victim < 0 || score > max_score)
+      {
+        victim = k;
+        max_score = score;
+      }
     }
-    *data = cache->data[max];
-    sz = cache->size[max];
+    // the remaining buffers are all in use, temporarily exceed the budget
+    if(victim < 0) return;
+    if(cache->hash[victim] != DT_PIPECACHE_INVALID) cache->evictions++;
+    _line_free(cache, victim);
+  }
+}
 
-    ASAN_POISON_MEMORY_REGION(*data, sz);
-    ASAN_UNPOISON_MEMORY_REGION(*data, size);
+int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size,
+                                        void **data, dt_iop_buffer_dsc_t **dsc, int weight)
+{
+  cache->queries++;
+  cache->clock++; // age all entries
+  *data = NULL;
 
-    // first, update our copy, then update the pointer to point at our copy
-    cache->dsc[max] = **dsc;
-    *dsc = &cache->dsc[max];
+  const int line = _line_lookup(cache, hash);
+  if(line >= 0 && cache->size[line] >= size)
+  {
+    *data = cache->data[line];
+    *dsc = &cache->dsc[line];
+    cache->used[line] = cache->clock - weight; // this is the MRU entry
 
-    cache->hash[max] = hash;
-    cache->used[max] = weight;
-    cache->misses++;
-    return 1;
+    ASAN_POISON_MEMORY_REGION(*data, cache->size[line]);
+    ASAN_UNPOISON_MEMORY_REGION(*data, size);
+    return 0;
   }
+
+  // the cached buffer is too small for the request, it must not be found again
+  if(line >= 0) _line_set_hash(cache, line, DT_PIPECACHE_INVALID);
+
+  int max = 0;
+  if(cache->memlimit)
+    max = _budget_pick_line(cache, size);
   else
-    return 0;
+  {
+    // kill LRU entry
+    int64_t max_used = -1;
+    for(int k = 0; k < cache->entries; k++)
+    {
+      if(_line_age(cache, k) > max_used)
+      {
+        max_used = _line_age(cache, k);
+        max = k;
+      }
+    }
+  }
+  // printf("[pixelpipe_cache_get] hash not found, returning slot %d/%d age %d\n", max, cache->entries,
+  // weight);
+  // only count lines which actually held a buffer, not empty or invalidated ones
+  if(cache->hash[max] != DT_PIPECACHE_INVALID) cache->evictions++;
+  _line_set_hash(cache, max, DT_PIPECACHE_INVALID);
+  if(cache->size[max] < size)
+  {
+    dt_free_align(cache->data[max]);
+    cache->allmem -= cache->size[max];
+    cache->data[max] = NULL;
+    cache->size[max] = 0;
+    if(cache->memlimit) _budget_make_room(cache, max, size);
+    cache->data[max] = (void *)dt_alloc_align(64, size);
+    cache->size[max] = size;
+    cache->allmem += size;
+  }
+  *data = cache->data[max];
+
+  ASAN_POISON_MEMORY_REGION(*data, cache->size[max]);
+  ASAN_UNPOISON_MEMORY_REGION(*data, size);
+
+  // first, update our copy, then update the pointer to point at our copy
+  cache->dsc[max] = **dsc;
+  *dsc = &cache->dsc[max];
+
+  _line_set_hash(cache, max, hash);
+  cache->used[max] = cache->clock - weight;
+  cache->misses++;
+  return 1;
 }
 
 void dt_dev_pixelpipe_cache_flush(dt_dev_pixelpipe_cache_t *cache)
 {
+  g_hash_table_remove_all(cache->index);
   for(int k = 0; k < cache->entries; k++)
   {
-    cache->hash[k] = -1;
-    cache->used[k] = 0;
+    cache->hash[k] = DT_PIPECACHE_INVALID;
+    cache->used[k] = cache->clock;
+    cache->cost[k] = 0.0f;
     ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
   }
 }
 
+void dt_dev_pixelpipe_cache_set_cost(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const float cost)
+{
+  const int line = _line_lookup(cache, hash);
+  if(line >= 0) cache->cost[line] = cost;
+}
+
 void dt_dev_pixelpipe_cache_reweight(dt_dev_pixelpipe_cache_t *cache, void *data)
 {
   for(int k = 0; k < cache->entries; k++)
   {
     if(cache->data[k] == data)
     {
-      cache->used[k] = -cache->entries;
+      cache->used[k] = cache->clock + cache->entries;
     }
   }
 }
@@ -227,7 +365,7 @@ void dt_dev_pixelpipe_cache_invalidate(dt_dev_pixelpipe_cache_t *cache, void *da
   {
     if(cache->data[k] == data)
     {
-      cache->hash[k] = -1;
+      _line_set_hash(cache, k, DT_PIPECACHE_INVALID);
       ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
     }
   }
@@ -237,11 +375,18 @@ void dt_dev_pixelpipe_cache_print(dt_dev_pixelpipe_cache_t *cache)
 {
   for(int k = 0; k < cache->entries; k++)
   {
+    if(cache->memlimit && !cache->data[k]) continue;
     printf("pixelpipe cacheline %d ", k);
-    printf("used %d by %" PRIu64 "", cache->used[k], cache->hash[k]);
+    printf("used %" PRId64 " by %" PRIu64 "", _line_age(cache, k), cache->hash[k]);
+    if(cache->memlimit) printf(", %.1f MB, cost %.1f ms", cache->size[k] / (1024.0 * 1024.0), cache->cost[k]);
     printf("\n");
   }
-  printf("cache hit rate so far: %.3f\n", (cache->queries - cache->misses) / (float)cache->queries);
+  printf("cache hits %" PRIu64 ", misses %" PRIu64 ", evictions %" PRIu64 ", hit rate so far: %.3f\n",
+         cache->queries - cache->misses, cache->misses, cache->evictions,
+         (cache->queries - cache->misses) / (float)cache->queries);
+  if(cache->memlimit)
+    printf("cache memory %.1f of %.1f MB\n", cache->allmem / (1024.0 * 1024.0),
+           cache->memlimit / (1024.0 * 1024.0));
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
@@ -18,8 +18,12 @@
 
 #pragma once
 
+#include <glib.h>
 #include <inttypes.h>
 
+// number of cache lines of a pipe in budgeted mode
+#define DT_DEV_PIXELPIPE_CACHE_MAX_ENTRIES 64
+
 struct dt_dev_pixelpipe_t;
 struct dt_iop_buffer_dsc_t;
 struct dt_iop_roi_t;
@@ -27,7 +31,13 @@ struct dt_iop_roi_t;
 /**
  * implements a simple pixel cache suitable for caching float images
  * corresponding to history items and zoom/pan settings in the develop module.
- * it is optimized for very few entries (~5), so most operations are O(N).
+ *
+ * cache lines are found through a hash index. there are two modes:
+ * - fixed: a small number of lines (~5) which are recycled in LRU order.
+ * - budgeted (memlimit > 0): up to `entries' lines, but the total size of all
+ *   buffers is bounded by memlimit bytes. when the budget is exceeded, lines are
+ *   evicted by age weighted with the time it took to compute them, so expensive
+ *   outputs (demosaic, denoise) survive longer than cheap ones.
  */
 
 typedef struct dt_dev_pixelpipe_cache_t
@@ -37,19 +47,31 @@ typedef struct dt_dev_pixelpipe_cache_t
   size_t *size;
   struct dt_iop_buffer_dsc_t *dsc;
   uint64_t *hash;
-  int32_t *used;
+  // age of line k is (clock - used[k]), so aging all lines is O(1)
+  int64_t *used;
+  // time in ms it took to compute the content of the line
+  float *cost;
 #ifdef HAVE_OPENCL
   void **gpu_mem;
 #endif
+  // hash -> line index + 1
+  GHashTable *index;
+  int64_t clock;
+  // byte budget for all lines, 0 for the fixed mode
+  size_t memlimit;
+  size_t allmem;
   // profiling:
   uint64_t queries;
   uint64_t misses;
+  uint64_t evictions;
 } dt_dev_pixelpipe_cache_t;
 
 /** constructs a new cache with given cache line count (entries) and float buffer entry size in bytes.
+  if memlimit is non-zero, the cache works in budgeted mode and will not keep more than memlimit bytes
+  (except for lines which are in use by the pipeline right now).
   \param[out] returns 0 if fail to allocate mem cache.
 */
-int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size);
+int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size, size_t memlimit);
 void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache);
 
 /** creates a hopefully unique hash from the complete module stack up to the module-th. */
@@ -72,6 +94,9 @@ int dt_dev_pixelpipe_cache_available(dt_dev_pixelpipe_cache_t *cache, const uint
 /** invalidates all cachelines. */
 void dt_dev_pixelpipe_cache_flush(dt_dev_pixelpipe_cache_t *cache);
 
+/** records how long (in ms) it took to compute the cache line with the given hash. */
+void dt_dev_pixelpipe_cache_set_cost(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const float cost);
+
 /** makes this buffer very important after it has been pulled from the cache. */
 void dt_dev_pixelpipe_cache_reweight(dt_dev_pixelpipe_cache_t *cache, void *data);
 
@@ -0,0 +1,454 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "develop/pixelpipe_cache_disk.h"
+#include "common/darktable.h"
+#include "common/database.h"
+#include "common/file_location.h"
+#include "common/grealpath.h"
+#include "common/image.h"
+#include "control/conf.h"
+#include "control/jobs.h"
+#include "develop/format.h"
+#include "develop/pixelpipe_hb.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DT_PIPECACHE_DISK_MAGIC "dtpipe1"
+
+typedef struct _disk_header_t
+{
+  char magic[8];
+  uint32_t dsc_size;
+  uint32_t half;
+  int32_t width;
+  int32_t height;
+  uint64_t key;
+  // size of the buffer in memory
+  uint64_t size;
+  dt_iop_buffer_dsc_t dsc;
+} _disk_header_t;
+
+// a buffer on its way to the disk, owned by the background job
+typedef struct _disk_write_t
+{
+  dt_dev_pixelpipe_cache_disk_t *cache;
+  uint64_t key;
+  void *data;
+  int width, height;
+  dt_iop_buffer_dsc_t dsc;
+} _disk_write_t;
+
+typedef struct _disk_file_t
+{
+  gchar *filename;
+  size_t size;
+  time_t mtime;
+} _disk_file_t;
+
+// operations whose output is expensive enough to be kept on disk
+static const char *_disk_cache_ops[] = { "demosaic", "rawdenoise", "denoiseprofile", "nlmeans", NULL };
+
+static inline uint16_t _float_to_half(const float f)
+{
+  union { float f; uint32_t i; } u = { .f = f };
+  const uint32_t sign = (u.i >> 16) & 0x8000;
+  const int32_t exponent = (int32_t)((u.i >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = u.i & 0x7fffff;
+
+  if(((u.i >> 23) & 0xff) == 0xff) return sign | 0x7c00 | (mantissa ? 0x200 : 0); // inf or nan
+  if(exponent >= 0x1f) return sign | 0x7c00; // too large, clamp to inf
+  if(exponent <= 0)
+  {
+    // subnormal or zero
+    if(exponent < -10) return sign;
+    mantissa |= 0x800000;
+    const int shift = 14 - exponent;
+    uint32_t h = mantissa >> shift;
+    if((mantissa >> (shift - 1)) & 1) h++; // round to nearest
+    return sign | h;
+  }
+  uint32_t h = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+  if(mantissa & 0x1000) h++; // round to nearest, a carry into the exponent is fine
+  return h;
+}
+
+static inline float _half_to_float(const uint16_t h)
+{
+  const uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  const uint32_t exponent = (h >> 10) & 0x1f;
+  const uint32_t mantissa = h & 0x3ff;
+  union { float f; uint32_t i; } u;
+
+  if(exponent == 0x1f)
+    u.i = sign | 0x7f800000 | (mantissa << 13);
+  else if(exponent == 0)
+  {
+    u.f = mantissa * (1.0f / 16777216.0f);
+    u.i |= sign;
+  }
+  else
+    u.i = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+  return u.f;
+}
+
+static inline uint64_t _hash_bytes(uint64_t hash, const void *data, const size_t size)
+{
+  // bernstein hash (djb2), as for the in-memory cache
+  const char *str = (const char *)data;
+  for(size_t i = 0; i < size; i++) hash = ((hash << 5) + hash) ^ str[i];
+  return hash;
+}
+
+static void _filename(const dt_dev_pixelpipe_cache_disk_t *cache, const uint64_t key, char *filename,
+                      const size_t size)
+{
+  snprintf(filename, size, "%s/%016" PRIx64 ".dtpc", cache->cachedir, key);
+}
+
+static gint _sort_by_mtime(gconstpointer a, gconstpointer b)
+{
+  const _disk_file_t *fa = (const _disk_file_t *)a;
+  const _disk_file_t *fb = (const _disk_file_t *)b;
+  return (fa->mtime > fb->mtime) - (fa->mtime < fb->mtime);
+}
+
+static void _free_file(gpointer data)
+{
+  _disk_file_t *file = (_disk_file_t *)data;
+  g_free(file->filename);
+  free(file);
+}
+
+static GList *_list_files(const dt_dev_pixelpipe_cache_disk_t *cache, size_t *allmem)
+{
+  GList *files = NULL;
+  *allmem = 0;
+  GDir *dir = g_dir_open(cache->cachedir, 0, NULL);
+  if(!dir) return NULL;
+
+  const gchar *name;
+  while((name = g_dir_read_name(dir)))
+  {
+    if(!g_str_has_suffix(name, ".dtpc")) continue;
+    gchar *filename = g_build_filename(cache->cachedir, name, NULL);
+    GStatBuf st;
+    if(g_stat(filename, &st) == 0)
+    {
+      _disk_file_t *file = (_disk_file_t *)malloc(sizeof(_disk_file_t));
+      file->filename = filename;
+      file->size = st.st_size;
+      file->mtime = st.st_mtime;
+      files = g_list_prepend(files, file);
+      *allmem += st.st_size;
+    }
+    else
+      g_free(filename);
+  }
+  g_dir_close(dir);
+  return files;
+}
+
+// remove least recently used files until we are well below the limit. called with the lock held.
+static void _garbage_collect(dt_dev_pixelpipe_cache_disk_t *cache)
+{
+  GList *files = g_list_sort(_list_files(cache, &cache->allmem), _sort_by_mtime);
+  const size_t target = cache->memlimit - cache->memlimit / 10;
+  for(GList *iter = files; iter && cache->allmem > target; iter = g_list_next(iter))
+  {
+    _disk_file_t *file = (_disk_file_t *)iter->data;
+    if(g_unlink(file->filename) == 0) cache->allmem -= MIN(cache->allmem, file->size);
+  }
+  g_list_free_full(files, _free_file);
+}
+
+void dt_dev_pixelpipe_cache_disk_init(dt_dev_pixelpipe_cache_disk_t *cache)
+{
+  dt_pthread_mutex_init(&cache->lock, NULL);
+  cache->cachedir[0] = '\0';
+  cache->allmem = cache->hits = cache->writes = 0;
+  const int64_t limit = dt_conf_get_int64("pixelpipe_disk_cache_size");
+  cache->memlimit = limit > 0 ? (size_t)limit : 0;
+  cache->half = dt_conf_get_bool("pixelpipe_disk_cache_half");
+  if(!cache->memlimit) return;
+
+  // image ids are only unique within one library
+  const gchar *dbfilename = dt_database_get_path(darktable.db);
+  if(!strcmp(dbfilename, ":memory:"))
+  {
+    cache->memlimit = 0;
+    return;
+  }
+  gchar *abspath = g_realpath(dbfilename);
+  if(!abspath) abspath = g_strdup(dbfilename);
+  cache->salt = _hash_bytes(5381, abspath, strlen(abspath));
+  cache->salt = _hash_bytes(cache->salt, darktable_package_version, strlen(darktable_package_version));
+  g_free(abspath);
+
+  char cachedir[PATH_MAX] = { 0 };
+  dt_loc_get_user_cache_dir(cachedir, sizeof(cachedir));
+  snprintf(cache->cachedir, sizeof(cache->cachedir), "%s/pixelpipe", cachedir);
+  if(g_mkdir_with_parents(cache->cachedir, 0750))
+  {
+    fprintf(stderr, "[pixelpipe_cache_disk] could not create directory `%s'\n", cache->cachedir);
+    cache->cachedir[0] = '\0';
+    return;
+  }
+
+  g_list_free_full(_list_files(cache, &cache->allmem), _free_file);
+  if(cache->allmem > cache->memlimit) _garbage_collect(cache);
+}
+
+void dt_dev_pixelpipe_cache_disk_cleanup(dt_dev_pixelpipe_cache_disk_t *cache)
+{
+  dt_print(DT_DEBUG_DEV, "[pixelpipe_cache_disk] %" PRIu64 " hits, %" PRIu64 " writes, %.1f MB on disk\n",
+           cache->hits, cache->writes, cache->allmem / (1024.0 * 1024.0));
+  dt_pthread_mutex_destroy(&cache->lock);
+}
+
+gboolean dt_dev_pixelpipe_cache_disk_wanted(const dt_dev_pixelpipe_cache_disk_t *cache,
+                                            const dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_iop_t *piece,
+                                            const dt_iop_roi_t *roi)
+{
+  if(!cache->memlimit || !cache->cachedir[0]) return FALSE;
+  // the full pipe sees a new region with every pan and zoom, only keep the one which shows all of the image
+  if(pipe->type == DT_DEV_PIXELPIPE_FULL)
+  {
+    if(roi->scale != 1.0f || roi->x != 0 || roi->y != 0 || roi->width != piece->buf_out.width
+       || roi->height != piece->buf_out.height)
+      return FALSE;
+  }
+  else if(pipe->type != DT_DEV_PIXELPIPE_PREVIEW)
+    return FALSE;
+  for(const char **o = _disk_cache_ops; *o; o++)
+    if(!strcmp(*o, piece->module->op)) return TRUE;
+  return FALSE;
+}
+
+uint64_t dt_dev_pixelpipe_cache_disk_source(const dt_dev_pixelpipe_cache_disk_t *cache,
+                                            const dt_dev_pixelpipe_t *pipe)
+{
+  if(!cache->memlimit || !cache->cachedir[0]) return 0;
+  if(pipe->type != DT_DEV_PIXELPIPE_FULL && pipe->type != DT_DEV_PIXELPIPE_PREVIEW) return 0;
+
+  // image ids are reused after a removal and the file behind an id can be replaced on disk,
+  // so the source file itself has to be part of the key as well
+  char pathname[PATH_MAX] = { 0 };
+  gboolean from_cache = FALSE;
+  dt_image_full_path(pipe->image.id, pathname, sizeof(pathname), &from_cache);
+  uint64_t source = _hash_bytes(5381, pathname, strlen(pathname));
+  GStatBuf st;
+  if(pathname[0] && g_stat(pathname, &st) == 0)
+  {
+    const int64_t size = st.st_size, mtime = st.st_mtime;
+    source = _hash_bytes(source, &size, sizeof(size));
+    source = _hash_bytes(source, &mtime, sizeof(mtime));
+  }
+  return source;
+}
+
+uint64_t dt_dev_pixelpipe_cache_disk_key(const dt_dev_pixelpipe_cache_disk_t *cache,
+                                         const dt_dev_pixelpipe_t *pipe, const uint64_t hash)
+{
+  // the in-memory hash does not know about the input buffer, which differs between pipes
+  uint64_t key = _hash_bytes(cache->salt, &hash, sizeof(hash));
+  key = _hash_bytes(key, &pipe->type, sizeof(pipe->type));
+  key = _hash_bytes(key, &pipe->iwidth, sizeof(pipe->iwidth));
+  key = _hash_bytes(key, &pipe->iheight, sizeof(pipe->iheight));
+  return _hash_bytes(key, &pipe->disk_cache_source, sizeof(pipe->disk_cache_source));
+}
+
+gboolean dt_dev_pixelpipe_cache_disk_available(const dt_dev_pixelpipe_cache_disk_t *cache, const uint64_t key)
+{
+  char filename[PATH_MAX] = { 0 };
+  _filename(cache, key, filename, sizeof(filename));
+  return g_file_test(filename, G_FILE_TEST_IS_REGULAR);
+}
+
+int dt_dev_pixelpipe_cache_disk_read(dt_dev_pixelpipe_cache_disk_t *cache, const uint64_t key, void *data,
+                                     const size_t size, dt_iop_buffer_dsc_t *dsc)
+{
+  char filename[PATH_MAX] = { 0 };
+  _filename(cache, key, filename, sizeof(filename));
+
+  GMappedFile *map = g_mapped_file_new(filename, FALSE, NULL);
+  if(!map) return 1;
+
+  int res = 1;
+  _disk_header_t header;
+  const size_t length = g_mapped_file_get_length(map);
+  const char *contents = g_mapped_file_get_contents(map);
+  if(length < sizeof(header)) goto error;
+
+  memcpy(&header, contents, sizeof(header));
+  if(memcmp(header.magic, DT_PIPECACHE_DISK_MAGIC, sizeof(header.magic))
+     || header.dsc_size != sizeof(dt_iop_buffer_dsc_t) || header.key != key || header.size != size)
+    goto error;
+  if(length != sizeof(header) + (header.half ? size / 2 : size)) goto error;
+
+  const char *payload = contents + sizeof(header);
+  if(header.half)
+  {
+    float *out = (float *)data;
+    const uint16_t *in = (const uint16_t *)payload;
+    const size_t n = size / sizeof(float);
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(in, n, out) schedule(static)
+#endif
+    for(size_t k = 0; k < n; k++) out[k] = _half_to_float(in[k]);
+  }
+  else
+    memcpy(data, payload, size);
+
+  struct dt_iop_order_iccprofile_info_t *work_profile_info = dsc->work_profile_info;
+  *dsc = header.dsc;
+  dsc->work_profile_info = work_profile_info;
+
+  // mark as recently used
+  g_utime(filename, NULL);
+  dt_pthread_mutex_lock(&cache->lock);
+  cache->hits++;
+  dt_pthread_mutex_unlock(&cache->lock);
+  res = 0;
+
+error:
+  g_mapped_file_unref(map);
+  return res;
+}
+
+static size_t _payload_size(const dt_dev_pixelpipe_cache_disk_t *cache, const int width, const int height,
+                            const dt_iop_buffer_dsc_t *dsc, gboolean *half)
+{
+  const size_t size = dt_iop_buffer_dsc_to_bpp(dsc) * width * height;
+  *half = cache->half && dsc->datatype == TYPE_FLOAT;
+  return *half ? size / 2 : size;
+}
+
+static int _write(dt_dev_pixelpipe_cache_disk_t *cache, const uint64_t key, const void *data, const int width,
+                  const int height, const dt_iop_buffer_dsc_t *dsc)
+{
+  _disk_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, DT_PIPECACHE_DISK_MAGIC, sizeof(header.magic));
+  header.dsc_size = sizeof(dt_iop_buffer_dsc_t);
+  gboolean half = FALSE;
+  const size_t payload_size = _payload_size(cache, width, height, dsc, &half);
+  header.half = half;
+  header.width = width;
+  header.height = height;
+  header.key = key;
+  header.size = dt_iop_buffer_dsc_to_bpp(dsc) * width * height;
+  header.dsc = *dsc;
+  header.dsc.work_profile_info = NULL;
+
+  void *payload = (void *)data;
+  if(header.half)
+  {
+    payload = dt_alloc_align(64, payload_size);
+    if(!payload) return 1;
+    const float *in = (const float *)data;
+    uint16_t *out = (uint16_t *)payload;
+    const size_t n = header.size / sizeof(float);
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(in, n, out) schedule(static)
+#endif
+    for(size_t k = 0; k < n; k++) out[k] = _float_to_half(in[k]);
+  }
+
+  // write to a temporary file and move it in place, so readers never see partial files
+  char filename[PATH_MAX] = { 0 };
+  _filename(cache, key, filename, sizeof(filename));
+  gchar *tmpname = g_strdup_printf("%s.%p.tmp", filename, (void *)g_thread_self());
+
+  int res = 1;
+  FILE *f = g_fopen(tmpname, "wb");
+  if(f)
+  {
+    const gboolean written = fwrite(&header, sizeof(header), 1, f) == 1
+                             && fwrite(payload, payload_size, 1, f) == 1;
+    fclose(f);
+    if(written && g_rename(tmpname, filename) == 0)
+      res = 0;
+    else
+      g_unlink(tmpname);
+  }
+  g_free(tmpname);
+  if(payload != data) dt_free_align(payload);
+  if(res) return res;
+
+  dt_pthread_mutex_lock(&cache->lock);
+  cache->writes++;
+  cache->allmem += sizeof(header) + payload_size;
+  if(cache->allmem > cache->memlimit) _garbage_collect(cache);
+  dt_pthread_mutex_unlock(&cache->lock);
+  return 0;
+}
+
+static int32_t _write_job_run(dt_job_t *job)
+{
+  _disk_write_t *params = (_disk_write_t *)dt_control_job_get_params(job);
+  _write(params->cache, params->key, params->data, params->width, params->height, &params->dsc);
+  return 0;
+}
+
+static void _write_job_cleanup(void *data)
+{
+  _disk_write_t *params = (_disk_write_t *)data;
+  dt_free_align(params->data);
+  free(params);
+}
+
+int dt_dev_pixelpipe_cache_disk_write(dt_dev_pixelpipe_cache_disk_t *cache, const uint64_t key, const void *data,
+                                      const int width, const int height, const dt_iop_buffer_dsc_t *dsc)
+{
+  gboolean half = FALSE;
+  // don't thrash the cache with buffers which would evict everything else
+  if(sizeof(_disk_header_t) + _payload_size(cache, width, height, dsc, &half) > cache->memlimit / 4) return 1;
+
+  _disk_write_t *params = (_disk_write_t *)calloc(1, sizeof(_disk_write_t));
+  if(!params) return 1;
+  const size_t size = dt_iop_buffer_dsc_to_bpp(dsc) * width * height;
+  params->data = dt_alloc_align(64, size);
+  if(!params->data)
+  {
+    free(params);
+    return 1;
+  }
+  memcpy(params->data, data, size);
+  params->cache = cache;
+  params->key = key;
+  params->width = width;
+  params->height = height;
+  params->dsc = *dsc;
+
+  dt_job_t *job = dt_control_job_create(&_write_job_run, "write pixelpipe cache");
+  if(!job)
+  {
+    _write_job_cleanup(params);
+    return 1;
+  }
+  dt_control_job_set_params(job, params, _write_job_cleanup);
+  return dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG, job);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
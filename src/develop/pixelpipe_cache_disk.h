@@ -0,0 +1,90 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/dtpthread.h"
+
+#include <glib.h>
+#include <inttypes.h>
+#include <limits.h>
+
+struct dt_dev_pixelpipe_t;
+struct dt_dev_pixelpipe_iop_t;
+struct dt_iop_buffer_dsc_t;
+struct dt_iop_roi_t;
+
+/**
+ * second level, disk backed cache for expensive pixelpipe intermediates (demosaic, denoise).
+ * buffers are stored one file per cache line under the user cache directory, keyed on the
+ * pixelpipe cache hash, and are read back through a memory mapping. the least recently used
+ * files are removed when the total size exceeds the configured limit.
+ */
+
+typedef struct dt_dev_pixelpipe_cache_disk_t
+{
+  dt_pthread_mutex_t lock;
+  // directory holding the cache files, empty if the disk cache is disabled
+  char cachedir[PATH_MAX];
+  // salt for the keys: darktable version and library
+  uint64_t salt;
+  // size limit of all files in bytes and current size
+  size_t memlimit;
+  size_t allmem;
+  // store float buffers as half floats
+  gboolean half;
+  // profiling:
+  uint64_t hits;
+  uint64_t writes;
+} dt_dev_pixelpipe_cache_disk_t;
+
+void dt_dev_pixelpipe_cache_disk_init(dt_dev_pixelpipe_cache_disk_t *cache);
+void dt_dev_pixelpipe_cache_disk_cleanup(dt_dev_pixelpipe_cache_disk_t *cache);
+
+/** true if the output of the piece for roi is worth keeping on disk. that is the case for expensive
+ *  operations in the preview pipe, and in the full pipe when it processes all of the image at scale 1. */
+gboolean dt_dev_pixelpipe_cache_disk_wanted(const dt_dev_pixelpipe_cache_disk_t *cache,
+                                            const struct dt_dev_pixelpipe_t *pipe,
+                                            const struct dt_dev_pixelpipe_iop_t *piece,
+                                            const struct dt_iop_roi_t *roi);
+
+/** hash of path, size and modification time of the source image of the pipe. it needs a database query
+ *  and a stat(), so it is computed once per image and kept in pipe->disk_cache_source. */
+uint64_t dt_dev_pixelpipe_cache_disk_source(const dt_dev_pixelpipe_cache_disk_t *cache,
+                                            const struct dt_dev_pixelpipe_t *pipe);
+
+/** combines the in-memory cache hash with everything else that identifies the buffer across sessions,
+ *  including pipe->disk_cache_source. */
+uint64_t dt_dev_pixelpipe_cache_disk_key(const dt_dev_pixelpipe_cache_disk_t *cache,
+                                         const struct dt_dev_pixelpipe_t *pipe, const uint64_t hash);
+
+/** test availability of a buffer on disk. */
+gboolean dt_dev_pixelpipe_cache_disk_available(const dt_dev_pixelpipe_cache_disk_t *cache, const uint64_t key);
+
+/** reads the buffer for key into data (of size bytes) and its format into dsc. returns 0 on success. */
+int dt_dev_pixelpipe_cache_disk_read(dt_dev_pixelpipe_cache_disk_t *cache, const uint64_t key, void *data,
+                                     const size_t size, struct dt_iop_buffer_dsc_t *dsc);
+
+/** copies width x height pixels in data with format dsc and writes them for the given key in a background job.
+ *  returns 0 if the job was queued. */
+int dt_dev_pixelpipe_cache_disk_write(dt_dev_pixelpipe_cache_disk_t *cache, const uint64_t key, const void *data,
+                                      const int width, const int height, const struct dt_iop_buffer_dsc_t *dsc);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
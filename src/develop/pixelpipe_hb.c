@@ -27,6 +27,8 @@
 #include "develop/format.h"
 #include "develop/imageop_math.h"
 #include "develop/pixelpipe.h"
+#include "develop/pixelpipe_cache_disk.h"
+#include "develop/pixelpipe_profile.h"
 #include "develop/tiling.h"
 #include "develop/masks.h"
 #include "gui/gtk.h"
@@ -35,6 +37,7 @@
 #include "gui/color_picker_proxy.h"
 
 #include <assert.h>
+#include <float.h>
 #include <math.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -66,6 +69,11 @@ typedef enum dt_pixelpipe_picker_source_t
 static void get_output_format(dt_iop_module_t *module, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece,
                               dt_develop_t *dev, dt_iop_buffer_dsc_t *dsc);
 
+static inline dt_dev_pixelpipe_cache_t *_pipe_cache(dt_dev_pixelpipe_t *pipe)
+{
+  return pipe->bypass_cache ? &(pipe->scratch_cache) : &(pipe->cache);
+}
+
 static char *_pipe_type_to_str(int pipe_type)
 {
   char *r;
@@ -96,7 +104,7 @@ static char *_pipe_type_to_str(int pipe_type)
 int dt_dev_pixelpipe_init_export(dt_dev_pixelpipe_t *pipe, int32_t width, int32_t height, int levels,
                                  gboolean store_masks)
 {
-  int res = dt_dev_pixelpipe_init_cached(pipe, 4 * sizeof(float) * width * height, 2);
+  int res = dt_dev_pixelpipe_init_cached(pipe, 4 * sizeof(float) * width * height, 2, 0);
   pipe->type = DT_DEV_PIXELPIPE_EXPORT;
   pipe->levels = levels;
   pipe->store_all_raster_masks = store_masks;
@@ -105,23 +113,32 @@ int dt_dev_pixelpipe_init_export(dt_dev_pixelpipe_t *pipe, int32_t width, int32_
 
 int dt_dev_pixelpipe_init_thumbnail(dt_dev_pixelpipe_t *pipe, int32_t width, int32_t height)
 {
-  int res = dt_dev_pixelpipe_init_cached(pipe, 4 * sizeof(float) * width * height, 2);
+  int res = dt_dev_pixelpipe_init_cached(pipe, 4 * sizeof(float) * width * height, 2, 0);
   pipe->type = DT_DEV_PIXELPIPE_THUMBNAIL;
   return res;
 }
 
 int dt_dev_pixelpipe_init_dummy(dt_dev_pixelpipe_t *pipe, int32_t width, int32_t height)
 {
-  int res = dt_dev_pixelpipe_init_cached(pipe, 4 * sizeof(float) * width * height, 0);
+  int res = dt_dev_pixelpipe_init_cached(pipe, 4 * sizeof(float) * width * height, 0, 0);
   pipe->type = DT_DEV_PIXELPIPE_THUMBNAIL;
   return res;
 }
 
+// cache setup of the interactive pipes: a few cache lines, or many lines within a memory budget
+static int32_t _darkroom_cache_entries(size_t *memlimit)
+{
+  const int64_t cache_memory = dt_conf_get_int64("pixelpipe_cache_memory");
+  *memlimit = cache_memory > 0 ? (size_t)cache_memory : 0;
+  return *memlimit ? DT_DEV_PIXELPIPE_CACHE_MAX_ENTRIES : 5;
+}
+
 int dt_dev_pixelpipe_init_preview(dt_dev_pixelpipe_t *pipe)
 {
   // don't know which buffer size we're going to need, set to 0 (will be alloced on demand)
-  int res = dt_dev_pixelpipe_init_cached(
-      pipe, 0, 5);
+  size_t memlimit = 0;
+  const int32_t entries = _darkroom_cache_entries(&memlimit);
+  int res = dt_dev_pixelpipe_init_cached(pipe, 0, entries, memlimit);
   pipe->type = DT_DEV_PIXELPIPE_PREVIEW;
   return res;
 }
@@ -129,7 +146,7 @@ int dt_dev_pixelpipe_init_preview(dt_dev_pixelpipe_t *pipe)
 int dt_dev_pixelpipe_init_preview2(dt_dev_pixelpipe_t *pipe)
 {
   // don't know which buffer size we're going to need, set to 0 (will be alloced on demand)
-  int res = dt_dev_pixelpipe_init_cached(pipe, 0, 5);
+  int res = dt_dev_pixelpipe_init_cached(pipe, 0, 5, 0);
   pipe->type = DT_DEV_PIXELPIPE_PREVIEW2;
   return res;
 }
@@ -137,13 +154,14 @@ int dt_dev_pixelpipe_init_preview2(dt_dev_pixelpipe_t *pipe)
 int dt_dev_pixelpipe_init(dt_dev_pixelpipe_t *pipe)
 {
   // don't know which buffer size we're going to need, set to 0 (will be alloced on demand)
-  int res = dt_dev_pixelpipe_init_cached(
-      pipe, 0, 5);
+  size_t memlimit = 0;
+  const int32_t entries = _darkroom_cache_entries(&memlimit);
+  int res = dt_dev_pixelpipe_init_cached(pipe, 0, entries, memlimit);
   pipe->type = DT_DEV_PIXELPIPE_FULL;
   return res;
 }
 
-int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t entries)
+int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t entries, size_t memlimit)
 {
   pipe->devid = -1;
   pipe->changed = DT_DEV_PIPE_UNCHANGED;
@@ -151,8 +169,11 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
   pipe->processed_height = pipe->backbuf_height = pipe->iheight = 0;
   pipe->nodes = NULL;
   pipe->backbuf_size = size;
-  if(!dt_dev_pixelpipe_cache_init(&(pipe->cache), entries, pipe->backbuf_size)) return 0;
+  if(!dt_dev_pixelpipe_cache_init(&(pipe->cache), entries, pipe->backbuf_size, memlimit)) return 0;
+  // enough for one run, like the export pipe
+  if(!dt_dev_pixelpipe_cache_init(&(pipe->scratch_cache), 2, 0, 0)) return 0;
   pipe->cache_obsolete = 0;
+  pipe->bypass_cache = 0;
   pipe->backbuf = NULL;
   pipe->backbuf_scale = 0.0f;
   pipe->backbuf_zoom_x = 0.0f;
@@ -162,11 +183,15 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
   pipe->output_backbuf_width = 0;
   pipe->output_backbuf_height = 0;
   pipe->output_imgid = 0;
+  pipe->output_forms = NULL;
+  pipe->disk_cache_imgid = -1;
+  pipe->disk_cache_source = 0;
 
   pipe->processing = 0;
   pipe->shutdown = 0;
   pipe->opencl_error = 0;
   pipe->tiling = 0;
+  pipe->profile = NULL;
   pipe->mask_display = DT_DEV_PIXELPIPE_DISPLAY_NONE;
   pipe->bypass_blendif = 0;
   pipe->input_timestamp = 0;
@@ -193,6 +218,13 @@ void dt_dev_pixelpipe_set_input(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, flo
   pipe->input = input;
   pipe->image = dev->image_storage;
   get_output_format(NULL, pipe, NULL, dev, &pipe->dsc);
+
+  // set_input() comes with every processing run, only look at the source file when the image changed
+  if(pipe->disk_cache_imgid != pipe->image.id)
+  {
+    pipe->disk_cache_source = dt_dev_pixelpipe_cache_disk_source(darktable.pipe_cache_disk, pipe);
+    pipe->disk_cache_imgid = pipe->image.id;
+  }
 }
 
 void dt_dev_pixelpipe_set_icc(dt_dev_pixelpipe_t *pipe, dt_colorspaces_color_profile_type_t icc_type,
@@ -212,6 +244,7 @@ void dt_dev_pixelpipe_cleanup(dt_dev_pixelpipe_t *pipe)
   dt_dev_pixelpipe_cleanup_nodes(pipe);
   // so now it's safe to clean up cache:
   dt_dev_pixelpipe_cache_cleanup(&(pipe->cache));
+  dt_dev_pixelpipe_cache_cleanup(&(pipe->scratch_cache));
   dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
   dt_pthread_mutex_destroy(&(pipe->backbuf_mutex));
   dt_pthread_mutex_destroy(&(pipe->busy_mutex));
@@ -230,6 +263,11 @@ void dt_dev_pixelpipe_cleanup(dt_dev_pixelpipe_t *pipe)
     g_list_free_full(pipe->forms, (void (*)(void *))dt_masks_free_form);
     pipe->forms = NULL;
   }
+  if(pipe->output_forms)
+  {
+    g_list_free_full(pipe->output_forms, (void (*)(void *))dt_masks_free_form);
+    pipe->output_forms = NULL;
+  }
 }
 
 void dt_dev_pixelpipe_cleanup_nodes(dt_dev_pixelpipe_t *pipe)
@@ -1122,6 +1160,27 @@ static int _transform_for_blend(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *p
   return ret;
 }
 
+// record one node of the pipe in the profiler
+static void _profile_node(dt_dev_pixelpipe_t *pipe, const dt_iop_module_t *module,
+                          const dt_dev_pixelpipe_profile_source_t source, const dt_pixelpipe_flow_t flow,
+                          const double start, const dt_iop_roi_t *roi_out, const size_t out_bytes,
+                          const size_t work_bytes)
+{
+  dt_dev_pixelpipe_profile_event_t ev = { { 0 } };
+  g_strlcpy(ev.op, module ? module->op : "input", sizeof(ev.op));
+  if(module) g_strlcpy(ev.name, module->multi_name, sizeof(ev.name));
+  ev.source = source;
+  ev.opencl = (flow & PIXELPIPE_FLOW_PROCESSED_ON_GPU) != 0;
+  ev.tiling = (flow & PIXELPIPE_FLOW_PROCESSED_WITH_TILING) != 0;
+  ev.start = start;
+  ev.end = dt_get_wtime();
+  ev.width = roi_out->width;
+  ev.height = roi_out->height;
+  ev.out_bytes = out_bytes;
+  ev.work_bytes = work_bytes;
+  dt_dev_pixelpipe_profile_add(pipe, &ev);
+}
+
 // recursive helper for process:
 static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
                                         void **cl_mem_output, dt_iop_buffer_dsc_t **out_format,
@@ -1151,6 +1210,8 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
   const size_t bpp = dt_iop_buffer_dsc_to_bpp(*out_format);
   const size_t bufsize = (size_t)bpp * roi_out->width * roi_out->height;
 
+  const double profile_start = pipe->profile ? dt_get_wtime() : 0.0;
+
   // 1) if cached buffer is still available, return data
   dt_pthread_mutex_lock(&pipe->busy_mutex);
   if(pipe->shutdown)
@@ -1164,16 +1225,19 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
   if(pipe->type != DT_DEV_PIXELPIPE_PREVIEW || module == NULL || strcmp(module->op, "gamma") != 0)
   {
     hash = dt_dev_pixelpipe_cache_hash(pipe->image.id, roi_out, pipe, pos);
-    cache_available = dt_dev_pixelpipe_cache_available(&(pipe->cache), hash);
+    cache_available = dt_dev_pixelpipe_cache_available(_pipe_cache(pipe), hash);
   }
   if(cache_available)
   {
     // if(module) printf("found valid buf pos %d in cache for module %s %s %lu\n", pos, module->op, pipe ==
     // dev->preview_pipe ? "[preview]" : "", hash);
 
-    (void)dt_dev_pixelpipe_cache_get(&(pipe->cache), hash, bufsize, output, out_format);
+    (void)dt_dev_pixelpipe_cache_get(_pipe_cache(pipe), hash, bufsize, output, out_format);
 
     dt_pthread_mutex_unlock(&pipe->busy_mutex);
+    if(pipe->profile)
+      _profile_node(pipe, module, DT_DEV_PIXELPIPE_PROFILE_CACHE, PIXELPIPE_FLOW_NONE, profile_start, roi_out,
+                    bufsize, 0);
     if(!modules) return 0;
     // go to post-collect directly:
     goto post_process_collect_info;
@@ -1181,6 +1245,37 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
   else
     dt_pthread_mutex_unlock(&pipe->busy_mutex);
 
+  // 1b) expensive buffers may still be in the disk cache from an earlier session
+  if(hash && module && pipe->mask_display == DT_DEV_PIXELPIPE_DISPLAY_NONE
+     && dt_dev_pixelpipe_cache_disk_wanted(darktable.pipe_cache_disk, pipe, piece, roi_out))
+  {
+    const uint64_t key = dt_dev_pixelpipe_cache_disk_key(darktable.pipe_cache_disk, pipe, hash);
+    if(dt_dev_pixelpipe_cache_disk_available(darktable.pipe_cache_disk, key))
+    {
+      dt_pthread_mutex_lock(&pipe->busy_mutex);
+      if(pipe->shutdown)
+      {
+        dt_pthread_mutex_unlock(&pipe->busy_mutex);
+        return 1;
+      }
+      dt_iop_buffer_dsc_t *requested_format = *out_format;
+      (void)dt_dev_pixelpipe_cache_get(_pipe_cache(pipe), hash, bufsize, output, out_format);
+      if(!dt_dev_pixelpipe_cache_disk_read(darktable.pipe_cache_disk, key, *output, bufsize, *out_format))
+      {
+        dt_pthread_mutex_unlock(&pipe->busy_mutex);
+        if(pipe->profile)
+          _profile_node(pipe, module, DT_DEV_PIXELPIPE_PROFILE_DISK_CACHE, PIXELPIPE_FLOW_NONE, profile_start,
+                        roi_out, bufsize, 0);
+        goto post_process_collect_info;
+      }
+      // stale or broken file, give the cache line back and process as usual
+      dt_dev_pixelpipe_cache_invalidate(_pipe_cache(pipe), *output);
+      *output = NULL;
+      *out_format = requested_format;
+      dt_pthread_mutex_unlock(&pipe->busy_mutex);
+    }
+  }
+
   // 2) if history changed or exit event, abort processing?
   // preview pipe: abort on all but zoom events (same buffer anyways)
   if(dt_iop_breakpoint(dev, pipe)) return 1;
@@ -1210,7 +1305,7 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
       {
         *output = pipe->input;
       }
-      else if(dt_dev_pixelpipe_cache_get(&(pipe->cache), hash, bufsize, output, out_format))
+      else if(dt_dev_pixelpipe_cache_get(_pipe_cache(pipe), hash, bufsize, output, out_format))
       {
         memset(*output, 0, bufsize);
         if(roi_in.scale == 1.0f)
@@ -1249,6 +1344,9 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     }
 
     dt_show_times_f(&start, "[dev_pixelpipe]", "initing base buffer [%s]", _pipe_type_to_str(pipe->type));
+    if(pipe->profile)
+      _profile_node(pipe, NULL, DT_DEV_PIXELPIPE_PROFILE_PROCESSED, PIXELPIPE_FLOW_PROCESSED_ON_CPU,
+                    start.clock, roi_out, bufsize, 0);
     dt_pthread_mutex_unlock(&pipe->busy_mutex);
   }
   else
@@ -1303,9 +1401,9 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     else
       important = (strcmp(module->op, "gamma") == 0);
     if(important)
-      (void)dt_dev_pixelpipe_cache_get_important(&(pipe->cache), hash, bufsize, output, out_format);
+      (void)dt_dev_pixelpipe_cache_get_important(_pipe_cache(pipe), hash, bufsize, output, out_format);
     else
-      (void)dt_dev_pixelpipe_cache_get(&(pipe->cache), hash, bufsize, output, out_format);
+      (void)dt_dev_pixelpipe_cache_get(_pipe_cache(pipe), hash, bufsize, output, out_format);
 
     dt_pthread_mutex_unlock(&pipe->busy_mutex);
 
@@ -2169,7 +2267,7 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
       }
 
       /* input is still only on GPU? Let's invalidate CPU input buffer then */
-      if(valid_input_on_gpu_only) dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), input);
+      if(valid_input_on_gpu_only) dt_dev_pixelpipe_cache_invalidate(_pipe_cache(pipe), input);
     }
     else
     {
@@ -2413,13 +2511,39 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
 
     // in case we get this buffer from the cache in the future, cache some stuff:
     **out_format = piece->dsc_out = pipe->dsc;
+    // and remember how expensive it would be to recompute it
+    dt_dev_pixelpipe_cache_set_cost(_pipe_cache(pipe), hash, 1000.0 * (dt_get_wtime() - start.clock));
+
+    if(pipe->profile)
+      _profile_node(pipe, module, DT_DEV_PIXELPIPE_PROFILE_PROCESSED, pixelpipe_flow, start.clock, roi_out,
+                    bufsize,
+                    (size_t)(tiling.factor * MAX(roi_in.width, roi_out->width) * MAX(roi_in.height, roi_out->height)
+                             * MAX(in_bpp, bpp))
+                        + tiling.overhead);
+
+    // keep expensive buffers for the next session, but not the parts of a view
+    if(hash && !pipe->opencl_error && !pipe->bypass_cache && pipe->mask_display == DT_DEV_PIXELPIPE_DISPLAY_NONE
+       && dt_dev_pixelpipe_cache_disk_wanted(darktable.pipe_cache_disk, pipe, piece, roi_out))
+    {
+      int err = 0;
+#ifdef HAVE_OPENCL
+      if(*cl_mem_output != NULL)
+        err = dt_opencl_copy_device_to_host(pipe->devid, *output, *cl_mem_output, roi_out->width,
+                                            roi_out->height, out_bpp);
+#endif
+      // only the copy is made here, conversion and file i/o happen in a background job
+      if(!err)
+        dt_dev_pixelpipe_cache_disk_write(darktable.pipe_cache_disk,
+                                          dt_dev_pixelpipe_cache_disk_key(darktable.pipe_cache_disk, pipe, hash),
+                                          *output, roi_out->width, roi_out->height, *out_format);
+    }
 
     dt_pthread_mutex_unlock(&pipe->busy_mutex);
     if(module == darktable.develop->gui_module)
     {
       // give the input buffer to the currently focused plugin more weight.
       // the user is likely to change that one soon, so keep it in cache.
-      dt_dev_pixelpipe_cache_reweight(&(pipe->cache), input);
+      dt_dev_pixelpipe_cache_reweight(_pipe_cache(pipe), input);
     }
 #ifndef _DEBUG
     if(darktable.unmuted & DT_DEBUG_NAN)
@@ -2684,8 +2808,203 @@ static int dt_dev_pixelpipe_process_rec_and_backcopy(dt_dev_pixelpipe_t *pipe, d
 }
 
 
-int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x, int y, int width, int height,
-                             float scale)
+#define DT_DEV_PIXELPIPE_DIRTY_SAMPLES 8
+
+// passes the outline of box (xmin, ymin, xmax, ymax) through the distortion of the module and replaces box
+// by the bounding box of the result.
+static void _dirty_box_distort(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, float box[4])
+{
+  const int n = DT_DEV_PIXELPIPE_DIRTY_SAMPLES;
+  float points[8 * (DT_DEV_PIXELPIPE_DIRTY_SAMPLES + 1)];
+  for(int k = 0; k <= n; k++)
+  {
+    const float x = box[0] + (box[2] - box[0]) * k / n;
+    const float y = box[1] + (box[3] - box[1]) * k / n;
+    points[8 * k + 0] = x;
+    points[8 * k + 1] = box[1];
+    points[8 * k + 2] = x;
+    points[8 * k + 3] = box[3];
+    points[8 * k + 4] = box[0];
+    points[8 * k + 5] = y;
+    points[8 * k + 6] = box[2];
+    points[8 * k + 7] = y;
+  }
+  module->distort_transform(module, piece, points, 4 * (n + 1));
+
+  box[0] = box[1] = FLT_MAX;
+  box[2] = box[3] = -FLT_MAX;
+  for(int k = 0; k < 4 * (n + 1); k++)
+  {
+    box[0] = fminf(box[0], points[2 * k]);
+    box[1] = fminf(box[1], points[2 * k + 1]);
+    box[2] = fmaxf(box[2], points[2 * k]);
+    box[3] = fmaxf(box[3], points[2 * k + 1]);
+  }
+  // room for the interpolation kernel
+  box[0] -= 4.0f;
+  box[1] -= 4.0f;
+  box[2] += 4.0f;
+  box[3] += 4.0f;
+}
+
+// an output pixel of the module depends on the input pixels modify_roi_in asks for, and on the overlap it needs
+// between tiles, which covers neighbourhoods the module reads without asking for a larger input. returns the
+// larger of both, in pixels around box.
+static int _module_support(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, const float box[4])
+{
+  dt_iop_roi_t roi_out = { floorf(box[0]), floorf(box[1]), 0, 0, 1.0f };
+  roi_out.width = ceilf(box[2]) - roi_out.x + 1;
+  roi_out.height = ceilf(box[3]) - roi_out.y + 1;
+  dt_iop_roi_t roi_in = roi_out;
+  module->modify_roi_in(module, piece, &roi_out, &roi_in);
+
+  const int grow = MAX(MAX(roi_out.x - roi_in.x, roi_out.y - roi_in.y),
+                       MAX(roi_in.x + roi_in.width - roi_out.x - roi_out.width,
+                           roi_in.y + roi_in.height - roi_out.y - roi_out.height));
+  dt_develop_tiling_t tiling = { 0 };
+  module->tiling_callback(module, piece, &roi_in, &roi_out, &tiling);
+  return MAX(grow, (int)tiling.overlap);
+}
+
+// a change spreads by the support of every module after the one it happened in.
+static void _dirty_box_grow(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, float box[4])
+{
+  const int grow = _module_support(module, piece, box);
+  if(grow <= 0) return;
+  box[0] -= grow;
+  box[1] -= grow;
+  box[2] += grow;
+  box[3] += grow;
+}
+
+// pixels near the border of a processed region are computed from less context than in a run over the whole
+// view. sums up the support of all modules, the width of the border which differs. returns -1 if a module
+// doesn't tell (no tiling support), then the pipe can't be processed in pieces. skip is left out, for a module
+// which asks for its whole input region itself. called with the history mutex held.
+static int _pipe_support(dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_iop_t *skip)
+{
+  const float box[4] = { 0.0f, 0.0f, pipe->iwidth - 1, pipe->iheight - 1 };
+  int support = 0;
+  GList *modules = pipe->iop;
+  for(GList *nodes = pipe->nodes; nodes && modules; nodes = g_list_next(nodes), modules = g_list_next(modules))
+  {
+    dt_iop_module_t *module = (dt_iop_module_t *)modules->data;
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    if(!piece->enabled || piece == skip) continue;
+    if(!piece->process_tiling_ready && strcmp(module->op, "gamma")) return -1;
+    // distortions ask for a different region, not for a neighbourhood
+    if(module->operation_tags() & IOP_TAG_DISTORT) continue;
+    support += _module_support(module, piece, box);
+  }
+  return support;
+}
+
+int dt_dev_pixelpipe_support(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, const dt_iop_roi_t *roi)
+{
+  dt_pthread_mutex_lock(&dev->history_mutex);
+  const int support = _pipe_support(pipe, NULL);
+  dt_pthread_mutex_unlock(&dev->history_mutex);
+  // into pixels of the view, with some safety margin for rounding
+  return support < 0 ? -1 : (int)ceilf(support * roi->scale) + 2;
+}
+
+gboolean dt_dev_pixelpipe_dirty_region(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, const dt_iop_roi_t *roi,
+                                       dt_iop_roi_t *area, dt_iop_roi_t *patch)
+{
+  if(!pipe->output_forms || pipe->cache_obsolete || !dt_conf_get_bool("pixelpipe_incremental_mask_edits"))
+    return FALSE;
+  if(!pipe->output_backbuf || pipe->output_backbuf_width != roi->width
+     || pipe->output_backbuf_height != roi->height || pipe->output_imgid != pipe->image.id)
+    return FALSE;
+  // with modules hiding their distortion while being edited, the output does not match the pipe
+  if(dev->gui_module && dev->gui_module->operation_tags_filter()) return FALSE;
+
+  dt_pthread_mutex_lock(&dev->history_mutex);
+
+  // the edit must have changed the masks of a single module and nothing else
+  dt_dev_pixelpipe_iop_t *dirty = NULL;
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    if(piece->hash == piece->output_hash) continue;
+    if(dirty || !piece->enabled || piece->params_hash != piece->output_params_hash || !piece->blendop_data)
+    {
+      dirty = NULL;
+      break;
+    }
+    dirty = piece;
+  }
+  if(!dirty)
+  {
+    dt_pthread_mutex_unlock(&dev->history_mutex);
+    return FALSE;
+  }
+
+  const int mask_id = ((dt_develop_blend_params_t *)dirty->blendop_data)->mask_id;
+  float box[4];
+  if(!dt_masks_group_get_changed_area(pipe->output_forms, dev->forms, mask_id, pipe->iwidth, pipe->iheight, box)
+     || box[0] > box[2] || box[1] > box[3])
+  {
+    dt_pthread_mutex_unlock(&dev->history_mutex);
+    return FALSE;
+  }
+  box[0] *= pipe->iwidth;
+  box[1] *= pipe->iheight;
+  box[2] *= pipe->iwidth;
+  box[3] *= pipe->iheight;
+
+  // retouch style modules fetch their sources outside of the region they change, other modules need to be
+  // able to work on parts of the image
+  dt_masks_form_t *grp = dt_masks_get_from_id_ext(dev->forms, mask_id);
+  gboolean local = dirty->process_tiling_ready || (grp && (grp->type & DT_MASKS_CLONE));
+  // the patch is processed with a border around it, so that the pixels pasted back have all their context
+  const int support = local ? _pipe_support(pipe, dirty->process_tiling_ready ? NULL : dirty) : 0;
+  if(support < 0) local = FALSE;
+
+  // masks are drawn on the output of their module: follow the distortions up to there, and after it
+  // everything that spreads the change further
+  gboolean after = FALSE;
+  GList *modules = pipe->iop;
+  for(GList *nodes = pipe->nodes; nodes && modules && local;
+      nodes = g_list_next(nodes), modules = g_list_next(modules))
+  {
+    dt_iop_module_t *module = (dt_iop_module_t *)modules->data;
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    if(!piece->enabled) continue;
+
+    if(after && !piece->process_tiling_ready && strcmp(module->op, "gamma"))
+      local = FALSE;
+    else if(module->operation_tags() & IOP_TAG_DISTORT)
+      _dirty_box_distort(module, piece, box);
+    else if(after)
+      _dirty_box_grow(module, piece, box);
+
+    if(piece == dirty) after = TRUE;
+  }
+  dt_pthread_mutex_unlock(&dev->history_mutex);
+
+  if(!local) return FALSE;
+
+  // into the coordinates of the view, with a pixel of safety margin for rounding
+  const int x0 = MAX(0, (int)floorf(box[0] * roi->scale) - roi->x - 2);
+  const int y0 = MAX(0, (int)floorf(box[1] * roi->scale) - roi->y - 2);
+  const int x1 = MIN(roi->width, (int)ceilf(box[2] * roi->scale) - roi->x + 2);
+  const int y1 = MIN(roi->height, (int)ceilf(box[3] * roi->scale) - roi->y + 2);
+
+  *patch = (dt_iop_roi_t){ x0, y0, MAX(0, x1 - x0), MAX(0, y1 - y0), roi->scale };
+  if(patch->width == 0 || patch->height == 0) patch->width = patch->height = 0;
+
+  const int border = (int)ceilf(support * roi->scale) + 2;
+  const int ax0 = MAX(0, x0 - border), ay0 = MAX(0, y0 - border);
+  const int ax1 = MIN(roi->width, x1 + border), ay1 = MIN(roi->height, y1 + border);
+  *area = (dt_iop_roi_t){ ax0, ay0, MAX(0, ax1 - ax0), MAX(0, ay1 - ay0), roi->scale };
+  return TRUE;
+}
+
+// runs the pipe for roi. with an area (relative to roi), only that part is processed and the patch inside of it
+// is pasted into the output buffer of the last run.
+static int _dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, const dt_iop_roi_t *full_roi,
+                                  const dt_iop_roi_t *area, const dt_iop_roi_t *patch)
 {
   pipe->processing = 1;
   pipe->opencl_enabled = dt_opencl_update_settings(); // update enabled flag and profile from preferences
@@ -2703,9 +3022,18 @@ int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x,
 
   if(pipe->devid >= 0) dt_opencl_events_reset(pipe->devid);
 
-  dt_iop_roi_t roi = (dt_iop_roi_t){ x, y, width, height, scale };
+  dt_dev_pixelpipe_profile_begin(pipe);
+
+  dt_iop_roi_t roi = *full_roi;
+  if(patch)
+  {
+    roi.x += area->x;
+    roi.y += area->y;
+    roi.width = area->width;
+    roi.height = area->height;
+  }
   // printf("pixelpipe homebrew process start\n");
-  if(darktable.unmuted & DT_DEBUG_DEV) dt_dev_pixelpipe_cache_print(&pipe->cache);
+  if(darktable.unmuted & DT_DEBUG_DEV) dt_dev_pixelpipe_cache_print(_pipe_cache(pipe));
 
   // get a snapshot of mask list
   if(pipe->forms) g_list_free_full(pipe->forms, (void (*)(void *))dt_masks_free_form);
@@ -2720,7 +3048,11 @@ int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x,
 restart:
 
   // check if we should obsolete caches
-  if(pipe->cache_obsolete) dt_dev_pixelpipe_cache_flush(&(pipe->cache));
+  if(pipe->cache_obsolete)
+  {
+    dt_dev_pixelpipe_cache_flush(&(pipe->cache));
+    dt_dev_pixelpipe_cache_flush(&(pipe->scratch_cache));
+  }
   pipe->cache_obsolete = 0;
 
   // mask display off as a starting point
@@ -2777,6 +3109,19 @@ restart:
   }
 
   // release resources:
+  if(!err && pipe->type == DT_DEV_PIXELPIPE_FULL)
+  {
+    // remember what the output is made of, a later mask edit only needs to reprocess the touched region
+    if(pipe->output_forms) g_list_free_full(pipe->output_forms, (void (*)(void *))dt_masks_free_form);
+    pipe->output_forms = pipe->forms;
+    pipe->forms = NULL;
+    for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+    {
+      dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+      piece->output_hash = piece->hash;
+      piece->output_params_hash = piece->params_hash;
+    }
+  }
   if (pipe->forms)
   {
     g_list_free_full(pipe->forms, (void (*)(void *))dt_masks_free_form);
@@ -2787,6 +3132,8 @@ restart:
     dt_opencl_unlock_device(pipe->devid);
     pipe->devid = -1;
   }
+  dt_dev_pixelpipe_profile_end(pipe, _pipe_type_to_str(pipe->type), err);
+
   // ... and in case of other errors ...
   if(err)
   {
@@ -2794,6 +3141,31 @@ restart:
     return 1;
   }
 
+  if(patch)
+  {
+    // paste the new part into the last output, without the border it was processed with
+    dt_pthread_mutex_lock(&pipe->backbuf_mutex);
+    if(pipe->output_backbuf && pipe->output_backbuf_width == full_roi->width
+       && pipe->output_backbuf_height == full_roi->height)
+    {
+      const uint8_t *const in
+          = (uint8_t *)buf + ((size_t)(patch->y - area->y) * area->width + patch->x - area->x) * 4;
+      for(int j = 0; j < patch->height; j++)
+        memcpy(pipe->output_backbuf + ((size_t)(patch->y + j) * pipe->output_backbuf_width + patch->x) * 4,
+               in + (size_t)j * area->width * 4, (size_t)patch->width * 4 * sizeof(uint8_t));
+      // the cache line of the last full run may have been recycled by now, the output is the whole view
+      pipe->backbuf = pipe->output_backbuf;
+      pipe->backbuf_width = full_roi->width;
+      pipe->backbuf_height = full_roi->height;
+      pipe->backbuf_hash = dt_dev_pixelpipe_cache_hash(pipe->image.id, full_roi, pipe, 0);
+    }
+    dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+    pipe->processing = 0;
+    return 0;
+  }
+
+  const int width = roi.width, height = roi.height;
+
   // terminate
   dt_pthread_mutex_lock(&pipe->backbuf_mutex);
   pipe->backbuf_hash = dt_dev_pixelpipe_cache_hash(pipe->image.id, &roi, pipe, 0);
@@ -2824,9 +3196,23 @@ restart:
   return 0;
 }
 
+int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x, int y, int width, int height,
+                             float scale)
+{
+  const dt_iop_roi_t roi = (dt_iop_roi_t){ x, y, width, height, scale };
+  return _dev_pixelpipe_process(pipe, dev, &roi, NULL, NULL);
+}
+
+int dt_dev_pixelpipe_process_patch(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, const dt_iop_roi_t *roi,
+                                   const dt_iop_roi_t *area, const dt_iop_roi_t *patch)
+{
+  return _dev_pixelpipe_process(pipe, dev, roi, area, patch);
+}
+
 void dt_dev_pixelpipe_flush_caches(dt_dev_pixelpipe_t *pipe)
 {
   dt_dev_pixelpipe_cache_flush(&pipe->cache);
+  dt_dev_pixelpipe_cache_flush(&pipe->scratch_cache);
 }
 
 void dt_dev_pixelpipe_get_dimensions(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int width_in,
@@ -58,6 +58,8 @@ typedef struct dt_dev_pixelpipe_iop_t
   float iscale;        // input actually just downscaled buffer? iscale*iwidth = actual width
   int iwidth, iheight; // width and height of input buffer
   uint64_t hash;       // hash of params and enabled.
+  uint64_t params_hash; // same without the drawn masks.
+  uint64_t output_hash, output_params_hash; // hashes as of the last output of the pipe
   int bpc;             // bits per channel, 32 means float
   int colors;          // how many colors per pixel
   dt_iop_roi_t buf_in,
@@ -94,6 +96,12 @@ typedef struct dt_dev_pixelpipe_t
   dt_dev_pixelpipe_cache_t cache;
   // set to non-zero in order to obsolete old cache entries on next pixelpipe run
   int cache_obsolete;
+  // a few lines for runs which shouldn't push the history/zoom lines out of the cache (progressive tiles)
+  dt_dev_pixelpipe_cache_t scratch_cache;
+  // set to non-zero to process with scratch_cache instead of cache
+  int bypass_cache;
+  // per node timing of the current run, if profiling is enabled
+  struct dt_dev_pixelpipe_profile_t *profile;
   // input buffer
   float *input;
   // width and height of input buffer
@@ -123,6 +131,8 @@ typedef struct dt_dev_pixelpipe_t
   uint8_t *output_backbuf;
   int output_backbuf_width, output_backbuf_height;
   int output_imgid;
+  // masks as of the last output, to find the region touched by a mask edit
+  GList *output_forms;
   // working?
   int processing;
   // shutting down?
@@ -146,6 +156,9 @@ typedef struct dt_dev_pixelpipe_t
   int devid;
   // image struct as it was when the pixelpipe was initialized. copied to avoid race conditions.
   dt_image_t image;
+  // part of the disk cache keys which depends on the source file of image, see dt_dev_pixelpipe_cache_disk_source()
+  int32_t disk_cache_imgid;
+  uint64_t disk_cache_source;
   // the user might choose to overwrite the output color space and rendering intent.
   dt_colorspaces_color_profile_type_t icc_type;
   gchar *icc_filename;
@@ -176,8 +189,9 @@ int dt_dev_pixelpipe_init_thumbnail(dt_dev_pixelpipe_t *pipe, int32_t width, int
 // inits all but the pixel caches, so you can't actually process an image (just get dimensions and
 // distortions)
 int dt_dev_pixelpipe_init_dummy(dt_dev_pixelpipe_t *pipe, int32_t width, int32_t height);
-// inits the pixelpipe with given cacheline size and number of entries.
-int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t entries);
+// inits the pixelpipe with given cacheline size and number of entries. a non-zero memlimit limits the
+// cache to that many bytes instead.
+int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t entries, size_t memlimit);
 // constructs a new input buffer from given RGB float array.
 void dt_dev_pixelpipe_set_input(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, float *input, int width,
                                 int height, float iscale);
@@ -210,6 +224,18 @@ void dt_dev_pixelpipe_synch_top(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *d
 // process region of interest of pixels. returns 1 if pipe was altered during processing.
 int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int x, int y, int width,
                              int height, float scale);
+// find the part of the last output (of roi) affected by a mask edit since then. returns FALSE if everything
+// has to be processed again, patch is empty if the edit is not visible in roi. area is the patch with the
+// border it has to be processed with.
+gboolean dt_dev_pixelpipe_dirty_region(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, const dt_iop_roi_t *roi,
+                                       dt_iop_roi_t *area, dt_iop_roi_t *patch);
+// width of the border (in pixels of roi) around a part of the view which is needed to process it exactly like
+// in a run over the whole view, -1 if the pipe can't be processed in parts.
+int dt_dev_pixelpipe_support(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, const dt_iop_roi_t *roi);
+// process only the area of roi again and paste the patch inside of it into the output buffer of the last run
+// with the same roi.
+int dt_dev_pixelpipe_process_patch(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, const dt_iop_roi_t *roi,
+                                   const dt_iop_roi_t *area, const dt_iop_roi_t *patch);
 // convenience method that does not gamma-compress the image.
 int dt_dev_pixelpipe_process_no_gamma(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int x, int y,
                                       int width, int height, float scale);
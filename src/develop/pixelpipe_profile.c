@@ -0,0 +1,162 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "develop/pixelpipe_profile.h"
+#include "common/darktable.h"
+#include "common/file_location.h"
+#include "control/conf.h"
+#include "develop/pixelpipe_hb.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *_source_to_str(const dt_dev_pixelpipe_profile_event_t *ev)
+{
+  switch(ev->source)
+  {
+    case DT_DEV_PIXELPIPE_PROFILE_CACHE:
+      return "cache";
+    case DT_DEV_PIXELPIPE_PROFILE_DISK_CACHE:
+      return "disk cache";
+    case DT_DEV_PIXELPIPE_PROFILE_PROCESSED:
+    default:
+      return ev->opencl ? "GPU" : "CPU";
+  }
+}
+
+// module labels are user supplied, keep them from breaking json strings and csv fields
+static void _sanitize(char *str)
+{
+  for(char *c = str; *c; c++)
+    if(*c == '"' || *c == '\\' || *c == ',' || (unsigned char)*c < ' ') *c = '_';
+}
+
+void dt_dev_pixelpipe_profile_begin(dt_dev_pixelpipe_t *pipe)
+{
+  pipe->profile = NULL;
+
+  gchar *format = dt_conf_get_string("pixelpipe_profile");
+  dt_dev_pixelpipe_profile_format_t f = DT_DEV_PIXELPIPE_PROFILE_NONE;
+  if(format && !strcmp(format, "chrome trace"))
+    f = DT_DEV_PIXELPIPE_PROFILE_CHROME_TRACE;
+  else if(format && !strcmp(format, "csv"))
+    f = DT_DEV_PIXELPIPE_PROFILE_CSV;
+  g_free(format);
+  if(f == DT_DEV_PIXELPIPE_PROFILE_NONE) return;
+
+  dt_dev_pixelpipe_profile_t *profile = (dt_dev_pixelpipe_profile_t *)calloc(1, sizeof(dt_dev_pixelpipe_profile_t));
+  profile->format = f;
+  profile->start = dt_get_wtime();
+  profile->events = g_array_new(FALSE, FALSE, sizeof(dt_dev_pixelpipe_profile_event_t));
+  pipe->profile = profile;
+}
+
+void dt_dev_pixelpipe_profile_add(dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_profile_event_t *event)
+{
+  if(!pipe->profile) return;
+  dt_dev_pixelpipe_profile_event_t ev = *event;
+  ev.op[sizeof(ev.op) - 1] = '\0';
+  ev.name[sizeof(ev.name) - 1] = '\0';
+  _sanitize(ev.name);
+  g_array_append_val(pipe->profile->events, ev);
+}
+
+static void _write_chrome_trace(FILE *f, const dt_dev_pixelpipe_profile_t *profile, const char *pipe_name,
+                                const int imgid)
+{
+  fprintf(f, "{\"traceEvents\":[\n");
+  for(guint k = 0; k < profile->events->len; k++)
+  {
+    const dt_dev_pixelpipe_profile_event_t *ev
+        = &g_array_index(profile->events, dt_dev_pixelpipe_profile_event_t, k);
+    fprintf(f,
+            "{\"name\":\"%s%s%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.1f,\"dur\":%.1f,\"pid\":%d,\"tid\":\"%s\","
+            "\"args\":{\"op\":\"%s\",\"tiling\":%s,\"width\":%d,\"height\":%d,\"output_bytes\":%zu,"
+            "\"working_bytes\":%zu}}%s\n",
+            ev->op, *ev->name ? " " : "", ev->name, _source_to_str(ev), 1e6 * (ev->start - profile->start),
+            1e6 * (ev->end - ev->start), imgid, pipe_name, ev->op, ev->tiling ? "true" : "false", ev->width,
+            ev->height, ev->out_bytes, ev->work_bytes, k + 1 < profile->events->len ? "," : "");
+  }
+  fprintf(f, "],\n\"displayTimeUnit\":\"ms\"}\n");
+}
+
+static void _write_csv(FILE *f, const dt_dev_pixelpipe_profile_t *profile, const char *pipe_name, const int imgid)
+{
+  fprintf(f, "pipe,image,module,instance,source,tiling,start_ms,duration_ms,width,height,output_bytes,working_bytes\n");
+  for(guint k = 0; k < profile->events->len; k++)
+  {
+    const dt_dev_pixelpipe_profile_event_t *ev
+        = &g_array_index(profile->events, dt_dev_pixelpipe_profile_event_t, k);
+    fprintf(f, "%s,%d,%s,%s,%s,%d,%.3f,%.3f,%d,%d,%zu,%zu\n", pipe_name, imgid, ev->op, ev->name,
+            _source_to_str(ev), ev->tiling ? 1 : 0, 1e3 * (ev->start - profile->start),
+            1e3 * (ev->end - ev->start), ev->width, ev->height, ev->out_bytes, ev->work_bytes);
+  }
+}
+
+void dt_dev_pixelpipe_profile_end(dt_dev_pixelpipe_t *pipe, const char *pipe_name, const int err)
+{
+  dt_dev_pixelpipe_profile_t *profile = pipe->profile;
+  if(!profile) return;
+  pipe->profile = NULL;
+
+  // aborted runs (zoom, history change, ...) are not interesting
+  if(!err && profile->events->len)
+  {
+    static int run = 0;
+    const int num = g_atomic_int_add(&run, 1);
+
+    char dir[PATH_MAX] = { 0 };
+    gchar *confdir = dt_conf_get_string("pixelpipe_profile_dir");
+    if(confdir && *confdir)
+      g_strlcpy(dir, confdir, sizeof(dir));
+    else
+    {
+      char cachedir[PATH_MAX] = { 0 };
+      dt_loc_get_user_cache_dir(cachedir, sizeof(cachedir));
+      snprintf(dir, sizeof(dir), "%s/profiles", cachedir);
+    }
+    g_free(confdir);
+
+    char filename[PATH_MAX] = { 0 };
+    snprintf(filename, sizeof(filename), "%s/%s_%d_%05d.%s", dir, pipe_name, pipe->image.id, num,
+             profile->format == DT_DEV_PIXELPIPE_PROFILE_CSV ? "csv" : "json");
+
+    FILE *f = NULL;
+    if(!g_mkdir_with_parents(dir, 0750)) f = g_fopen(filename, "wb");
+    if(f)
+    {
+      if(profile->format == DT_DEV_PIXELPIPE_PROFILE_CSV)
+        _write_csv(f, profile, pipe_name, pipe->image.id);
+      else
+        _write_chrome_trace(f, profile, pipe_name, pipe->image.id);
+      fclose(f);
+      dt_print(DT_DEBUG_PERF, "[pixelpipe_profile] wrote `%s'\n", filename);
+    }
+    else
+      fprintf(stderr, "[pixelpipe_profile] could not write `%s'\n", filename);
+  }
+
+  g_array_free(profile->events, TRUE);
+  free(profile);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,78 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <inttypes.h>
+#include <stddef.h>
+
+struct dt_dev_pixelpipe_t;
+
+/**
+ * structured timing of pixelpipe runs. when enabled in the preferences, every node of
+ * dt_dev_pixelpipe_process_rec() is recorded and the whole run is written to a file in
+ * chrome trace (load it in chrome://tracing or perfetto) or csv format.
+ */
+
+typedef enum dt_dev_pixelpipe_profile_format_t
+{
+  DT_DEV_PIXELPIPE_PROFILE_NONE = 0,
+  DT_DEV_PIXELPIPE_PROFILE_CHROME_TRACE = 1,
+  DT_DEV_PIXELPIPE_PROFILE_CSV = 2
+} dt_dev_pixelpipe_profile_format_t;
+
+typedef enum dt_dev_pixelpipe_profile_source_t
+{
+  DT_DEV_PIXELPIPE_PROFILE_PROCESSED = 0, // module ran
+  DT_DEV_PIXELPIPE_PROFILE_CACHE = 1,     // output taken from the pixelpipe cache
+  DT_DEV_PIXELPIPE_PROFILE_DISK_CACHE = 2 // output read from the disk cache
+} dt_dev_pixelpipe_profile_source_t;
+
+typedef struct dt_dev_pixelpipe_profile_event_t
+{
+  char op[20];
+  char name[64];
+  dt_dev_pixelpipe_profile_source_t source;
+  gboolean opencl;
+  gboolean tiling;
+  // wall clock, as returned by dt_get_wtime()
+  double start, end;
+  int width, height;
+  // size of the output buffer and estimated working memory of the module
+  size_t out_bytes;
+  size_t work_bytes;
+} dt_dev_pixelpipe_profile_event_t;
+
+typedef struct dt_dev_pixelpipe_profile_t
+{
+  dt_dev_pixelpipe_profile_format_t format;
+  double start;
+  GArray *events;
+} dt_dev_pixelpipe_profile_t;
+
+/** starts recording into pipe->profile if enabled in the preferences. */
+void dt_dev_pixelpipe_profile_begin(struct dt_dev_pixelpipe_t *pipe);
+/** appends one node, only call it if pipe->profile is set. */
+void dt_dev_pixelpipe_profile_add(struct dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_profile_event_t *event);
+/** writes the recorded run to disk (unless it failed) and frees pipe->profile. */
+void dt_dev_pixelpipe_profile_end(struct dt_dev_pixelpipe_t *pipe, const char *pipe_name, const int err);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -101,9 +101,8 @@ static void _image_update_group_tooltip(dt_thumbnail_t *thumb)
 
   // and the other images
   sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT id, version, filename FROM main.images WHERE group_id = ?1", -1, &stmt,
-                              NULL);
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db, "SELECT id, version, filename FROM main.images WHERE group_id = ?1",
+                                  &stmt);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, thumb->groupid);
   while(sqlite3_step(stmt) == SQLITE_ROW)
   {
@@ -122,7 +121,7 @@ static void _image_update_group_tooltip(dt_thumbnail_t *thumb)
       }
     }
   }
-  sqlite3_finalize(stmt);
+  dt_database_release_cached(darktable.db, stmt);
 
   // and the number of grouped images
   gchar *ttf = dt_util_dstrcat(NULL, "%d %s\n%s", nb, _("grouped images"), tt);
@@ -244,6 +243,123 @@ static void _thumb_write_extension(dt_thumbnail_t *thumb)
   g_free(ext2);
 }
 
+// the surfaces of the thumbnails are prepared by jobs (mipmap fetch, color management and scaling), the
+// finished requests are handed back to the gui thread through a queue, so the draw handler only has to blit them
+typedef struct dt_thumbnail_surface_request_t
+{
+  dt_thumbnail_t *thumb; // NULL once the thumbnail doesn't want the surface anymore. only used in the gui thread
+  int imgid;
+  int width, height;
+  gboolean display_focus;
+  gint cancelled;
+  gboolean done; // set in the gui thread once the job is finished
+  int res;       // != 0 if the mipmap wasn't available yet
+  cairo_surface_t *surface;
+} dt_thumbnail_surface_request_t;
+
+static GAsyncQueue *_surface_ready = NULL;
+static gint _surface_ready_idle = FALSE;
+
+static void _thumb_surface_request_free(dt_thumbnail_surface_request_t *req)
+{
+  if(req->surface) cairo_surface_destroy(req->surface);
+  free(req);
+}
+
+static gboolean _thumb_surface_ready_idle(gpointer user_data)
+{
+  g_atomic_int_set(&_surface_ready_idle, FALSE);
+  dt_thumbnail_surface_request_t *req;
+  while((req = g_async_queue_try_pop(_surface_ready)))
+  {
+    if(req->thumb)
+    {
+      req->done = TRUE;
+      gtk_widget_queue_draw(req->thumb->w_image);
+    }
+    else
+      _thumb_surface_request_free(req);
+  }
+  return G_SOURCE_REMOVE;
+}
+
+// called when the job is disposed, either finished or pushed out of the queue
+static void _thumb_surface_job_done(void *p)
+{
+  g_async_queue_push(_surface_ready, p);
+  if(g_atomic_int_compare_and_exchange(&_surface_ready_idle, FALSE, TRUE))
+    g_idle_add(_thumb_surface_ready_idle, NULL);
+}
+
+static int32_t _thumb_surface_job_run(dt_job_t *job)
+{
+  dt_thumbnail_surface_request_t *req = dt_control_job_get_params(job);
+  if(g_atomic_int_get(&req->cancelled)) return 0;
+
+  req->res = dt_view_image_get_surface(req->imgid, req->width, req->height, &req->surface);
+  if(req->res || !req->display_focus || g_atomic_int_get(&req->cancelled)) return 0;
+
+  uint8_t *full_res_thumb = NULL;
+  int32_t full_res_thumb_wd, full_res_thumb_ht;
+  dt_colorspaces_color_profile_type_t color_space;
+  char path[PATH_MAX] = { 0 };
+  gboolean from_cache = TRUE;
+  dt_image_full_path(req->imgid, path, sizeof(path), &from_cache);
+  if(!dt_imageio_large_thumbnail(path, &full_res_thumb, &full_res_thumb_wd, &full_res_thumb_ht, &color_space))
+  {
+    // we look for focus areas
+    dt_focus_cluster_t full_res_focus[49];
+    const int frows = 5, fcols = 5;
+    dt_focus_create_clusters(full_res_focus, frows, fcols, full_res_thumb, full_res_thumb_wd, full_res_thumb_ht);
+    // and we draw them on the image
+    cairo_t *cri = cairo_create(req->surface);
+    dt_focus_draw_clusters(cri, cairo_image_surface_get_width(req->surface),
+                           cairo_image_surface_get_height(req->surface), req->imgid, full_res_thumb_wd,
+                           full_res_thumb_ht, full_res_focus, frows, fcols, 1.0, 0, 0);
+    cairo_destroy(cri);
+  }
+  dt_free_align(full_res_thumb);
+  return 0;
+}
+
+static void _thumb_surface_request(dt_thumbnail_t *thumb, const int width, const int height)
+{
+  if(!_surface_ready) _surface_ready = g_async_queue_new();
+
+  dt_thumbnail_surface_request_t *req = calloc(1, sizeof(dt_thumbnail_surface_request_t));
+  req->thumb = thumb;
+  req->imgid = thumb->imgid;
+  req->width = width;
+  req->height = height;
+  req->display_focus = thumb->display_focus;
+  thumb->img_surf_request = req;
+
+  dt_job_t *job = dt_control_job_create(&_thumb_surface_job_run, "thumbnail surface %d", thumb->imgid);
+  if(!job)
+  {
+    _thumb_surface_job_done(req);
+    return;
+  }
+  // with the request in the params, jobs of different thumbnails don't count as duplicates
+  dt_control_job_set_params_with_size(job, req, sizeof(dt_thumbnail_surface_request_t), _thumb_surface_job_done);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, job);
+}
+
+// forget the pending surface, if any. it's freed when the job comes back
+static void _thumb_surface_request_drop(dt_thumbnail_t *thumb)
+{
+  dt_thumbnail_surface_request_t *req = thumb->img_surf_request;
+  if(!req) return;
+  thumb->img_surf_request = NULL;
+  if(req->done)
+    _thumb_surface_request_free(req);
+  else
+  {
+    req->thumb = NULL;
+    g_atomic_int_set(&req->cancelled, TRUE);
+  }
+}
+
 static gboolean _event_image_draw(GtkWidget *widget, cairo_t *cr, gpointer user_data)
 {
   if(!user_data) return TRUE;
@@ -366,54 +482,40 @@ static gboolean _event_image_draw(GtkWidget *widget, cairo_t *cr, gpointer user_
     }
     else
     {
-      gboolean res;
-      cairo_surface_t *img_surf = NULL;
-      if(thumb->zoomable)
+      const int surf_w = thumb->zoomable ? image_w * thumb->zoom : image_w;
+      const int surf_h = thumb->zoomable ? image_h * thumb->zoom : image_h;
+
+      // a request for another size is useless now
+      dt_thumbnail_surface_request_t *req = thumb->img_surf_request;
+      if(req && (req->width != surf_w || req->height != surf_h || req->display_focus != thumb->display_focus))
       {
-        res = dt_view_image_get_surface(thumb->imgid, image_w * thumb->zoom, image_h * thumb->zoom, &img_surf);
+        _thumb_surface_request_drop(thumb);
+        req = NULL;
       }
-      else
+
+      if(!req || !req->done)
       {
-        res = dt_view_image_get_surface(thumb->imgid, image_w, image_h, &img_surf);
+        // the surface is prepared in the background, meanwhile we still draw the old one to avoid flickering
+        if(!req) _thumb_surface_request(thumb, surf_w, surf_h);
+        _thumb_draw_image(thumb, cr);
+        return TRUE;
       }
 
-      if(res)
+      thumb->img_surf_request = NULL;
+      if(req->res || !req->surface)
       {
-        // if the image is missing, we reload it again
+        // if the image is missing (or the job got pushed out of the queue), we reload it again
+        _thumb_surface_request_free(req);
         g_timeout_add(250, _thumb_expose_again, widget);
-        // we still draw the thumb to avoid flickering
         _thumb_draw_image(thumb, cr);
         return TRUE;
       }
 
       cairo_surface_t *tmp_surf = thumb->img_surf;
-      thumb->img_surf = img_surf;
+      thumb->img_surf = req->surface;
+      req->surface = NULL;
+      _thumb_surface_request_free(req);
       if(tmp_surf && cairo_surface_get_reference_count(tmp_surf) > 0) cairo_surface_destroy(tmp_surf);
-
-      if(thumb->display_focus)
-      {
-        uint8_t *full_res_thumb = NULL;
-        int32_t full_res_thumb_wd, full_res_thumb_ht;
-        dt_colorspaces_color_profile_type_t color_space;
-        char path[PATH_MAX] = { 0 };
-        gboolean from_cache = TRUE;
-        dt_image_full_path(thumb->imgid, path, sizeof(path), &from_cache);
-        if(!dt_imageio_large_thumbnail(path, &full_res_thumb, &full_res_thumb_wd, &full_res_thumb_ht, &color_space))
-        {
-          // we look for focus areas
-          dt_focus_cluster_t full_res_focus[49];
-          const int frows = 5, fcols = 5;
-          dt_focus_create_clusters(full_res_focus, frows, fcols, full_res_thumb, full_res_thumb_wd,
-                                   full_res_thumb_ht);
-          // and we draw them on the image
-          cairo_t *cri = cairo_create(thumb->img_surf);
-          dt_focus_draw_clusters(cri, cairo_image_surface_get_width(thumb->img_surf),
-                                 cairo_image_surface_get_height(thumb->img_surf), thumb->imgid, full_res_thumb_wd,
-                                 full_res_thumb_ht, full_res_focus, frows, fcols, 1.0, 0, 0);
-          cairo_destroy(cri);
-        }
-        dt_free_align(full_res_thumb);
-      }
     }
 
     thumb->img_surf_dirty = FALSE;
@@ -826,6 +928,7 @@ static void _dt_preview_updated_callback(gpointer instance, gpointer user_data)
      && darktable.develop->preview_pipe->output_backbuf)
   {
     // reset surface
+    _thumb_surface_request_drop(thumb);
     thumb->img_surf_dirty = TRUE;
     gtk_widget_queue_draw(thumb->w_main);
   }
@@ -851,6 +954,7 @@ static void _dt_mipmaps_updated_callback(gpointer instance, int imgid, gpointer
   }
 
   // reset surface
+  _thumb_surface_request_drop(thumb);
   thumb->img_surf_dirty = TRUE;
   gtk_widget_queue_draw(thumb->w_main);
 }
@@ -1190,6 +1294,7 @@ void dt_thumbnail_destroy(dt_thumbnail_t *thumb)
   dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_dt_preview_updated_callback), thumb);
   dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_dt_image_info_changed_callback), thumb);
   dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_dt_collection_changed_callback), thumb);
+  _thumb_surface_request_drop(thumb);
   if(thumb->img_surf && cairo_surface_get_reference_count(thumb->img_surf) > 0)
     cairo_surface_destroy(thumb->img_surf);
   thumb->img_surf = NULL;
@@ -1478,6 +1583,7 @@ void dt_thumbnail_set_drop(dt_thumbnail_t *thumb, gboolean accept_drop)
 // force the image to be reloaded from cache if any
 void dt_thumbnail_image_refresh(dt_thumbnail_t *thumb)
 {
+  _thumb_surface_request_drop(thumb);
   thumb->img_surf_dirty = TRUE;
   gtk_widget_queue_draw(thumb->w_main);
 }
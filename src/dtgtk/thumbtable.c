@@ -21,6 +21,7 @@
 #include "common/colorlabels.h"
 #include "common/debug.h"
 #include "common/history.h"
+#include "common/mipmap_cache.h"
 #include "common/ratings.h"
 #include "common/selection.h"
 #include "control/control.h"
@@ -28,6 +29,9 @@
 #include "gui/drag_and_drop.h"
 #include "views/view.h"
 
+// how far ahead of the scroll we prefetch, in seconds of scrolling at the current speed
+#define DT_THUMBTABLE_PREFETCH_LOOKAHEAD 1.0f
+
 // specials functions for GList globals actions
 static gint _list_compare_by_imgid(gconstpointer a, gconstpointer b)
 {
@@ -521,6 +525,140 @@ static int _thumbs_load_needed(dt_thumbtable_t *table)
   return changed;
 }
 
+typedef struct _prefetch_t
+{
+  dt_thumbtable_t *table;
+  gint generation;
+  dt_mipmap_size_t mip;
+  // the first nb_generate images are generated if needed, the others are only read from the disk cache
+  int nb_generate;
+  GList *imgids;
+} _prefetch_t;
+
+static void _prefetch_free(void *data)
+{
+  _prefetch_t *params = (_prefetch_t *)data;
+  g_list_free(params->imgids);
+  free(params);
+}
+
+static int32_t _prefetch_job_run(dt_job_t *job)
+{
+  _prefetch_t *params = dt_control_job_get_params(job);
+  int pos = 0;
+  for(GList *l = params->imgids; l; l = g_list_next(l), pos++)
+  {
+    // the scroll direction has changed or the table has been reloaded, the rest is not needed any more
+    if(g_atomic_int_get(&params->table->prefetch_generation) != params->generation) break;
+
+    const int imgid = GPOINTER_TO_INT(l->data);
+    if(pos >= params->nb_generate && !dt_mipmap_cache_is_on_disk(darktable.mipmap_cache, imgid, params->mip))
+      continue;
+    dt_mipmap_buffer_t buf;
+    dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, params->mip, DT_MIPMAP_BLOCKING, 'r');
+    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  }
+  return 0;
+}
+
+// drop all queued prefetching
+static void _prefetch_cancel(dt_thumbtable_t *table)
+{
+  g_atomic_int_inc(&table->prefetch_generation);
+  table->scroll_direction = 0;
+  table->scroll_speed = 0.0f;
+  table->prefetch_rowid = 0;
+}
+
+// update the scroll speed after a move of delta pixels and queue the thumbnails ahead of the scroll
+static void _prefetch_update(dt_thumbtable_t *table, const int delta)
+{
+  if(table->mode != DT_THUMBTABLE_MODE_FILEMANAGER && table->mode != DT_THUMBTABLE_MODE_FILMSTRIP) return;
+  if(delta == 0 || !table->list || table->thumb_size <= 0) return;
+  const int max_screens = dt_conf_get_int("lighttable/ui/prefetch_screens");
+  if(max_screens <= 0) return;
+
+  // moving the thumbs up (or left) shows the next images
+  const int direction = delta < 0 ? 1 : -1;
+  const gint64 now = g_get_monotonic_time();
+  if(direction != table->scroll_direction)
+  {
+    _prefetch_cancel(table);
+    table->scroll_direction = direction;
+  }
+  else
+  {
+    const float dt = (now - table->scroll_time) / 1000000.0f;
+    const float speed = abs(delta) / (float)table->thumb_size / MAX(dt, 0.01f);
+    // after a pause, start again from the current move
+    table->scroll_speed = (dt > 1.0f) ? 0.0f : 0.7f * table->scroll_speed + 0.3f * speed;
+  }
+  table->scroll_time = now;
+
+  // one screen at least, more when scrolling fast
+  const int rows = MAX(1, table->rows);
+  const int screens
+      = CLAMP(1 + (int)(table->scroll_speed * DT_THUMBTABLE_PREFETCH_LOOKAHEAD / rows), 1, max_screens);
+  const int per_screen = rows * table->thumbs_per_row;
+
+  const dt_thumbnail_t *edge
+      = (dt_thumbnail_t *)(direction > 0 ? g_list_last(table->list) : g_list_first(table->list))->data;
+  int from = edge->rowid + direction;
+  if(table->prefetch_rowid > 0 && direction * (table->prefetch_rowid - from) >= 0)
+    from = table->prefetch_rowid + direction;
+  const int to = MAX(1, edge->rowid + direction * screens * per_screen);
+  // queue whole rows only, to keep the number of jobs low
+  if(from < 1 || direction * (to - from) + 1 < table->thumbs_per_row) return;
+  table->prefetch_rowid = to;
+
+  _prefetch_t *params = (_prefetch_t *)calloc(1, sizeof(_prefetch_t));
+  params->table = table;
+  params->generation = g_atomic_int_get(&table->prefetch_generation);
+  // same size as the visible thumbnails, see dt_thumbnail_t image area
+  float ratio_w = 1.0f, ratio_h = 1.0f;
+  if(edge->img_margin)
+  {
+    ratio_w = (100 - edge->img_margin->left - edge->img_margin->right) / 100.0f;
+    ratio_h = (100 - edge->img_margin->top - edge->img_margin->bottom) / 100.0f;
+  }
+  params->mip = dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, edge->width * ratio_w,
+                                                  edge->height * ratio_h);
+
+  sqlite3_stmt *stmt;
+  gchar *query = dt_util_dstrcat(NULL,
+                                 "SELECT rowid, imgid FROM memory.collected_images WHERE rowid BETWEEN %d AND %d "
+                                 "ORDER BY rowid %s",
+                                 MIN(from, to), MAX(from, to), direction > 0 ? "ASC" : "DESC");
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    if(direction * (sqlite3_column_int(stmt, 0) - edge->rowid) <= per_screen) params->nb_generate++;
+    params->imgids = g_list_prepend(params->imgids, GINT_TO_POINTER(sqlite3_column_int(stmt, 1)));
+  }
+  sqlite3_finalize(stmt);
+  g_free(query);
+  params->imgids = g_list_reverse(params->imgids);
+
+  if(!params->imgids)
+  {
+    // end of the collection
+    _prefetch_free(params);
+    return;
+  }
+
+  dt_job_t *job = dt_control_job_create(&_prefetch_job_run, "prefetch thumbnails");
+  if(!job)
+  {
+    _prefetch_free(params);
+    return;
+  }
+  dt_control_job_set_params(job, params, _prefetch_free);
+  dt_print(DT_DEBUG_LIGHTTABLE, "prefetch thumbs %d to %d (%d screens, %.1f rows/s)\n", from, to, screens,
+           table->scroll_speed);
+  // low priority, so this never delays the thumbnails that are actually shown
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG, job);
+}
+
 // move all thumbs from the table.
 // if clamp, we verify that the move is allowed (collection bounds, etc...)
 static gboolean _move(dt_thumbtable_t *table, const int x, const int y, gboolean clamp)
@@ -645,6 +783,9 @@ static gboolean _move(dt_thumbtable_t *table, const int x, const int y, gboolean
   // and we store it
   dt_conf_set_int("plugins/lighttable/recentcollect/pos0", table->offset);
 
+  // load the next thumbnails in background
+  _prefetch_update(table, (table->mode == DT_THUMBTABLE_MODE_FILMSTRIP) ? posx : posy);
+
   // update scrollbars
   _thumbtable_update_scrollbars(table);
 
@@ -1601,6 +1742,7 @@ void dt_thumbtable_full_redraw(dt_thumbtable_t *table, gboolean force)
 
     const double start = dt_get_wtime();
     table->dragging = FALSE;
+    _prefetch_cancel(table);
     sqlite3_stmt *stmt;
     dt_print(DT_DEBUG_LIGHTTABLE,
              "reload thumbs from db. force=%d w=%d h=%d zoom=%d rows=%d size=%d offset=%d centering=%d...\n",
@@ -93,6 +93,13 @@ typedef struct dt_thumbtable_t
 
   // in lighttable preview or culling, we can navigate inside selection or inside full collection
   gboolean navigate_inside_selection;
+
+  // scroll tracking for the thumbnail prefetching
+  int scroll_direction;     // 1 towards the end of the collection, -1 towards the start, 0 unknown
+  float scroll_speed;       // smoothed, in rows per second
+  gint64 scroll_time;       // time of the last move
+  gint prefetch_generation; // incremented to cancel the queued prefetch jobs
+  int prefetch_rowid;       // last rowid already queued for prefetching in scroll_direction
 } dt_thumbtable_t;
 
 dt_thumbtable_t *dt_thumbtable_new();
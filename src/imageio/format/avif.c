@@ -633,6 +633,11 @@ const char *extension(dt_imageio_module_data_t *data)
   return "avif";
 }
 
+int parallel_write(dt_imageio_module_format_t *self)
+{
+  return 1;
+}
+
 const char *name()
 {
   return _("AVIF (8/10/12-bit)");
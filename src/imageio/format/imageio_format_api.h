@@ -88,6 +88,9 @@ int flags(struct dt_imageio_module_data_t *data);
 
 int read_image(struct dt_imageio_module_data_t *data, uint8_t *out);
 
+/* optional: return 1 if write_image() may be called for several images at the same time. */
+int parallel_write(struct dt_imageio_module_format_t *self);
+
 #pragma GCC visibility pop
 
 #ifdef __cplusplus
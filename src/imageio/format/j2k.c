@@ -607,6 +607,11 @@ const char *extension(dt_imageio_module_data_t *data_tmp)
     return "jp2";
 }
 
+int parallel_write(dt_imageio_module_format_t *self)
+{
+  return 1;
+}
+
 const char *name()
 {
   return _("JPEG 2000 (12-bit)");
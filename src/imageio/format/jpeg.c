@@ -550,6 +550,11 @@ const char *extension(dt_imageio_module_data_t *data)
   return "jpg";
 }
 
+int parallel_write(dt_imageio_module_format_t *self)
+{
+  return 1;
+}
+
 int flags(dt_imageio_module_data_t *data)
 {
   return FORMAT_FLAGS_SUPPORT_XMP;
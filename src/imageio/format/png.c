@@ -479,6 +479,11 @@ const char *extension(dt_imageio_module_data_t *data)
   return "png";
 }
 
+int parallel_write(dt_imageio_module_format_t *self)
+{
+  return 1;
+}
+
 const char *name()
 {
   return _("PNG (8/16-bit)");
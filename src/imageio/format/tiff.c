@@ -714,6 +714,11 @@ const char *extension(dt_imageio_module_data_t *data)
   return "tif";
 }
 
+int parallel_write(dt_imageio_module_format_t *self)
+{
+  return 1;
+}
+
 const char *name()
 {
   return _("TIFF (8/16/32-bit)");
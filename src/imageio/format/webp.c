@@ -283,6 +283,11 @@ const char *extension(dt_imageio_module_data_t *data)
   return "webp";
 }
 
+int parallel_write(dt_imageio_module_format_t *self)
+{
+  return 1;
+}
+
 const char *name()
 {
   return _("WebP (8-bit)");
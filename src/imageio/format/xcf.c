@@ -293,6 +293,11 @@ const char *extension(dt_imageio_module_data_t *data)
   return "xcf";
 }
 
+int parallel_write(dt_imageio_module_format_t *self)
+{
+  return 1;
+}
+
 const char *name()
 {
   return _("xcf");
@@ -238,12 +238,13 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
   g_strlcpy(pattern, d->filename, sizeof(pattern));
   gboolean from_cache = FALSE;
   dt_image_full_path(imgid, input_dir, sizeof(input_dir), &from_cache);
-  // set max_width and max_height values to expand them afterwards in darktable variables
-  dt_variables_set_max_width_height(d->vp, fdata->max_width, fdata->max_height);
   int fail = 0;
+  gboolean reserved = FALSE;
   // we're potentially called in parallel. have sequence number synchronized:
   dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
   {
+    // set max_width and max_height values to expand them afterwards in darktable variables
+    dt_variables_set_max_width_height(d->vp, fdata->max_width, fdata->max_height);
 try_again:
     // avoid braindead export which is bound to overwrite at random:
     if(total > 1 && !g_strrstr(pattern, "$"))
@@ -309,6 +310,13 @@ try_again:
         snprintf(c, filename_free_space, "_%.2d.%s", seq, ext);
         seq++;
       }
+      // other images might be exported at the same time, claim the name before leaving the critical block
+      FILE *f = g_fopen(filename, "wb");
+      if(f)
+      {
+        fclose(f);
+        reserved = TRUE;
+      }
     }
 
     if(!fail && d->onsave_action == DT_EXPORT_ONCONFLICT_SKIP)
@@ -332,6 +340,7 @@ try_again:
   {
     fprintf(stderr, "[imageio_storage_disk] could not export to file: `%s'!\n", filename);
     dt_control_log(_("could not export to file `%s'!"), filename);
+    if(reserved) g_unlink(filename);
     return 1;
   }
 
@@ -341,6 +350,14 @@ try_again:
   return 0;
 }
 
+int parallel_store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata)
+{
+  // only unique file names are claimed in the critical block of store(). when overwriting or skipping, two
+  // images expanding to the same name would both write it.
+  const dt_imageio_disk_t *d = (dt_imageio_disk_t *)sdata;
+  return d->onsave_action == DT_EXPORT_ONCONFLICT_UNIQUEFILENAME;
+}
+
 size_t params_size(dt_imageio_module_storage_t *self)
 {
   return sizeof(dt_imageio_disk_t) - sizeof(void *);
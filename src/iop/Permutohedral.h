@@ -37,6 +37,7 @@ DAMAGE.
 
 #include <algorithm>
 #include <math.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -125,21 +126,47 @@ public:
    *  kd_: the dimensionality of the position vectors on the hyperplane.
    *  vd_: the dimensionality of the value vectors
    */
-  HashTablePermutohedral()
+  HashTablePermutohedral(size_t expected = 0)
   {
     capacity = 1 << 15;
     capacity_bits = 0x7fff;
+    while(capacity / 2 < expected)
+    {
+      capacity *= 2;
+      capacity_bits = (capacity_bits << 1) | 1;
+    }
     filled = 0;
     entries = new Entry[capacity];
     keys = new Key[maxFill()];
-    values = new Value[maxFill()] { 0 };
+    values = new Value[maxFill()];
   }
 
   ~HashTablePermutohedral()
+  {
+    clear();
+  }
+
+  // Frees the storage, the table can't be used afterwards.
+  void clear()
   {
     delete[] entries;
     delete[] keys;
     delete[] values;
+    entries = nullptr;
+    keys = nullptr;
+    values = nullptr;
+    capacity = filled = 0;
+  }
+
+  // Exchanges the contents of two tables.
+  void swap(HashTablePermutohedral &other)
+  {
+    std::swap(keys, other.keys);
+    std::swap(values, other.values);
+    std::swap(entries, other.entries);
+    std::swap(capacity, other.capacity);
+    std::swap(filled, other.filled);
+    std::swap(capacity_bits, other.capacity_bits);
   }
 
   // Returns the number of vectors stored.
@@ -181,26 +208,59 @@ public:
       if(e.keyIdx == -1)
       {
         if(!create) return -1; // Return not found.
-	// Double hash table size if necessary
-	if(filled >= maxFill())
-	   {
-	   grow();
-	   }
+        // Double hash table size if necessary
+        if(filled >= maxFill())
+        {
+          grow();
+          // the cell found so far belongs to the old table
+          return lookupOffset(key, create);
+        }
         // need to create an entry. Store the given key.
-	keys[filled] = key;
+        keys[filled] = key;
+        Value::clear(values[filled].value);
         entries[h].keyIdx = filled;
+        entries[h].hash = key.hash;
         return filled++;
       }
 
-      // check if the cell has a matching key
-      if (keys[e.keyIdx] == key)
-	 return e.keyIdx;
+      // check if the cell has a matching key, the hash in the entry saves most visits to the keys
+      if(e.hash == key.hash && keys[e.keyIdx] == key) return e.keyIdx;
 
       // increment the bucket with wraparound
       h = (h + 1) & capacity_bits;
     }
   }
 
+  /* Like lookupOffset(key, true), but may be called from several threads at once as long as no other kind of
+   * lookup runs at the same time. The table must have been created large enough for all keys, it can't grow.
+   * Cells are claimed with a compare and swap on their index, the value of a new key is cleared.
+   */
+  int insertConcurrent(const Key &key)
+  {
+    size_t h = key.hash & capacity_bits;
+    while(1)
+    {
+      volatile int *const cell = &entries[h].keyIdx;
+      int idx = *cell;
+      if(idx == -1 && __sync_bool_compare_and_swap(cell, -1, -2))
+      {
+        // this thread owns the cell, publish the key before its index
+        idx = __sync_fetch_and_add(&filled, 1);
+        keys[idx] = key;
+        Value::clear(values[idx].value);
+        entries[h].hash = key.hash;
+        __sync_synchronize();
+        *cell = idx;
+        return idx;
+      }
+      // another thread is storing its key here
+      while((idx = *cell) == -2) sched_yield();
+      __sync_synchronize();
+      if(idx >= 0 && entries[h].hash == key.hash && keys[idx] == key) return idx;
+      if(idx >= 0) h = (h + 1) & capacity_bits;
+    }
+  }
+
   /* Looks up the value vector associated with a given key vector.
    *        k : reference to the key vector to be looked up.
    *   create : true if a non-existing key should be created.
@@ -239,7 +299,7 @@ public:
     for(size_t i = 0; i < oldCapacity; i++)
     {
       if(entries[i].keyIdx == -1) continue;
-      size_t h = keys[entries[i].keyIdx].hash & capacity_bits;
+      size_t h = entries[i].hash & capacity_bits;
       while(newEntries[h].keyIdx != -1)
       {
         h = (h+1) & capacity_bits;
@@ -254,10 +314,11 @@ private:
   // Private struct for the hash table entries.
   struct Entry
   {
-    Entry() : keyIdx(-1)
+    Entry() : keyIdx(-1), hash(0)
     {
     }
-    int keyIdx;
+    int keyIdx; // -1 for an empty cell, -2 while insertConcurrent() fills it
+    unsigned hash;
   };
 
   Key *keys;
@@ -329,6 +390,7 @@ public:
     scaleFactor = scaleFactorTmp;
 
     hashTables = new HashTable[nThreads];
+    splatCache = new SplatCache[nThreads];
   }
 
 
@@ -338,6 +400,7 @@ public:
     delete[] replay;
     delete[] canonical;
     delete[] hashTables;
+    delete[] splatCache;
   }
 
 
@@ -436,8 +499,15 @@ public:
       for(int i = 0; i < D; i++) key.key[i] = greedy[i] + canonical[remainder * (D + 1) + rank[i]];
       key.setHash();
 
-      // Retrieve pointer to the value at this vertex.
-      Value *val = hashTables[thread_index].lookup(key, true);
+      // Retrieve pointer to the value at this vertex. neighbouring pixels mostly fall into the same simplex,
+      // so the vertices of the previous one are tried before the hash table.
+      SplatCache &cache = splatCache[thread_index];
+      if(cache.offset[remainder] < 0 || !(cache.key[remainder] == key))
+      {
+        cache.key[remainder] = key;
+        cache.offset[remainder] = hashTables[thread_index].lookupOffset(key, true);
+      }
+      Value *val = hashTables[thread_index].getValues() + cache.offset[remainder];
 
       // Accumulate values with barycentric weight.
       val->add(value,barycentric[remainder]);
@@ -448,54 +518,63 @@ public:
     }
   }
 
-  /* Merge the multiple threads' hash tables into the totals. */
+  /* Merge the multiple threads' hash tables into the totals.
+   *
+   * The keys of all tables are inserted into a new table in parallel, sized for the sum of their entries so
+   * that it never has to grow. The values are then added table by table: the keys of one table are unique,
+   * so the threads adding it never write the same vertex and each vertex sums up the tables in the same
+   * order, whichever thread inserted it first.
+   */
   void merge_splat_threads(void)
   {
     if(nThreads <= 1) return;
 
-    /* Because growing the hash table is expensive, we want to avoid having to do it multiple times.
-     * Only a small percentage of entries in the individual hash tables have the same key, so we
-     * won't waste much space if we simply grow the destination table enough to hold the sum of the
-     * entries in the individual tables
-     */
-    size_t total_entries = hashTables[0].size();
-    for(int i = 1; i < nThreads; i++)
-      total_entries += hashTables[i].size();
-    int order = 0;
-    while (total_entries > hashTables[0].maxFill())
+    size_t total_entries = 0;
+    for(int i = 0; i < nThreads; i++) total_entries += hashTables[i].size();
+    HashTable merged(total_entries);
+
+    int **offset_remap = new int *[nThreads];
+    for(int i = 0; i < nThreads; i++) offset_remap[i] = new int[hashTables[i].size()];
+
+    for(int i = 0; i < nThreads; i++)
     {
-      order++;
-      total_entries /= 2;
+      const Key *const oldKeys = hashTables[i].getKeys();
+      int *const remap = offset_remap[i];
+      const int filled = hashTables[i].size();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) shared(merged) firstprivate(oldKeys, remap, filled)
+#endif
+      for(int j = 0; j < filled; j++) remap[j] = merged.insertConcurrent(oldKeys[j]);
     }
-    if (order > 0)
-       hashTables[0].grow(order);
-    /* Merge the multiple hash tables into one, creating an offset remap table. */
-    int **offset_remap = new int *[nThreads];
-    for(int i = 1; i < nThreads; i++)
+
+    Value *const newVals = merged.getValues();
+    for(int i = 0; i < nThreads; i++)
     {
-      const Key *oldKeys = hashTables[i].getKeys();
-      const Value *oldVals = hashTables[i].getValues();
+      const Value *const oldVals = hashTables[i].getValues();
+      const int *const remap = offset_remap[i];
       const int filled = hashTables[i].size();
-      offset_remap[i] = new int[filled];
-      for(int j = 0; j < filled; j++)
-      {
-        Value *val = hashTables[0].lookup(oldKeys[j], true);
-	val->add(oldVals[j]);
-        offset_remap[i][j] = val - hashTables[0].getValues();
-      }
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) firstprivate(newVals, oldVals, remap, filled)
+#endif
+      for(int j = 0; j < filled; j++) newVals[remap[j]] += oldVals[j];
     }
 
     /* Rewrite the offsets in the replay structure from the above generated table. */
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) shared(offset_remap)
+#endif
     for(int i = 0; i < nData; i++)
     {
-      if(replay[i].table > 0)
-      {
-        for (int dim = 0; dim <= D; dim++)
-	  replay[i].offset[dim] = offset_remap[replay[i].table][replay[i].offset[dim]];
-      }
+      const int *const remap = offset_remap[replay[i].table];
+      for(int dim = 0; dim <= D; dim++) replay[i].offset[dim] = remap[replay[i].offset[dim]];
+      replay[i].table = 0;
     }
 
-    for(int i = 1; i < nThreads; i++) delete[] offset_remap[i];
+    // the merged table replaces the first one, the others aren't needed any longer
+    hashTables[0].swap(merged);
+    for(int i = 1; i < nThreads; i++) hashTables[i].clear();
+
+    for(int i = 0; i < nThreads; i++) delete[] offset_remap[i];
     delete[] offset_remap;
   }
 
@@ -529,7 +608,7 @@ public:
     for(int j = 0; j <= D; j++)
     {
 #ifdef _OPENMP
-#pragma omp parallel for shared(j, oldValue, newValue)
+#pragma omp parallel for schedule(static) shared(j, oldValue, newValue)
 #endif
       // For each vertex in the lattice,
       for(int i = 0; i < hashTables[0].size(); i++) // blur point i in dimension j
@@ -583,6 +662,18 @@ private:
   } *replay;
 
   HashTable *hashTables;
+
+  // the vertices of the simplex last splatted into by each thread, padded against false sharing
+  struct SplatCache
+  {
+    SplatCache()
+    {
+      for(int i = 0; i <= D; i++) offset[i] = -1;
+    }
+    Key key[D + 1];
+    int offset[D + 1];
+    char padding[64];
+  } *splatCache;
 };
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
@@ -36,6 +36,9 @@
 #if defined(__SSE__)
 #include <xmmintrin.h>
 #endif
+#if defined(DT_HAVE_AVX_CODEPATHS)
+#include <immintrin.h>
+#endif
 
 #define INSET DT_PIXEL_APPLY_DPI(5)
 #define INFL .3f
@@ -557,6 +560,292 @@ static void eaw_decompose_sse2(float *const out, const float *const in, float *c
   _mm_sfence();
 }
 
+#if defined(DT_HAVE_AVX_CODEPATHS)
+/* 8-wide version of dt_fast_expf_sse2() */
+DT_TARGET_AVX2 static inline __m256 dt_fast_expf_avx2(const __m256 x)
+{
+  const __m256 f = _mm256_fmadd_ps(x, _mm256_set1_ps(0x00adf880u), _mm256_set1_ps(0x3f800000u));
+  const __m256i i = _mm256_max_epi32(_mm256_cvtps_epi32(f), _mm256_setzero_si256()); // i(n) = 0 if i(n) < 0
+  return _mm256_castsi256_ps(i);
+}
+
+/* weight_sse2() for two pixels at once, one in each 128 bit lane. in memory order
+ * the result is (wl, wc, wc, 1) for both of them. */
+DT_TARGET_AVX2 static inline __m256 weight_avx2(const __m256 c1, const __m256 c2, const __m256 vsharpen)
+{
+  const __m256 diff = _mm256_sub_ps(c1, c2);
+  const __m256 square = _mm256_mul_ps(diff, diff);                            // (d1, d2, d3, ?)
+  const __m256 square2 = _mm256_permute_ps(square, _MM_SHUFFLE(3, 1, 2, 0));  // (d1, d3, d2, ?)
+  const __m256 added = _mm256_blend_ps(_mm256_add_ps(square, square2), square, 0x11); // (d1, d2+d3, d2+d3, ?)
+  const __m256 exp = dt_fast_expf_avx2(_mm256_mul_ps(added, vsharpen));      // (wl, wc, wc, ?)
+  return _mm256_blend_ps(exp, _mm256_set1_ps(1.0f), 0x88);                   // (wl, wc, wc, 1)
+}
+
+/* same as eaw_decompose_sse2(), but the inner part of the image, where most of the time goes, is done for two
+ * pixels per 256 bit vector. the borders keep the sse2 code. */
+DT_TARGET_AVX2 static void eaw_decompose_avx2(float *const out, const float *const in, float *const detail,
+                                              const int scale, const float sharpen, const int32_t width,
+                                              const int32_t height)
+{
+  const int mult = 1 << scale;
+  static const float filter[5] = { 1.0f / 16.0f, 4.0f / 16.0f, 6.0f / 16.0f, 4.0f / 16.0f, 1.0f / 16.0f };
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(detail, filter, height, in, mult, out, sharpen, width) \
+  schedule(static)
+#endif
+  for(int j = 0; j < 2 * mult; j++)
+  {
+    ROW_PROLOGUE_SSE
+
+    for(int i = 0; i < width; i++)
+    {
+      SUM_PIXEL_PROLOGUE_SSE
+      for(int jj = 0; jj < 5; jj++)
+      {
+        for(int ii = 0; ii < 5; ii++)
+        {
+          SUM_PIXEL_CONTRIBUTION_WITH_TEST_SSE2(ii, jj);
+        }
+      }
+      SUM_PIXEL_EPILOGUE_SSE
+    }
+  }
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(detail, filter, height, in, mult, out, sharpen, width) \
+  schedule(static)
+#endif
+  for(int j = 2 * mult; j < height - 2 * mult; j++)
+  {
+    ROW_PROLOGUE_SSE
+
+    for(int i = 0; i < 2 * mult; i++)
+    {
+      SUM_PIXEL_PROLOGUE_SSE
+      for(int jj = 0; jj < 5; jj++)
+      {
+        for(int ii = 0; ii < 5; ii++)
+        {
+          SUM_PIXEL_CONTRIBUTION_WITH_TEST_SSE2(ii, jj);
+        }
+      }
+      SUM_PIXEL_EPILOGUE_SSE
+    }
+
+    const __m256 vsharpen = _mm256_set1_ps(-sharpen);
+    int i = 2 * mult;
+    for(; i + 1 < width - 2 * mult; i += 2)
+    {
+      const __m256 c = _mm256_loadu_ps((const float *)px);
+      __m256 sum = _mm256_setzero_ps();
+      __m256 wgt = _mm256_setzero_ps();
+      const float *pn = in + (size_t)4 * (i - 2 * mult + (size_t)(j - 2 * mult) * width);
+      for(int jj = 0; jj < 5; jj++)
+      {
+        for(int ii = 0; ii < 5; ii++)
+        {
+          const __m256 p = _mm256_loadu_ps(pn);
+          const __m256 w = _mm256_mul_ps(_mm256_set1_ps(filter[ii] * filter[jj]), weight_avx2(c, p, vsharpen));
+          sum = _mm256_fmadd_ps(w, p, sum);
+          wgt = _mm256_add_ps(wgt, w);
+          pn += (size_t)4 * mult;
+        }
+        pn += (size_t)4 * (width - 5) * mult;
+      }
+      sum = _mm256_div_ps(sum, wgt);
+      _mm256_storeu_ps(pdetail, _mm256_sub_ps(c, sum));
+      _mm256_storeu_ps(pcoarse, sum);
+      px += 2;
+      pdetail += 8;
+      pcoarse += 8;
+    }
+
+    // odd pixel left over in the inner part, and the right border
+    for(; i < width; i++)
+    {
+      SUM_PIXEL_PROLOGUE_SSE
+      for(int jj = 0; jj < 5; jj++)
+      {
+        for(int ii = 0; ii < 5; ii++)
+        {
+          SUM_PIXEL_CONTRIBUTION_WITH_TEST_SSE2(ii, jj);
+        }
+      }
+      SUM_PIXEL_EPILOGUE_SSE
+    }
+  }
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(detail, filter, height, in, mult, out, sharpen, width) \
+  schedule(static)
+#endif
+  for(int j = height - 2 * mult; j < height; j++)
+  {
+    ROW_PROLOGUE_SSE
+
+    for(int i = 0; i < width; i++)
+    {
+      SUM_PIXEL_PROLOGUE_SSE
+      for(int jj = 0; jj < 5; jj++)
+      {
+        for(int ii = 0; ii < 5; ii++)
+        {
+          SUM_PIXEL_CONTRIBUTION_WITH_TEST_SSE2(ii, jj);
+        }
+      }
+      SUM_PIXEL_EPILOGUE_SSE
+    }
+  }
+
+  _mm_sfence();
+}
+
+/* 16-wide version of dt_fast_expf_sse2() */
+DT_TARGET_AVX512 static inline __m512 dt_fast_expf_avx512(const __m512 x)
+{
+  const __m512 f = _mm512_fmadd_ps(x, _mm512_set1_ps(0x00adf880u), _mm512_set1_ps(0x3f800000u));
+  const __m512i i = _mm512_max_epi32(_mm512_cvtps_epi32(f), _mm512_setzero_si512()); // i(n) = 0 if i(n) < 0
+  return _mm512_castsi512_ps(i);
+}
+
+/* weight_sse2() for four pixels at once, one in each 128 bit lane, see weight_avx2() */
+DT_TARGET_AVX512 static inline __m512 weight_avx512(const __m512 c1, const __m512 c2, const __m512 vsharpen)
+{
+  const __m512 diff = _mm512_sub_ps(c1, c2);
+  const __m512 square = _mm512_mul_ps(diff, diff);                                   // (d1, d2, d3, ?)
+  const __m512 square2 = _mm512_permute_ps(square, _MM_SHUFFLE(3, 1, 2, 0));         // (d1, d3, d2, ?)
+  const __m512 added = _mm512_mask_blend_ps(0x1111, _mm512_add_ps(square, square2), square); // (d1, d2+d3, d2+d3, ?)
+  const __m512 exp = dt_fast_expf_avx512(_mm512_mul_ps(added, vsharpen));           // (wl, wc, wc, ?)
+  return _mm512_mask_blend_ps(0x8888, exp, _mm512_set1_ps(1.0f));                   // (wl, wc, wc, 1)
+}
+
+/* eaw_decompose_avx2() with four pixels per 512 bit vector in the inner part of the image */
+DT_TARGET_AVX512 static void eaw_decompose_avx512(float *const out, const float *const in, float *const detail,
+                                                  const int scale, const float sharpen, const int32_t width,
+                                                  const int32_t height)
+{
+  const int mult = 1 << scale;
+  static const float filter[5] = { 1.0f / 16.0f, 4.0f / 16.0f, 6.0f / 16.0f, 4.0f / 16.0f, 1.0f / 16.0f };
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(detail, filter, height, in, mult, out, sharpen, width) \
+  schedule(static)
+#endif
+  for(int j = 0; j < 2 * mult; j++)
+  {
+    ROW_PROLOGUE_SSE
+
+    for(int i = 0; i < width; i++)
+    {
+      SUM_PIXEL_PROLOGUE_SSE
+      for(int jj = 0; jj < 5; jj++)
+      {
+        for(int ii = 0; ii < 5; ii++)
+        {
+          SUM_PIXEL_CONTRIBUTION_WITH_TEST_SSE2(ii, jj);
+        }
+      }
+      SUM_PIXEL_EPILOGUE_SSE
+    }
+  }
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(detail, filter, height, in, mult, out, sharpen, width) \
+  schedule(static)
+#endif
+  for(int j = 2 * mult; j < height - 2 * mult; j++)
+  {
+    ROW_PROLOGUE_SSE
+
+    for(int i = 0; i < 2 * mult; i++)
+    {
+      SUM_PIXEL_PROLOGUE_SSE
+      for(int jj = 0; jj < 5; jj++)
+      {
+        for(int ii = 0; ii < 5; ii++)
+        {
+          SUM_PIXEL_CONTRIBUTION_WITH_TEST_SSE2(ii, jj);
+        }
+      }
+      SUM_PIXEL_EPILOGUE_SSE
+    }
+
+    const __m512 vsharpen = _mm512_set1_ps(-sharpen);
+    int i = 2 * mult;
+    for(; i + 3 < width - 2 * mult; i += 4)
+    {
+      const __m512 c = _mm512_loadu_ps((const float *)px);
+      __m512 sum = _mm512_setzero_ps();
+      __m512 wgt = _mm512_setzero_ps();
+      const float *pn = in + (size_t)4 * (i - 2 * mult + (size_t)(j - 2 * mult) * width);
+      for(int jj = 0; jj < 5; jj++)
+      {
+        for(int ii = 0; ii < 5; ii++)
+        {
+          const __m512 p = _mm512_loadu_ps(pn);
+          const __m512 w = _mm512_mul_ps(_mm512_set1_ps(filter[ii] * filter[jj]), weight_avx512(c, p, vsharpen));
+          sum = _mm512_fmadd_ps(w, p, sum);
+          wgt = _mm512_add_ps(wgt, w);
+          pn += (size_t)4 * mult;
+        }
+        pn += (size_t)4 * (width - 5) * mult;
+      }
+      sum = _mm512_div_ps(sum, wgt);
+      _mm512_storeu_ps(pdetail, _mm512_sub_ps(c, sum));
+      _mm512_storeu_ps(pcoarse, sum);
+      px += 4;
+      pdetail += 16;
+      pcoarse += 16;
+    }
+
+    // up to three pixels left over in the inner part, and the right border
+    for(; i < width; i++)
+    {
+      SUM_PIXEL_PROLOGUE_SSE
+      for(int jj = 0; jj < 5; jj++)
+      {
+        for(int ii = 0; ii < 5; ii++)
+        {
+          SUM_PIXEL_CONTRIBUTION_WITH_TEST_SSE2(ii, jj);
+        }
+      }
+      SUM_PIXEL_EPILOGUE_SSE
+    }
+  }
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(detail, filter, height, in, mult, out, sharpen, width) \
+  schedule(static)
+#endif
+  for(int j = height - 2 * mult; j < height; j++)
+  {
+    ROW_PROLOGUE_SSE
+
+    for(int i = 0; i < width; i++)
+    {
+      SUM_PIXEL_PROLOGUE_SSE
+      for(int jj = 0; jj < 5; jj++)
+      {
+        for(int ii = 0; ii < 5; ii++)
+        {
+          SUM_PIXEL_CONTRIBUTION_WITH_TEST_SSE2(ii, jj);
+        }
+      }
+      SUM_PIXEL_EPILOGUE_SSE
+    }
+  }
+
+  _mm_sfence();
+}
+#endif
+
 #undef SUM_PIXEL_CONTRIBUTION_COMMON_SSE2
 #undef SUM_PIXEL_CONTRIBUTION_WITH_TEST_SSE2
 #undef ROW_PROLOGUE_SSE
@@ -798,6 +1087,20 @@ void process_sse2(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *p
 }
 #endif
 
+#if defined(DT_HAVE_AVX_CODEPATHS)
+void process_avx2(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const void *const i,
+                  void *const o, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  process_wavelets(self, piece, i, o, roi_in, roi_out, eaw_decompose_avx2, eaw_synthesize_sse2);
+}
+
+void process_avx512(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const void *const i,
+                    void *const o, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  process_wavelets(self, piece, i, o, roi_in, roi_out, eaw_decompose_avx512, eaw_synthesize_sse2);
+}
+#endif
+
 #ifdef HAVE_OPENCL
 /* this version is adapted to the new global tiling mechanism. it no longer does tiling by itself. */
 int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
@@ -24,6 +24,7 @@
 #include "control/control.h"
 #include "develop/develop.h"
 #include "develop/imageop.h"
+#include "develop/tiling.h"
 #include "dtgtk/resetlabel.h"
 #include "gui/gtk.h"
 #include "iop/iop_api.h"
@@ -39,25 +40,42 @@
 
 #define ROUND_POSISTIVE(f) ((unsigned int)((f)+0.5))
 
-DT_MODULE(1)
+#define BINS (256)
+
+DT_MODULE(2)
+
+typedef enum dt_iop_rlce_mode_t
+{
+  DT_RLCE_MODE_SLIDING = 0, // histogram of a window around every pixel, the result of version 1
+  DT_RLCE_MODE_TILED = 1    // histograms of tiles, interpolated between the tile centres
+} dt_iop_rlce_mode_t;
+
+typedef struct dt_iop_rlce_params_v1_t
+{
+  double radius;
+  double slope;
+} dt_iop_rlce_params_v1_t;
 
 typedef struct dt_iop_rlce_params_t
 {
   double radius;
   double slope;
+  dt_iop_rlce_mode_t mode;
 } dt_iop_rlce_params_t;
 
 typedef struct dt_iop_rlce_gui_data_t
 {
   GtkBox *vbox1, *vbox2;
-  GtkWidget *label1, *label2;
+  GtkWidget *label1, *label2, *label3;
   GtkWidget *scale1, *scale2; // radie pixels, slope
+  GtkWidget *mode;
 } dt_iop_rlce_gui_data_t;
 
 typedef struct dt_iop_rlce_data_t
 {
   double radius;
   double slope;
+  dt_iop_rlce_mode_t mode;
 } dt_iop_rlce_data_t;
 
 
@@ -73,7 +91,7 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_DEPRECATED;
+  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_DEPRECATED | IOP_FLAGS_ALLOW_TILING;
 }
 
 int default_colorspace(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -81,43 +99,55 @@ int default_colorspace(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_p
   return iop_cs_rgb;
 }
 
-void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
-             void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+int legacy_params(dt_iop_module_t *self, const void *const old_params, const int old_version,
+                  void *new_params, const int new_version)
 {
-  dt_iop_rlce_data_t *data = (dt_iop_rlce_data_t *)piece->data;
-  const int ch = piece->colors;
+  if(old_version == 1 && new_version == 2)
+  {
+    const dt_iop_rlce_params_v1_t *o = (dt_iop_rlce_params_v1_t *)old_params;
+    dt_iop_rlce_params_t *n = (dt_iop_rlce_params_t *)new_params;
+    n->radius = o->radius;
+    n->slope = o->slope;
+    n->mode = DT_RLCE_MODE_SLIDING; // keep the look of old edits
+    return 0;
+  }
+  return 1;
+}
 
-  // PASS1: Get a luminance map of image...
-  float *luminance = (float *)malloc(((size_t)roi_out->width * roi_out->height) * sizeof(float));
-// double lsmax=0.0,lsmin=1.0;
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(ch, ivoid, roi_out) \
-  shared(luminance) \
-  schedule(static)
-#endif
-  for(int j = 0; j < roi_out->height; j++)
+// clips the histogram at limit and redistributes the clipped entries over all bins
+static void clip_histogram(int *clippedhist, const int limit)
+{
+  int ce = 0, ceb = 0;
+  do
   {
-    float *in = (float *)ivoid + (size_t)j * roi_out->width * ch;
-    float *lm = luminance + (size_t)j * roi_out->width;
-    for(int i = 0; i < roi_out->width; i++)
+    ceb = ce;
+    ce = 0;
+    for(int b = 0; b <= BINS; b++)
     {
-      double pmax = CLIP(fmax(in[0], fmax(in[1], in[2]))); // Max value in RGB set
-      double pmin = CLIP(fmin(in[0], fmin(in[1], in[2]))); // Min value in RGB set
-      *lm = (pmax + pmin) / 2.0;                           // Pixel luminocity
-      in += ch;
-      lm++;
+      int d = clippedhist[b] - limit;
+      if(d > 0)
+      {
+        ce += d;
+        clippedhist[b] = limit;
+      }
     }
-  }
 
+    int d = (ce / (float)(BINS + 1));
+    int m = ce % (BINS + 1);
+    for(int b = 0; b <= BINS; b++) clippedhist[b] += d;
 
-  // Params
-  const int rad = data->radius * roi_in->scale / piece->iscale;
-
-#define BINS (256)
-
-  const float slope = data->slope;
+    if(m != 0)
+    {
+      int s = BINS / (float)m;
+      for(int b = 0; b <= BINS; b += s) ++clippedhist[b];
+    }
+  } while(ce != ceb);
+}
 
+static void process_sliding(const float *const luminance, const void *const ivoid, void *const ovoid,
+                            const int ch, const int rad, const float slope, const dt_iop_roi_t *const roi_in,
+                            const dt_iop_roi_t *const roi_out)
+{
   const size_t destbuf_size = roi_out->width;
   float *const dest_buf = malloc(destbuf_size * sizeof(float) * dt_get_num_threads());
 
@@ -183,31 +213,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 
       /* clip histogram and redistribute clipped entries */
       memcpy(clippedhist, hist, (BINS + 1) * sizeof(int));
-      int ce = 0, ceb = 0;
-      do
-      {
-        ceb = ce;
-        ce = 0;
-        for(int b = 0; b <= BINS; b++)
-        {
-          int d = clippedhist[b] - limit;
-          if(d > 0)
-          {
-            ce += d;
-            clippedhist[b] = limit;
-          }
-        }
-
-        int d = (ce / (float)(BINS + 1));
-        int m = ce % (BINS + 1);
-        for(int b = 0; b <= BINS; b++) clippedhist[b] += d;
-
-        if(m != 0)
-        {
-          int s = BINS / (float)m;
-          for(int b = 0; b <= BINS; b += s) ++clippedhist[b];
-        }
-      } while(ce != ceb);
+      clip_histogram(clippedhist, limit);
 
       /* build cdf of clipped histogram */
       unsigned int hMin = BINS;
@@ -243,11 +249,204 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   }
 
   free(dest_buf);
+}
+
+// tile size in pixels of roi_out. no lower bound here, that would make the grid of a zoomed out view coarser
+// than the one of the export. every tile keeps a lut of BINS + 1 floats, tiling_callback accounts for them.
+static float _tile_size(const dt_iop_rlce_data_t *const data, const dt_iop_roi_t *const roi_in,
+                        const dt_dev_pixelpipe_iop_t *const piece)
+{
+  // from the radius before rounding, so the grid scales exactly with the image
+  return 2.0f * data->radius * roi_in->scale / piece->iscale + 1.0f;
+}
+
+// the tiles of the image grid touching roi_out
+static void _tile_grid(const float tile, const dt_iop_roi_t *const roi_out, int *first_x, int *first_y,
+                       int *tiles_x, int *tiles_y)
+{
+  *first_x = roi_out->x / tile;
+  *first_y = roi_out->y / tile;
+  *tiles_x = (int)((roi_out->x + roi_out->width - 1) / tile) - *first_x + 1;
+  *tiles_y = (int)((roi_out->y + roi_out->height - 1) / tile) - *first_y + 1;
+}
+
+// classic clahe: the clipped cdf of the histogram of every tile is computed once, each pixel interpolates the
+// mappings of the four tiles around it bilinearly. the tiles are about as large as the window of the sliding
+// version, which makes the results similar. tile is their size in pixels of roi_out, the grid starts at the
+// corner of the image, so that it doesn't move with the region of interest. tiles cut by its border only see
+// their part inside of it.
+static void process_tiled(const float *const luminance, const void *const ivoid, void *const ovoid, const int ch,
+                          const float tile, const float slope, const dt_iop_roi_t *const roi_out)
+{
+  const float *const in = (const float *)ivoid;
+  float *const out = (float *)ovoid;
+  const int width = roi_out->width, height = roi_out->height;
+  const int roi_x = roi_out->x, roi_y = roi_out->y;
+  int first_x, first_y, tiles_x, tiles_y;
+  _tile_grid(tile, roi_out, &first_x, &first_y, &tiles_x, &tiles_y);
+
+  // PASS2: mapping of every tile from luminance bins to the new luminance
+  float *const lut = dt_alloc_align(64, sizeof(float) * (BINS + 1) * tiles_x * tiles_y);
+  if(!lut)
+  {
+    fprintf(stderr, "[clahe] failed to allocate the tile mappings\n");
+    memcpy(out, in, sizeof(float) * ch * width * height);
+    return;
+  }
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(first_x, first_y, height, luminance, lut, roi_x, roi_y, slope, tile, tiles_x, tiles_y, \
+                      width) \
+  schedule(dynamic)
+#endif
+  for(int t = 0; t < tiles_x * tiles_y; t++)
+  {
+    // pixel x of the image is in tile k for ceil(k * tile) <= x < ceil((k + 1) * tile)
+    const int tx = first_x + t % tiles_x, ty = first_y + t / tiles_x;
+    const int x0 = CLAMPS((int)ceilf(tx * tile) - roi_x, 0, width);
+    const int x1 = CLAMPS((int)ceilf((tx + 1) * tile) - roi_x, 0, width);
+    const int y0 = CLAMPS((int)ceilf(ty * tile) - roi_y, 0, height);
+    const int y1 = CLAMPS((int)ceilf((ty + 1) * tile) - roi_y, 0, height);
+
+    int hist[BINS + 1] = { 0 };
+    for(int y = y0; y < y1; y++)
+      for(int x = x0; x < x1; x++) ++hist[ROUND_POSISTIVE(luminance[(size_t)y * width + x] * (float)BINS)];
+
+    const int limit = (int)(slope * MAX(x1 - x0, 1) * MAX(y1 - y0, 1) / BINS + 0.5f);
+    clip_histogram(hist, limit);
+
+    int hMin = BINS;
+    for(int b = 0; b < BINS; b++)
+      if(hist[b] != 0)
+      {
+        hMin = b;
+        break;
+      }
+    int cdfMax = 0;
+    for(int b = hMin; b <= BINS; b++) cdfMax += hist[b];
+    const int cdfMin = hist[hMin];
+
+    float *const l = lut + (size_t)t * (BINS + 1);
+    int cdf = 0;
+    for(int b = 0; b <= BINS; b++)
+    {
+      if(b >= hMin) cdf += hist[b];
+      l[b] = (cdfMax > cdfMin) ? CLIP((cdf - cdfMin) / (float)(cdfMax - cdfMin)) : b / (float)BINS;
+    }
+  }
+
+  // PASS3: interpolate between the tile centres and apply
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(ch, first_x, first_y, height, in, luminance, lut, out, roi_x, roi_y, tile, tiles_x, \
+                      tiles_y, width) \
+  schedule(static)
+#endif
+  for(int j = 0; j < height; j++)
+  {
+    const float fy = CLAMPS((roi_y + j + 0.5f) / tile - 0.5f - first_y, 0.0f, tiles_y - 1);
+    const int ty0 = MIN((int)fy, tiles_y - 1), ty1 = MIN(ty0 + 1, tiles_y - 1);
+    const float wy = fy - ty0;
+    const float *in2 = in + (size_t)j * width * ch;
+    float *out2 = out + (size_t)j * width * ch;
+    for(int i = 0; i < width; i++, in2 += ch, out2 += ch)
+    {
+      const float fx = CLAMPS((roi_x + i + 0.5f) / tile - 0.5f - first_x, 0.0f, tiles_x - 1);
+      const int tx0 = MIN((int)fx, tiles_x - 1), tx1 = MIN(tx0 + 1, tiles_x - 1);
+      const float wx = fx - tx0;
+      const int v = ROUND_POSISTIVE(luminance[(size_t)j * width + i] * (float)BINS);
+
+      const float l00 = lut[((size_t)ty0 * tiles_x + tx0) * (BINS + 1) + v];
+      const float l01 = lut[((size_t)ty0 * tiles_x + tx1) * (BINS + 1) + v];
+      const float l10 = lut[((size_t)ty1 * tiles_x + tx0) * (BINS + 1) + v];
+      const float l11 = lut[((size_t)ty1 * tiles_x + tx1) * (BINS + 1) + v];
+      const float L = (1.0f - wy) * ((1.0f - wx) * l00 + wx * l01) + wy * ((1.0f - wx) * l10 + wx * l11);
+
+      float H, S, l;
+      rgb2hsl(in2, &H, &S, &l);
+      hsl2rgb(out2, H, S, L);
+    }
+  }
+
+  dt_free_align(lut);
+}
+
+void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                     const dt_iop_roi_t *roi_in, const dt_iop_roi_t *roi_out,
+                     struct dt_develop_tiling_t *tiling)
+{
+  const dt_iop_rlce_data_t *data = (dt_iop_rlce_data_t *)piece->data;
+
+  // input, output and the luminance map
+  tiling->factor = 2.0f + 1.0f / piece->colors;
+  tiling->maxbuf = 1.0f;
+  tiling->overhead = 0;
+  tiling->xalign = 1;
+  tiling->yalign = 1;
+
+  if(data->mode == DT_RLCE_MODE_TILED)
+  {
+    const float tile = _tile_size(data, roi_in, piece);
+    int first_x, first_y, tiles_x, tiles_y;
+    _tile_grid(tile, roi_out, &first_x, &first_y, &tiles_x, &tiles_y);
+    // the luts grow with the area of a tile of the image, small tiles make for smaller parts. the tiles cut by
+    // the border of a part come on top, at most a row and a column of them.
+    tiling->factor += (float)(BINS + 1) / (tile * tile * piece->colors);
+    tiling->overhead = sizeof(float) * (BINS + 1) * (tiles_x + tiles_y + 1);
+    // a pixel interpolates between the mappings of its own and the neighbouring tiles
+    tiling->overlap = ceilf(2.0f * tile);
+  }
+  else
+    tiling->overlap = data->radius * roi_in->scale / piece->iscale;
+}
+
+void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
+             void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  dt_iop_rlce_data_t *data = (dt_iop_rlce_data_t *)piece->data;
+  const int ch = piece->colors;
+
+  // PASS1: Get a luminance map of image...
+  float *luminance = (float *)malloc(((size_t)roi_out->width * roi_out->height) * sizeof(float));
+  if(!luminance)
+  {
+    fprintf(stderr, "[clahe] failed to allocate the luminance map\n");
+    memcpy(ovoid, ivoid, sizeof(float) * ch * roi_out->width * roi_out->height);
+    return;
+  }
+// double lsmax=0.0,lsmin=1.0;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(ch, ivoid, roi_out) \
+  shared(luminance) \
+  schedule(static)
+#endif
+  for(int j = 0; j < roi_out->height; j++)
+  {
+    float *in = (float *)ivoid + (size_t)j * roi_out->width * ch;
+    float *lm = luminance + (size_t)j * roi_out->width;
+    for(int i = 0; i < roi_out->width; i++)
+    {
+      double pmax = CLIP(fmax(in[0], fmax(in[1], in[2]))); // Max value in RGB set
+      double pmin = CLIP(fmin(in[0], fmin(in[1], in[2]))); // Min value in RGB set
+      *lm = (pmax + pmin) / 2.0;                           // Pixel luminocity
+      in += ch;
+      lm++;
+    }
+  }
+
+
+  // Params
+  const int rad = data->radius * roi_in->scale / piece->iscale;
+  const float slope = data->slope;
+
+  if(data->mode == DT_RLCE_MODE_TILED)
+    process_tiled(luminance, ivoid, ovoid, ch, _tile_size(data, roi_in, piece), slope, roi_out);
+  else
+    process_sliding(luminance, ivoid, ovoid, ch, rad, slope, roi_in, roi_out);
 
   // Cleanup
   free(luminance);
-
-#undef BINS
 }
 
 static void radius_callback(GtkWidget *slider, gpointer user_data)
@@ -268,6 +467,15 @@ static void slope_callback(GtkWidget *slider, gpointer user_data)
   dt_dev_add_history_item(darktable.develop, self, TRUE);
 }
 
+static void mode_callback(GtkWidget *combo, gpointer user_data)
+{
+  dt_iop_module_t *self = (dt_iop_module_t *)user_data;
+  if(self->dt->gui->reset) return;
+  dt_iop_rlce_params_t *p = (dt_iop_rlce_params_t *)self->params;
+  p->mode = dt_bauhaus_combobox_get(combo);
+  dt_dev_add_history_item(darktable.develop, self, TRUE);
+}
+
 
 
 void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pixelpipe_t *pipe,
@@ -278,6 +486,7 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 
   d->radius = p->radius;
   d->slope = p->slope;
+  d->mode = p->mode;
 }
 
 void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -299,6 +508,7 @@ void gui_update(struct dt_iop_module_t *self)
   dt_iop_rlce_params_t *p = (dt_iop_rlce_params_t *)module->params;
   dt_bauhaus_slider_set(g->scale1, p->radius);
   dt_bauhaus_slider_set(g->scale2, p->slope);
+  dt_bauhaus_combobox_set(g->mode, p->mode);
 }
 
 void init(dt_iop_module_t *module)
@@ -308,7 +518,7 @@ void init(dt_iop_module_t *module)
   module->default_enabled = 0;
   module->params_size = sizeof(dt_iop_rlce_params_t);
   module->gui_data = NULL;
-  dt_iop_rlce_params_t tmp = (dt_iop_rlce_params_t){ 64, 1.25 };
+  dt_iop_rlce_params_t tmp = (dt_iop_rlce_params_t){ 64, 1.25, DT_RLCE_MODE_TILED };
   memcpy(module->params, &tmp, sizeof(dt_iop_rlce_params_t));
   memcpy(module->default_params, &tmp, sizeof(dt_iop_rlce_params_t));
 }
@@ -338,6 +548,8 @@ void gui_init(struct dt_iop_module_t *self)
   gtk_box_pack_start(GTK_BOX(g->vbox1), g->label1, TRUE, TRUE, 0);
   g->label2 = dtgtk_reset_label_new(_("amount"), self, &p->slope, sizeof(float));
   gtk_box_pack_start(GTK_BOX(g->vbox1), g->label2, TRUE, TRUE, 0);
+  g->label3 = dtgtk_reset_label_new(_("algorithm"), self, &p->mode, sizeof(p->mode));
+  gtk_box_pack_start(GTK_BOX(g->vbox1), g->label3, TRUE, TRUE, 0);
 
   g->scale1 = dt_bauhaus_slider_new_with_range(NULL, 0.0, 256.0, 1.0,
                                                p->radius, 0);
@@ -347,11 +559,22 @@ void gui_init(struct dt_iop_module_t *self)
 
   gtk_box_pack_start(GTK_BOX(g->vbox2), GTK_WIDGET(g->scale1), TRUE, TRUE, 0);
   gtk_box_pack_start(GTK_BOX(g->vbox2), GTK_WIDGET(g->scale2), TRUE, TRUE, 0);
+
+  g->mode = dt_bauhaus_combobox_new(self);
+  dt_bauhaus_combobox_add(g->mode, _("sliding window"));
+  dt_bauhaus_combobox_add(g->mode, _("tiles"));
+  dt_bauhaus_combobox_set_default(g->mode, DT_RLCE_MODE_TILED);
+  dt_bauhaus_combobox_set(g->mode, p->mode);
+  gtk_box_pack_start(GTK_BOX(g->vbox2), GTK_WIDGET(g->mode), TRUE, TRUE, 0);
   gtk_widget_set_tooltip_text(GTK_WIDGET(g->scale1), _("size of features to preserve"));
   gtk_widget_set_tooltip_text(GTK_WIDGET(g->scale2), _("strength of the effect"));
+  gtk_widget_set_tooltip_text(GTK_WIDGET(g->mode), _("sliding window is the slow original algorithm, "
+                                                    "tiles interpolates between histograms of tiles "
+                                                    "and is much faster on large images"));
 
   g_signal_connect(G_OBJECT(g->scale1), "value-changed", G_CALLBACK(radius_callback), self);
   g_signal_connect(G_OBJECT(g->scale2), "value-changed", G_CALLBACK(slope_callback), self);
+  g_signal_connect(G_OBJECT(g->mode), "value-changed", G_CALLBACK(mode_callback), self);
 }
 
 void gui_cleanup(struct dt_iop_module_t *self)
@@ -1457,6 +1457,131 @@ void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, c
 }
 #endif
 
+#if defined(DT_HAVE_AVX_CODEPATHS)
+// the color matrix fast path for two pixels per 256 bit vector. an odd last pixel is done with masked loads and
+// stores.
+DT_TARGET_AVX2 static void process_avx2_cmatrix_fastpath_simple(struct dt_iop_module_t *self,
+                                                                dt_dev_pixelpipe_iop_t *piece,
+                                                                const void *const ivoid, void *const ovoid,
+                                                                const dt_iop_roi_t *const roi_in,
+                                                                const dt_iop_roi_t *const roi_out)
+{
+  const dt_iop_colorin_data_t *const d = (dt_iop_colorin_data_t *)piece->data;
+  const int ch = piece->colors;
+  const size_t npixels = (size_t)roi_out->width * roi_out->height;
+
+  // only color matrix. use our optimized fast path!
+  const float *const cmat = d->cmatrix;
+
+  const __m256 cm0 = _mm256_setr_ps(cmat[0], cmat[3], cmat[6], 0.0f, cmat[0], cmat[3], cmat[6], 0.0f);
+  const __m256 cm1 = _mm256_setr_ps(cmat[1], cmat[4], cmat[7], 0.0f, cmat[1], cmat[4], cmat[7], 0.0f);
+  const __m256 cm2 = _mm256_setr_ps(cmat[2], cmat[5], cmat[8], 0.0f, cmat[2], cmat[5], cmat[8], 0.0f);
+  const __m256i first = _mm256_setr_epi32(-1, -1, -1, -1, 0, 0, 0, 0);
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(ch, cm0, cm1, cm2, first, ivoid, npixels, ovoid) \
+  schedule(static)
+#endif
+  for(size_t k = 0; k < npixels; k += 2)
+  {
+    const float *const in = (const float *)ivoid + (size_t)ch * k;
+    float *const out = (float *)ovoid + (size_t)ch * k;
+    const int last = (k + 1 == npixels);
+
+    const __m256 input = last ? _mm256_maskload_ps(in, first) : _mm256_loadu_ps(in);
+
+    const __m256 xyz = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(cm0, _mm256_shuffle_ps(input, input, _MM_SHUFFLE(0, 0, 0, 0))),
+                      _mm256_mul_ps(cm1, _mm256_shuffle_ps(input, input, _MM_SHUFFLE(1, 1, 1, 1)))),
+        _mm256_mul_ps(cm2, _mm256_shuffle_ps(input, input, _MM_SHUFFLE(2, 2, 2, 2))));
+    const __m256 Lab = dt_XYZ_to_Lab_avx2(xyz);
+
+    if(last)
+      _mm256_maskstore_ps(out, first, Lab);
+    else
+      _mm256_storeu_ps(out, Lab);
+  }
+}
+
+DT_TARGET_AVX2 static void process_avx2_cmatrix_fastpath_clipping(struct dt_iop_module_t *self,
+                                                                  dt_dev_pixelpipe_iop_t *piece,
+                                                                  const void *const ivoid, void *const ovoid,
+                                                                  const dt_iop_roi_t *const roi_in,
+                                                                  const dt_iop_roi_t *const roi_out)
+{
+  const dt_iop_colorin_data_t *const d = (dt_iop_colorin_data_t *)piece->data;
+  const int ch = piece->colors;
+  const size_t npixels = (size_t)roi_out->width * roi_out->height;
+
+  // only color matrix. use our optimized fast path!
+  const float *const nmat = d->nmatrix;
+  const float *const lmat = d->lmatrix;
+
+  const __m256 nm0 = _mm256_setr_ps(nmat[0], nmat[3], nmat[6], 0.0f, nmat[0], nmat[3], nmat[6], 0.0f);
+  const __m256 nm1 = _mm256_setr_ps(nmat[1], nmat[4], nmat[7], 0.0f, nmat[1], nmat[4], nmat[7], 0.0f);
+  const __m256 nm2 = _mm256_setr_ps(nmat[2], nmat[5], nmat[8], 0.0f, nmat[2], nmat[5], nmat[8], 0.0f);
+
+  const __m256 lm0 = _mm256_setr_ps(lmat[0], lmat[3], lmat[6], 0.0f, lmat[0], lmat[3], lmat[6], 0.0f);
+  const __m256 lm1 = _mm256_setr_ps(lmat[1], lmat[4], lmat[7], 0.0f, lmat[1], lmat[4], lmat[7], 0.0f);
+  const __m256 lm2 = _mm256_setr_ps(lmat[2], lmat[5], lmat[8], 0.0f, lmat[2], lmat[5], lmat[8], 0.0f);
+  const __m256i first = _mm256_setr_epi32(-1, -1, -1, -1, 0, 0, 0, 0);
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(ch, first, ivoid, lm0, lm1, lm2, nm0, nm1, nm2, npixels, ovoid) \
+  schedule(static)
+#endif
+  for(size_t k = 0; k < npixels; k += 2)
+  {
+    const float *const in = (const float *)ivoid + (size_t)ch * k;
+    float *const out = (float *)ovoid + (size_t)ch * k;
+    const int last = (k + 1 == npixels);
+
+    const __m256 input = last ? _mm256_maskload_ps(in, first) : _mm256_loadu_ps(in);
+
+    const __m256 nrgb = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(nm0, _mm256_shuffle_ps(input, input, _MM_SHUFFLE(0, 0, 0, 0))),
+                      _mm256_mul_ps(nm1, _mm256_shuffle_ps(input, input, _MM_SHUFFLE(1, 1, 1, 1)))),
+        _mm256_mul_ps(nm2, _mm256_shuffle_ps(input, input, _MM_SHUFFLE(2, 2, 2, 2))));
+    const __m256 crgb = _mm256_min_ps(_mm256_max_ps(nrgb, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+    const __m256 xyz = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(lm0, _mm256_shuffle_ps(crgb, crgb, _MM_SHUFFLE(0, 0, 0, 0))),
+                      _mm256_mul_ps(lm1, _mm256_shuffle_ps(crgb, crgb, _MM_SHUFFLE(1, 1, 1, 1)))),
+        _mm256_mul_ps(lm2, _mm256_shuffle_ps(crgb, crgb, _MM_SHUFFLE(2, 2, 2, 2))));
+    const __m256 Lab = dt_XYZ_to_Lab_avx2(xyz);
+
+    if(last)
+      _mm256_maskstore_ps(out, first, Lab);
+    else
+      _mm256_storeu_ps(out, Lab);
+  }
+}
+
+void process_avx2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
+                  void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  const dt_iop_colorin_data_t *const d = (dt_iop_colorin_data_t *)piece->data;
+  const int blue_mapping = d->blue_mapping && dt_image_is_matrix_correction_supported(&piece->pipe->image);
+
+  // only the color matrix fast path has an avx2 version, everything else is the same as with sse2
+  if(d->type == DT_COLORSPACE_LAB || isnan(d->cmatrix[0]) || blue_mapping || d->nonlinearlut)
+  {
+    process_sse2(self, piece, ivoid, ovoid, roi_in, roi_out);
+    return;
+  }
+
+  if(d->nrgb == NULL)
+    process_avx2_cmatrix_fastpath_simple(self, piece, ivoid, ovoid, roi_in, roi_out);
+  else
+    process_avx2_cmatrix_fastpath_clipping(self, piece, ivoid, ovoid, roi_in, roi_out);
+
+  dt_ioppr_set_pipe_work_profile_info(self->dev, piece->pipe, d->type_work, d->filename_work, DT_INTENT_PERCEPTUAL);
+
+  if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK) dt_iop_alpha_copy(ivoid, ovoid, roi_out->width, roi_out->height);
+}
+#endif
+
 static void mat3mul(float *dst, const float *const m1, const float *const m2)
 {
   for(int k = 0; k < 3; k++)
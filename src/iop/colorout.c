@@ -559,6 +559,72 @@ void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, c
 }
 #endif
 
+#if defined(DT_HAVE_AVX_CODEPATHS)
+// the color matrix path of process_sse2() for two pixels per 256 bit vector. an odd last pixel in a row is done
+// with masked loads and stores.
+DT_TARGET_AVX2 static void process_avx2_cmatrix(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
+                                               const void *const ivoid, void *const ovoid,
+                                               const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  const dt_iop_colorout_data_t *const d = (dt_iop_colorout_data_t *)piece->data;
+  const int ch = piece->colors;
+  const float *const cmat = d->cmatrix;
+
+  const __m256 m0 = _mm256_setr_ps(cmat[0], cmat[3], cmat[6], 0.0f, cmat[0], cmat[3], cmat[6], 0.0f);
+  const __m256 m1 = _mm256_setr_ps(cmat[1], cmat[4], cmat[7], 0.0f, cmat[1], cmat[4], cmat[7], 0.0f);
+  const __m256 m2 = _mm256_setr_ps(cmat[2], cmat[5], cmat[8], 0.0f, cmat[2], cmat[5], cmat[8], 0.0f);
+  const __m256i first = _mm256_setr_epi32(-1, -1, -1, -1, 0, 0, 0, 0);
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(ch, first, ivoid, m0, m1, m2, ovoid, roi_in, roi_out) \
+  schedule(static)
+#endif
+  for(int j = 0; j < roi_out->height; j++)
+  {
+    const float *in = (const float *)ivoid + (size_t)ch * roi_in->width * j;
+    float *out = (float *)ovoid + (size_t)ch * roi_out->width * j;
+
+    for(int i = 0; i < roi_out->width; i += 2, in += 2 * ch, out += 2 * ch)
+    {
+      const int last = (i + 1 == roi_out->width);
+      const __m256 Lab = last ? _mm256_maskload_ps(in, first) : _mm256_loadu_ps(in);
+      const __m256 xyz = dt_Lab_to_XYZ_avx2(Lab);
+      const __m256 t = _mm256_add_ps(
+          _mm256_mul_ps(m0, _mm256_shuffle_ps(xyz, xyz, _MM_SHUFFLE(0, 0, 0, 0))),
+          _mm256_add_ps(_mm256_mul_ps(m1, _mm256_shuffle_ps(xyz, xyz, _MM_SHUFFLE(1, 1, 1, 1))),
+                        _mm256_mul_ps(m2, _mm256_shuffle_ps(xyz, xyz, _MM_SHUFFLE(2, 2, 2, 2)))));
+
+      if(last)
+        _mm256_maskstore_ps(out, first, t);
+      else
+        _mm256_storeu_ps(out, t);
+    }
+  }
+}
+
+void process_avx2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
+                  void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  const dt_iop_colorout_data_t *const d = (dt_iop_colorout_data_t *)piece->data;
+
+  // only the color matrix path has an avx2 version, everything else is the same as with sse2
+  if(d->type == DT_COLORSPACE_LAB || isnan(d->cmatrix[0]))
+  {
+    process_sse2(self, piece, ivoid, ovoid, roi_in, roi_out);
+    return;
+  }
+
+  process_avx2_cmatrix(self, piece, ivoid, ovoid, roi_in, roi_out);
+  process_fastpath_apply_tonecurves(self, piece, ivoid, ovoid, roi_in, roi_out);
+
+  // we no longer use the working profile
+  piece->pipe->dsc.work_profile_info = NULL;
+
+  if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK) dt_iop_alpha_copy(ivoid, ovoid, roi_out->width, roi_out->height);
+}
+#endif
+
 static cmsHPROFILE _make_clipping_profile(cmsHPROFILE profile)
 {
   cmsUInt32Number size;
@@ -39,6 +39,9 @@
 #if defined(__SSE__)
 #include <xmmintrin.h>
 #endif
+#if defined(DT_HAVE_AVX_CODEPATHS)
+#include <immintrin.h>
+#endif
 
 #define REDUCESIZE 64
 #define NUM_BUCKETS 4
@@ -1345,6 +1348,154 @@ static void eaw_decompose_sse(float *const out, const float *const in, float *co
   _mm_sfence();
 }
 
+#if defined(DT_HAVE_AVX_CODEPATHS)
+/* weight_sse() for two pixels at once, one in each 128 bit lane. fast_mexp2f() is done with a truncating
+ * conversion, like the float to integer assignment in the scalar code. */
+DT_TARGET_AVX2 static inline __m256 weight_avx2(const __m256 c1, const __m256 c2, const __m256 inv_sigma2)
+{
+  // 3d distance based on color
+  const __m256 diff = _mm256_sub_ps(c1, c2);
+  const __m256 sqr = _mm256_mul_ps(diff, diff);
+  const __m256 sum = _mm256_add_ps(_mm256_add_ps(_mm256_permute_ps(sqr, _MM_SHUFFLE(0, 0, 0, 0)),
+                                                 _mm256_permute_ps(sqr, _MM_SHUFFLE(1, 1, 1, 1))),
+                                   _mm256_permute_ps(sqr, _MM_SHUFFLE(2, 2, 2, 2)));
+  const __m256 dot = _mm256_mul_ps(sum, inv_sigma2);
+  const __m256 var = _mm256_set1_ps(0.02f); // FIXME: see weight()
+  const __m256 off2 = _mm256_set1_ps(9.0f); // (3 sigma)^2
+  const __m256 x = _mm256_max_ps(_mm256_sub_ps(_mm256_mul_ps(dot, var), off2), _mm256_setzero_ps());
+
+  // fast_mexp2f(x)
+  const float i1 = (float)0x3f800000u; // 2^0
+  const float i2 = (float)0x3f000000u; // 2^-1
+  const __m256 k0 = _mm256_add_ps(_mm256_set1_ps(i1), _mm256_mul_ps(x, _mm256_set1_ps(i2 - i1)));
+  const __m256 valid = _mm256_cmp_ps(k0, _mm256_set1_ps((float)0x800000u), _CMP_GE_OQ);
+  return _mm256_and_ps(_mm256_castsi256_ps(_mm256_cvttps_epi32(k0)), valid);
+}
+
+/* same as eaw_decompose_sse(), but the inner part of the image is done for two pixels per 256 bit vector. the
+ * borders keep the sse code. */
+DT_TARGET_AVX2 static void eaw_decompose_avx2(float *const out, const float *const in, float *const detail,
+                                              const int scale, const float inv_sigma2, const int32_t width,
+                                              const int32_t height)
+{
+  const int mult = 1u << scale;
+  static const float filter[5] = { 1.0f / 16.0f, 4.0f / 16.0f, 6.0f / 16.0f, 4.0f / 16.0f, 1.0f / 16.0f };
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(detail, filter, height, in, inv_sigma2, mult, out, width) \
+  schedule(static)
+#endif
+  for(int j = 0; j < 2 * mult; j++)
+  {
+    ROW_PROLOGUE_SSE
+
+    for(int i = 0; i < width; i++)
+    {
+      SUM_PIXEL_PROLOGUE_SSE
+      for(int jj = 0; jj < 5; jj++)
+      {
+        for(int ii = 0; ii < 5; ii++)
+        {
+          SUM_PIXEL_CONTRIBUTION_WITH_TEST_SSE(ii, jj);
+        }
+      }
+      SUM_PIXEL_EPILOGUE_SSE
+    }
+  }
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(detail, filter, height, in, inv_sigma2, mult, out, width) \
+  schedule(static)
+#endif
+  for(int j = 2 * mult; j < height - 2 * mult; j++)
+  {
+    ROW_PROLOGUE_SSE
+
+    for(int i = 0; i < 2 * mult; i++)
+    {
+      SUM_PIXEL_PROLOGUE_SSE
+      for(int jj = 0; jj < 5; jj++)
+      {
+        for(int ii = 0; ii < 5; ii++)
+        {
+          SUM_PIXEL_CONTRIBUTION_WITH_TEST_SSE(ii, jj);
+        }
+      }
+      SUM_PIXEL_EPILOGUE_SSE
+    }
+
+    const __m256 vinv_sigma2 = _mm256_set1_ps(inv_sigma2);
+    int i = 2 * mult;
+    for(; i + 1 < width - 2 * mult; i += 2)
+    {
+      const __m256 c = _mm256_loadu_ps((const float *)px);
+      __m256 sum = _mm256_setzero_ps();
+      __m256 wgt = _mm256_setzero_ps();
+      const float *pn = in + (size_t)4 * (i - 2 * mult + (size_t)(j - 2 * mult) * width);
+      for(int jj = 0; jj < 5; jj++)
+      {
+        for(int ii = 0; ii < 5; ii++)
+        {
+          const __m256 p = _mm256_loadu_ps(pn);
+          const __m256 w = _mm256_mul_ps(_mm256_set1_ps(filter[ii] * filter[jj]), weight_avx2(c, p, vinv_sigma2));
+          sum = _mm256_fmadd_ps(w, p, sum);
+          wgt = _mm256_add_ps(wgt, w);
+          pn += (size_t)4 * mult;
+        }
+        pn += (size_t)4 * (width - 5) * mult;
+      }
+      sum = _mm256_div_ps(sum, wgt);
+      _mm256_storeu_ps(pdetail, _mm256_sub_ps(c, sum));
+      _mm256_storeu_ps(pcoarse, sum);
+      px += 2;
+      pdetail += 8;
+      pcoarse += 8;
+    }
+
+    // odd pixel left over in the inner part, and the right border
+    for(; i < width; i++)
+    {
+      SUM_PIXEL_PROLOGUE_SSE
+      for(int jj = 0; jj < 5; jj++)
+      {
+        for(int ii = 0; ii < 5; ii++)
+        {
+          SUM_PIXEL_CONTRIBUTION_WITH_TEST_SSE(ii, jj);
+        }
+      }
+      SUM_PIXEL_EPILOGUE_SSE
+    }
+  }
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(detail, filter, height, in, inv_sigma2, mult, out, width) \
+  schedule(static)
+#endif
+  for(int j = height - 2 * mult; j < height; j++)
+  {
+    ROW_PROLOGUE_SSE
+
+    for(int i = 0; i < width; i++)
+    {
+      SUM_PIXEL_PROLOGUE_SSE
+      for(int jj = 0; jj < 5; jj++)
+      {
+        for(int ii = 0; ii < 5; ii++)
+        {
+          SUM_PIXEL_CONTRIBUTION_WITH_TEST_SSE(ii, jj);
+        }
+      }
+      SUM_PIXEL_EPILOGUE_SSE
+    }
+  }
+
+  _mm_sfence();
+}
+#endif
+
 #undef SUM_PIXEL_CONTRIBUTION_COMMON_SSE
 #undef SUM_PIXEL_CONTRIBUTION_WITH_TEST_SSE
 #undef ROW_PROLOGUE_SSE
@@ -3289,6 +3440,20 @@ void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, c
 }
 #endif
 
+#if defined(DT_HAVE_AVX_CODEPATHS)
+void process_avx2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
+                  void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  dt_iop_denoiseprofile_params_t *d = (dt_iop_denoiseprofile_params_t *)piece->data;
+  if(d->mode == MODE_NLMEANS || d->mode == MODE_NLMEANS_AUTO)
+    process_nlmeans_sse(self, piece, ivoid, ovoid, roi_in, roi_out);
+  else if(d->mode == MODE_WAVELETS || d->mode == MODE_WAVELETS_AUTO)
+    process_wavelets(self, piece, ivoid, ovoid, roi_in, roi_out, eaw_decompose_avx2, eaw_synthesize_sse2);
+  else
+    process_variance(self, piece, ivoid, ovoid, roi_in, roi_out);
+}
+#endif
+
 static inline unsigned infer_radius_from_profile(const float a)
 {
   return MIN((unsigned)(1.0f + a * 15000.0f + a * a * 300000.0f), 8);
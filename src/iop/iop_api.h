@@ -191,6 +191,18 @@ void process_sse2(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *p
                   const struct dt_iop_roi_t *const roi_out);
 #endif
 
+#if defined(DT_HAVE_AVX_CODEPATHS)
+/** variants of process() with AVX2 (+FMA) or AVX-512 intrinsics, used instead of process_sse2() when the cpu
+ * supports them. compile them with DT_TARGET_AVX2 / DT_TARGET_AVX512, the build target doesn't include them. */
+/** can be provided by each IOP. */
+void process_avx2(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const void *const i,
+                  void *const o, const struct dt_iop_roi_t *const roi_in,
+                  const struct dt_iop_roi_t *const roi_out);
+void process_avx512(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const void *const i,
+                    void *const o, const struct dt_iop_roi_t *const roi_in,
+                    const struct dt_iop_roi_t *const roi_out);
+#endif
+
 #ifdef HAVE_OPENCL
 /** the opencl equivalent of process(). */
 int process_cl(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in,
@@ -0,0 +1,455 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * performance regression benchmark for image operations.
+ *
+ * runs process() (and process_sse2/avx2/avx512() where present) of image operations on a
+ * synthetic or user supplied image at several sizes and thread counts and
+ * reports the throughput in Mpix/s. results are compared against a stored
+ * baseline and the program fails if any of them got slower than the threshold.
+ *
+ * Please see README.md for more detailed documentation.
+ */
+
+#include "common/darktable.h"
+#include "common/film.h"
+#include "common/image.h"
+#include "common/image_cache.h"
+#include "common/mipmap_cache.h"
+#include "control/conf.h"
+#include "develop/develop.h"
+#include "develop/imageop.h"
+#include "develop/pixelpipe_hb.h"
+
+#include <glib/gstdio.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// operations benchmarked if none are given on the command line
+#define BENCH_DEFAULT_OPS                                                                                     \
+  "exposure,colorin,colorout,basecurve,tonecurve,rgbcurve,levels,colorzones,colorbalance,filmicrgb,"        \
+  "toneequal,shadhi,bilat,atrous,bilateral,nlmeans,denoiseprofile,sharpen,highpass,lowpass,bloom,soften,"  \
+  "grain,vignette,velvia,vibrance,clahe"
+#define BENCH_DEFAULT_SIZES "512,2048"
+#define BENCH_DEFAULT_ITERATIONS 3
+#define BENCH_DEFAULT_THRESHOLD 10.0
+#define BENCH_SYNTHETIC_SIZE 1024
+
+typedef void (*bench_process_t)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                                const void *const i, void *const o, const struct dt_iop_roi_t *const roi_in,
+                                const struct dt_iop_roi_t *const roi_out);
+
+typedef struct bench_result_t
+{
+  char op[20];
+  const char *path;
+  int size;
+  int threads;
+  double mpixs;
+} bench_result_t;
+
+static void usage(const char *progname)
+{
+  fprintf(stderr, "usage: %s [options] [--core <darktable options>]\n", progname);
+  fprintf(stderr, "\n");
+  fprintf(stderr, "options:\n");
+  fprintf(stderr, "   --ops <op,op,...> default: a selection of common operations\n");
+  fprintf(stderr, "   --sizes <n,n,...> square image sizes in pixels, default: " BENCH_DEFAULT_SIZES "\n");
+  fprintf(stderr, "   --threads <n,n,...> default: 1 and all threads\n");
+  fprintf(stderr, "   --iterations <n> best of n runs is reported, default: %d\n", BENCH_DEFAULT_ITERATIONS);
+  fprintf(stderr, "   --image <file> use a (non raw) image instead of the synthetic one\n");
+  fprintf(stderr, "   --baseline <file> compare against this file, created if missing\n");
+  fprintf(stderr, "   --update-baseline write the results to the baseline file\n");
+  fprintf(stderr, "   --threshold <percent> allowed slowdown, default: %.0f\n", BENCH_DEFAULT_THRESHOLD);
+}
+
+static GArray *_parse_int_list(const char *list)
+{
+  GArray *values = g_array_new(FALSE, FALSE, sizeof(int));
+  gchar **tokens = g_strsplit(list, ",", -1);
+  for(gchar **t = tokens; *t; t++)
+  {
+    const int v = atoi(*t);
+    if(v > 0) g_array_append_val(values, v);
+  }
+  g_strfreev(tokens);
+  return values;
+}
+
+// deterministic test pattern: smooth gradients with fine detail and hard edges, so that
+// neither edge aware filters nor denoisers hit trivial early outs.
+static gboolean _write_synthetic_pfm(const char *filename, const int size)
+{
+  FILE *f = g_fopen(filename, "wb");
+  if(!f) return FALSE;
+  fprintf(f, "PF\n%d %d\n-1.0\n", size, size);
+  float *row = malloc(sizeof(float) * 3 * size);
+  for(int j = 0; j < size; j++)
+  {
+    for(int i = 0; i < size; i++)
+    {
+      const uint32_t h = ((uint32_t)i * 73856093u) ^ ((uint32_t)j * 19349663u);
+      const float detail = 0.05f * ((h % 1024) / 1023.0f - 0.5f);
+      const float edge = (((i / 64) + (j / 64)) & 1) ? 0.2f : 0.0f;
+      const float x = (float)i / size, y = (float)j / size;
+      row[3 * i + 0] = fmaxf(0.0f, x * x + edge + detail);
+      row[3 * i + 1] = fmaxf(0.0f, 0.5f * (x + y) + detail);
+      row[3 * i + 2] = fmaxf(0.0f, y + 0.5f * edge - detail);
+    }
+    fwrite(row, sizeof(float), 3 * size, f);
+  }
+  free(row);
+  fclose(f);
+  return TRUE;
+}
+
+// fill a size x size buffer by repeating the source image
+static void _fill_input(float *rgb, float *lab, const float *src, const int src_width, const int src_height,
+                        const int size)
+{
+  for(int j = 0; j < size; j++)
+    for(int i = 0; i < size; i++)
+    {
+      const float *in = src + 4 * ((size_t)(j % src_height) * src_width + (i % src_width));
+      float *out = rgb + 4 * ((size_t)j * size + i);
+      float *outlab = lab + 4 * ((size_t)j * size + i);
+      for(int c = 0; c < 4; c++) out[c] = in[c];
+      // not a real conversion, just values in a sensible range for modules working on Lab
+      outlab[0] = 100.0f * fminf(1.0f, 0.2126f * in[0] + 0.7152f * in[1] + 0.0722f * in[2]);
+      outlab[1] = 100.0f * (in[0] - in[1]);
+      outlab[2] = 100.0f * (in[1] - in[2]);
+      outlab[3] = 0.0f;
+    }
+}
+
+static double _run(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, bench_process_t process,
+                   const float *input, float *output, const int size, const int iterations)
+{
+  const dt_iop_roi_t roi = { 0, 0, size, size, 1.0f };
+  piece->buf_in = piece->buf_out = roi;
+  piece->processed_roi_in = piece->processed_roi_out = roi;
+  piece->iwidth = piece->iheight = size;
+  piece->pipe->processed_width = piece->pipe->processed_height = size;
+
+  // warm up caches and lazily initialized tables
+  process(module, piece, input, output, &roi, &roi);
+
+  double best = INFINITY;
+  for(int k = 0; k < iterations; k++)
+  {
+    const double start = dt_get_wtime();
+    process(module, piece, input, output, &roi, &roi);
+    best = fmin(best, dt_get_wtime() - start);
+  }
+  return (double)size * size / 1e6 / fmax(best, 1e-9);
+}
+
+static GHashTable *_read_baseline(const char *filename)
+{
+  gchar *content = NULL;
+  if(!filename || !g_file_get_contents(filename, &content, NULL, NULL)) return NULL;
+
+  GHashTable *baseline = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  gchar **lines = g_strsplit(content, "\n", -1);
+  for(gchar **line = lines; *line; line++)
+  {
+    char op[20], path[8];
+    int size, threads;
+    double mpixs;
+    if(**line == '#' || sscanf(*line, "%19s %7s %d %d %lf", op, path, &size, &threads, &mpixs) != 5) continue;
+    double *value = g_malloc(sizeof(double));
+    *value = mpixs;
+    g_hash_table_insert(baseline, g_strdup_printf("%s %s %d %d", op, path, size, threads), value);
+  }
+  g_strfreev(lines);
+  g_free(content);
+  return baseline;
+}
+
+static void _write_baseline(const char *filename, GArray *results)
+{
+  FILE *f = g_fopen(filename, "wb");
+  if(!f)
+  {
+    fprintf(stderr, "[benchmark] could not write baseline `%s'\n", filename);
+    return;
+  }
+  fprintf(f, "# op path size threads Mpix/s\n");
+  for(guint k = 0; k < results->len; k++)
+  {
+    const bench_result_t *r = &g_array_index(results, bench_result_t, k);
+    fprintf(f, "%s %s %d %d %.3f\n", r->op, r->path, r->size, r->threads, r->mpixs);
+  }
+  fclose(f);
+  printf("[benchmark] wrote baseline `%s'\n", filename);
+}
+
+int main(int argc, char *arg[])
+{
+  const char *ops = BENCH_DEFAULT_OPS;
+  const char *sizes_list = BENCH_DEFAULT_SIZES;
+  const char *threads_list = NULL;
+  const char *image_filename = NULL;
+  const char *baseline_filename = NULL;
+  int iterations = BENCH_DEFAULT_ITERATIONS;
+  double threshold = BENCH_DEFAULT_THRESHOLD;
+  gboolean update_baseline = FALSE;
+
+  int k;
+  for(k = 1; k < argc; k++)
+  {
+    if(!strcmp(arg[k], "--help") || !strcmp(arg[k], "-h"))
+    {
+      usage(arg[0]);
+      exit(1);
+    }
+    else if(!strcmp(arg[k], "--ops") && argc > k + 1)
+      ops = arg[++k];
+    else if(!strcmp(arg[k], "--sizes") && argc > k + 1)
+      sizes_list = arg[++k];
+    else if(!strcmp(arg[k], "--threads") && argc > k + 1)
+      threads_list = arg[++k];
+    else if(!strcmp(arg[k], "--iterations") && argc > k + 1)
+      iterations = MAX(atoi(arg[++k]), 1);
+    else if(!strcmp(arg[k], "--image") && argc > k + 1)
+      image_filename = arg[++k];
+    else if(!strcmp(arg[k], "--baseline") && argc > k + 1)
+      baseline_filename = arg[++k];
+    else if(!strcmp(arg[k], "--update-baseline"))
+      update_baseline = TRUE;
+    else if(!strcmp(arg[k], "--threshold") && argc > k + 1)
+      threshold = MAX(atof(arg[++k]), 0.0);
+    else if(!strcmp(arg[k], "--core"))
+    {
+      // everything from here on should be passed to the core
+      k++;
+      break;
+    }
+    else
+    {
+      usage(arg[0]);
+      exit(1);
+    }
+  }
+
+  int m_argc = 0;
+  char **m_arg = malloc((5 + argc - k + 1) * sizeof(char *));
+  m_arg[m_argc++] = "darktable-bench-iop";
+  m_arg[m_argc++] = "--library";
+  m_arg[m_argc++] = ":memory:";
+  m_arg[m_argc++] = "--conf";
+  m_arg[m_argc++] = "write_sidecar_files=FALSE";
+  for(; k < argc; k++) m_arg[m_argc++] = arg[k];
+  m_arg[m_argc] = NULL;
+
+  // no gui and no presets, we want the plain defaults of every module
+  if(dt_init(m_argc, m_arg, FALSE, FALSE, NULL))
+  {
+    free(m_arg);
+    exit(1);
+  }
+
+  GArray *sizes = _parse_int_list(sizes_list);
+  GArray *threads = NULL;
+  if(threads_list)
+    threads = _parse_int_list(threads_list);
+  else
+  {
+    threads = g_array_new(FALSE, FALSE, sizeof(int));
+    const int one = 1, all = darktable.num_openmp_threads;
+    g_array_append_val(threads, one);
+    if(all > 1) g_array_append_val(threads, all);
+  }
+
+  gchar *synthetic = NULL;
+  if(!image_filename)
+  {
+    synthetic = g_build_filename(g_get_tmp_dir(), "darktable-bench-iop.pfm", NULL);
+    if(!_write_synthetic_pfm(synthetic, BENCH_SYNTHETIC_SIZE))
+    {
+      fprintf(stderr, "[benchmark] could not write `%s'\n", synthetic);
+      exit(1);
+    }
+    image_filename = synthetic;
+  }
+
+  dt_film_t film;
+  gchar *directory = g_path_get_dirname(image_filename);
+  const int filmid = dt_film_new(&film, directory);
+  g_free(directory);
+  const int imgid = filmid ? dt_image_import(filmid, image_filename, TRUE) : 0;
+  if(!imgid)
+  {
+    fprintf(stderr, "[benchmark] can't open file %s\n", image_filename);
+    exit(1);
+  }
+
+  dt_develop_t dev;
+  dt_dev_init(&dev, 0);
+  dt_dev_load_image(&dev, imgid);
+
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING, 'r');
+  const dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgid, 'r');
+  const gboolean usable = buf.buf && buf.width && buf.height && img->buf_dsc.channels == 4
+                          && img->buf_dsc.datatype == TYPE_FLOAT && img->buf_dsc.filters == 0;
+  dt_image_cache_read_release(darktable.image_cache, img);
+  if(!usable)
+  {
+    fprintf(stderr, "[benchmark] `%s' can't be used, please provide a developed (non raw) image\n",
+            image_filename);
+    exit(1);
+  }
+
+  dt_dev_pixelpipe_t pipe;
+  dt_dev_pixelpipe_init_dummy(&pipe, buf.width, buf.height);
+  dt_dev_pixelpipe_set_input(&pipe, &dev, (float *)buf.buf, buf.width, buf.height, buf.iscale);
+  dt_dev_pixelpipe_create_nodes(&pipe, &dev);
+  dt_dev_pixelpipe_synch_all(&pipe, &dev);
+
+  GArray *results = g_array_new(FALSE, FALSE, sizeof(bench_result_t));
+  gchar **op_list = g_strsplit(ops, ",", -1);
+
+  printf("%-16s %-6s %6s %8s %10s\n", "op", "path", "size", "threads", "Mpix/s");
+  for(guint s = 0; s < sizes->len; s++)
+  {
+    const int size = g_array_index(sizes, int, s);
+    float *rgb = dt_alloc_align(64, sizeof(float) * 4 * size * size);
+    float *lab = dt_alloc_align(64, sizeof(float) * 4 * size * size);
+    float *out = dt_alloc_align(64, sizeof(float) * 4 * size * size);
+    _fill_input(rgb, lab, (const float *)buf.buf, buf.width, buf.height, size);
+
+    for(gchar **op = op_list; *op; op++)
+    {
+      dt_iop_module_t *module = NULL;
+      dt_dev_pixelpipe_iop_t *piece = NULL;
+      for(GList *nodes = pipe.nodes; nodes; nodes = g_list_next(nodes))
+      {
+        dt_dev_pixelpipe_iop_t *p = (dt_dev_pixelpipe_iop_t *)nodes->data;
+        if(!strcmp(p->module->op, *op))
+        {
+          piece = p;
+          module = p->module;
+          break;
+        }
+      }
+      if(!module)
+      {
+        fprintf(stderr, "[benchmark] unknown operation `%s', skipped\n", *op);
+        continue;
+      }
+      const int cst = module->input_colorspace(module, &pipe, piece);
+      if(cst == iop_cs_RAW || (module->operation_tags() & IOP_TAG_DISTORT))
+      {
+        fprintf(stderr, "[benchmark] `%s' works on raw data or distorts the image, skipped\n", *op);
+        continue;
+      }
+      piece->dsc_in = piece->dsc_out = pipe.dsc;
+      piece->dsc_in.channels = piece->dsc_out.channels = 4;
+      piece->dsc_in.datatype = piece->dsc_out.datatype = TYPE_FLOAT;
+      const float *input = (cst == iop_cs_Lab || cst == iop_cs_LCh) ? lab : rgb;
+
+      const struct
+      {
+        const char *name;
+        bench_process_t process;
+        gboolean enabled;
+      } paths[] = { { "plain", module->process_plain, TRUE },
+                    { "sse2", module->process_sse2, darktable.codepath.SSE2 },
+                    { "avx2", module->process_avx2, darktable.codepath.AVX2 },
+                    { "avx512", module->process_avx512, darktable.codepath.AVX512 } };
+      for(int path = 0; path < (int)(sizeof(paths) / sizeof(paths[0])); path++)
+      {
+        const char *path_name = paths[path].name;
+        bench_process_t process = paths[path].process;
+        if(!process || !paths[path].enabled) continue;
+
+        for(guint t = 0; t < threads->len; t++)
+        {
+          const int nthreads = g_array_index(threads, int, t);
+#ifdef _OPENMP
+          omp_set_num_threads(nthreads);
+#endif
+          bench_result_t r = { { 0 } };
+          g_strlcpy(r.op, *op, sizeof(r.op));
+          r.path = path_name;
+          r.size = size;
+          r.threads = nthreads;
+          r.mpixs = _run(module, piece, process, input, out, size, iterations);
+          g_array_append_val(results, r);
+          printf("%-16s %-6s %6d %8d %10.2f\n", r.op, r.path, r.size, r.threads, r.mpixs);
+        }
+      }
+    }
+    dt_free_align(rgb);
+    dt_free_align(lab);
+    dt_free_align(out);
+  }
+#ifdef _OPENMP
+  omp_set_num_threads(darktable.num_openmp_threads);
+#endif
+
+  // compare with the baseline
+  int regressions = 0;
+  GHashTable *baseline = _read_baseline(baseline_filename);
+  if(baseline)
+  {
+    for(guint r = 0; r < results->len; r++)
+    {
+      const bench_result_t *res = &g_array_index(results, bench_result_t, r);
+      gchar *key = g_strdup_printf("%s %s %d %d", res->op, res->path, res->size, res->threads);
+      const double *base = g_hash_table_lookup(baseline, key);
+      g_free(key);
+      if(base && res->mpixs < *base * (1.0 - threshold / 100.0))
+      {
+        printf("REGRESSION %s %s %d %d: %.2f Mpix/s, baseline %.2f Mpix/s (%.1f%%)\n", res->op, res->path,
+               res->size, res->threads, res->mpixs, *base, 100.0 * (res->mpixs / *base - 1.0));
+        regressions++;
+      }
+    }
+    g_hash_table_destroy(baseline);
+    printf("[benchmark] %d regression(s) beyond %.0f%%\n", regressions, threshold);
+  }
+  if(baseline_filename && (update_baseline || !g_file_test(baseline_filename, G_FILE_TEST_EXISTS)))
+    _write_baseline(baseline_filename, results);
+
+  // cleanup time
+  g_strfreev(op_list);
+  g_array_free(results, TRUE);
+  g_array_free(sizes, TRUE);
+  g_array_free(threads, TRUE);
+  dt_dev_pixelpipe_cleanup(&pipe);
+  dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  dt_dev_cleanup(&dev);
+  if(synthetic)
+  {
+    g_unlink(synthetic);
+    g_free(synthetic);
+  }
+
+  dt_cleanup();
+
+  free(m_arg);
+  return regressions ? 1 : 0;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
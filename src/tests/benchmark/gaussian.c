@@ -0,0 +1,238 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * micro benchmark for the recursive gaussian blur of common/gaussian.c.
+ *
+ * runs dt_gaussian_blur() and dt_gaussian_blur_4c() on random buffers of several sizes, channel counts and
+ * thread counts and reports the throughput in Mpix/s, next to the older column-wise implementations they fall
+ * back to. all results are checked against the one of dt_gaussian_blur_columns().
+ *
+ * Please see README.md for more detailed documentation.
+ */
+
+#include "common/darktable.h"
+#include "common/gaussian.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_DEFAULT_SIZES "1024,4096"
+#define BENCH_DEFAULT_ITERATIONS 5
+#define BENCH_DEFAULT_SIGMA 20.0f
+
+static void usage(const char *progname)
+{
+  fprintf(stderr, "usage: %s [options] [--core <darktable options>]\n", progname);
+  fprintf(stderr, "\n");
+  fprintf(stderr, "options:\n");
+  fprintf(stderr, "   --sizes <n,n,...> square image sizes in pixels, default: " BENCH_DEFAULT_SIZES "\n");
+  fprintf(stderr, "   --channels <n,n,...> default: 1,2,3,4\n");
+  fprintf(stderr, "   --threads <n,n,...> default: 1 and all threads\n");
+  fprintf(stderr, "   --sigma <s> default: %.0f\n", BENCH_DEFAULT_SIGMA);
+  fprintf(stderr, "   --iterations <n> best of n runs is reported, default: %d\n", BENCH_DEFAULT_ITERATIONS);
+}
+
+static GArray *_parse_int_list(const char *list)
+{
+  GArray *values = g_array_new(FALSE, FALSE, sizeof(int));
+  gchar **tokens = g_strsplit(list, ",", -1);
+  for(gchar **t = tokens; *t; t++)
+  {
+    const int v = atoi(*t);
+    if(v > 0) g_array_append_val(values, v);
+  }
+  g_strfreev(tokens);
+  return values;
+}
+
+typedef void (*bench_blur_t)(dt_gaussian_t *g, const float *const in, float *const out);
+
+static double _run(dt_gaussian_t *g, bench_blur_t blur, const float *const in, float *const out, const int size,
+                   const int iterations)
+{
+  // warm up caches and page in the buffers
+  blur(g, in, out);
+
+  double best = INFINITY;
+  for(int k = 0; k < iterations; k++)
+  {
+    const double start = dt_get_wtime();
+    blur(g, in, out);
+    best = fmin(best, dt_get_wtime() - start);
+  }
+  return (double)size * size / 1e6 / fmax(best, 1e-9);
+}
+
+int main(int argc, char *arg[])
+{
+  const char *sizes_list = BENCH_DEFAULT_SIZES;
+  const char *channels_list = "1,2,3,4";
+  const char *threads_list = NULL;
+  float sigma = BENCH_DEFAULT_SIGMA;
+  int iterations = BENCH_DEFAULT_ITERATIONS;
+
+  int k;
+  for(k = 1; k < argc; k++)
+  {
+    if(!strcmp(arg[k], "--help") || !strcmp(arg[k], "-h"))
+    {
+      usage(arg[0]);
+      exit(1);
+    }
+    else if(!strcmp(arg[k], "--sizes") && argc > k + 1)
+      sizes_list = arg[++k];
+    else if(!strcmp(arg[k], "--channels") && argc > k + 1)
+      channels_list = arg[++k];
+    else if(!strcmp(arg[k], "--threads") && argc > k + 1)
+      threads_list = arg[++k];
+    else if(!strcmp(arg[k], "--sigma") && argc > k + 1)
+      sigma = MAX(atof(arg[++k]), 0.1);
+    else if(!strcmp(arg[k], "--iterations") && argc > k + 1)
+      iterations = MAX(atoi(arg[++k]), 1);
+    else if(!strcmp(arg[k], "--core"))
+    {
+      // everything from here on should be passed to the core
+      k++;
+      break;
+    }
+    else
+    {
+      usage(arg[0]);
+      exit(1);
+    }
+  }
+
+  int m_argc = 0;
+  char **m_arg = malloc((3 + argc - k + 1) * sizeof(char *));
+  m_arg[m_argc++] = "darktable-bench-gaussian";
+  m_arg[m_argc++] = "--library";
+  m_arg[m_argc++] = ":memory:";
+  for(; k < argc; k++) m_arg[m_argc++] = arg[k];
+  m_arg[m_argc] = NULL;
+
+  // only for the thread count
+  if(dt_init(m_argc, m_arg, FALSE, FALSE, NULL))
+  {
+    free(m_arg);
+    exit(1);
+  }
+
+  GArray *sizes = _parse_int_list(sizes_list);
+  GArray *channels = _parse_int_list(channels_list);
+  GArray *threads = NULL;
+  if(threads_list)
+    threads = _parse_int_list(threads_list);
+  else
+  {
+    threads = g_array_new(FALSE, FALSE, sizeof(int));
+    const int one = 1, all = darktable.num_openmp_threads;
+    g_array_append_val(threads, one);
+    if(all > 1) g_array_append_val(threads, all);
+  }
+
+  const float max[4] = { INFINITY, INFINITY, INFINITY, INFINITY };
+  const float min[4] = { -INFINITY, -INFINITY, -INFINITY, -INFINITY };
+  int mismatches = 0;
+
+  printf("%-12s %6s %3s %8s %10s %10s\n", "function", "size", "ch", "threads", "Mpix/s", "max diff");
+  for(guint s = 0; s < sizes->len; s++)
+  {
+    const int size = g_array_index(sizes, int, s);
+    for(guint c = 0; c < channels->len; c++)
+    {
+      const int ch = MIN(4, g_array_index(channels, int, c));
+      const size_t nfloats = (size_t)size * size * ch;
+      float *in = dt_alloc_align(64, sizeof(float) * nfloats);
+      float *out = dt_alloc_align(64, sizeof(float) * nfloats);
+      float *reference = dt_alloc_align(64, sizeof(float) * nfloats);
+      dt_gaussian_t *g = dt_gaussian_init(size, size, ch, max, min, sigma, DT_IOP_GAUSSIAN_ZERO);
+      if(!in || !out || !reference || !g)
+      {
+        fprintf(stderr, "[benchmark] out of memory for size %d\n", size);
+        exit(1);
+      }
+
+      // deterministic noise, the blur has no data dependent paths anyway
+      uint32_t state = 1;
+      for(size_t i = 0; i < nfloats; i++)
+      {
+        state = state * 1664525u + 1013904223u;
+        in[i] = (state >> 8) / (float)(1 << 24);
+      }
+
+      // the reference, with all threads
+#ifdef _OPENMP
+      omp_set_num_threads(darktable.num_openmp_threads);
+#endif
+      dt_gaussian_blur_columns(g, in, reference);
+
+      const struct
+      {
+        const char *name;
+        bench_blur_t blur;
+        gboolean four; // only takes 4 channels
+      } functions[] = { { "columns", dt_gaussian_blur_columns, FALSE },
+#if defined(__SSE__)
+                        { "4c_sse", darktable.codepath.SSE2 ? dt_gaussian_blur_4c_sse : NULL, TRUE },
+#endif
+                        { "blur", dt_gaussian_blur, FALSE },
+                        { "blur_4c", dt_gaussian_blur_4c, TRUE } };
+      for(int f = 0; f < (int)(sizeof(functions) / sizeof(functions[0])); f++)
+      {
+        if(!functions[f].blur || (functions[f].four && ch != 4)) continue;
+        for(guint t = 0; t < threads->len; t++)
+        {
+          const int nthreads = g_array_index(threads, int, t);
+#ifdef _OPENMP
+          omp_set_num_threads(nthreads);
+#endif
+          const double mpixs = _run(g, functions[f].blur, in, out, size, iterations);
+
+          float diff = 0.0f;
+          for(size_t i = 0; i < nfloats; i++) diff = fmaxf(diff, fabsf(out[i] - reference[i]));
+          if(diff > 1e-4f) mismatches++;
+
+          printf("%-12s %6d %3d %8d %10.2f %10.2g\n", functions[f].name, size, ch, nthreads, mpixs, diff);
+        }
+      }
+
+      dt_gaussian_free(g);
+      dt_free_align(in);
+      dt_free_align(out);
+      dt_free_align(reference);
+    }
+  }
+
+#ifdef _OPENMP
+  omp_set_num_threads(darktable.num_openmp_threads);
+#endif
+  if(mismatches) printf("[benchmark] %d result(s) differ from the reference\n", mismatches);
+
+  g_array_free(sizes, TRUE);
+  g_array_free(channels, TRUE);
+  g_array_free(threads, TRUE);
+  dt_cleanup();
+  free(m_arg);
+  return mismatches ? 1 : 0;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,220 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for the concurrent cache in common/cache.c
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <limits.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include <cmocka.h>
+
+#include "common/cache.h"
+
+/*
+ * DEFINITIONS
+ */
+
+#define THREADS 8
+#define ITERATIONS 20000
+#define KEYS 512
+#define QUOTA 64
+
+typedef struct payload_t
+{
+  uint32_t key;
+  uint32_t writes;
+} payload_t;
+
+typedef struct worker_t
+{
+  dt_cache_t *cache;
+  uint32_t seed;
+  int errors;
+} worker_t;
+
+static void _allocate(void *data, dt_cache_entry_t *entry)
+{
+  payload_t *payload = (payload_t *)calloc(1, sizeof(payload_t));
+  payload->key = entry->key;
+  entry->data = payload;
+  entry->data_size = sizeof(payload_t);
+  entry->cost = 1;
+}
+
+static void _cleanup(void *data, dt_cache_entry_t *entry)
+{
+  free(entry->data);
+}
+
+static void _init(dt_cache_t *cache, const dt_cache_eviction_t eviction)
+{
+  dt_cache_init(cache, 0, QUOTA);
+  dt_cache_set_allocate_callback(cache, _allocate, NULL);
+  dt_cache_set_cleanup_callback(cache, _cleanup, NULL);
+  dt_cache_set_eviction(cache, eviction);
+}
+
+// deterministic sequence per thread, the interleaving of the threads isn't anyway
+static inline uint32_t _next(uint32_t *seed)
+{
+  *seed = *seed * 1664525u + 1013904223u;
+  return *seed >> 8;
+}
+
+static void *_worker(void *data)
+{
+  worker_t *w = (worker_t *)data;
+  for(int i = 0; i < ITERATIONS; i++)
+  {
+    const uint32_t key = 1 + _next(&w->seed) % KEYS;
+    const uint32_t op = _next(&w->seed) % 10;
+    if(op < 6)
+    {
+      dt_cache_entry_t *entry = dt_cache_get(w->cache, key, 'r');
+      if(entry->key != key || ((payload_t *)entry->data)->key != key) w->errors++;
+      dt_cache_release(w->cache, entry);
+    }
+    else if(op < 8)
+    {
+      dt_cache_entry_t *entry = dt_cache_get(w->cache, key, 'w');
+      payload_t *payload = (payload_t *)entry->data;
+      if(payload->key != key) w->errors++;
+      payload->writes++;
+      dt_cache_release(w->cache, entry);
+    }
+    else if(op < 9)
+    {
+      dt_cache_entry_t *entry = dt_cache_testget(w->cache, key, 'r');
+      if(entry)
+      {
+        if(((payload_t *)entry->data)->key != key) w->errors++;
+        dt_cache_release(w->cache, entry);
+      }
+    }
+    else
+      dt_cache_remove(w->cache, key);
+  }
+  return NULL;
+}
+
+static int _count_entry(const uint32_t key, const void *data, void *user_data)
+{
+  int *count = (int *)user_data;
+  if(((const payload_t *)data)->key != key) return 1;
+  (*count)++;
+  return 0;
+}
+
+static void _run_concurrent(const dt_cache_eviction_t eviction)
+{
+  dt_cache_t cache;
+  _init(&cache, eviction);
+
+  pthread_t threads[THREADS];
+  worker_t workers[THREADS];
+  for(int k = 0; k < THREADS; k++)
+  {
+    workers[k] = (worker_t){ .cache = &cache, .seed = 17 * k + 1, .errors = 0 };
+    assert_int_equal(pthread_create(&threads[k], NULL, _worker, &workers[k]), 0);
+  }
+  for(int k = 0; k < THREADS; k++)
+  {
+    pthread_join(threads[k], NULL);
+    assert_int_equal(workers[k].errors, 0);
+  }
+
+  // every entry still has its own data and the global cost matches the contents
+  int count = 0;
+  assert_int_equal(dt_cache_for_all(&cache, _count_entry, &count), 0);
+  assert_int_equal(count, cache.cost);
+
+  dt_cache_cleanup(&cache);
+}
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_concurrent_lru(void **state)
+{
+  _run_concurrent(DT_CACHE_EVICT_LRU);
+}
+
+static void test_concurrent_clock(void **state)
+{
+  _run_concurrent(DT_CACHE_EVICT_CLOCK);
+}
+
+static void test_remove_and_recycle(void **state)
+{
+  dt_cache_t cache;
+  _init(&cache, DT_CACHE_EVICT_CLOCK);
+
+  // the second lookup is answered without the shard lock
+  dt_cache_entry_t *entry = dt_cache_get(&cache, 1, 'w');
+  ((payload_t *)entry->data)->writes = 42;
+  dt_cache_release(&cache, entry);
+  entry = dt_cache_get(&cache, 1, 'r');
+  assert_int_equal(((payload_t *)entry->data)->writes, 42);
+  dt_cache_release(&cache, entry);
+
+  // a removed entry must not be found anymore, not even when it is recycled for another key
+  assert_int_equal(dt_cache_remove(&cache, 1), 0);
+  assert_int_equal(dt_cache_remove(&cache, 1), 1);
+  assert_null(dt_cache_testget(&cache, 1, 'r'));
+  for(uint32_t key = 2; key < 2 + DT_CACHE_HINTS; key++)
+  {
+    entry = dt_cache_get(&cache, key, 'r');
+    assert_int_equal(((payload_t *)entry->data)->key, key);
+    dt_cache_release(&cache, entry);
+  }
+  assert_null(dt_cache_testget(&cache, 1, 'r'));
+  assert_int_equal(dt_cache_contains(&cache, 1), 0);
+
+  // and a new one starts from scratch
+  entry = dt_cache_get(&cache, 1, 'r');
+  assert_int_equal(((payload_t *)entry->data)->writes, 0);
+  dt_cache_release(&cache, entry);
+
+  dt_cache_cleanup(&cache);
+}
+
+/*
+ * MAIN FUNCTION
+ */
+int main(int argc, char *argv[])
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_remove_and_recycle),
+    cmocka_unit_test(test_concurrent_lru),
+    cmocka_unit_test(test_concurrent_clock),
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
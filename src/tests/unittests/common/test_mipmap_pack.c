@@ -0,0 +1,188 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for the packed thumbnail disk backend in common/mipmap_pack.c
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <limits.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cmocka.h>
+#include <glib/gstdio.h>
+
+#include "common/mipmap_pack.h"
+
+/*
+ * DEFINITIONS
+ */
+
+#define WIDTH 64
+#define HEIGHT 48
+#define SIZE (WIDTH * HEIGHT * 4)
+#define COUNT 300
+
+// every thumbnail has its own content, so mixed up offsets are noticed
+static void _fill(uint8_t *buf, const uint32_t imgid)
+{
+  for(int k = 0; k < SIZE; k++) buf[k] = (uint8_t)(imgid * 31 + k);
+}
+
+static int _check(dt_mipmap_pack_t *pack, const uint32_t imgid)
+{
+  uint8_t expected[SIZE], out[SIZE];
+  uint32_t width = 0, height = 0;
+  dt_colorspaces_color_profile_type_t color_space = DT_COLORSPACE_NONE;
+  if(dt_mipmap_pack_read(pack, imgid, out, sizeof(out), &width, &height, &color_space)) return 1;
+  _fill(expected, imgid);
+  return width != WIDTH || height != HEIGHT || color_space != DT_COLORSPACE_SRGB
+         || memcmp(out, expected, sizeof(out));
+}
+
+static int _setup(void **state)
+{
+  *state = g_dir_make_tmp("darktable-test-XXXXXX", NULL);
+  return *state ? 0 : 1;
+}
+
+static int _teardown(void **state)
+{
+  gchar *dir = (gchar *)*state;
+  gchar *pack = g_build_filename(dir, "thumbs.pack", NULL);
+  gchar *index = g_build_filename(dir, "thumbs.idx", NULL);
+  g_unlink(pack);
+  g_unlink(index);
+  g_rmdir(dir);
+  g_free(pack);
+  g_free(index);
+  g_free(dir);
+  return 0;
+}
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_round_trip(void **state)
+{
+  dt_mipmap_pack_t *pack = dt_mipmap_pack_open((const char *)*state);
+  assert_non_null(pack);
+
+  uint8_t in[SIZE];
+  _fill(in, 1);
+  assert_false(dt_mipmap_pack_contains(pack, 1));
+  assert_int_equal(dt_mipmap_pack_write(pack, 1, in, WIDTH, HEIGHT, DT_COLORSPACE_SRGB, 0), 0);
+  assert_true(dt_mipmap_pack_contains(pack, 1));
+  assert_int_equal(_check(pack, 1), 0);
+
+  // a buffer too small for the thumbnail is refused
+  uint32_t width, height;
+  dt_colorspaces_color_profile_type_t color_space;
+  assert_int_not_equal(dt_mipmap_pack_read(pack, 1, in, SIZE - 1, &width, &height, &color_space), 0);
+
+  // a thumbnail which is there already is not written again
+  const uint64_t size = pack->size;
+  assert_int_equal(dt_mipmap_pack_write(pack, 1, in, WIDTH, HEIGHT, DT_COLORSPACE_SRGB, 0), 0);
+  assert_int_equal(pack->size, size);
+
+  // a duplicate shares the data, and keeps it when the original is invalidated
+  dt_mipmap_pack_copy(pack, 2, 1);
+  dt_mipmap_pack_remove(pack, 1);
+  assert_false(dt_mipmap_pack_contains(pack, 1));
+  assert_int_not_equal(dt_mipmap_pack_read(pack, 1, in, SIZE, &width, &height, &color_space), 0);
+  assert_true(dt_mipmap_pack_contains(pack, 2));
+  assert_int_equal(pack->size, size);
+
+  // after the invalidation a new thumbnail is written
+  _fill(in, 1);
+  assert_int_equal(dt_mipmap_pack_write(pack, 1, in, WIDTH, HEIGHT, DT_COLORSPACE_SRGB, 0), 0);
+  assert_int_equal(pack->size, 2 * size);
+  assert_int_equal(_check(pack, 1), 0);
+
+  dt_mipmap_pack_close(pack);
+}
+
+static void test_growth_and_reopen(void **state)
+{
+  dt_mipmap_pack_t *pack = dt_mipmap_pack_open((const char *)*state);
+  assert_non_null(pack);
+
+  // reading in between makes the pack remap itself whenever it grew
+  uint8_t in[SIZE];
+  uint64_t capacity = pack->capacity;
+  int grown = 0;
+  for(uint32_t imgid = 1; imgid <= COUNT; imgid++)
+  {
+    _fill(in, imgid);
+    assert_int_equal(dt_mipmap_pack_write(pack, imgid, in, WIDTH, HEIGHT, DT_COLORSPACE_SRGB, 0), 0);
+    assert_int_equal(_check(pack, imgid), 0);
+    assert_true(pack->size <= pack->capacity);
+    if(pack->capacity != capacity) grown++;
+    capacity = pack->capacity;
+  }
+  // the file grows by doubling, not by every thumbnail
+  assert_int_equal(pack->size, (uint64_t)COUNT * SIZE);
+  assert_true(grown <= 5);
+  assert_true(pack->capacity < 2 * pack->size);
+
+  for(uint32_t imgid = 1; imgid <= COUNT; imgid += 2) dt_mipmap_pack_remove(pack, imgid);
+  dt_mipmap_pack_close(pack);
+
+  // the index remembers where the thumbnails are and which ones were removed
+  pack = dt_mipmap_pack_open((const char *)*state);
+  assert_non_null(pack);
+  assert_int_equal(pack->size, (uint64_t)COUNT * SIZE);
+  for(uint32_t imgid = 1; imgid <= COUNT; imgid++)
+  {
+    if(imgid & 1)
+      assert_false(dt_mipmap_pack_contains(pack, imgid));
+    else
+      assert_int_equal(_check(pack, imgid), 0);
+  }
+
+  // new thumbnails go behind the used part, not behind the end of the file
+  _fill(in, COUNT + 1);
+  assert_int_equal(dt_mipmap_pack_write(pack, COUNT + 1, in, WIDTH, HEIGHT, DT_COLORSPACE_SRGB, 0), 0);
+  assert_int_equal(pack->size, (uint64_t)(COUNT + 1) * SIZE);
+  assert_int_equal(_check(pack, COUNT + 1), 0);
+  assert_int_equal(_check(pack, COUNT), 0);
+
+  dt_mipmap_pack_close(pack);
+}
+
+/*
+ * MAIN FUNCTION
+ */
+int main(int argc, char *argv[])
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test_setup_teardown(test_round_trip, _setup, _teardown),
+    cmocka_unit_test_setup_teardown(test_growth_and_reopen, _setup, _teardown),
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;